@@ -23,7 +23,10 @@ struct MaterialParameters
 };
     
 ConstantBuffer<SceneParameters> gScene : register(b0);
-ConstantBuffer<MeshParameters> gMesh : register(b1);
+// インスタンス毎の行列の位置. 描画単位の先頭から SV_InstanceID で参照する.
+StructuredBuffer<uint> gInstances : register(t0, space1);
+// 描画対象モデルの全ノードの行列. 変化したノードのみが転送される.
+StructuredBuffer<MeshParameters> gTransforms : register(t1, space1);
 ConstantBuffer<MaterialParameters> gMaterial : register(b2);
 
 struct VSInput
@@ -33,6 +36,7 @@ struct VSInput
     float2 texcoord0 : TEXCOORD0;
     float3 tangent : TANGENT0;
     float3 binormal : BINORMAL0;
+    uint instanceID : SV_InstanceID;
 };
 
 struct PSInput
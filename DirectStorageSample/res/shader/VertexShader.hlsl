@@ -4,16 +4,17 @@ PSInput main(VSInput input)
 {
     PSInput result = (PSInput) 0;
     float4x4 mtxVP = mul(gScene.mtxView, gScene.mtxProj);
+    float4x4 mtxWorld = gTransforms[gInstances[input.instanceID]].mtxWorld;
     
-    float4 worldPos = mul(input.position, gMesh.mtxWorld);
-    float3 worldNormal = mul(input.normal, (float3x3) gMesh.mtxWorld);
+    float4 worldPos = mul(input.position, mtxWorld);
+    float3 worldNormal = mul(input.normal, (float3x3) mtxWorld);
     result.position = mul(worldPos, mtxVP);
     result.worldPosition = worldPos;
     result.worldNormal = normalize(worldNormal);
     result.uv0 = input.texcoord0;
 
-    result.tangent = mul(input.tangent, (float3x3) gMesh.mtxWorld);
-    result.binormal = mul(input.binormal, (float3x3) gMesh.mtxWorld);
+    result.tangent = mul(input.tangent, (float3x3) mtxWorld);
+    result.binormal = mul(input.binormal, (float3x3) mtxWorld);
 
     return result;
 }
\ No newline at end of file
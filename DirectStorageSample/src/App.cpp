@@ -10,10 +10,23 @@
 #include "implot.h"
 
 #include "DStorageLoader.h"
+#include "ModelAssetCache.h"
+#include "JobSystem.h"
+#include "TransformBenchmark.h"
+#include "DrawPacketBenchmark.h"
+#include "CullingBenchmark.h"
+#include "BvhBenchmark.h"
+#include "OcclusionBenchmark.h"
+#include "DescriptorAllocatorStress.h"
+#include "UploadRingStress.h"
+#include "ResidencySimulation.h"
 #include "TextureUtility.h"
 #include <DirectXTex.h>
 #include <fstream>
+#include <numeric>
 #include <random>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <windows.h>
 
@@ -33,6 +46,24 @@ std::unique_ptr<MyApplication>& GetApplication()
   return gMyApplication;
 }
 
+// モデルを並べるグリッド (1 辺 5 セル).
+constexpr float ModelGridSize = 5.0f;
+constexpr float ModelCellSize = 1.5f;
+
+void CalculateGridCell(int index, int& gx, int& gy, int& gz)
+{
+  gz = index / 25;
+  gx = (index - 25 * gz) % 5;
+  gy = (index - 25 * gz) / 5;
+}
+
+// セルの中心. CalculateWorldMatrix の平行移動と同じ位置.
+DirectX::XMFLOAT3 CalculateCellCenter(int gx, int gy, int gz, float gridSize, float cellSize)
+{
+  float gridCenterOffset = (gridSize * cellSize) / 2.0f - cellSize / 2.0f;
+  return { gx * cellSize - gridCenterOffset, gy * cellSize - gridCenterOffset, gz * cellSize - gridCenterOffset };
+}
+
 DirectX::XMMATRIX CalculateWorldMatrix(int gx, int gy, int gz, std::shared_ptr<model::SimpleModel> model, float gridSize, float cellSize)
 {
   DirectX::XMFLOAT3 aabbMin, aabbMax;
@@ -42,15 +73,11 @@ DirectX::XMMATRIX CalculateWorldMatrix(int gx, int gy, int gz, std::shared_ptr<m
   float modelHeight = aabbMax.y - aabbMin.y;
   float modelDepth = aabbMax.z - aabbMin.z;
   float scale = cellSize / (std::max)({ modelWidth, modelHeight, modelDepth });
-  float gridCenterOffset = (gridSize * cellSize) / 2.0f - cellSize / 2.0f;
-
-  float px = gx * cellSize - gridCenterOffset;
-  float py = gy * cellSize - gridCenterOffset;
-  float pz = gz * cellSize - gridCenterOffset;
+  auto center = CalculateCellCenter(gx, gy, gz, gridSize, cellSize);
 
   scale *= 0.75f;
   auto mtxScale = DirectX::XMMatrixScaling(scale, scale, scale);
-  auto mtxTranslation = DirectX::XMMatrixTranslation(px, py, pz);
+  auto mtxTranslation = DirectX::XMMatrixTranslation(center.x, center.y, center.z);
   auto mtxRotation = DirectX::XMMatrixRotationAxis(model->m_tumbleAxis, model->m_tumbleAngle);
   return mtxScale * mtxRotation * mtxTranslation;
 }
@@ -85,8 +112,14 @@ void MyApplication::Initialize()
 
   PrepareSceneConstantBuffer();
 
+  // 行列転送用のアップロードバッファ. 転送が溢れた場合は次フレームで拡張し、転送を持ち越す.
+  m_meshConstantsUpload.Initialize(32 * 1024 * 1024);
+
   PrepareModelDrawPipeline();
 
+  // 描画コマンドの並列記録用. ジョブの並列数分のコマンドリストを用意.
+  gfxDevice->PrepareRecordingContexts(GetJobSystem()->GetConcurrency());
+
   PrepareModelData();
 
   // ビューポートおよびシザー領域の設定.
@@ -103,6 +136,10 @@ void MyApplication::Initialize()
     .right = width, .bottom = height,
   };
 
+  // 遮蔽判定用の深度バッファは横 256 ピクセルとし、画面の縦横比に合わせる.
+  constexpr uint32_t OcclusionBufferWidth = 256;
+  m_occlusion.Initialize(OcclusionBufferWidth, (std::max)(1u, uint32_t(OcclusionBufferWidth * height / (std::max)(width, 1))));
+
 }
 
 void MyApplication::PrepareDepthBuffer()
@@ -211,13 +248,13 @@ void MyApplication::PrepareModelDrawPipeline()
       },
       .ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL
     },
-    {
-      .ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV,
-      .Constants = {
-        .ShaderRegister = 1,
-        .RegisterSpace = 0,
+    {  // t0, space1 インスタンス毎の行列の位置.
+      .ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV,
+      .Descriptor = {
+        .ShaderRegister = 0,
+        .RegisterSpace = 1,
       },
-      .ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL
+      .ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX
     },
     {
       .ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV,
@@ -244,6 +281,14 @@ void MyApplication::PrepareModelDrawPipeline()
       },
       .ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL,
     },
+    {  // t1, space1 描画対象モデルの行列.
+      .ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV,
+      .Descriptor = {
+        .ShaderRegister = 1,
+        .RegisterSpace = 1,
+      },
+      .ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX
+    },
   };
 
   D3D12_ROOT_SIGNATURE_DESC rootSignatureDesc{
@@ -499,7 +544,18 @@ void MyApplication::OnUpdate()
     m_isCoolingPeriod = false;
   }
 
-  bool isLoadedAll = std::all_of(m_modelList.begin(), m_modelList.end(), [](auto v) { return v->IsFinishLoading(); });
+  UpdateResidency();
+  CheckLoadingComplete();
+
+  // 予算によりロードを見送っているものは完了待ちの対象外.
+  bool isLoadedAll = true;
+  for (uint32_t i = 0; i < m_modelList.size(); ++i)
+  {
+    if (m_residency.GetState(m_modelEntryIds[i]) == ResidencyManager::State::Loading && !m_modelList[i]->IsFinishLoading())
+    {
+      isLoadedAll = false;
+    }
+  }
   if (!isLoadedAll)
   {
     GetDStorageLoader()->GetQueueSystemMemory()->Submit();
@@ -512,7 +568,7 @@ void MyApplication::OnUpdate()
 
   // ロード自体に掛かった時間を計算. ローディング中は経過時間を求める.
   using namespace std::chrono;
-  auto elapsedTime = (isLoadedAll ? m_endLoadingTime : high_resolution_clock::now()) - m_startLoadingTime;
+  auto elapsedTime = (m_isLoadTimeRecorded ? m_endLoadingTime : high_resolution_clock::now()) - m_startLoadingTime;
   auto elapsedMilliseconds = duration_cast<milliseconds>(elapsedTime).count();
 
   // ImGui更新処理.
@@ -527,7 +583,7 @@ void MyApplication::OnUpdate()
   ImGui::InputFloat3("LightDir", lightDir);
 
   ImGui::Text("Status: %s", m_loadStatusMessage.c_str());
-  ImGui::Text("Models: %d", m_modelCountLoadCompleted.load());
+  ImGui::Text("Models: %u", m_modelCountLoadCompleted);
   ImGui::Text("LoadingTime: %.2f s", elapsedMilliseconds/1000.0f);
   ImGui::Text("Max CPUPeak: %.1f %%", m_maxCpuUtilizationInLoading.load());
   // 再ロード用ボタンや個数の設定が有効な範囲は、ロードが完了・クーリング状態ではないを満たすとき.
@@ -540,11 +596,225 @@ void MyApplication::OnUpdate()
   ImGui::Checkbox("Pre-AllocationMode", &m_isPreAllocationMode);
   ImGui::EndDisabled();
 
+  ImGui::Checkbox("VRAM Budget", &m_useVramBudget);
+  ImGui::BeginDisabled(!m_useVramBudget);
+  ImGui::SliderInt("Budget (MiB)", &m_vramBudgetMiB, 64, 8192);
+  ImGui::EndDisabled();
+  {
+    const auto& stats = m_residency.GetStats();
+    ImGui::Text("Resident: %u (%.1f MiB)", stats.residentCount, stats.residentBytes / (1024 * 1024.0));
+    ImGui::Text("Loading: %u  Deferred: %u  Failed: %u", stats.loadingCount, stats.deferredCount, stats.failedCount);
+    ImGui::Text("Evicted(total): %llu", stats.totalEvictCount);
+  }
+  {
+    auto stats = GetModelAssetCache()->GetStats();
+    ImGui::Text("Shared Assets: %u (hit %llu / miss %llu)", stats.liveAssetCount, stats.hitCount, stats.missCount);
+  }
+  {
+    auto stats = GetGfxDevice()->GetDescriptorStats(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    ImGui::Text("SRV Descriptors: live %u / %u (peak %u, pending %u, frag %.2f)",
+      stats.liveCount, stats.capacity, stats.peakCount, stats.pendingFreeCount, stats.GetFragmentation());
+  }
+  ImGui::Text("Culling: models %u / %u, meshes %u / %u (culled %u)",
+    m_cullingStats.visibleModelCount, m_cullingStats.modelCount,
+    m_cullingStats.visibleMeshCount, m_cullingStats.meshCount,
+    (m_cullingStats.modelCount - m_cullingStats.visibleModelCount) + (m_cullingStats.meshCount - m_cullingStats.visibleMeshCount));
+  ImGui::Checkbox("Occlusion Culling", &m_useOcclusionCulling);
+  ImGui::BeginDisabled(!m_useOcclusionCulling);
+  ImGui::SliderInt("Occlusion Budget (us)", &m_occlusionBudgetUs, 100, 5000);
+  {
+    const auto& stats = m_occlusion.GetStats();
+    ImGui::Text("Occluders: %u / %u%s, occluded models %u / %u (%.2f + %.2f ms)",
+      stats.rasterizedCount, stats.occluderCount, stats.budgetExceeded ? " (over budget)" : "",
+      stats.occludedCount, stats.testedCount, stats.rasterizeMs, stats.testMs);
+  }
+  ImGui::EndDisabled();
+  {
+    uint64_t stateChangeCount = 0, skippedCount = 0;
+    for (uint32_t i = 0; i < m_drawCommandListCount; ++i)
+    {
+      stateChangeCount += m_drawStateFilters[i].GetStateChangeCount();
+      skippedCount += m_drawStateFilters[i].GetSkippedCount();
+    }
+    ImGui::Text("Draw Packets: %zu in %u lists (state sets %llu, skipped %llu)", m_drawPackets.GetCount(),
+      m_drawCommandListCount, stateChangeCount, skippedCount);
+  }
+  ImGui::Checkbox("Instancing", &m_useInstancing);
+  ImGui::SameLine();
+  ImGui::Text("instances %u in %zu draws", m_instanceBatcher.GetInstanceCount(), m_instanceBatcher.GetBatches().size());
+  {
+    const auto& allocator = m_meshConstantsUpload.GetAllocator();
+    ImGui::Text("Matrix Upload: %.2f / %.2f MiB (%u frames in flight, grown %u)",
+      allocator.GetUsedBytes() / 1024.0 / 1024.0, allocator.GetCapacity() / 1024.0 / 1024.0, allocator.GetPendingFrameCount(),
+      m_meshConstantsUpload.GetGrowCount());
+  }
+
   ImGui::Begin("Property");
   ImGui::Text("%s", m_strBandwidth.c_str());
   ImGui::Text("%s", m_strCpuMemData.c_str());
   ImGui::Text("%s", m_strBufferData.c_str());
   ImGui::Text("%s", m_strTextureData.c_str());
+
+  ImGui::Separator();
+  // 行列更新のベンチマークは数秒かかるため、別スレッドで実行して描画を止めないようにする.
+  bool isTransformBenchmarkRunning = m_transformBenchmarkTask.valid();
+  if (isTransformBenchmarkRunning && m_transformBenchmarkTask.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+  {
+    m_strTransformBenchmark = m_transformBenchmarkTask.get();
+    isTransformBenchmarkRunning = false;
+  }
+  ImGui::BeginDisabled(isTransformBenchmarkRunning);
+  if (ImGui::Button("Transform Benchmark"))
+  {
+    m_strTransformBenchmark = "running...";
+    m_transformBenchmarkTask = std::async(std::launch::async, []() {
+      auto result = RunTransformBenchmark();
+      return std::format(
+        "{}x{} nodes (AVX2:{})\n AoS scalar: {:7.2f} ms\n SoA single: {:7.2f} ms\n SoA jobs  : {:7.2f} ms",
+        result.modelCount, result.nodeCount, result.avx2 ? "on" : "off",
+        result.aosScalarMs, result.soaSingleThreadMs, result.soaParallelMs);
+    });
+  }
+  if (ImGui::Button("Incremental Transform Benchmark"))
+  {
+    m_strTransformBenchmark = "running...";
+    m_transformBenchmarkTask = std::async(std::launch::async, []() {
+      constexpr float changeRatios[] = { 0.0f, 0.01f, 0.1f, 0.5f, 1.0f };
+      std::string str = "change  full(ms)  incremental(ms)";
+      for (const auto& result : RunIncrementalTransformBenchmark(changeRatios))
+      {
+        str += std::format("\n{:5.1f}% {:9.2f} {:9.2f}",
+          result.changeRatio * 100.0f, result.fullMs, result.incrementalMs);
+      }
+      return str;
+    });
+  }
+  ImGui::EndDisabled();
+  ImGui::Text("%s", m_strTransformBenchmark.c_str());
+  if (ImGui::Button("Draw Packet Benchmark"))
+  {
+    auto result = RunDrawPacketBenchmark();
+    m_strDrawPacketBenchmark = std::format(
+      "{} packets\n build     : {:7.2f} ms\n std::sort : {:7.2f} ms\n radix sort: {:7.2f} ms\n state sets: {} -> {}\n"
+      " instancing: {} -> {} draws ({:.2f} ms, valid:{})",
+      result.packetCount, result.buildMs, result.stdSortMs, result.radixSortMs,
+      result.stateChangesUnsorted, result.stateChangesSorted,
+      result.gridDrawCount, result.instancedDrawCount, result.instanceBatchMs, result.instanceDataValid ? "yes" : "NO");
+  }
+  ImGui::Text("%s", m_strDrawPacketBenchmark.c_str());
+  if (ImGui::Button("Culling Benchmark"))
+  {
+    auto result = RunCullingBenchmark();
+    m_strCullingBenchmark = std::format(
+      "{} AABBs (AVX2:{})\n scalar: {:7.3f} ms\n SIMD  : {:7.3f} ms\n visible {} (match:{})",
+      result.aabbCount, result.avx2 ? "on" : "off", result.scalarMs, result.simdMs,
+      result.visibleCount, result.resultsMatch ? "yes" : "NO");
+  }
+  ImGui::SameLine();
+  if (ImGui::Button("Culling Self Check"))
+  {
+    auto result = RunCullingSelfCheck();
+    m_strCullingBenchmark = std::format(
+      "{} cases ({} skipped near boundaries)\n aabb transform {}, list {}, planes {}\n cull {}, sphere {}, model bounds {}\n passed:{}",
+      result.caseCount, result.skippedCount, result.aabbTransformErrors, result.listMismatchCount, result.frustumPlaneErrors,
+      result.cullErrors, result.sphereErrors, result.modelBoundErrors, result.passed ? "yes" : "NO");
+  }
+  ImGui::Text("%s", m_strCullingBenchmark.c_str());
+  if (ImGui::Button("BVH Benchmark"))
+  {
+    constexpr uint32_t instanceCounts[] = { 1000, 10000, 100000 };
+    m_strBvhBenchmark = "count  height  frustum(bvh/linear)  sphere(bvh/linear)  ray(bvh/linear) [ms]";
+    for (const auto& result : RunBvhBenchmark(instanceCounts))
+    {
+      m_strBvhBenchmark += std::format("\n{:6} {:3}  {:7.3f}/{:7.3f}  {:7.4f}/{:7.4f}  {:7.4f}/{:7.4f}  build {:7.2f} ms  update {:6.2f} ms",
+        result.instanceCount, result.height, result.frustumBvhMs, result.frustumLinearMs,
+        result.sphereBvhMs, result.sphereLinearMs, result.rayBvhMs, result.rayLinearMs, result.buildMs, result.updateMs);
+      m_strBvhBenchmark += std::format("\n       valid:{} match frustum:{} sphere:{} ray:{}",
+        result.valid ? "yes" : "NO", result.frustumResultsMatch ? "yes" : "NO",
+        result.sphereResultsMatch ? "yes" : "NO", result.rayResultsMatch ? "yes" : "NO");
+    }
+  }
+  ImGui::Text("%s", m_strBvhBenchmark.c_str());
+  if (ImGui::Button("Occlusion Benchmark"))
+  {
+    auto result = RunOcclusionBenchmark();
+    m_strOcclusionBenchmark = std::format(
+      "{}x{} {} occluders\n rasterize: {:7.3f} ms\n test     : {:7.3f} ms\n hidden occluded {} / {}, front visible:{}",
+      result.width, result.height, result.occluderCount, result.rasterizeMs, result.testMs,
+      result.hiddenOccludedCount, result.hiddenCount, result.frontAllVisible ? "yes" : "NO");
+  }
+  ImGui::Text("%s", m_strOcclusionBenchmark.c_str());
+  if (ImGui::Button("Descriptor Allocator Stress"))
+  {
+    auto result = RunDescriptorAllocatorStress();
+    m_strDescriptorStress = std::format(
+      "{} threads, {} ops: {:.1f} ms\n peak {}, frag {:.2f}, overlaps {}\n deferred free:{} coalesced:{} valid:{}",
+      result.threadCount, result.operationCount, result.elapsedMs, result.peakCount, result.fragmentation, result.overlapCount,
+      result.deferredFreeRespected ? "yes" : "NO", result.fullyCoalesced ? "yes" : "NO", result.valid ? "yes" : "NO");
+  }
+  ImGui::Text("%s", m_strDescriptorStress.c_str());
+  if (ImGui::Button("Upload Ring Stress"))
+  {
+    auto result = RunUploadRingStress();
+    m_strUploadRingStress = std::format(
+      "{} frames, {} allocs: {:.1f} ms\n failed {}, wraps {}, overlaps {}, misaligned {}, accounting {}\n oversize rejected:{} full keeps state:{} released:{}",
+      result.frameCount, result.allocationCount, result.elapsedMs, result.failedCount, result.wrapCount,
+      result.overlapCount, result.misalignedCount, result.accountingErrors,
+      result.oversizeRejected ? "yes" : "NO", result.failureKeepsState ? "yes" : "NO", result.fullyReleased ? "yes" : "NO");
+  }
+  ImGui::Text("%s", m_strUploadRingStress.c_str());
+  if (ImGui::Button("Residency Trace Simulation"))
+  {
+    auto result = RunResidencyTraceSimulation();
+    m_strResidencySimulation = std::format(
+      "{} frames: {:.1f} ms  loads {} evicts {}\n budget {} MB peak {} MB, over budget {}\n visible evicts {}, lru violations {}, missing {} / {}, deterministic:{}\n"
+      " failed {}, re-requested {}, charge kept {}",
+      result.frameCount, result.elapsedMs, result.loadRequestCount, result.evictCount,
+      result.budgetBytes >> 20, result.peakCommittedBytes >> 20, result.budgetExceededFrames,
+      result.visibleEvictCount, result.lruViolationCount, result.missingVisibleCount, result.visibleCount,
+      result.deterministic ? "yes" : "NO", result.failedCount, result.failedRequestCount, result.failedChargeErrors);
+  }
+  ImGui::Text("%s", m_strResidencySimulation.c_str());
+
+  // ロード工程ごとの所要時間.
+  ImGui::Separator();
+  ImGui::Text("Load Stages (ms)  models: %zu", m_loadTelemetry.GetRecords().size());
+  ImGui::Text("%-18s %8s %8s %8s", "Stage", "p50", "p95", "p99");
+  for (uint32_t i = 1; i < LoadTelemetry::StageCount; ++i)
+  {
+    auto stage = LoadTelemetry::Stage(i);
+    auto p = m_loadTelemetry.GetStagePercentiles(stage);
+    ImGui::Text("%-18s %8.2f %8.2f %8.2f", LoadTelemetry::GetStageName(stage), p.p50, p.p95, p.p99);
+  }
+
+  // 選択した工程のレイテンシ分布.
+  if (ImGui::BeginCombo("Histogram Stage", LoadTelemetry::GetStageName(LoadTelemetry::Stage(m_histogramStage))))
+  {
+    for (int i = 1; i < int(LoadTelemetry::StageCount); ++i)
+    {
+      if (ImGui::Selectable(LoadTelemetry::GetStageName(LoadTelemetry::Stage(i)), i == m_histogramStage))
+      {
+        m_histogramStage = i;
+      }
+    }
+    ImGui::EndCombo();
+  }
+  auto histogram = m_loadTelemetry.GetStageHistogram(LoadTelemetry::Stage(m_histogramStage), 32);
+  if (ImPlot::BeginPlot("Stage Latency", ImVec2(-1, 120), ImPlotFlags_NoInputs))
+  {
+    ImPlot::SetupAxes("ms", "models", ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
+    ImPlot::PlotBars("", histogram.bucketCenters.data(), histogram.counts.data(), int(histogram.counts.size()), histogram.bucketWidthMs);
+    ImPlot::EndPlot();
+  }
+  if (ImGui::Button("Export Trace (JSON)"))
+  {
+    m_loadTelemetry.ExportChromeTrace("load_trace.json");
+  }
+  ImGui::SameLine();
+  if (ImGui::Button("Export CSV"))
+  {
+    m_loadTelemetry.ExportCsv("load_trace.csv");
+  }
   ImGui::End();
 
   if(ImPlot::BeginPlot("GPU Usage (%)", ImVec2(-1, 100), ImPlotFlags_NoInputs) )
@@ -608,14 +878,23 @@ void MyApplication::OnUpdate()
 
   auto& gfxDevice = GetGfxDevice();
   gfxDevice->NewFrame();
+  m_meshConstantsUpload.BeginFrame();
 
   // 描画のコマンドを作成.
-  auto commandList = MakeCommandList();
+  std::vector<ComPtr<ID3D12GraphicsCommandList>> commandLists;
+  MakeCommandLists(commandLists);
 
-  // 作成したコマンドを実行.
-  gfxDevice->Submit(commandList.Get());
+  // 作成したコマンドをまとめて実行.
+  std::vector<ID3D12CommandList*> submitLists;
+  for (auto& commandList : commandLists)
+  {
+    submitLists.push_back(commandList.Get());
+  }
+  gfxDevice->Submit(submitLists);
+  m_meshConstantsUpload.EndFrame();
   // 描画した内容を画面へ反映.
   gfxDevice->Present(1);
+  m_frameCount++;
 }
 
 void MyApplication::Shutdown()
@@ -625,6 +904,22 @@ void MyApplication::Shutdown()
 
   // リソースを解放.
   UnloadModelData();
+  m_retiredModels.clear();
+  m_meshConstantsUpload.Shutdown();
+  for (auto& buffer : m_instanceBuffers)
+  {
+    buffer.Reset();
+  }
+  m_transformBuffer.Reset();
+  m_retiredBuffers.clear();
+  m_transformSlots.Reset(0);
+  GetModelAssetCache()->Clear();
+  // ベンチマークがジョブプールを使用中であれば終わるのを待つ.
+  if (m_transformBenchmarkTask.valid())
+  {
+    m_transformBenchmarkTask.wait();
+  }
+  GetJobSystem().reset();
   m_drawOpaquePipeline.Reset();
   m_rootSignature.Reset();
 
@@ -640,11 +935,10 @@ void MyApplication::Shutdown()
   tpc::Shutdown();
 }
 
-ComPtr<ID3D12GraphicsCommandList>  MyApplication::MakeCommandList()
+void MyApplication::SetCommonDrawState(ID3D12GraphicsCommandList* commandList)
 {
   auto& gfxDevice = GetGfxDevice();
   auto frameIndex = gfxDevice->GetFrameIndex();
-  auto commandList = gfxDevice->CreateCommandList();
 
   // ルートシグネチャおよびパイプラインステートオブジェクト(PSO)をセット.
   commandList->SetGraphicsRootSignature(m_rootSignature.Get());
@@ -653,6 +947,31 @@ ComPtr<ID3D12GraphicsCommandList>  MyApplication::MakeCommandList()
   commandList->RSSetViewports(1, &m_viewport);
   commandList->RSSetScissorRects(1, &m_scissorRect);
 
+  auto rtvHandle = gfxDevice->GetSwapchainBufferDescriptor();
+  auto dsvHandle = m_depthBuffer.dsvHandle;
+  commandList->OMSetRenderTargets(1, &rtvHandle.hCpu, FALSE, &(dsvHandle.hCpu));
+
+  ID3D12DescriptorHeap* heaps[] = {
+    gfxDevice->GetDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV).Get(),
+    gfxDevice->GetDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER).Get(),
+  };
+  commandList->SetDescriptorHeaps(_countof(heaps), heaps);
+
+  auto cb = m_constantBuffer[frameIndex].buffer;
+  commandList->SetGraphicsRootConstantBufferView(0, cb->GetGPUVirtualAddress());
+  if (m_transformBuffer)
+  {
+    commandList->SetGraphicsRootShaderResourceView(5, m_transformBuffer->GetGPUVirtualAddress());
+  }
+}
+
+void MyApplication::MakeCommandLists(std::vector<ComPtr<ID3D12GraphicsCommandList>>& commandLists)
+{
+  auto& gfxDevice = GetGfxDevice();
+  auto frameIndex = gfxDevice->GetFrameIndex();
+  auto commandList = gfxDevice->CreateCommandList();
+  commandLists.push_back(commandList);
+
   auto renderTarget = gfxDevice->GetSwapchainBufferResource();
   auto barrierToRT = D3D12_RESOURCE_BARRIER{
     .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
@@ -666,21 +985,14 @@ ComPtr<ID3D12GraphicsCommandList>  MyApplication::MakeCommandList()
   };
 
   commandList->ResourceBarrier(1, &barrierToRT);
+  SetCommonDrawState(commandList.Get());
 
   auto rtvHandle = gfxDevice->GetSwapchainBufferDescriptor();
   auto dsvHandle = m_depthBuffer.dsvHandle;
-  commandList->OMSetRenderTargets(1, &rtvHandle.hCpu, FALSE, &(dsvHandle.hCpu));
-  
   const float clearColor[] = { 0.75f, 0.9f, 1.0f, 1.0f };
   commandList->ClearRenderTargetView(rtvHandle.hCpu, clearColor, 0, nullptr);
   commandList->ClearDepthStencilView(dsvHandle.hCpu, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
 
-  ID3D12DescriptorHeap* heaps[] = {
-    gfxDevice->GetDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV).Get(),
-    gfxDevice->GetDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER).Get(),
-  };
-  commandList->SetDescriptorHeaps(_countof(heaps), heaps);
-
   XMFLOAT3 eyePos(-1.0, 0.5, 10.0f), target(0, 0.0, 0), upDir(0, 1, 0);
   XMMATRIX mtxView = XMMatrixLookAtRH(
     XMLoadFloat3(&eyePos), XMLoadFloat3(&target), XMLoadFloat3(&upDir)
@@ -700,9 +1012,6 @@ ComPtr<ID3D12GraphicsCommandList>  MyApplication::MakeCommandList()
   memcpy(p, &m_sceneParams, sizeof(m_sceneParams));
   cb->Unmap(0, nullptr);
 
-  auto cbDescriptor = m_constantBuffer[frameIndex].descriptorCbv;
-  commandList->SetGraphicsRootConstantBufferView(0, cb->GetGPUVirtualAddress());
-
   static int count = 0;
   XMMATRIX mtxWorldRoot = XMMatrixIdentity();
   mtxWorldRoot = XMMatrixRotationY(XMConvertToRadians(count*0.1f)) * XMMatrixRotationX(XMConvertToRadians(count * 0.12f));
@@ -711,11 +1020,15 @@ ComPtr<ID3D12GraphicsCommandList>  MyApplication::MakeCommandList()
   if (!m_requestReload)
   {
     UpdateModelMatrices();
-    DrawModels(commandList);
+    DrawModels(commandList, mtxView, mtxProj, commandLists);
   }
-  // ImGui による描画.
+  commandList->Close();
+
+  // ImGui による描画. モデル描画の後に実行されるよう別のコマンドリストに積む.
+  auto uiCommandList = gfxDevice->CreateCommandList();
+  SetCommonDrawState(uiCommandList.Get());
   ImGui::Render();
-  ImGui_ImplDX12_RenderDrawData(ImGui::GetDrawData(), commandList.Get());
+  ImGui_ImplDX12_RenderDrawData(ImGui::GetDrawData(), uiCommandList.Get());
 
   D3D12_RESOURCE_BARRIER barrierToPresent{
     .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
@@ -727,9 +1040,9 @@ ComPtr<ID3D12GraphicsCommandList>  MyApplication::MakeCommandList()
       .StateAfter = D3D12_RESOURCE_STATE_PRESENT,
     }
   };
-  commandList->ResourceBarrier(1, &barrierToPresent);
-  commandList->Close();
-  return commandList;
+  uiCommandList->ResourceBarrier(1, &barrierToPresent);
+  uiCommandList->Close();
+  commandLists.push_back(uiCommandList);
 }
 
 std::vector<MyApplication::TextureInfo>::const_iterator MyApplication::FindModelTexture(const std::string& filePath, const ModelData& model)
@@ -749,33 +1062,49 @@ void MyApplication::LoadModelDataByDirectStorage()
   // ファイルリストを入れ替え.
   std::shuffle(m_fileList.begin(), m_fileList.end(), rng);
 
+  m_residency.Clear();
+  m_modelEntryIds.clear();
+  m_entryModels.clear();
+  m_prefetchEntries.clear();
+  m_estimateEntries.clear();
+  m_loadTelemetry.Clear();
+  m_modelLoaded.assign(m_currentModelCount, 0);
+  m_modelCountLoadCompleted = 0;
+  m_isLoadTimeRecorded = false;
+  m_loadedDataSize = {};
+  std::unordered_map<std::wstring, ResidencyManager::EntryId> entryMap;
   for (uint32_t i = 0; i < m_currentModelCount; ++i)
   {
     auto model = std::make_shared<model::SimpleModel>();
     m_modelList.push_back(model);
     model->m_tumbleAxis = XMVectorSet(d(rng), d(rng), d(rng), 0.0f);
     model->m_tumbleAngle = d(rng);
-    model->SetLoadingCompleteCallback([&](auto m) { CheckLoadingComplete(); });
-  }
+    model->SetLoadingCompleteCallback([this](auto) { m_hasLoadCompletedEvent = true; });
 
-  if (m_isPreAllocationMode)
-  {
-    // 先にヘッダをロードしてヒープの確保を行っておく.
-    for (uint32_t i = 0; i < m_modelList.size(); ++i)
+    // 同じファイルを参照するモデルはデータを共有するため、常駐管理もファイル単位で行う.
+    auto [itr, inserted] = entryMap.try_emplace(m_fileList[i], 0);
+    if (inserted)
     {
-      m_modelList[i]->RequestLoadHeaderOnly(m_fileList[i]);
+      // 推定サイズはヘッダとメタデータから求めたリソースの確保サイズとする.
+      // 読み込みはスレッドプールでの先読みで行い、完了するまではファイルサイズで代用する.
+      std::error_code ec;
+      uint64_t estimatedBytes = std::filesystem::file_size(m_fileList[i], ec);
+      itr->second = m_residency.AddEntry(ec ? 0 : estimatedBytes);
+      m_entryModels.emplace_back();
+      if (model->RequestLoadHeaderOnly(m_fileList[i]))
+      {
+        m_estimateEntries.push_back(itr->second);
+      }
     }
+    m_modelEntryIds.push_back(itr->second);
+    m_entryModels[itr->second].push_back(i);
   }
 
   tpc::ResetPeakCPU();
 
   // ロードの開始.
+  // 実際のロード要求は UpdateResidency にて予算内に収まるものから発行される.
   m_startLoadingTime = std::chrono::high_resolution_clock::now();
-  uint32_t fileIndex = 0;
-  for (uint32_t i = 0; i < m_modelList.size(); ++i)
-  {
-    m_modelList[i]->RequestLoad(m_fileList[i]);
-  }
 }
 
 void MyApplication::UnloadModelData()
@@ -785,7 +1114,203 @@ void MyApplication::UnloadModelData()
     model.reset();
   }
   m_modelList.clear();
+  m_modelLoaded.clear();
   m_modelCountLoadCompleted = 0;
+  m_residency.Clear();
+  m_modelEntryIds.clear();
+  m_entryModels.clear();
+  m_prefetchEntries.clear();
+  m_estimateEntries.clear();
+  m_modelBvh.Clear();
+  m_modelProxies.clear();
+}
+
+void MyApplication::UpdateResidency()
+{
+  ReleaseRetiredModels();
+
+  m_residency.SetBudget(m_useVramBudget ? uint64_t(m_vramBudgetMiB) * 1024 * 1024 : ResidencyManager::UnlimitedBudget);
+  m_residency.BeginFrame(m_frameCount);
+
+  // 可視判定には前フレームのカリング結果を使う.
+  // 描画対象となっているモデルは視錐台カリングの結果、まだ描画対象でないモデルは配置先のセルを囲む球で判定する.
+  // セルの球はモデルの形状が不明でも使えるよう、セルの幅を半径とした大きめのもの.
+  // カリングを行う前は全て可視として扱う.
+  std::unordered_set<const model::SimpleModel*> culledVisible(m_visibleModels.begin(), m_visibleModels.end());
+  auto mtxModelRoot = XMLoadFloat4x4(&m_mtxModelRoot);
+  for (uint32_t i = 0; i < m_modelList.size(); ++i)
+  {
+    const auto* model = m_modelList[i].get();
+    bool visible = !m_hasCullingFrustum;
+    if (!visible && m_modelProxies.contains(model))
+    {
+      visible = culledVisible.contains(model);
+    }
+    else if (!visible)
+    {
+      int gx, gy, gz;
+      CalculateGridCell(int(i), gx, gy, gz);
+      auto cellCenter = CalculateCellCenter(gx, gy, gz, ModelGridSize, ModelCellSize);
+      XMFLOAT3 center;
+      XMStoreFloat3(&center, XMVector3Transform(XMLoadFloat3(&cellCenter), mtxModelRoot));
+      visible = m_cullingFrustum.IntersectsSphere(center, ModelCellSize);
+    }
+    if (visible)
+    {
+      m_residency.MarkVisible(m_modelEntryIds[i]);
+    }
+  }
+
+  // 先読みが完了したものは推定サイズを置き換える.
+  std::erase_if(m_estimateEntries, [&](auto id) {
+    const auto& asset = m_modelList[m_entryModels[id].front()]->GetAsset();
+    if (asset && !asset->IsMetadataPrefetched())
+    {
+      return false;
+    }
+    uint64_t bytes = 0;
+    if (asset && asset->GetPrefetchedGpuMemoryUsage(bytes))
+    {
+      m_residency.UpdateEstimate(id, bytes);
+    }
+    return true;
+  });
+
+  for (ResidencyManager::EntryId id = 0; id < m_residency.GetEntryCount(); ++id)
+  {
+    const auto& models = m_entryModels[id];
+    // ロードに失敗したものは予算を解放し、ロード途中のデータは追い出しと同様に破棄する.
+    // 以降はロード要求の対象としない.
+    if (m_residency.GetState(id) == ResidencyManager::State::Loading &&
+      std::any_of(models.begin(), models.end(), [&](auto i) { return m_modelList[i]->IsLoadFailed(); }))
+    {
+      m_residency.OnLoadFailed(id);
+      std::erase(m_prefetchEntries, id);
+      for (auto i : models)
+      {
+        EvictModel(i);
+      }
+      continue;
+    }
+    // 共有している全インスタンスの準備が整えばロード完了として実際の確保サイズを通知.
+    if (m_residency.GetState(id) == ResidencyManager::State::Loading &&
+      std::all_of(models.begin(), models.end(), [&](auto i) { return m_modelList[i]->IsRenderingPrepared(); }))
+    {
+      uint64_t bytes = m_modelList[models.front()]->GetAsset()->GetGpuMemoryUsage().Total();
+      for (auto i : models)
+      {
+        bytes += m_modelList[i]->GetGpuMemoryUsage().Total();
+      }
+      m_residency.OnLoaded(id, bytes);
+      const auto& asset = m_modelList[models.front()]->GetAsset();
+      m_loadTelemetry.AddRecord(asset->GetLoadRecord());
+      if (!m_isLoadTimeRecorded)
+      {
+        const auto& prop = asset->m_dataSizeProperty;
+        m_loadedDataSize.cpuByteCount += prop.cpuByteCount;
+        m_loadedDataSize.buffersByteCount += prop.buffersByteCount;
+        m_loadedDataSize.texturesByteCount += prop.texturesByteCount;
+      }
+    }
+  }
+
+  ResidencyManager::Decision decision;
+  m_residency.Evaluate(decision);
+  for (auto id : decision.evictList)
+  {
+    for (auto index : m_entryModels[id])
+    {
+      EvictModel(index);
+    }
+  }
+  RequestModelLoad(decision.loadList);
+  IssuePrefetchedModelLoad();
+}
+
+void MyApplication::RequestModelLoad(const std::vector<ResidencyManager::EntryId>& loadList)
+{
+  if (m_isPreAllocationMode)
+  {
+    // 先にヘッダを非同期で先読みしておき、全て揃った時点でまとめてヒープ確保とロードを行う.
+    for (auto id : loadList)
+    {
+      for (auto index : m_entryModels[id])
+      {
+        m_modelList[index]->RequestLoadHeaderOnly(m_fileList[index]);
+      }
+    }
+    m_prefetchEntries.insert(m_prefetchEntries.end(), loadList.begin(), loadList.end());
+    return;
+  }
+  for (auto id : loadList)
+  {
+    for (auto index : m_entryModels[id])
+    {
+      m_modelList[index]->RequestLoad(m_fileList[index]);
+    }
+  }
+}
+
+void MyApplication::IssuePrefetchedModelLoad()
+{
+  if (m_prefetchEntries.empty())
+  {
+    return;
+  }
+  for (auto id : m_prefetchEntries)
+  {
+    for (auto index : m_entryModels[id])
+    {
+      if (!m_modelList[index]->IsMetadataPrefetched())
+      {
+        // 先読み待ち. メインスレッドはブロックせず次フレームで再確認する.
+        return;
+      }
+    }
+  }
+  auto entries = std::move(m_prefetchEntries);
+  m_prefetchEntries.clear();
+  // 全ての配置情報が揃った時点で、ロード要求の発行より先にヒープの作成をまとめて行う.
+  // ヒープを作成できなかったものは通常モードでロードされる.
+  for (auto id : entries)
+  {
+    for (auto index : m_entryModels[id])
+    {
+      m_modelList[index]->CreatePreallocatedHeap();
+    }
+  }
+  for (auto id : entries)
+  {
+    for (auto index : m_entryModels[id])
+    {
+      m_modelList[index]->RequestLoad(m_fileList[index]);
+    }
+  }
+}
+
+void MyApplication::EvictModel(uint32_t modelIndex)
+{
+  // 描画用の固有データは引き継いで、未ロード状態のモデルと差し替える.
+  auto& current = m_modelList[modelIndex];
+  auto model = std::make_shared<model::SimpleModel>();
+  model->m_tumbleAxis = current->m_tumbleAxis;
+  model->m_tumbleAngle = current->m_tumbleAngle;
+  model->SetLoadingCompleteCallback([this](auto) { m_hasLoadCompletedEvent = true; });
+
+  m_retiredModels.emplace_back(RetiredModel{ current, m_frameCount });
+  current = model;
+  m_modelLoaded[modelIndex] = 0;
+}
+
+void MyApplication::ReleaseRetiredModels()
+{
+  // バックバッファ数分のフレームが経過していれば GPU からの参照は無い.
+  std::erase_if(m_retiredModels, [&](const auto& v) {
+    return v.retiredFrame + GfxDevice::BackBufferCount < m_frameCount;
+  });
+  std::erase_if(m_retiredBuffers, [&](const auto& v) {
+    return v.retiredFrame + GfxDevice::BackBufferCount < m_frameCount;
+  });
 }
 
 void MyApplication::UpdateModelMatrices()
@@ -795,87 +1320,525 @@ void MyApplication::UpdateModelMatrices()
   mtxWorldRoot = XMMatrixRotationY(XMConvertToRadians(count * 0.1f)) * XMMatrixRotationX(XMConvertToRadians(count * 0.12f));
   count++;
 
+  std::vector<SceneTransforms*> transforms;
+  std::vector<XMFLOAT4X4> rootTransforms;
+  transforms.reserve(m_modelList.size());
+  rootTransforms.reserve(m_modelList.size());
+
+  XMStoreFloat4x4(&m_mtxModelRoot, mtxWorldRoot);
+
   int index = 0;
   for (auto& model : m_modelList)
   {
     // 行列を更新し反映.
-    int pz = index / 25;
-    int px = (index - 25 * pz) % 5;
-    int py = (index - 25 * pz) / 5;
-    auto mtxWorld = CalculateWorldMatrix(px, py, pz, model, 5.0, 1.5f);
+    int px, py, pz;
+    CalculateGridCell(index, px, py, pz);
+    auto mtxWorld = CalculateWorldMatrix(px, py, pz, model, ModelGridSize, ModelCellSize);
     index++;
 
     if (!model->IsRenderingPrepared())
     {
       continue;
     }
-    model->UpdateMatrices(mtxWorld * mtxWorldRoot);
+    transforms.push_back(&model->GetTransforms());
+    XMStoreFloat4x4(&rootTransforms.emplace_back(), mtxWorld * mtxWorldRoot);
     model->m_tumbleAngle += 0.01f;
 
     // 描画用リストに追加.
     m_drawList.push_back(model);
   }
+  // 行列の更新は全モデル分をまとめて並列に処理.
+  SceneTransforms::UpdateWorldBatch(transforms, rootTransforms);
+  UpdateModelBvh();
+  UploadModelTransforms();
 }
 
-void MyApplication::DrawModels(ComPtr<ID3D12GraphicsCommandList> commandList)
+void MyApplication::UpdateModelBvh()
 {
+  // 描画対象のモデルを登録/更新する. 余白の範囲内の移動であれば木は変化しない.
   for (auto& model : m_drawList)
   {
-    model->SubmitMatrices(commandList);
+    DynamicBvh::Aabb aabb;
+    model->GetWorldAABB(aabb.min, aabb.max);
+    auto [itr, inserted] = m_modelProxies.try_emplace(model.get(),
+      ModelProxy{ DynamicBvh::NullProxy, 0, DescriptorAllocator::InvalidOffset, (std::max)(model->GetTransforms().GetNodeCount(), 1u), true });
+    if (inserted)
+    {
+      itr->second.proxy = m_modelBvh.CreateProxy(aabb, reinterpret_cast<uint64_t>(model.get()));
+    }
+    else
+    {
+      m_modelBvh.MoveProxy(itr->second.proxy, aabb);
+    }
+    itr->second.lastFrame = m_frameCount;
+  }
+  // 描画対象から外れたモデルを取り除く. 行列バッファの領域は GPU が参照し終わってから再利用する.
+  auto frameFenceValue = GetGfxDevice()->GetFrameFenceValue();
+  for (auto itr = m_modelProxies.begin(); itr != m_modelProxies.end();)
+  {
+    if (itr->second.lastFrame != m_frameCount)
+    {
+      m_modelBvh.DestroyProxy(itr->second.proxy);
+      if (itr->second.transformOffset != DescriptorAllocator::InvalidOffset)
+      {
+        m_transformSlots.FreeDeferred(itr->second.transformOffset, itr->second.transformCount, frameFenceValue);
+      }
+      itr = m_modelProxies.erase(itr);
+    }
+    else
+    {
+      ++itr;
+    }
   }
+}
 
-  model::DrawMode ModeList[] = {
-    model::DrawMode::DrawModeOpaque, model::DrawMode::DrawModeMask,
-    model::DrawMode::DrawModeBlend,
-  };
-  for (auto mode : ModeList)
+void MyApplication::AllocateTransformSlots()
+{
+  auto& gfxDevice = GetGfxDevice();
+  m_transformSlots.ReleaseCompleted(gfxDevice->GetCompletedFenceValue());
+  bool allocated = true;
+  for (auto& [model, proxy] : m_modelProxies)
   {
-    switch (mode)
+    if (proxy.transformOffset == DescriptorAllocator::InvalidOffset)
+    {
+      proxy.transformOffset = m_transformSlots.Allocate(proxy.transformCount);
+      proxy.uploadAll = true;
+      allocated &= proxy.transformOffset != DescriptorAllocator::InvalidOffset;
+    }
+  }
+  if (allocated)
+  {
+    return;
+  }
+
+  // 不足した場合は必要数の 2 倍以上の大きさで作り直し、全モデル分を割り当て直す.
+  uint32_t requiredCount = 0;
+  for (const auto& [model, proxy] : m_modelProxies)
+  {
+    requiredCount += proxy.transformCount;
+  }
+  uint32_t capacity = (std::max)(m_transformSlots.GetStats().capacity, 4096u);
+  while (capacity < requiredCount * 2)
+  {
+    capacity *= 2;
+  }
+  for (;; capacity *= 2)
+  {
+    m_transformSlots.Reset(capacity);
+    allocated = true;
+    for (auto& [model, proxy] : m_modelProxies)
+    {
+      proxy.transformOffset = m_transformSlots.Allocate(proxy.transformCount);
+      proxy.uploadAll = true;
+      allocated &= proxy.transformOffset != DescriptorAllocator::InvalidOffset;
+    }
+    if (allocated)
     {
-    default:
-    case model::DrawModeOpaque:
-    case model::DrawModeMask:
-      commandList->SetPipelineState(m_drawOpaquePipeline.Get());
-      break;
-    case model::DrawModeBlend:
-      commandList->SetPipelineState(m_drawBlendPipeline.Get());
       break;
     }
+  }
+  if (m_transformBuffer)
+  {
+    m_retiredBuffers.emplace_back(RetiredBuffer{ m_transformBuffer, m_frameCount });
+  }
+  D3D12_RESOURCE_DESC resDesc{
+    .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+    .Width = UINT64(sizeof(XMFLOAT4X4)) * capacity,
+    .Height = 1,
+    .DepthOrArraySize = 1,
+    .MipLevels = 1,
+    .Format = DXGI_FORMAT_UNKNOWN,
+    .SampleDesc = {.Count = 1, .Quality = 0},
+    .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+  };
+  m_transformBuffer = gfxDevice->CreateBuffer(resDesc, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COMMON);
+}
+
+void MyApplication::UploadModelTransforms()
+{
+  AllocateTransformSlots();
 
-    for (auto model : m_drawList)
+  // モデル毎に転送するノードの行列を 1 つの領域へ詰め、連続するノードは 1 回のコピーにまとめる.
+  // 転送できなかったモデルは変更の記録を残し、次のフレームで転送する.
+  // アップロードバッファは不足分に合わせて次のフレームで拡張される.
+  constexpr UINT64 MatrixSize = sizeof(XMFLOAT4X4);
+  std::vector<uint32_t> nodes;
+  for (auto& model : m_drawList)
+  {
+    auto& proxy = m_modelProxies.at(model.get());
+    auto& transforms = model->GetTransforms();
+    if (proxy.uploadAll)
     {
-      model->Draw(commandList, mode);
+      nodes.resize(proxy.transformCount);
+      std::iota(nodes.begin(), nodes.end(), 0u);
     }
+    else
+    {
+      auto changed = transforms.GetChangedNodes();
+      nodes.assign(changed.begin(), changed.end());
+      std::sort(nodes.begin(), nodes.end());
+    }
+    if (nodes.empty())
+    {
+      proxy.transformsUploaded = true;
+      continue;
+    }
+
+    UploadRingBuffer::Allocation allocation;
+    if (!m_meshConstantsUpload.Allocate(MatrixSize * nodes.size(), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, allocation))
+    {
+      proxy.transformsUploaded = false;
+      continue;
+    }
+    auto dst = reinterpret_cast<XMFLOAT4X4*>(allocation.cpuAddress);
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+      // 転置して転送.
+      XMStoreFloat4x4(&dst[i], XMMatrixTranspose(XMLoadFloat4x4(&transforms.GetWorldMatrix(nodes[i]))));
+    }
+    for (size_t begin = 0; begin < nodes.size();)
+    {
+      auto end = begin + 1;
+      while (end < nodes.size() && nodes[end] == nodes[end - 1] + 1)
+      {
+        ++end;
+      }
+      auto src = allocation;
+      src.offset += MatrixSize * begin;
+      m_meshConstantsUpload.EnqueueCopy(m_transformBuffer.Get(), MatrixSize * (proxy.transformOffset + nodes[begin]), src, MatrixSize * (end - begin));
+      begin = end;
+    }
+    transforms.ClearChangedNodes();
+    proxy.uploadAll = false;
+    proxy.transformsUploaded = true;
   }
+}
+
+void MyApplication::DrawModels(ComPtr<ID3D12GraphicsCommandList> commandList, DirectX::FXMMATRIX mtxView, DirectX::CXMMATRIX mtxProj,
+  std::vector<ComPtr<ID3D12GraphicsCommandList>>& drawCommandLists)
+{
+  // 不透明→マスク→半透明の順に、状態毎にまとまるよう並べ替える.
+  CullAndBuildDrawPackets(mtxView, mtxProj);
+  m_drawPackets.Sort();
+  // 行列の転送は全インスタンス分をまとめ、バリアを 1 組で済ませる.
+  m_meshConstantsUpload.FlushCopies(commandList.Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
   m_drawList.clear();
+
+  // ソート済みの並びを連続した範囲に分割し、範囲毎に別スレッドでコマンドリストへ記録する.
+  // 実行順は分割の順序のままとなるため、半透明の描画順も保たれる.
+  constexpr size_t MinPacketsPerCommandList = 256;
+  auto& gfxDevice = GetGfxDevice();
+  auto items = m_drawPackets.GetSortedItems();
+  if (items.empty())
+  {
+    m_drawCommandListCount = 0;
+    return;
+  }
+  auto listCount = uint32_t((items.size() + MinPacketsPerCommandList - 1) / MinPacketsPerCommandList);
+  listCount = (std::min)(listCount, gfxDevice->GetRecordingContextCount());
+  listCount = (std::max)(listCount, 1u);
+  m_drawStateFilters.resize(gfxDevice->GetRecordingContextCount());
+  m_drawCommandListCount = listCount;
+
+  std::vector<ComPtr<ID3D12GraphicsCommandList>> recorded(listCount);
+  auto itemsPerList = (items.size() + listCount - 1) / listCount;
+  GetJobSystem()->ParallelFor(listCount, 1, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; ++i)
+    {
+      auto first = (std::min)(items.size(), itemsPerList * i);
+      auto last = (std::min)(items.size(), first + itemsPerList);
+      auto drawCommandList = gfxDevice->BeginRecording(i);
+      SetCommonDrawState(drawCommandList.Get());
+      RecordDrawPackets(drawCommandList.Get(), items.subspan(first, last - first), m_drawStateFilters[i]);
+      drawCommandList->Close();
+      recorded[i] = drawCommandList;
+    }
+  });
+  drawCommandLists.insert(drawCommandLists.end(), recorded.begin(), recorded.end());
+}
+
+void MyApplication::CullAndBuildDrawPackets(DirectX::FXMMATRIX mtxView, DirectX::CXMMATRIX mtxProj)
+{
+  auto frustum = Frustum::FromViewProjection(XMMatrixMultiply(mtxView, mtxProj));
+  m_cullingFrustum = frustum;
+  m_hasCullingFrustum = true;
+
+  // モデル全体の AABB で判定 (BVH).
+  m_visibleProxies.clear();
+  m_modelBvh.QueryFrustum(frustum, m_visibleProxies);
+  m_visibleModels.clear();
+  m_visibleTransformOffsets.clear();
+  for (auto proxy : m_visibleProxies)
+  {
+    auto model = reinterpret_cast<model::SimpleModel*>(m_modelBvh.GetUserData(proxy));
+    m_visibleModels.push_back(model);
+    const auto& modelProxy = m_modelProxies.at(model);
+    m_visibleTransformOffsets.push_back(modelProxy.transformsUploaded ? modelProxy.transformOffset : DescriptorAllocator::InvalidOffset);
+  }
+
+  // 可視モデルについてメッシュ単位で判定.
+  m_meshBounds.Clear();
+  m_meshBoundsOffsets.clear();
+  for (auto model : m_visibleModels)
+  {
+    m_meshBoundsOffsets.push_back(m_meshBounds.GetCount());
+    model->AddMeshBounds(m_meshBounds);
+  }
+  m_visibleMeshes.clear();
+  m_meshBounds.Cull(frustum, m_visibleMeshes);
+
+  // 遮蔽されたモデルはメッシュごと除外する.
+  m_occludeeVisible.assign(m_visibleModels.size(), 1);
+  if (m_useOcclusionCulling)
+  {
+    CullOccludedModels(mtxView, mtxProj);
+  }
+
+  // 可視メッシュは昇順に並んでいるため、モデルの範囲を順に進めながら対応付ける.
+  m_instanceBatcher.Clear();
+  m_instanceBatcher.SetInstancingEnabled(m_useInstancing);
+  size_t rangeIndex = 0;
+  for (auto meshBoundsIndex : m_visibleMeshes)
+  {
+    while (rangeIndex + 1 < m_meshBoundsOffsets.size() && m_meshBoundsOffsets[rangeIndex + 1] <= meshBoundsIndex)
+    {
+      ++rangeIndex;
+    }
+    // 行列を転送できなかったモデルは古い行列で描画しないよう除外する.
+    if (!m_occludeeVisible[rangeIndex] || m_visibleTransformOffsets[rangeIndex] == DescriptorAllocator::InvalidOffset)
+    {
+      continue;
+    }
+    auto model = m_visibleModels[rangeIndex];
+    auto center = m_meshBounds.GetCenter(meshBoundsIndex);
+    auto position = XMVector3Transform(XMLoadFloat3(&center), mtxView);
+    // 右手系のため -z が深度.
+    model->AddInstance(m_instanceBatcher, meshBoundsIndex - m_meshBoundsOffsets[rangeIndex], -XMVectorGetZ(position),
+      m_visibleTransformOffsets[rangeIndex]);
+  }
+
+  // まとめた描画単位毎にパケットを作成.
+  m_instanceBatcher.Build();
+  m_drawPackets.Clear();
+  auto instanceData = UploadInstanceData();
+  if (instanceData != 0)
+  {
+    for (const auto& batch : m_instanceBatcher.GetBatches())
+    {
+      auto packet = batch.packet;
+      packet.meshConstants = instanceData + sizeof(InstanceBatcher::InstanceData) * batch.firstInstance;
+      packet.instanceCount = batch.instanceCount;
+      m_drawPackets.Add(packet, batch.viewDepth, batch.backToFront);
+    }
+  }
+
+  m_cullingStats.modelCount = m_modelBvh.GetProxyCount();
+  m_cullingStats.visibleModelCount = uint32_t(std::count(m_occludeeVisible.begin(), m_occludeeVisible.end(), uint8_t(1)));
+  m_cullingStats.meshCount = m_meshBounds.GetCount();
+  m_cullingStats.visibleMeshCount = uint32_t(m_visibleMeshes.size());
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS MyApplication::UploadInstanceData()
+{
+  auto instanceCount = m_instanceBatcher.GetInstanceCount();
+  if (instanceCount == 0)
+  {
+    return 0;
+  }
+  // 前回このフレーム番号で使用したバッファは GPU の処理が完了しているため、不足していれば作り直す.
+  auto& gfxDevice = GetGfxDevice();
+  auto& instanceBuffer = m_instanceBuffers[gfxDevice->GetFrameIndex()];
+  UINT64 dataSize = sizeof(InstanceBatcher::InstanceData) * instanceCount;
+  if (!instanceBuffer || instanceBuffer->GetDesc().Width < dataSize)
+  {
+    UINT64 capacity = 64 * 1024;
+    while (capacity < dataSize)
+    {
+      capacity *= 2;
+    }
+    D3D12_RESOURCE_DESC resDesc{
+      .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+      .Width = capacity,
+      .Height = 1,
+      .DepthOrArraySize = 1,
+      .MipLevels = 1,
+      .Format = DXGI_FORMAT_UNKNOWN,
+      .SampleDesc = {.Count = 1, .Quality = 0},
+      .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+    };
+    instanceBuffer = gfxDevice->CreateBuffer(resDesc, D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_COMMON);
+  }
+
+  UploadRingBuffer::Allocation allocation;
+  if (!m_meshConstantsUpload.Allocate(dataSize, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, allocation))
+  {
+    // 次のフレームでアップロードバッファが拡張されるまで、このフレームの描画は行わない.
+    return 0;
+  }
+  m_instanceBatcher.WriteInstanceData(reinterpret_cast<InstanceBatcher::InstanceData*>(allocation.cpuAddress));
+  m_meshConstantsUpload.EnqueueCopy(instanceBuffer.Get(), 0, allocation, dataSize);
+  return instanceBuffer->GetGPUVirtualAddress();
+}
+
+void MyApplication::CullOccludedModels(DirectX::FXMMATRIX mtxView, DirectX::CXMMATRIX mtxProj)
+{
+  // 遮蔽物は視錐台内の不透明なメッシュのうち、画面上で大きいと見込まれるもの(半径 / 距離 が大きいもの)から選ぶ.
+  // 半透明やアルファテストのメッシュは背後が見えるため遮蔽物にしない.
+  // AABB は中身が詰まっているとは限らないため、中心に向けて縮小してから遮蔽物とする.
+  constexpr uint32_t MaxOccluderCount = 64;
+  constexpr float OccluderShrink = 0.6f;
+  auto eyePosition = XMLoadFloat3(&m_sceneParams.eyePosition);
+  auto screenScore = [&](uint32_t index) {
+    auto center = m_meshBounds.GetCenter(index);
+    auto extent = m_meshBounds.GetExtent(index);
+    float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&center), eyePosition)));
+    return XMVectorGetX(XMVector3Length(XMLoadFloat3(&extent))) / (std::max)(distance, 0.01f);
+  };
+  m_occluderCandidates.clear();
+  size_t rangeIndex = 0;
+  for (auto meshBoundsIndex : m_visibleMeshes)
+  {
+    while (rangeIndex + 1 < m_meshBoundsOffsets.size() && m_meshBoundsOffsets[rangeIndex + 1] <= meshBoundsIndex)
+    {
+      ++rangeIndex;
+    }
+    auto meshIndex = meshBoundsIndex - m_meshBoundsOffsets[rangeIndex];
+    if (m_visibleModels[rangeIndex]->GetMeshDrawMode(meshIndex) == model::DrawModeOpaque)
+    {
+      m_occluderCandidates.push_back(meshBoundsIndex);
+    }
+  }
+  auto occluderCount = (std::min)(uint32_t(m_occluderCandidates.size()), MaxOccluderCount);
+  std::partial_sort(m_occluderCandidates.begin(), m_occluderCandidates.begin() + occluderCount, m_occluderCandidates.end(),
+    [&](uint32_t a, uint32_t b) { return screenScore(a) > screenScore(b); });
+
+  m_occlusion.BeginFrame(XMMatrixMultiply(mtxView, mtxProj));
+  for (uint32_t i = 0; i < occluderCount; ++i)
+  {
+    auto center = m_meshBounds.GetCenter(m_occluderCandidates[i]);
+    auto extent = m_meshBounds.GetExtent(m_occluderCandidates[i]);
+    XMFLOAT3 occluderMin{ center.x - extent.x * OccluderShrink, center.y - extent.y * OccluderShrink, center.z - extent.z * OccluderShrink };
+    XMFLOAT3 occluderMax{ center.x + extent.x * OccluderShrink, center.y + extent.y * OccluderShrink, center.z + extent.z * OccluderShrink };
+    m_occlusion.AddOccluder(occluderMin, occluderMax);
+  }
+  m_occlusion.Rasterize(std::chrono::microseconds(m_occlusionBudgetUs));
+
+  // モデル全体の AABB で判定.
+  auto modelCount = uint32_t(m_visibleModels.size());
+  m_occludeeMins.resize(modelCount);
+  m_occludeeMaxs.resize(modelCount);
+  for (uint32_t i = 0; i < modelCount; ++i)
+  {
+    m_visibleModels[i]->GetWorldAABB(m_occludeeMins[i], m_occludeeMaxs[i]);
+  }
+  m_occlusion.TestAabbs(m_occludeeMins.data(), m_occludeeMaxs.data(), modelCount, m_occludeeVisible.data());
+}
+
+void MyApplication::RecordDrawPackets(ID3D12GraphicsCommandList* commandList,
+  std::span<const DrawPacketList::SortItem> items, DrawStateFilter& filter)
+{
+  ID3D12PipelineState* pipelines[] = {
+    m_drawOpaquePipeline.Get(), // Opaque
+    m_drawOpaquePipeline.Get(), // Mask
+    m_drawBlendPipeline.Get(),  // Blend
+  };
+  commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+  filter.Reset();
+  ID3D12PipelineState* currentPipeline = nullptr;
+  for (const auto& item : items)
+  {
+    const auto& packet = m_drawPackets.GetPacket(item);
+    auto changes = filter.Apply(packet);
+    if (changes & DrawStateFilter::ChangePipeline)
+    {
+      // マスクと不透明は同じパイプラインを使用する.
+      auto pipeline = pipelines[packet.pipeline];
+      if (pipeline != currentPipeline)
+      {
+        commandList->SetPipelineState(pipeline);
+        currentPipeline = pipeline;
+      }
+    }
+    if (changes & DrawStateFilter::ChangeIndexBuffer)
+    {
+      D3D12_INDEX_BUFFER_VIEW ibv{};
+      ibv.BufferLocation = packet.indexBufferAddress;
+      ibv.Format = DXGI_FORMAT_R32_UINT;
+      ibv.SizeInBytes = packet.indexBufferSize;
+      commandList->IASetIndexBuffer(&ibv);
+    }
+    if (changes & DrawStateFilter::ChangeVertexBuffer)
+    {
+      D3D12_VERTEX_BUFFER_VIEW vbv{};
+      vbv.BufferLocation = packet.vertexBufferAddress;
+      vbv.SizeInBytes = packet.vertexBufferSize;
+      vbv.StrideInBytes = packet.vertexStride;
+      commandList->IASetVertexBuffers(0, 1, &vbv);
+    }
+    if (changes & DrawStateFilter::ChangeMeshConstants)
+    {
+      commandList->SetGraphicsRootShaderResourceView(1, packet.meshConstants);
+    }
+    if (changes & DrawStateFilter::ChangeMaterialConstants)
+    {
+      commandList->SetGraphicsRootConstantBufferView(2, packet.materialConstants);
+    }
+    if (changes & DrawStateFilter::ChangeTextureTable)
+    {
+      commandList->SetGraphicsRootDescriptorTable(3, D3D12_GPU_DESCRIPTOR_HANDLE{ packet.textureTable });
+    }
+    if (changes & DrawStateFilter::ChangeSamplerTable)
+    {
+      commandList->SetGraphicsRootDescriptorTable(4, D3D12_GPU_DESCRIPTOR_HANDLE{ packet.samplerTable });
+    }
+    commandList->DrawIndexedInstanced(packet.indexCount, packet.instanceCount, 0, 0, 0);
+  }
 }
 
 void MyApplication::CheckLoadingComplete()
 {
   using namespace std::chrono;
 
-  m_modelCountLoadCompleted++;
-  if (m_modelCountLoadCompleted == m_currentModelCount)
+  // 通知はローダーのスレッドから届くため、ここではモデル一覧を直接参照して判定する.
+  if (m_hasLoadCompletedEvent.exchange(false))
   {
-    m_endLoadingTime = std::chrono::high_resolution_clock::now();
-    m_maxCpuUtilizationInLoading = (float)tpc::GetPeakCPUUtilization();
-
-    size_t total = 0;
-    size_t cpuDataTotal = 0, bufferDataTotal = 0, textureDataTotal = 0;
-    for (const auto& model : m_modelList)
+    for (uint32_t i = 0; i < m_modelList.size(); ++i)
     {
-      const auto& prop = model->m_dataSizeProperty;
-      total += (prop.cpuByteCount + prop.buffersByteCount + prop.texturesByteCount);
-      cpuDataTotal += prop.cpuByteCount;
-      bufferDataTotal += prop.buffersByteCount;
-      textureDataTotal += prop.texturesByteCount;
+      if (m_modelList[i]->IsRenderingPrepared())
+      {
+        m_modelLoaded[i] = 1;
+      }
     }
+  }
+  m_modelCountLoadCompleted = uint32_t(std::count(m_modelLoaded.begin(), m_modelLoaded.end(), uint8_t(1)));
 
-    auto secondFloat = duration<float, seconds::period>(m_endLoadingTime - m_startLoadingTime);
-    auto bandwidth = (total / secondFloat.count()) / 1000.0f / 1000.0f / 1000.0f;
-    m_strBandwidth = std::format("Bandwidth: {:7.2f} GB/s", bandwidth);
-    m_strCpuMemData = std::format("CPU Mem Data: {:7.2f} MiB", cpuDataTotal / 1024.0f / 1024.0f);
-    m_strBufferData = std::format(" Buffer Data: {:7.2f} MiB", bufferDataTotal / 1024.0f / 1024.0f);
-    m_strTextureData = std::format("Texture Data: {:7.2f} MiB", textureDataTotal / 1024.0f / 1024.0f);
+  // 要求したロードが全て終わった時点を完了とする. 予算によりロードを見送っているものは待たない.
+  if (m_isLoadTimeRecorded || m_isCoolingPeriod)
+  {
+    return;
+  }
+  for (ResidencyManager::EntryId id = 0; id < m_residency.GetEntryCount(); ++id)
+  {
+    if (m_residency.GetState(id) == ResidencyManager::State::Loading)
+    {
+      return;
+    }
   }
+  m_isLoadTimeRecorded = true;
+  m_endLoadingTime = std::chrono::high_resolution_clock::now();
+  m_maxCpuUtilizationInLoading = (float)tpc::GetPeakCPUUtilization();
+
+  // 共有データはエントリ単位で数えているため重複しない.
+  size_t cpuDataTotal = m_loadedDataSize.cpuByteCount;
+  size_t bufferDataTotal = m_loadedDataSize.buffersByteCount;
+  size_t textureDataTotal = m_loadedDataSize.texturesByteCount;
+  size_t total = cpuDataTotal + bufferDataTotal + textureDataTotal;
+
+  auto secondFloat = duration<float, seconds::period>(m_endLoadingTime - m_startLoadingTime);
+  auto bandwidth = (total / secondFloat.count()) / 1000.0f / 1000.0f / 1000.0f;
+  m_strBandwidth = std::format("Bandwidth: {:7.2f} GB/s", bandwidth);
+  m_strCpuMemData = std::format("CPU Mem Data: {:7.2f} MiB", cpuDataTotal / 1024.0f / 1024.0f);
+  m_strBufferData = std::format(" Buffer Data: {:7.2f} MiB", bufferDataTotal / 1024.0f / 1024.0f);
+  m_strTextureData = std::format("Texture Data: {:7.2f} MiB", textureDataTotal / 1024.0f / 1024.0f);
 }
@@ -1,13 +1,24 @@
 ﻿#pragma once
+#include <future>
 #include <memory>
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <span>
 #include <wrl.h>
 #include <d3d12.h>
 #include <DirectXMath.h>
 
 #include "GfxDevice.h"
 #include "Model.h"
+#include "ResidencyManager.h"
+#include "LoadTelemetry.h"
+#include "UploadRingBuffer.h"
+#include "DrawPacket.h"
+#include "InstanceBatcher.h"
+#include "FrustumCulling.h"
+#include "DynamicBvh.h"
+#include "OcclusionCulling.h"
 
 class MyApplication 
 {
@@ -28,7 +39,10 @@ private:
   void PrepareModelData();
   void PrepareImGui();
   void DestroyImGui();
-  ComPtr<ID3D12GraphicsCommandList> MakeCommandList();
+  // 描画コマンドを作成. 実行順に並んだコマンドリストを commandLists に追加する.
+  void MakeCommandLists(std::vector<ComPtr<ID3D12GraphicsCommandList>>& commandLists);
+  // 描画先やルートパラメータなど、各コマンドリストで共通の状態を設定.
+  void SetCommonDrawState(ID3D12GraphicsCommandList* commandList);
 
   struct Vertex
   {
@@ -139,8 +153,19 @@ private:
   std::string  m_loadStatusMessage;
   time_point m_startLoadingTime;
   time_point m_endLoadingTime;
-  std::atomic<uint32_t> m_modelCountLoadCompleted;
   std::atomic<float> m_maxCpuUtilizationInLoading;
+  // ロード完了の通知. ローダーのスレッドではフラグを立てるのみとし、集計はメインスレッドで行う.
+  std::atomic<bool> m_hasLoadCompletedEvent = false;
+  std::vector<uint8_t> m_modelLoaded;       // モデル毎の描画準備完了フラグ. 追い出したものは 0 に戻す.
+  uint32_t m_modelCountLoadCompleted = 0;
+  bool m_isLoadTimeRecorded = false;        // 要求したロードが全て完了し、所要時間を記録済みか.
+  // 計測期間中にロードしたデータサイズ. 追い出し後の再ロード分も転送量として含める.
+  struct LoadedDataSize
+  {
+    size_t cpuByteCount = 0;
+    size_t buffersByteCount = 0;
+    size_t texturesByteCount = 0;
+  } m_loadedDataSize;
 
   //std::shared_ptr<model::ModelDeserialized> m_test;
   //using ModelDataDS = std::shared_ptr<model::ModelDeserialized>;
@@ -166,14 +191,130 @@ private:
   void LoadModelDataByDirectStorage();
   void UnloadModelData();
   void UpdateModelMatrices();
-  void DrawModels(ComPtr<ID3D12GraphicsCommandList> commandList);
+  void DrawModels(ComPtr<ID3D12GraphicsCommandList> commandList, DirectX::FXMMATRIX mtxView, DirectX::CXMMATRIX mtxProj,
+    std::vector<ComPtr<ID3D12GraphicsCommandList>>& drawCommandLists);
+  // 描画対象モデルの BVH を更新.
+  void UpdateModelBvh();
+  // 視錐台カリングを行い、可視のメッシュのみを描画パケットとして追加.
+  void CullAndBuildDrawPackets(DirectX::FXMMATRIX mtxView, DirectX::CXMMATRIX mtxProj);
+  // 描画対象モデルの行列のうち、変化したノードのみを行列バッファへ転送予約する.
+  // アップロードバッファが不足したモデルは ModelProxy::transformsUploaded が false となり、このフレームでは描画しない.
+  void UploadModelTransforms();
+  // 新たに描画対象となったモデルへ行列バッファの領域を割り当てる. 不足していればバッファを拡張する.
+  void AllocateTransformSlots();
+  // インスタンスデータを今フレームのインスタンスバッファへ転送予約し、その GPU アドレスを返す.
+  // アップロードバッファが不足している場合は 0.
+  D3D12_GPU_VIRTUAL_ADDRESS UploadInstanceData();
+  // 可視モデルの大きいメッシュを遮蔽物とし、遮蔽されたモデルを m_occludeeVisible に 0 で記録.
+  // m_meshBounds が構築済みであること.
+  void CullOccludedModels(DirectX::FXMMATRIX mtxView, DirectX::CXMMATRIX mtxProj);
+  void RecordDrawPackets(ID3D12GraphicsCommandList* commandList,
+    std::span<const DrawPacketList::SortItem> items, DrawStateFilter& filter);
 
+  // ロード完了の通知を集計し、要求したロードが全て終わっていれば所要時間と転送量を記録する.
   void CheckLoadingComplete();
 
+  // VRAM 予算に従ってモデルのロード/追い出しを行う.
+  void UpdateResidency();
+  void RequestModelLoad(const std::vector<ResidencyManager::EntryId>& loadList);
+  void IssuePrefetchedModelLoad();
+  void EvictModel(uint32_t modelIndex);
+  void ReleaseRetiredModels();
+
+  ResidencyManager m_residency;
+  std::vector<ResidencyManager::EntryId> m_modelEntryIds;  // モデル毎の常駐管理エントリ.
+  std::vector<std::vector<uint32_t>> m_entryModels;       // エントリを共有するモデル一覧.
+  std::vector<ResidencyManager::EntryId> m_prefetchEntries; // ヘッダ先読み完了待ちのエントリ.
+  std::vector<ResidencyManager::EntryId> m_estimateEntries; // 先読みによる推定サイズの確定待ちのエントリ.
+  bool m_useVramBudget = false;
+  int  m_vramBudgetMiB = 1024;
+  uint64_t m_frameCount = 0;
+  // 追い出したモデルは GPU が参照し終わるまで保持しておく.
+  struct RetiredModel
+  {
+    SampleModel model;
+    uint64_t retiredFrame;
+  };
+  std::vector<RetiredModel> m_retiredModels;
+
+  // モデルの行列転送用. 全モデルで共有し、GPU が参照中の領域はフェンスで保護する.
+  UploadRingBuffer m_meshConstantsUpload;
+  // 同じアセットのメッシュはインスタンス描画にまとめる.
+  // インスタンス毎の行列の位置はフレーム毎のインスタンスバッファ (VRAM) に詰めて転送する.
+  InstanceBatcher m_instanceBatcher;
+  bool m_useInstancing = true;
+  ComPtr<ID3D12Resource1> m_instanceBuffers[GfxDevice::BackBufferCount];
+  // 描画対象モデルの行列 (VRAM). モデル毎にノード数分の連続した領域を割り当てて常駐させ、
+  // SceneTransforms で再計算されたノードのみを転送する.
+  ComPtr<ID3D12Resource1> m_transformBuffer;
+  DescriptorAllocator m_transformSlots;
+  // 拡張前の行列バッファは GPU が参照し終わるまで保持しておく.
+  struct RetiredBuffer
+  {
+    ComPtr<ID3D12Resource1> buffer;
+    uint64_t retiredFrame;
+  };
+  std::vector<RetiredBuffer> m_retiredBuffers;
+  // 描画パケットはソートした上で、変化した状態のみを設定して発行する.
+  // 記録はワーカースレッドで分担し、スレッド毎に状態を追跡する.
+  DrawPacketList m_drawPackets;
+  std::vector<DrawStateFilter> m_drawStateFilters;
+  uint32_t m_drawCommandListCount = 0;
+
+  // 視錐台カリング. モデル単位で BVH により判定した後、可視モデルのメッシュ単位で判定する.
+  DynamicBvh m_modelBvh{ 0.5f };
+  struct ModelProxy
+  {
+    DynamicBvh::ProxyId proxy;
+    uint64_t lastFrame;
+    uint32_t transformOffset;   // 行列バッファ内の位置. 未割り当てであれば InvalidOffset.
+    uint32_t transformCount;    // ノード数.
+    bool     uploadAll;         // 全ノードの転送が必要か (割り当て直後など).
+    bool     transformsUploaded; // 今フレームの行列が行列バッファに揃っているか.
+  };
+  std::unordered_map<const model::SimpleModel*, ModelProxy> m_modelProxies;
+  std::vector<DynamicBvh::ProxyId> m_visibleProxies;
+  std::vector<model::SimpleModel*> m_visibleModels;
+  std::vector<uint32_t> m_visibleTransformOffsets;  // m_visibleModels と同じ並び. 行列が揃っていなければ InvalidOffset.
+  Frustum m_cullingFrustum{};
+  bool m_hasCullingFrustum = false;         // 一度でもカリングを行ったか.
+  DirectX::XMFLOAT4X4 m_mtxModelRoot{ 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };  // グリッド全体の回転.
+  AabbCullingList m_meshBounds;
+  std::vector<uint32_t> m_visibleMeshes;
+  std::vector<uint32_t> m_meshBoundsOffsets;  // 可視モデル毎の m_meshBounds 内の開始位置.
+  struct CullingStats
+  {
+    uint32_t modelCount = 0;
+    uint32_t visibleModelCount = 0;
+    uint32_t meshCount = 0;   // 可視モデルのメッシュ数.
+    uint32_t visibleMeshCount = 0;
+  } m_cullingStats;
+
+  // ソフトウェアによる遮蔽カリング. 視錐台カリング後のモデル単位で判定する.
+  SoftwareOcclusion m_occlusion;
+  bool m_useOcclusionCulling = false;
+  int  m_occlusionBudgetUs = 1000;
+  std::vector<uint32_t> m_occluderCandidates;
+  std::vector<DirectX::XMFLOAT3> m_occludeeMins, m_occludeeMaxs;
+  std::vector<uint8_t> m_occludeeVisible;  // m_visibleModels と同じ並び.
+
+  // モデル毎のロード工程の計測結果.
+  LoadTelemetry m_loadTelemetry;
+  int m_histogramStage = int(LoadTelemetry::Stage::RenderingPrepared);  // ヒストグラムを表示する工程.
+
   std::string m_strBandwidth;
   std::string m_strCpuMemData;
   std::string m_strBufferData;
   std::string m_strTextureData;
+  std::string m_strTransformBenchmark;
+  std::future<std::string> m_transformBenchmarkTask;  // 実行中の行列更新ベンチマーク.
+  std::string m_strDrawPacketBenchmark;
+  std::string m_strCullingBenchmark;
+  std::string m_strBvhBenchmark;
+  std::string m_strOcclusionBenchmark;
+  std::string m_strDescriptorStress;
+  std::string m_strUploadRingStress;
+  std::string m_strResidencySimulation;
 
   std::vector<std::wstring> m_fileList;
 };
@@ -0,0 +1,238 @@
+﻿#include "BvhBenchmark.h"
+#include "DynamicBvh.h"
+#include "FrustumCulling.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+  template<typename Func>
+  double MeasureMilliseconds(uint32_t iterations, Func func)
+  {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+      func(i);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+  }
+
+  // 結果を user data (インスタンス番号) の昇順に並べる.
+  std::vector<uint32_t> ToSortedIndices(const DynamicBvh& bvh, const std::vector<DynamicBvh::ProxyId>& proxies)
+  {
+    std::vector<uint32_t> indices;
+    indices.reserve(proxies.size());
+    for (auto proxy : proxies)
+    {
+      indices.push_back(uint32_t(bvh.GetUserData(proxy)));
+    }
+    std::sort(indices.begin(), indices.end());
+    return indices;
+  }
+
+  // DynamicBvh の視錐台判定と同じ式による全件判定.
+  bool IsOutsideFrustum(const Frustum& frustum, const DynamicBvh::Aabb& a)
+  {
+    float cx = (a.min.x + a.max.x) * 0.5f, cy = (a.min.y + a.max.y) * 0.5f, cz = (a.min.z + a.max.z) * 0.5f;
+    float ex = (a.max.x - a.min.x) * 0.5f, ey = (a.max.y - a.min.y) * 0.5f, ez = (a.max.z - a.min.z) * 0.5f;
+    for (const auto& plane : frustum.planes)
+    {
+      float d = plane.x * cx + plane.y * cy + plane.z * cz + plane.w;
+      float r = std::abs(plane.x) * ex + std::abs(plane.y) * ey + std::abs(plane.z) * ez;
+      if (d + r < 0.0f)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  BvhBenchmarkResult RunOne(uint32_t instanceCount, uint32_t iterations)
+  {
+    BvhBenchmarkResult result;
+    result.instanceCount = instanceCount;
+
+    // 密度が一定となるよう、数に応じて配置範囲を広げる.
+    float extent = 4.0f * std::cbrt(float(instanceCount));
+    std::default_random_engine rng;
+    std::uniform_real_distribution<float> position(-extent, extent);
+    std::uniform_real_distribution<float> size(0.5f, 1.5f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<DynamicBvh::Aabb> boxes(instanceCount);
+    for (auto& box : boxes)
+    {
+      XMFLOAT3 c{ position(rng), position(rng), position(rng) };
+      float s = size(rng);
+      box = { { c.x - s, c.y - s, c.z - s }, { c.x + s, c.y + s, c.z + s } };
+    }
+
+    DynamicBvh bvh(0.2f);
+    std::vector<DynamicBvh::ProxyId> proxies(instanceCount);
+    result.buildMs = MeasureMilliseconds(1, [&](uint32_t) {
+      for (uint32_t i = 0; i < instanceCount; ++i)
+      {
+        proxies[i] = bvh.CreateProxy(boxes[i], i);
+      }
+    });
+    result.height = bvh.GetHeight();
+    result.valid = bvh.Validate();
+
+    // 各インスタンスを毎フレーム少しだけ動かす.
+    std::vector<XMFLOAT3> velocities(instanceCount);
+    for (auto& v : velocities)
+    {
+      v = { unit(rng) * 0.05f, unit(rng) * 0.05f, unit(rng) * 0.05f };
+    }
+    uint32_t reinsertCount = 0;
+    result.updateMs = MeasureMilliseconds(iterations, [&](uint32_t) {
+      for (uint32_t i = 0; i < instanceCount; ++i)
+      {
+        auto& box = boxes[i];
+        const auto& v = velocities[i];
+        box.min = { box.min.x + v.x, box.min.y + v.y, box.min.z + v.z };
+        box.max = { box.max.x + v.x, box.max.y + v.y, box.max.z + v.z };
+        reinsertCount += bvh.MoveProxy(proxies[i], box) ? 1 : 0;
+      }
+    });
+    result.reinsertCount = reinsertCount / iterations;
+    result.valid = result.valid && bvh.Validate() && bvh.GetProxyCount() == instanceCount;
+
+    // BVH は余白付きの AABB を持つため、全件判定側も同じ AABB を使う.
+    for (uint32_t i = 0; i < instanceCount; ++i)
+    {
+      boxes[i] = bvh.GetFatAabb(proxies[i]);
+    }
+    AabbCullingList list;
+    list.Reserve(instanceCount);
+    XMFLOAT4X4 identity;
+    XMStoreFloat4x4(&identity, XMMatrixIdentity());
+    for (const auto& box : boxes)
+    {
+      list.Add(box.min, box.max, identity);
+    }
+
+    // 視錐台は原点から -Z 方向. 範囲全体に比べて狭い領域のみを含む.
+    auto frustum = Frustum::FromViewProjection(XMMatrixPerspectiveFovRH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 100.0f));
+    std::vector<DynamicBvh::ProxyId> proxyResults;
+    std::vector<uint32_t> indexResults;
+    result.frustumBvhMs = MeasureMilliseconds(iterations, [&](uint32_t) {
+      proxyResults.clear();
+      bvh.QueryFrustum(frustum, proxyResults);
+    });
+    result.frustumLinearMs = MeasureMilliseconds(iterations, [&](uint32_t) {
+      indexResults.clear();
+      list.Cull(frustum, indexResults);
+    });
+    {
+      // 計測用の AabbCullingList は積和の順序が異なるため、BVH と同じ式で判定したものと比べる.
+      indexResults.clear();
+      for (uint32_t i = 0; i < instanceCount; ++i)
+      {
+        if (!IsOutsideFrustum(frustum, boxes[i]))
+        {
+          indexResults.push_back(i);
+        }
+      }
+      result.frustumResultsMatch = ToSortedIndices(bvh, proxyResults) == indexResults;
+    }
+
+    constexpr uint32_t QueriesPerIteration = 100;
+    std::vector<XMFLOAT3> origins(QueriesPerIteration), directions(QueriesPerIteration);
+    for (uint32_t i = 0; i < QueriesPerIteration; ++i)
+    {
+      origins[i] = { position(rng), position(rng), position(rng) };
+      XMStoreFloat3(&directions[i], XMVector3Normalize(XMVectorSet(unit(rng), unit(rng), unit(rng), 0.0f)));
+    }
+    const float radius = 5.0f;
+    auto querySphereLinear = [&](const XMFLOAT3& center, std::vector<uint32_t>& results) {
+      for (uint32_t i = 0; i < instanceCount; ++i)
+      {
+        const auto& box = boxes[i];
+        float dx = (std::max)((std::max)(box.min.x - center.x, 0.0f), center.x - box.max.x);
+        float dy = (std::max)((std::max)(box.min.y - center.y, 0.0f), center.y - box.max.y);
+        float dz = (std::max)((std::max)(box.min.z - center.z, 0.0f), center.z - box.max.z);
+        if (dx * dx + dy * dy + dz * dz <= radius * radius)
+        {
+          results.push_back(i);
+        }
+      }
+    };
+    result.sphereBvhMs = MeasureMilliseconds(iterations, [&](uint32_t) {
+      for (const auto& center : origins)
+      {
+        proxyResults.clear();
+        bvh.QuerySphere(center, radius, proxyResults);
+      }
+    }) / QueriesPerIteration;
+    result.sphereLinearMs = MeasureMilliseconds(iterations, [&](uint32_t) {
+      for (const auto& center : origins)
+      {
+        indexResults.clear();
+        querySphereLinear(center, indexResults);
+      }
+    }) / QueriesPerIteration;
+    result.sphereResultsMatch = true;
+    for (const auto& center : origins)
+    {
+      proxyResults.clear();
+      bvh.QuerySphere(center, radius, proxyResults);
+      indexResults.clear();
+      querySphereLinear(center, indexResults);
+      result.sphereResultsMatch = result.sphereResultsMatch && ToSortedIndices(bvh, proxyResults) == indexResults;
+    }
+
+    const float maxDistance = extent * 4.0f;
+    std::vector<uint32_t> bvhHits(QueriesPerIteration), linearHits(QueriesPerIteration);
+    result.rayBvhMs = MeasureMilliseconds(iterations, [&](uint32_t) {
+      for (uint32_t q = 0; q < QueriesPerIteration; ++q)
+      {
+        DynamicBvh::RayHit hit;
+        bvhHits[q] = bvh.RayCast(origins[q], directions[q], maxDistance, hit) ? uint32_t(bvh.GetUserData(hit.proxy)) : UINT32_MAX;
+      }
+    }) / QueriesPerIteration;
+    result.rayLinearMs = MeasureMilliseconds(iterations, [&](uint32_t) {
+      for (uint32_t q = 0; q < QueriesPerIteration; ++q)
+      {
+        const auto& o = origins[q];
+        const auto& d = directions[q];
+        XMFLOAT3 inv{ 1.0f / d.x, 1.0f / d.y, 1.0f / d.z };
+        float closest = maxDistance;
+        uint32_t closestIndex = UINT32_MAX;
+        for (uint32_t i = 0; i < instanceCount; ++i)
+        {
+          const auto& box = boxes[i];
+          float t1 = (box.min.x - o.x) * inv.x, t2 = (box.max.x - o.x) * inv.x;
+          float tmin = (std::min)(t1, t2), tmax = (std::max)(t1, t2);
+          t1 = (box.min.y - o.y) * inv.y; t2 = (box.max.y - o.y) * inv.y;
+          tmin = (std::max)(tmin, (std::min)(t1, t2)); tmax = (std::min)(tmax, (std::max)(t1, t2));
+          t1 = (box.min.z - o.z) * inv.z; t2 = (box.max.z - o.z) * inv.z;
+          tmin = (std::max)(tmin, (std::min)(t1, t2)); tmax = (std::min)(tmax, (std::max)(t1, t2));
+          tmin = (std::max)(tmin, 0.0f);
+          if (tmin <= tmax && tmin < closest)
+          {
+            closest = tmin;
+            closestIndex = i;
+          }
+        }
+        linearHits[q] = closestIndex;
+      }
+    }) / QueriesPerIteration;
+    result.rayResultsMatch = bvhHits == linearHits;
+    return result;
+  }
+}
+
+std::vector<BvhBenchmarkResult> RunBvhBenchmark(std::span<const uint32_t> instanceCounts, uint32_t iterations)
+{
+  std::vector<BvhBenchmarkResult> results;
+  for (auto count : instanceCounts)
+  {
+    results.push_back(RunOne(count, iterations));
+  }
+  return results;
+}
@@ -0,0 +1,29 @@
+﻿#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// 動的 BVH の CPU ベンチマーク.
+// インスタンス数を変えて、構築/更新と各クエリを全件走査の場合と比較する.
+// 構築後と更新後に木の整合性を検証し、各クエリの結果が全件走査と一致するかも確認する.
+struct BvhBenchmarkResult
+{
+  uint32_t instanceCount = 0;
+  int32_t  height = 0;
+  // 時間はミリ秒. クエリは1回あたりの平均.
+  double buildMs = 0.0;
+  double updateMs = 0.0;        // 全インスタンスを少しずつ移動した場合の1フレーム分.
+  double frustumBvhMs = 0.0;
+  double frustumLinearMs = 0.0; // AabbCullingList (SIMD) による全件判定.
+  double sphereBvhMs = 0.0;
+  double sphereLinearMs = 0.0;
+  double rayBvhMs = 0.0;
+  double rayLinearMs = 0.0;
+  uint32_t reinsertCount = 0;   // 更新時に木を付け替えた数.
+  bool     valid = false;             // 構築後と更新後の Validate() の結果.
+  bool     frustumResultsMatch = false; // 視錐台の結果が全件走査と一致したか.
+  bool     sphereResultsMatch = false;  // 球の結果が全件走査と一致したか.
+  bool     rayResultsMatch = false; // レイの最近傍が全件走査と一致したか.
+};
+
+std::vector<BvhBenchmarkResult> RunBvhBenchmark(std::span<const uint32_t> instanceCounts, uint32_t iterations = 20);
@@ -0,0 +1,319 @@
+﻿#include "CullingBenchmark.h"
+#include "FrustumCulling.h"
+#include "SceneTransforms.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+  template<typename Func>
+  double MeasureMilliseconds(uint32_t iterations, Func func)
+  {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+      func(i);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+  }
+
+  // 判定が境界付近のものを除外する際の余裕.
+  constexpr float Tolerance = 1.0e-3f;
+
+  XMMATRIX RandomAffine(std::default_random_engine& rng)
+  {
+    std::uniform_real_distribution<float> angle(0.0f, XM_2PI);
+    std::uniform_real_distribution<float> scale(0.2f, 3.0f);
+    std::uniform_real_distribution<float> position(-20.0f, 20.0f);
+    auto axis = XMVector3Normalize(XMVectorSet(position(rng), position(rng), position(rng) + 0.1f, 0.0f));
+    return XMMatrixScaling(scale(rng), scale(rng), scale(rng)) * XMMatrixRotationAxis(axis, angle(rng)) *
+      XMMatrixTranslation(position(rng), position(rng), position(rng));
+  }
+
+  void RandomAabb(std::default_random_engine& rng, XMFLOAT3& aabbMin, XMFLOAT3& aabbMax)
+  {
+    std::uniform_real_distribution<float> center(-5.0f, 5.0f);
+    std::uniform_real_distribution<float> extent(0.01f, 4.0f);
+    XMFLOAT3 c{ center(rng), center(rng), center(rng) };
+    XMFLOAT3 e{ extent(rng), extent(rng), extent(rng) };
+    aabbMin = { c.x - e.x, c.y - e.y, c.z - e.z };
+    aabbMax = { c.x + e.x, c.y + e.y, c.z + e.z };
+  }
+
+  // AABB の 8 頂点を個別に変換する.
+  void TransformCorners(const XMFLOAT3& aabbMin, const XMFLOAT3& aabbMax, FXMMATRIX world, XMFLOAT3 corners[8])
+  {
+    for (int i = 0; i < 8; ++i)
+    {
+      auto p = XMVectorSet((i & 1) ? aabbMax.x : aabbMin.x, (i & 2) ? aabbMax.y : aabbMin.y, (i & 4) ? aabbMax.z : aabbMin.z, 1.0f);
+      XMStoreFloat3(&corners[i], XMVector3Transform(p, world));
+    }
+  }
+
+  float PlaneDistance(const XMFLOAT4& plane, const XMFLOAT3& p)
+  {
+    return plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w;
+  }
+
+  bool IsInsideClipSpace(const XMFLOAT3& p, FXMMATRIX mtxViewProj)
+  {
+    XMFLOAT4 clip;
+    XMStoreFloat4(&clip, XMVector4Transform(XMVectorSet(p.x, p.y, p.z, 1.0f), mtxViewProj));
+    return clip.w > 0.0f && std::abs(clip.x) <= clip.w && std::abs(clip.y) <= clip.w && clip.z >= 0.0f && clip.z <= clip.w;
+  }
+
+  // 平面に対する最小の距離の絶対値. 小さいものは境界付近として除外する.
+  float MinPlaneDistance(const Frustum& frustum, const XMFLOAT3& p)
+  {
+    float result = FLT_MAX;
+    for (const auto& plane : frustum.planes)
+    {
+      result = (std::min)(result, std::abs(PlaneDistance(plane, p)));
+    }
+    return result;
+  }
+}
+
+CullingBenchmarkResult RunCullingBenchmark(uint32_t aabbCount, uint32_t iterations)
+{
+  CullingBenchmarkResult result;
+  result.aabbCount = aabbCount;
+  result.iterations = iterations;
+  result.avx2 = transform_math::IsAvx2Supported();
+
+  // 原点から -Z を向くカメラの周囲にランダムな AABB を配置.
+  std::default_random_engine rng;
+  std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+  std::uniform_real_distribution<float> size(0.1f, 4.0f);
+  std::uniform_real_distribution<float> angle(0.0f, XM_2PI);
+  AabbCullingList list;
+  list.Reserve(aabbCount);
+  for (uint32_t i = 0; i < aabbCount; ++i)
+  {
+    XMFLOAT3 aabbMin{ -size(rng), -size(rng), -size(rng) };
+    XMFLOAT3 aabbMax{ size(rng), size(rng), size(rng) };
+    XMFLOAT4X4 world;
+    XMStoreFloat4x4(&world, XMMatrixRotationY(angle(rng)) * XMMatrixTranslation(position(rng), position(rng), position(rng)));
+    list.Add(aabbMin, aabbMax, world);
+  }
+  auto frustum = Frustum::FromViewProjection(XMMatrixPerspectiveFovRH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 200.0f));
+
+  std::vector<uint32_t> scalarVisible, simdVisible;
+  scalarVisible.reserve(aabbCount);
+  simdVisible.reserve(aabbCount);
+  result.scalarMs = MeasureMilliseconds(iterations, [&](uint32_t) {
+    scalarVisible.clear();
+    list.CullScalar(frustum, scalarVisible);
+  });
+  result.simdMs = MeasureMilliseconds(iterations, [&](uint32_t) {
+    simdVisible.clear();
+    list.Cull(frustum, simdVisible);
+  });
+  result.visibleCount = uint32_t(simdVisible.size());
+  result.resultsMatch = scalarVisible == simdVisible;
+  return result;
+}
+
+CullingSelfCheckResult RunCullingSelfCheck(uint32_t caseCount)
+{
+  CullingSelfCheckResult result;
+  result.caseCount = caseCount;
+  std::default_random_engine rng(1);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+  // TransformAabb: 変換後の全頂点を包含し、各面に頂点が接していること.
+  // AabbCullingList::Add も同じ中心と半径を登録すること.
+  AabbCullingList list;
+  for (uint32_t i = 0; i < caseCount; ++i)
+  {
+    XMFLOAT3 aabbMin, aabbMax, outMin, outMax;
+    RandomAabb(rng, aabbMin, aabbMax);
+    auto mtxWorld = RandomAffine(rng);
+    XMFLOAT4X4 world;
+    XMStoreFloat4x4(&world, mtxWorld);
+    culling_math::TransformAabb(aabbMin, aabbMax, world, outMin, outMax);
+
+    XMFLOAT3 corners[8];
+    TransformCorners(aabbMin, aabbMax, mtxWorld, corners);
+    auto cornerMin = XMLoadFloat3(&corners[0]);
+    auto cornerMax = cornerMin;
+    for (const auto& corner : corners)
+    {
+      cornerMin = XMVectorMin(cornerMin, XMLoadFloat3(&corner));
+      cornerMax = XMVectorMax(cornerMax, XMLoadFloat3(&corner));
+    }
+    auto tolerance = XMVectorReplicate(Tolerance * 10.0f);
+    if (!XMVector3NearEqual(cornerMin, XMLoadFloat3(&outMin), tolerance) ||
+      !XMVector3NearEqual(cornerMax, XMLoadFloat3(&outMax), tolerance))
+    {
+      result.aabbTransformErrors++;
+    }
+
+    auto index = list.Add(aabbMin, aabbMax, world);
+    auto listCenter = list.GetCenter(index);
+    auto listExtent = list.GetExtent(index);
+    auto center = XMLoadFloat3(&listCenter);
+    auto extent = XMLoadFloat3(&listExtent);
+    if (!XMVector3NearEqual(XMVectorSubtract(center, extent), XMLoadFloat3(&outMin), tolerance) ||
+      !XMVector3NearEqual(XMVectorAdd(center, extent), XMLoadFloat3(&outMax), tolerance))
+    {
+      result.listMismatchCount++;
+    }
+  }
+
+  // 視錐台と点/AABB/球の判定. 視錐台はランダムな位置と向きのカメラから作る.
+  constexpr uint32_t FrustumCount = 16;
+  const uint32_t casesPerFrustum = (std::max)(1u, caseCount / FrustumCount);
+  for (uint32_t f = 0; f < FrustumCount; ++f)
+  {
+    auto eye = XMVectorSet(unit(rng) * 10.0f, unit(rng) * 10.0f, unit(rng) * 10.0f, 1.0f);
+    auto dir = XMVector3Normalize(XMVectorSet(unit(rng), unit(rng), unit(rng) + 0.01f, 0.0f));
+    auto mtxView = XMMatrixLookToRH(eye, dir, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    auto mtxProj = XMMatrixPerspectiveFovRH(XM_PIDIV4 + unit(rng) * 0.3f, 16.0f / 9.0f, 0.1f, 60.0f);
+    auto mtxViewProj = XMMatrixMultiply(mtxView, mtxProj);
+    auto frustum = Frustum::FromViewProjection(mtxViewProj);
+    auto randomPoint = [&]() {
+      XMFLOAT3 p;
+      XMStoreFloat3(&p, XMVectorAdd(eye, XMVectorScale(XMVectorSet(unit(rng), unit(rng), unit(rng), 0.0f), 40.0f)));
+      return p;
+    };
+
+    // 点: 平面の内側判定とクリップ空間での判定が一致すること.
+    for (uint32_t i = 0; i < casesPerFrustum; ++i)
+    {
+      auto p = randomPoint();
+      if (MinPlaneDistance(frustum, p) < Tolerance)
+      {
+        result.skippedCount++;
+        continue;
+      }
+      bool insidePlanes = std::all_of(std::begin(frustum.planes), std::end(frustum.planes),
+        [&](const XMFLOAT4& plane) { return PlaneDistance(plane, p) >= 0.0f; });
+      result.frustumPlaneErrors += insidePlanes != IsInsideClipSpace(p, mtxViewProj) ? 1 : 0;
+    }
+
+    // AABB: いずれかの平面の外側に 8 頂点が全て出ているものだけが除外されること.
+    // 件数は 8 の倍数にせず、詰め物の除外も確認する.
+    AabbCullingList aabbs;
+    std::vector<uint8_t> expected;
+    std::vector<uint8_t> ambiguous;
+    for (uint32_t i = 0; i < casesPerFrustum + 3; ++i)
+    {
+      auto p = randomPoint();
+      std::uniform_real_distribution<float> extent(0.05f, 3.0f);
+      XMFLOAT3 e{ extent(rng), extent(rng), extent(rng) };
+      XMFLOAT3 aabbMin{ p.x - e.x, p.y - e.y, p.z - e.z }, aabbMax{ p.x + e.x, p.y + e.y, p.z + e.z };
+      XMFLOAT4X4 identity;
+      XMStoreFloat4x4(&identity, XMMatrixIdentity());
+      aabbs.Add(aabbMin, aabbMax, identity);
+
+      XMFLOAT3 corners[8];
+      TransformCorners(aabbMin, aabbMax, XMMatrixIdentity(), corners);
+      bool culled = false, nearBoundary = false;
+      for (const auto& plane : frustum.planes)
+      {
+        float maxDistance = -FLT_MAX;
+        for (const auto& corner : corners)
+        {
+          maxDistance = (std::max)(maxDistance, PlaneDistance(plane, corner));
+        }
+        culled |= maxDistance < 0.0f;
+        nearBoundary |= std::abs(maxDistance) < Tolerance;
+      }
+      expected.push_back(culled ? 0 : 1);
+      ambiguous.push_back(nearBoundary ? 1 : 0);
+    }
+    std::vector<uint32_t> visibleSimd, visibleScalar;
+    aabbs.Cull(frustum, visibleSimd);
+    aabbs.CullScalar(frustum, visibleScalar);
+    for (const auto* visibleIndices : { &visibleSimd, &visibleScalar })
+    {
+      std::vector<uint8_t> actual(expected.size(), 0);
+      for (auto index : *visibleIndices)
+      {
+        if (index >= actual.size())
+        {
+          result.cullErrors++;
+          continue;
+        }
+        actual[index] = 1;
+      }
+      for (size_t i = 0; i < expected.size(); ++i)
+      {
+        if (ambiguous[i])
+        {
+          result.skippedCount++;
+          continue;
+        }
+        result.cullErrors += actual[i] != expected[i] ? 1 : 0;
+      }
+    }
+
+    // 球: 視錐台内の点を含む球は除外されないこと.
+    for (uint32_t i = 0; i < casesPerFrustum; ++i)
+    {
+      auto center = randomPoint();
+      float radius = (unit(rng) + 1.0f) * 2.0f;
+      bool containsInside = false;
+      for (int s = 0; s < 32 && !containsInside; ++s)
+      {
+        auto offset = XMVectorScale(XMVector3Normalize(XMVectorSet(unit(rng), unit(rng), unit(rng) + 0.01f, 0.0f)), radius * (unit(rng) + 1.0f) * 0.5f);
+        XMFLOAT3 p;
+        XMStoreFloat3(&p, XMVectorAdd(XMLoadFloat3(&center), offset));
+        containsInside = MinPlaneDistance(frustum, p) >= Tolerance && IsInsideClipSpace(p, mtxViewProj);
+      }
+      result.sphereErrors += containsInside && !frustum.IntersectsSphere(center, radius) ? 1 : 0;
+    }
+  }
+
+  // モデル全体の AABB: ノード階層を持つモデルの各メッシュの AABB を、ノードのワールド行列で変換して合わせる.
+  // (SimpleModel::GetWorldAABB と同じ方法) 全メッシュの変換後の頂点を包含すること.
+  for (uint32_t i = 0; i < caseCount / 20; ++i)
+  {
+    constexpr uint32_t NodeCount = 12;
+    std::vector<XMFLOAT4X4> localMatrices(NodeCount);
+    std::vector<uint32_t> parentIndices(NodeCount);
+    for (uint32_t n = 0; n < NodeCount; ++n)
+    {
+      XMStoreFloat4x4(&localMatrices[n], RandomAffine(rng) * XMMatrixScaling(0.5f, 0.5f, 0.5f));
+      parentIndices[n] = n == 0 ? SceneTransforms::InvalidIndex : uint32_t(rng() % n);
+    }
+    SceneTransforms transforms;
+    transforms.Initialize(localMatrices, parentIndices);
+    transforms.UpdateWorld(RandomAffine(rng));
+
+    XMFLOAT3 boundsMin{ FLT_MAX, FLT_MAX, FLT_MAX }, boundsMax{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    std::vector<XMFLOAT3> meshMins(NodeCount), meshMaxs(NodeCount);
+    for (uint32_t n = 0; n < NodeCount; ++n)
+    {
+      RandomAabb(rng, meshMins[n], meshMaxs[n]);
+      culling_math::MergeTransformedAabb(meshMins[n], meshMaxs[n], transforms.GetWorldMatrix(n), boundsMin, boundsMax);
+    }
+    auto tolerance = XMVectorReplicate(Tolerance * 100.0f);
+    for (uint32_t n = 0; n < NodeCount; ++n)
+    {
+      XMFLOAT3 corners[8];
+      TransformCorners(meshMins[n], meshMaxs[n], XMLoadFloat4x4(&transforms.GetWorldMatrix(n)), corners);
+      for (const auto& corner : corners)
+      {
+        auto p = XMLoadFloat3(&corner);
+        if (!XMVector3InBounds(XMVectorSubtract(p, XMVectorScale(XMVectorAdd(XMLoadFloat3(&boundsMin), XMLoadFloat3(&boundsMax)), 0.5f)),
+          XMVectorAdd(XMVectorScale(XMVectorSubtract(XMLoadFloat3(&boundsMax), XMLoadFloat3(&boundsMin)), 0.5f), tolerance)))
+        {
+          result.modelBoundErrors++;
+        }
+      }
+    }
+  }
+
+  result.passed = result.aabbTransformErrors == 0 && result.listMismatchCount == 0 && result.frustumPlaneErrors == 0 &&
+    result.cullErrors == 0 && result.sphereErrors == 0 && result.modelBoundErrors == 0;
+  return result;
+}
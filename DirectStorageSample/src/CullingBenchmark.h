@@ -0,0 +1,36 @@
+﻿#pragma once
+#include <cstdint>
+
+// 視錐台カリングの CPU ベンチマーク.
+// スカラー版と AVX2 版の速度を比較し、判定結果が一致するかを検証する.
+struct CullingBenchmarkResult
+{
+  uint32_t aabbCount = 0;
+  uint32_t iterations = 0;
+  bool     avx2 = false;
+  // 1回あたりの平均時間 (ミリ秒).
+  double scalarMs = 0.0;
+  double simdMs = 0.0;
+  uint32_t visibleCount = 0;
+  bool     resultsMatch = false;
+};
+
+CullingBenchmarkResult RunCullingBenchmark(uint32_t aabbCount = 100000, uint32_t iterations = 100);
+
+// 視錐台/AABB の補助関数の検証.
+// ランダムな行列や視錐台に対し、8 頂点を個別に変換するなどの素朴な方法で求めた結果と比較する.
+// 境界付近で浮動小数点の誤差により判定が分かれるものは除外する.
+struct CullingSelfCheckResult
+{
+  uint32_t caseCount = 0;
+  uint32_t skippedCount = 0;         // 境界付近のため除外した数.
+  uint32_t aabbTransformErrors = 0;  // TransformAabb が変換後の頂点を包含しない/最小でない (0 であること).
+  uint32_t listMismatchCount = 0;    // AabbCullingList::Add と TransformAabb の不一致 (0 であること).
+  uint32_t frustumPlaneErrors = 0;   // 平面による点の判定がクリップ空間での判定と異なる (0 であること).
+  uint32_t cullErrors = 0;           // CullAabbs (AVX2/スカラー) が頂点による判定と異なる (0 であること).
+  uint32_t sphereErrors = 0;         // 視錐台内の点を含む球を IntersectsSphere が除外した (0 であること).
+  uint32_t modelBoundErrors = 0;     // ノード階層のメッシュの頂点が合成した AABB の外にある (0 であること).
+  bool     passed = false;
+};
+
+CullingSelfCheckResult RunCullingSelfCheck(uint32_t caseCount = 2000);
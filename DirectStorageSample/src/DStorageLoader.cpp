@@ -64,11 +64,44 @@ void DirectStorageLoader::Initialize(ID3D12Device* d3d12Device)
 
 void DirectStorageLoader::Shutdown()
 {
+  {
+    std::lock_guard lock(m_codecMutex);
+    m_codecPool.clear();
+  }
   m_dsQueueGpuMemory.Reset();
   m_dsQueueSystemMemory.Reset();
   m_dsFactory.Reset();
 }
 
+bool DirectStorageLoader::DecompressGDeflate(const void* src, size_t srcSize, void* dst, size_t dstSize)
+{
+  Microsoft::WRL::ComPtr<IDStorageCompressionCodec> codec;
+  {
+    std::lock_guard lock(m_codecMutex);
+    if (!m_codecPool.empty())
+    {
+      codec = m_codecPool.back();
+      m_codecPool.pop_back();
+    }
+  }
+  if (!codec)
+  {
+    // Ăяoɓ삷邽߁AR[fbNł̓XbhȂ.
+    constexpr uint32_t NumCodecThread = 1;
+    auto hr = DStorageCreateCompressionCodec(DSTORAGE_COMPRESSION_FORMAT_GDEFLATE, NumCodecThread, IID_PPV_ARGS(&codec));
+    if (FAILED(hr))
+    {
+      return false;
+    }
+  }
+  size_t decompressedSize = 0;
+  auto hr = codec->DecompressBuffer(src, srcSize, dst, dstSize, &decompressedSize);
+
+  std::lock_guard lock(m_codecMutex);
+  m_codecPool.push_back(codec);
+  return SUCCEEDED(hr) && decompressedSize == dstSize;
+}
+
 std::unique_ptr<DirectStorageHandle> DirectStorageLoader::CreateHandle(std::filesystem::path filePath, uint32_t statusCount)
 {
   auto handle = std::make_unique<DirectStorageHandle>();
@@ -3,6 +3,8 @@
 #include <dstorage.h>
 #include <wrl/client.h>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include <filesystem>
 
 class DirectStorageHandle;
@@ -21,11 +23,17 @@ public:
   Microsoft::WRL::ComPtr<IDStorageQueue1> GetQueueSystemMemory() { return m_dsQueueSystemMemory; }
   Microsoft::WRL::ComPtr<IDStorageQueue1> GetQueueGpuMemory() { return m_dsQueueGpuMemory; }
 
+  // GDeflate f[^ CPU œWJ. R[fbN̓v[ăXbhԂŎg.
+  bool DecompressGDeflate(const void* src, size_t srcSize, void* dst, size_t dstSize);
+
 private:
   Microsoft::WRL::ComPtr<IDStorageFactory> m_dsFactory;
   Microsoft::WRL::ComPtr<IDStorageQueue1> m_dsQueueSystemMemory;
   Microsoft::WRL::ComPtr<IDStorageQueue1> m_dsQueueGpuMemory;
 
+  std::mutex m_codecMutex;
+  std::vector<Microsoft::WRL::ComPtr<IDStorageCompressionCodec>> m_codecPool;
+
 };
 
 class DirectStorageHandle
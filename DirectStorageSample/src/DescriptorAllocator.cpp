@@ -0,0 +1,207 @@
+﻿#include "DescriptorAllocator.h"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+void DescriptorAllocator::Reset(uint32_t capacity)
+{
+  std::lock_guard lock(m_mutex);
+  m_capacity = capacity;
+  std::fill(std::begin(m_freeHeads), std::end(m_freeHeads), NullIndex);
+  m_nonEmptyOrders = 0;
+  m_next.assign(capacity, NullIndex);
+  m_prev.assign(capacity, NullIndex);
+  m_freeOrder.assign(capacity, 0);
+  m_pendingFrees.clear();
+  m_stats = Stats{};
+  m_stats.capacity = capacity;
+  FreeRange(0, capacity);
+}
+
+uint32_t DescriptorAllocator::Allocate(uint32_t count)
+{
+  std::lock_guard lock(m_mutex);
+  if (count == 0 || count > m_capacity)
+  {
+    m_stats.failedCount++;
+    return InvalidOffset;
+  }
+  // 要求数を収められる最小のブロックを探す.
+  uint32_t order = std::bit_width(count - 1);
+  uint32_t candidates = order < MaxOrder ? m_nonEmptyOrders & ~((1u << order) - 1) : 0;
+  if (candidates == 0)
+  {
+    m_stats.failedCount++;
+    return InvalidOffset;
+  }
+  uint32_t blockOrder = std::countr_zero(candidates);
+  uint32_t offset = m_freeHeads[blockOrder];
+  RemoveFree(offset, blockOrder);
+
+  // 余りを空きへ戻す. 余りのバディはブロック内の使用中の領域となるため結合は起こらない.
+  uint32_t blockSize = 1u << blockOrder;
+  if (blockSize > count)
+  {
+    FreeRange(offset + count, blockSize - count);
+  }
+  m_stats.liveCount += count;
+  m_stats.peakCount = (std::max)(m_stats.peakCount, m_stats.liveCount);
+  return offset;
+}
+
+void DescriptorAllocator::Free(uint32_t offset, uint32_t count)
+{
+  std::lock_guard lock(m_mutex);
+  assert(offset + count <= m_capacity);
+  FreeRange(offset, count);
+  m_stats.liveCount -= count;
+}
+
+void DescriptorAllocator::FreeDeferred(uint32_t offset, uint32_t count, uint64_t fenceValue)
+{
+  std::lock_guard lock(m_mutex);
+  m_pendingFrees.push_back(PendingFree{ fenceValue, offset, count });
+  m_stats.pendingFreeCount += count;
+}
+
+void DescriptorAllocator::ReleaseCompleted(uint64_t completedFenceValue)
+{
+  std::lock_guard lock(m_mutex);
+  // フェンス値は登録順に増加するとは限らないため全体を確認する.
+  auto itr = std::remove_if(m_pendingFrees.begin(), m_pendingFrees.end(), [&](const PendingFree& pending) {
+    if (pending.fenceValue > completedFenceValue)
+    {
+      return false;
+    }
+    FreeRange(pending.offset, pending.count);
+    m_stats.liveCount -= pending.count;
+    m_stats.pendingFreeCount -= pending.count;
+    return true;
+  });
+  m_pendingFrees.erase(itr, m_pendingFrees.end());
+}
+
+DescriptorAllocator::Stats DescriptorAllocator::GetStats() const
+{
+  std::lock_guard lock(m_mutex);
+  auto stats = m_stats;
+  stats.largestFreeBlock = m_nonEmptyOrders ? 1u << (std::bit_width(m_nonEmptyOrders) - 1) : 0;
+  return stats;
+}
+
+bool DescriptorAllocator::Validate() const
+{
+  std::lock_guard lock(m_mutex);
+  std::vector<uint8_t> used(m_capacity);
+  uint32_t freeCount = 0, freeBlockCount = 0;
+  for (uint32_t order = 0; order < MaxOrder; ++order)
+  {
+    bool hasBlock = m_freeHeads[order] != NullIndex;
+    if (hasBlock != ((m_nonEmptyOrders >> order) & 1))
+    {
+      return false;
+    }
+    uint32_t prev = NullIndex;
+    for (auto offset = m_freeHeads[order]; offset != NullIndex; offset = m_next[offset])
+    {
+      uint32_t size = 1u << order;
+      // 先頭はサイズの倍数にそろっており、重複しないこと.
+      if (offset % size != 0 || offset + size > m_capacity || m_freeOrder[offset] != order + 1 || m_prev[offset] != prev)
+      {
+        return false;
+      }
+      for (uint32_t i = offset; i < offset + size; ++i)
+      {
+        if (used[i]++)
+        {
+          return false;
+        }
+      }
+      // 結合可能なバディが残っていないこと.
+      uint32_t buddy = offset ^ size;
+      if (order + 1 < MaxOrder && buddy + size <= m_capacity && m_freeOrder[buddy] == order + 1)
+      {
+        return false;
+      }
+      freeCount += size;
+      freeBlockCount++;
+      prev = offset;
+    }
+  }
+  return freeCount == m_stats.freeCount && freeBlockCount == m_stats.freeBlockCount &&
+    freeCount + m_stats.liveCount == m_capacity;
+}
+
+void DescriptorAllocator::FreeRange(uint32_t offset, uint32_t count)
+{
+  // 先頭の位置とサイズにそろった 2 のべき乗のブロックに分けて解放.
+  while (count > 0)
+  {
+    uint32_t order = std::bit_width(count) - 1;
+    if (offset != 0)
+    {
+      order = (std::min)(order, uint32_t(std::countr_zero(offset)));
+    }
+    FreeBlock(offset, order);
+    offset += 1u << order;
+    count -= 1u << order;
+  }
+}
+
+void DescriptorAllocator::FreeBlock(uint32_t offset, uint32_t order)
+{
+  while (order + 1 < MaxOrder)
+  {
+    uint32_t size = 1u << order;
+    uint32_t buddy = offset ^ size;
+    if (buddy + size > m_capacity || m_freeOrder[buddy] != order + 1)
+    {
+      break;
+    }
+    RemoveFree(buddy, order);
+    offset = (std::min)(offset, buddy);
+    order++;
+  }
+  PushFree(offset, order);
+}
+
+void DescriptorAllocator::PushFree(uint32_t offset, uint32_t order)
+{
+  auto head = m_freeHeads[order];
+  m_next[offset] = head;
+  m_prev[offset] = NullIndex;
+  if (head != NullIndex)
+  {
+    m_prev[head] = offset;
+  }
+  m_freeHeads[order] = offset;
+  m_freeOrder[offset] = uint8_t(order + 1);
+  m_nonEmptyOrders |= 1u << order;
+  m_stats.freeCount += 1u << order;
+  m_stats.freeBlockCount++;
+}
+
+void DescriptorAllocator::RemoveFree(uint32_t offset, uint32_t order)
+{
+  auto next = m_next[offset];
+  auto prev = m_prev[offset];
+  if (prev != NullIndex)
+  {
+    m_next[prev] = next;
+  }
+  else
+  {
+    m_freeHeads[order] = next;
+  }
+  if (next != NullIndex)
+  {
+    m_prev[next] = prev;
+  }
+  if (m_freeHeads[order] == NullIndex)
+  {
+    m_nonEmptyOrders &= ~(1u << order);
+  }
+  m_freeOrder[offset] = 0;
+  m_stats.freeCount -= 1u << order;
+  m_stats.freeBlockCount--;
+}
@@ -0,0 +1,70 @@
+﻿#pragma once
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// ディスクリプタヒープ内の位置(インデックス)の割り当て管理.
+// 2 のべき乗サイズのブロック毎に空きリストを持ち、解放時は隣接するバディと結合する.
+// 割り当ては要求数ちょうどとし、ブロックの余りは小さいブロックとして空きリストへ戻す.
+// GPU が参照中の可能性があるものは FreeDeferred でフェンス値の完了まで解放を遅らせる.
+// 全ての操作はスレッドセーフ. インデックスの管理のみを行うため GPU 無しで動作確認できる.
+class DescriptorAllocator
+{
+public:
+  static constexpr uint32_t InvalidOffset = UINT32_MAX;
+
+  struct Stats
+  {
+    uint32_t capacity = 0;
+    uint32_t liveCount = 0;         // 割り当て中の個数.
+    uint32_t peakCount = 0;
+    uint32_t freeCount = 0;
+    uint32_t freeBlockCount = 0;
+    uint32_t largestFreeBlock = 0;  // 一度に割り当て可能な最大の個数 (2 のべき乗).
+    uint32_t pendingFreeCount = 0;  // フェンス待ちの個数.
+    uint64_t failedCount = 0;
+    // 空き領域の断片化率. 0 で全ての空きが 1 ブロックにまとまっている.
+    float GetFragmentation() const { return freeCount ? 1.0f - float(largestFreeBlock) / float(freeCount) : 0.0f; }
+  };
+
+  void Reset(uint32_t capacity);
+
+  // count 個連続した領域を割り当て. 不足している場合は InvalidOffset を返す.
+  uint32_t Allocate(uint32_t count);
+  // 直ちに解放.
+  void Free(uint32_t offset, uint32_t count);
+  // fenceValue の完了後に解放されるよう登録.
+  void FreeDeferred(uint32_t offset, uint32_t count, uint64_t fenceValue);
+  // completedFenceValue までに完了した解放待ちを処理.
+  void ReleaseCompleted(uint64_t completedFenceValue);
+
+  Stats GetStats() const;
+  // 空きリストの整合性を検証 (デバッグ用).
+  bool Validate() const;
+
+private:
+  static constexpr uint32_t MaxOrder = 32;
+  static constexpr uint32_t NullIndex = UINT32_MAX;
+
+  void FreeRange(uint32_t offset, uint32_t count);
+  void FreeBlock(uint32_t offset, uint32_t order);
+  void PushFree(uint32_t offset, uint32_t order);
+  void RemoveFree(uint32_t offset, uint32_t order);
+
+  struct PendingFree
+  {
+    uint64_t fenceValue;
+    uint32_t offset;
+    uint32_t count;
+  };
+
+  mutable std::mutex m_mutex;
+  uint32_t m_capacity = 0;
+  uint32_t m_freeHeads[MaxOrder];
+  uint32_t m_nonEmptyOrders = 0;       // 空きブロックが存在するサイズのビット.
+  std::vector<uint32_t> m_next, m_prev; // 空きリスト (ブロック先頭のインデックスで連結).
+  std::vector<uint8_t>  m_freeOrder;    // 空きブロック先頭であれば order + 1. それ以外は 0.
+  std::deque<PendingFree> m_pendingFrees;
+  Stats m_stats;
+};
@@ -0,0 +1,167 @@
+﻿#include "DescriptorAllocatorStress.h"
+#include "DescriptorAllocator.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  constexpr uint32_t Capacity = 65536;
+
+  struct Allocation
+  {
+    uint32_t offset;
+    uint32_t count;
+  };
+
+  // 各インデックスの所有スレッドを記録し、重複した割り当てを検出する.
+  class OwnershipTracker
+  {
+  public:
+    OwnershipTracker() : m_owners(std::make_unique<std::atomic<uint32_t>[]>(Capacity)) {}
+    uint64_t Acquire(const Allocation& allocation, uint32_t owner)
+    {
+      uint64_t overlaps = 0;
+      for (uint32_t i = allocation.offset; i < allocation.offset + allocation.count; ++i)
+      {
+        uint32_t expected = 0;
+        overlaps += m_owners[i].compare_exchange_strong(expected, owner) ? 0 : 1;
+      }
+      return overlaps;
+    }
+    void Release(const Allocation& allocation)
+    {
+      for (uint32_t i = allocation.offset; i < allocation.offset + allocation.count; ++i)
+      {
+        m_owners[i].store(0);
+      }
+    }
+  private:
+    std::unique_ptr<std::atomic<uint32_t>[]> m_owners;
+  };
+
+  // ディスクリプタテーブルを模して 1 個の確保を中心に、まれに大きなものを混ぜる.
+  uint32_t RandomCount(std::default_random_engine& rng)
+  {
+    auto r = rng() % 100;
+    if (r < 70) return 1;
+    if (r < 90) return 4;
+    if (r < 98) return 1 + rng() % 16;
+    return 32 + rng() % 96;
+  }
+}
+
+DescriptorAllocatorStressResult RunDescriptorAllocatorStress(uint32_t threadCount, uint32_t operationsPerThread)
+{
+  DescriptorAllocatorStressResult result;
+  result.threadCount = threadCount;
+
+  DescriptorAllocator allocator;
+  allocator.Reset(Capacity);
+  OwnershipTracker tracker;
+  std::atomic<uint64_t> overlapCount = 0;
+  std::atomic<uint64_t> operationCount = 0;
+
+  // 複数スレッドでの確保/解放.
+  auto start = std::chrono::high_resolution_clock::now();
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < threadCount; ++t)
+  {
+    threads.emplace_back([&, t]() {
+      std::default_random_engine rng(t + 1);
+      std::vector<Allocation> live;
+      uint64_t overlaps = 0;
+      for (uint32_t i = 0; i < operationsPerThread; ++i)
+      {
+        // 保持数が増えるほど解放を選びやすくする.
+        bool doFree = !live.empty() && (rng() % 1024) < live.size() * 2;
+        if (doFree)
+        {
+          auto index = rng() % live.size();
+          tracker.Release(live[index]);
+          allocator.Free(live[index].offset, live[index].count);
+          live[index] = live.back();
+          live.pop_back();
+        }
+        else
+        {
+          Allocation allocation{ 0, RandomCount(rng) };
+          allocation.offset = allocator.Allocate(allocation.count);
+          if (allocation.offset != DescriptorAllocator::InvalidOffset)
+          {
+            overlaps += tracker.Acquire(allocation, t + 1);
+            live.push_back(allocation);
+          }
+        }
+      }
+      for (const auto& allocation : live)
+      {
+        tracker.Release(allocation);
+        allocator.Free(allocation.offset, allocation.count);
+      }
+      overlapCount += overlaps;
+      operationCount += operationsPerThread + live.size();
+    });
+  }
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  result.elapsedMs = std::chrono::duration<double, std::milli>(end - start).count();
+  result.operationCount = operationCount;
+  result.overlapCount = overlapCount;
+  result.peakCount = allocator.GetStats().peakCount;
+
+  // 断片化した状態を作り、断片化率を計測.
+  {
+    std::default_random_engine rng;
+    std::vector<Allocation> live;
+    for (uint32_t i = 0; i < Capacity / 8; ++i)
+    {
+      Allocation allocation{ 0, RandomCount(rng) };
+      allocation.offset = allocator.Allocate(allocation.count);
+      if (allocation.offset != DescriptorAllocator::InvalidOffset)
+      {
+        live.push_back(allocation);
+      }
+    }
+    for (size_t i = 0; i < live.size(); i += 2)
+    {
+      allocator.Free(live[i].offset, live[i].count);
+    }
+    result.fragmentation = allocator.GetStats().GetFragmentation();
+    for (size_t i = 1; i < live.size(); i += 2)
+    {
+      allocator.Free(live[i].offset, live[i].count);
+    }
+  }
+
+  // 遅延解放. 全て確保した状態で解放を予約し、フェンス値の完了までは確保できないこと.
+  {
+    std::vector<uint32_t> offsets;
+    for (uint32_t offset; (offset = allocator.Allocate(64)) != DescriptorAllocator::InvalidOffset;)
+    {
+      offsets.push_back(offset);
+    }
+    uint64_t fenceValue = 1;
+    for (auto offset : offsets)
+    {
+      allocator.FreeDeferred(offset, 64, fenceValue++);
+    }
+    bool respected = allocator.Allocate(1) == DescriptorAllocator::InvalidOffset;
+    allocator.ReleaseCompleted(fenceValue / 2);
+    respected &= allocator.GetStats().pendingFreeCount == (offsets.size() - (fenceValue / 2)) * 64;
+    allocator.ReleaseCompleted(fenceValue);
+    respected &= allocator.GetStats().pendingFreeCount == 0;
+    result.deferredFreeRespected = respected && !offsets.empty();
+  }
+
+  auto stats = allocator.GetStats();
+  result.fullyCoalesced = stats.liveCount == 0 && stats.freeBlockCount == 1 && stats.largestFreeBlock == Capacity;
+  result.valid = allocator.Validate();
+  return result;
+}
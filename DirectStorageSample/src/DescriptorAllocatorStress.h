@@ -0,0 +1,20 @@
+﻿#pragma once
+#include <cstdint>
+
+// DescriptorAllocator の負荷試験.
+// 複数スレッドから確保/解放を繰り返して重複した割り当てが無いことを検証し、
+// 遅延解放がフェンス値の完了まで再利用されないこと、全解放後に空きが 1 つに結合されることを確認する.
+struct DescriptorAllocatorStressResult
+{
+  uint32_t threadCount = 0;
+  uint64_t operationCount = 0;
+  double   elapsedMs = 0.0;
+  uint32_t peakCount = 0;
+  float    fragmentation = 0.0f;   // 負荷中の最後の時点での断片化率.
+  uint64_t overlapCount = 0;       // 他の割り当てと重なっていた回数 (0 であること).
+  bool     deferredFreeRespected = false;
+  bool     fullyCoalesced = false;
+  bool     valid = false;          // 空きリストの整合性.
+};
+
+DescriptorAllocatorStressResult RunDescriptorAllocatorStress(uint32_t threadCount = 8, uint32_t operationsPerThread = 200000);
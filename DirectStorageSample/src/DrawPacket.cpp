@@ -0,0 +1,185 @@
+﻿#include "DrawPacket.h"
+#include <bit>
+#include <cstring>
+
+namespace
+{
+  constexpr uint32_t DepthBits = 30;
+  constexpr uint64_t DepthMask = (1ull << DepthBits) - 1;
+  constexpr uint64_t IdMask = 0xFFFF;
+
+  // 正の浮動小数点数はビット列の大小関係が値の大小と一致する.
+  // 符号ビットを除いた 31bit から下位 1bit を落として 30bit に量子化.
+  uint64_t QuantizeDepth(float viewDepth)
+  {
+    if (!(viewDepth > 0.0f))
+    {
+      return 0;
+    }
+    return (uint64_t(std::bit_cast<uint32_t>(viewDepth)) >> 1) & DepthMask;
+  }
+}
+
+uint64_t draw_key::MakeFrontToBack(uint32_t pipeline, uint32_t materialId, uint32_t geometryId, float viewDepth)
+{
+  return (uint64_t(pipeline & 0x3) << 62) |
+    ((materialId & IdMask) << 46) |
+    ((geometryId & IdMask) << 30) |
+    QuantizeDepth(viewDepth);
+}
+
+uint64_t draw_key::MakeBackToFront(uint32_t pipeline, uint32_t materialId, uint32_t geometryId, float viewDepth)
+{
+  return (uint64_t(pipeline & 0x3) << 62) |
+    ((DepthMask - QuantizeDepth(viewDepth)) << 32) |
+    ((materialId & IdMask) << 16) |
+    (geometryId & IdMask);
+}
+
+void DrawPacketList::Clear()
+{
+  m_packets.clear();
+  m_items.clear();
+  m_materialIds.clear();
+  m_geometryIds.clear();
+}
+
+void DrawPacketList::Reserve(size_t count)
+{
+  m_packets.reserve(count);
+  m_items.reserve(count);
+}
+
+void DrawPacketList::Add(const DrawPacket& packet, float viewDepth, bool backToFront)
+{
+  auto materialId = GetMaterialId(packet.materialConstants);
+  auto geometryId = GetGeometryId(packet.vertexBufferAddress);
+  auto key = backToFront ?
+    draw_key::MakeBackToFront(packet.pipeline, materialId, geometryId, viewDepth) :
+    draw_key::MakeFrontToBack(packet.pipeline, materialId, geometryId, viewDepth);
+  m_items.emplace_back(SortItem{ key, uint32_t(m_packets.size()) });
+  m_packets.push_back(packet);
+}
+
+void DrawPacketList::Sort()
+{
+  RadixSort(m_items, m_scratch);
+}
+
+void DrawPacketList::RadixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch)
+{
+  const size_t count = items.size();
+  if (count < 2)
+  {
+    return;
+  }
+  scratch.resize(count);
+
+  // 全桁のヒストグラムを1回の走査で作成.
+  uint32_t histograms[8][256];
+  std::memset(histograms, 0, sizeof(histograms));
+  for (const auto& item : items)
+  {
+    for (int pass = 0; pass < 8; ++pass)
+    {
+      histograms[pass][(item.key >> (pass * 8)) & 0xFF]++;
+    }
+  }
+
+  SortItem* src = items.data();
+  SortItem* dst = scratch.data();
+  for (int pass = 0; pass < 8; ++pass)
+  {
+    auto& histogram = histograms[pass];
+    const uint32_t shift = pass * 8;
+    // 全要素が同じ値の桁は並びが変わらないため省略.
+    if (histogram[(src[0].key >> shift) & 0xFF] == count)
+    {
+      continue;
+    }
+    uint32_t offsets[256];
+    uint32_t sum = 0;
+    for (int i = 0; i < 256; ++i)
+    {
+      offsets[i] = sum;
+      sum += histogram[i];
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+      dst[offsets[(src[i].key >> shift) & 0xFF]++] = src[i];
+    }
+    std::swap(src, dst);
+  }
+  if (src != items.data())
+  {
+    items.swap(scratch);
+  }
+}
+
+uint32_t DrawPacketList::GetMaterialId(uint64_t materialConstants)
+{
+  auto [itr, inserted] = m_materialIds.try_emplace(materialConstants, uint32_t(m_materialIds.size()));
+  return itr->second;
+}
+
+uint32_t DrawPacketList::GetGeometryId(uint64_t vertexBufferAddress)
+{
+  auto [itr, inserted] = m_geometryIds.try_emplace(vertexBufferAddress, uint32_t(m_geometryIds.size()));
+  return itr->second;
+}
+
+void DrawStateFilter::Reset()
+{
+  m_current = DrawPacket{};
+  m_valid = false;
+  m_stateChangeCount = 0;
+  m_skippedCount = 0;
+}
+
+uint32_t DrawStateFilter::Apply(const DrawPacket& packet)
+{
+  uint32_t changes = 0;
+  if (!m_valid)
+  {
+    changes = (1u << ChangeCount) - 1;
+    m_valid = true;
+  }
+  else
+  {
+    if (packet.pipeline != m_current.pipeline)
+    {
+      changes |= ChangePipeline;
+    }
+    if (packet.indexBufferAddress != m_current.indexBufferAddress || packet.indexBufferSize != m_current.indexBufferSize)
+    {
+      changes |= ChangeIndexBuffer;
+    }
+    if (packet.vertexBufferAddress != m_current.vertexBufferAddress || packet.vertexBufferSize != m_current.vertexBufferSize ||
+      packet.vertexStride != m_current.vertexStride)
+    {
+      changes |= ChangeVertexBuffer;
+    }
+    if (packet.meshConstants != m_current.meshConstants)
+    {
+      changes |= ChangeMeshConstants;
+    }
+    if (packet.materialConstants != m_current.materialConstants)
+    {
+      changes |= ChangeMaterialConstants;
+    }
+    if (packet.textureTable != m_current.textureTable)
+    {
+      changes |= ChangeTextureTable;
+    }
+    if (packet.samplerTable != m_current.samplerTable)
+    {
+      changes |= ChangeSamplerTable;
+    }
+  }
+  m_current = packet;
+
+  auto changeCount = std::popcount(changes);
+  m_stateChangeCount += changeCount;
+  m_skippedCount += ChangeCount - changeCount;
+  return changes;
+}
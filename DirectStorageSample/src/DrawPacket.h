@@ -0,0 +1,96 @@
+﻿#pragma once
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// 1メッシュの描画に必要な状態をまとめたもの.
+// GPU アドレスやディスクリプタは数値として保持し、D3D12 には依存しない.
+struct DrawPacket
+{
+  uint64_t indexBufferAddress = 0;
+  uint64_t vertexBufferAddress = 0;
+  uint64_t meshConstants = 0;      // インスタンスデータ (StructuredBuffer) の先頭.
+  uint64_t materialConstants = 0;
+  uint64_t textureTable = 0;
+  uint64_t samplerTable = 0;
+  uint32_t indexBufferSize = 0;
+  uint32_t vertexBufferSize = 0;
+  uint32_t vertexStride = 0;
+  uint32_t indexCount = 0;
+  uint32_t instanceCount = 1;
+  uint32_t pipeline = 0;   // 0～3. 小さいものから先に描画される.
+};
+
+// 64bit のソートキー.
+//   不透明: [pipeline:2][material:16][geometry:16][depth:30] (手前から奥へ)
+//   半透明: [pipeline:2][depth:30][material:16][geometry:16] (奥から手前へ)
+namespace draw_key
+{
+  uint64_t MakeFrontToBack(uint32_t pipeline, uint32_t materialId, uint32_t geometryId, float viewDepth);
+  uint64_t MakeBackToFront(uint32_t pipeline, uint32_t materialId, uint32_t geometryId, float viewDepth);
+}
+
+// 描画パケットを収集してソートする.
+// CPU のみで完結するため GPU 無しでも計測可能.
+class DrawPacketList
+{
+public:
+  struct SortItem
+  {
+    uint64_t key;
+    uint32_t index;
+  };
+
+  void Clear();
+  void Reserve(size_t count);
+  // viewDepth はビュー空間でのカメラからの距離. backToFront は半透明描画で指定する.
+  void Add(const DrawPacket& packet, float viewDepth, bool backToFront);
+  // キーの昇順に並べ替え (基数ソート).
+  void Sort();
+
+  size_t GetCount() const { return m_packets.size(); }
+  const DrawPacket& GetPacket(const SortItem& item) const { return m_packets[item.index]; }
+  std::span<const SortItem> GetSortedItems() const { return m_items; }
+
+  // キーの下位から 8bit ずつの基数ソート (LSD). 全要素で同じ桁は処理を省略する.
+  static void RadixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch);
+private:
+  uint32_t GetMaterialId(uint64_t materialConstants);
+  uint32_t GetGeometryId(uint64_t vertexBufferAddress);
+
+  std::vector<DrawPacket> m_packets;
+  std::vector<SortItem> m_items;
+  std::vector<SortItem> m_scratch;
+  std::unordered_map<uint64_t, uint32_t> m_materialIds;
+  std::unordered_map<uint64_t, uint32_t> m_geometryIds;
+};
+
+// 直前に設定した状態を保持し、変化した項目のみを返す.
+// 同じ状態の再設定を省くために使用する.
+class DrawStateFilter
+{
+public:
+  enum ChangeFlags : uint32_t
+  {
+    ChangePipeline          = 1 << 0,
+    ChangeIndexBuffer       = 1 << 1,
+    ChangeVertexBuffer      = 1 << 2,
+    ChangeMeshConstants     = 1 << 3,
+    ChangeMaterialConstants = 1 << 4,
+    ChangeTextureTable      = 1 << 5,
+    ChangeSamplerTable      = 1 << 6,
+    ChangeCount = 7,
+  };
+  void Reset();
+  // packet を描画するために設定が必要な項目を返し、状態を更新する.
+  uint32_t Apply(const DrawPacket& packet);
+
+  uint64_t GetStateChangeCount() const { return m_stateChangeCount; }
+  uint64_t GetSkippedCount() const { return m_skippedCount; }
+private:
+  DrawPacket m_current;
+  bool m_valid = false;
+  uint64_t m_stateChangeCount = 0;
+  uint64_t m_skippedCount = 0;
+};
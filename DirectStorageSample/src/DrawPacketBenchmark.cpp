@@ -0,0 +1,160 @@
+﻿#include "DrawPacketBenchmark.h"
+#include "DrawPacket.h"
+#include "InstanceBatcher.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace
+{
+  struct SourceDraw
+  {
+    DrawPacket packet;
+    float viewDepth;
+    bool backToFront;
+  };
+
+  // モデル/メッシュ/マテリアルの組み合わせを模した描画を生成.
+  std::vector<SourceDraw> MakeRandomDraws(uint32_t packetCount)
+  {
+    std::default_random_engine rng;
+    std::uniform_real_distribution<float> depth(0.1f, 200.0f);
+    constexpr uint32_t MeshesPerModel = 64;
+    constexpr uint32_t MaterialsPerModel = 16;
+    std::vector<SourceDraw> draws(packetCount);
+    for (uint32_t i = 0; i < packetCount; ++i)
+    {
+      auto modelIndex = i / MeshesPerModel;
+      auto materialIndex = rng() % MaterialsPerModel;
+      auto& draw = draws[i];
+      draw.packet.pipeline = uint32_t(rng() % 8 == 0 ? 2 : rng() % 2);
+      draw.packet.vertexBufferAddress = (uint64_t(modelIndex) << 32) | ((i % MeshesPerModel) << 16);
+      draw.packet.indexBufferAddress = draw.packet.vertexBufferAddress + 0x8000;
+      draw.packet.vertexBufferSize = 0x8000;
+      draw.packet.indexBufferSize = 0x4000;
+      draw.packet.vertexStride = 32;
+      draw.packet.meshConstants = (uint64_t(modelIndex) << 32) | ((i % MeshesPerModel) * 256);
+      draw.packet.materialConstants = (uint64_t(modelIndex % 4) << 32) | (materialIndex * 256);
+      draw.packet.textureTable = draw.packet.materialConstants;
+      draw.packet.samplerTable = 1;
+      draw.packet.indexCount = 3000;
+      draw.viewDepth = depth(rng);
+      draw.backToFront = draw.packet.pipeline == 2;
+    }
+    return draws;
+  }
+
+  // 4 種類のアセットを共有するモデルを並べたグリッド.
+  // 不透明のメッシュのみとし、行列の位置はモデル毎に GridMeshesPerModel 個ずつ連続して割り当てたものとする.
+  constexpr uint32_t GridAssetCount = 4;
+  constexpr uint32_t GridMeshesPerModel = 64;
+  void AddGridInstances(InstanceBatcher& batcher, uint32_t modelCount)
+  {
+    for (uint32_t model = 0; model < modelCount; ++model)
+    {
+      auto asset = model % GridAssetCount;
+      for (uint32_t mesh = 0; mesh < GridMeshesPerModel; ++mesh)
+      {
+        DrawPacket packet;
+        packet.vertexBufferAddress = (uint64_t(asset) << 32) | (mesh << 16);
+        packet.indexBufferAddress = packet.vertexBufferAddress + 0x8000;
+        packet.indexCount = 3000;
+        batcher.Add(asset * GridMeshesPerModel + mesh, packet, model * GridMeshesPerModel + mesh, float(model), false);
+      }
+    }
+  }
+
+  template<typename Func>
+  double MeasureMilliseconds(uint32_t iterations, Func func)
+  {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+      func(i);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+  }
+}
+
+DrawPacketBenchmarkResult RunDrawPacketBenchmark(uint32_t packetCount, uint32_t iterations)
+{
+  DrawPacketBenchmarkResult result;
+  result.packetCount = packetCount;
+  result.iterations = iterations;
+
+  auto draws = MakeRandomDraws(packetCount);
+  DrawPacketList list;
+  list.Reserve(packetCount);
+  auto build = [&]() {
+    list.Clear();
+    for (const auto& draw : draws)
+    {
+      list.Add(draw.packet, draw.viewDepth, draw.backToFront);
+    }
+  };
+  result.buildMs = MeasureMilliseconds(iterations, [&](uint32_t) { build(); });
+
+  // ソート前の順序での状態設定数.
+  DrawStateFilter filter;
+  filter.Reset();
+  for (const auto& item : list.GetSortedItems())
+  {
+    filter.Apply(list.GetPacket(item));
+  }
+  result.stateChangesUnsorted = filter.GetStateChangeCount();
+
+  auto original = std::vector<DrawPacketList::SortItem>(list.GetSortedItems().begin(), list.GetSortedItems().end());
+  std::vector<DrawPacketList::SortItem> items, scratch;
+  result.stdSortMs = MeasureMilliseconds(iterations, [&](uint32_t) {
+    items = original;
+    std::sort(items.begin(), items.end(), [](const auto& a, const auto& b) { return a.key < b.key; });
+  });
+  result.radixSortMs = MeasureMilliseconds(iterations, [&](uint32_t) {
+    items = original;
+    DrawPacketList::RadixSort(items, scratch);
+  });
+
+  list.Sort();
+  filter.Reset();
+  for (const auto& item : list.GetSortedItems())
+  {
+    filter.Apply(list.GetPacket(item));
+  }
+  result.stateChangesSorted = filter.GetStateChangeCount();
+
+  // インスタンス描画へのまとめ.
+  auto modelCount = (std::max)(packetCount / GridMeshesPerModel, 1u);
+  InstanceBatcher batcher;
+  std::vector<InstanceBatcher::InstanceData> instanceData(modelCount * GridMeshesPerModel);
+  result.instanceBatchMs = MeasureMilliseconds(iterations, [&](uint32_t) {
+    batcher.Clear();
+    AddGridInstances(batcher, modelCount);
+    batcher.Build();
+    batcher.WriteInstanceData(instanceData.data());
+  });
+  result.gridDrawCount = modelCount * GridMeshesPerModel;
+  result.instancedDrawCount = uint32_t(batcher.GetBatches().size());
+
+  // 各描画単位の範囲に、同じメッシュの全モデル分の行列の位置が書き込まれているかを確認.
+  std::vector<uint8_t> written(instanceData.size());
+  result.instanceDataValid = batcher.GetInstanceCount() == instanceData.size();
+  for (const auto& batch : batcher.GetBatches())
+  {
+    auto mesh = uint32_t((batch.packet.vertexBufferAddress >> 16) & 0xFFFF);
+    for (uint32_t i = 0; i < batch.instanceCount; ++i)
+    {
+      auto index = instanceData[batch.firstInstance + i];
+      auto model = index / GridMeshesPerModel;
+      bool valid = index % GridMeshesPerModel == mesh && model % GridAssetCount == (batch.packet.vertexBufferAddress >> 32) &&
+        index < written.size() && !written[index];
+      result.instanceDataValid &= valid;
+      if (index < written.size())
+      {
+        written[index] = 1;
+      }
+    }
+  }
+  return result;
+}
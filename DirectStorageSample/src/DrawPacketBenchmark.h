@@ -0,0 +1,25 @@
+﻿#pragma once
+#include <cstdint>
+
+// 描画パケットの構築とソートの CPU ベンチマーク.
+// 標準のソートとの比較、およびソート前後での状態設定回数を計測する.
+// また、アセットを共有するモデルのグリッドでインスタンス描画にまとめた場合の描画数を計測する.
+struct DrawPacketBenchmarkResult
+{
+  uint32_t packetCount = 0;
+  uint32_t iterations = 0;
+  // 1回あたりの平均時間 (ミリ秒).
+  double buildMs = 0.0;
+  double stdSortMs = 0.0;
+  double radixSortMs = 0.0;
+  // 1回の描画あたりの状態設定数.
+  uint64_t stateChangesUnsorted = 0;
+  uint64_t stateChangesSorted = 0;
+  // インスタンス描画.
+  uint32_t gridDrawCount = 0;       // モデル数 x メッシュ数.
+  uint32_t instancedDrawCount = 0;  // まとめた後の描画数.
+  double   instanceBatchMs = 0.0;   // まとめる処理とインスタンスデータの書き込み.
+  bool     instanceDataValid = false;  // 全インスタンスが描画単位の範囲内へ重複なく書き込まれたか.
+};
+
+DrawPacketBenchmarkResult RunDrawPacketBenchmark(uint32_t packetCount = 100000, uint32_t iterations = 10);
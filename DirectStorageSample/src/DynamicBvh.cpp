@@ -0,0 +1,544 @@
+﻿#include "DynamicBvh.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+  using Aabb = DynamicBvh::Aabb;
+
+  Aabb Combine(const Aabb& a, const Aabb& b)
+  {
+    return Aabb{
+      { (std::min)(a.min.x, b.min.x), (std::min)(a.min.y, b.min.y), (std::min)(a.min.z, b.min.z) },
+      { (std::max)(a.max.x, b.max.x), (std::max)(a.max.y, b.max.y), (std::max)(a.max.z, b.max.z) },
+    };
+  }
+
+  // 表面積の半分. 挿入位置の評価に使う.
+  float GetHalfArea(const Aabb& a)
+  {
+    float dx = a.max.x - a.min.x, dy = a.max.y - a.min.y, dz = a.max.z - a.min.z;
+    return dx * dy + dy * dz + dz * dx;
+  }
+
+  bool Contains(const Aabb& outer, const Aabb& inner)
+  {
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+      inner.max.x <= outer.max.x && inner.max.y <= outer.max.y && inner.max.z <= outer.max.z;
+  }
+
+  bool Overlaps(const Aabb& a, const Aabb& b)
+  {
+    return a.min.x <= b.max.x && b.min.x <= a.max.x &&
+      a.min.y <= b.max.y && b.min.y <= a.max.y &&
+      a.min.z <= b.max.z && b.min.z <= a.max.z;
+  }
+
+  enum class FrustumTest
+  {
+    Outside, Intersect, Inside,
+  };
+  FrustumTest TestFrustum(const Frustum& frustum, const Aabb& a)
+  {
+    float cx = (a.min.x + a.max.x) * 0.5f, cy = (a.min.y + a.max.y) * 0.5f, cz = (a.min.z + a.max.z) * 0.5f;
+    float ex = (a.max.x - a.min.x) * 0.5f, ey = (a.max.y - a.min.y) * 0.5f, ez = (a.max.z - a.min.z) * 0.5f;
+    auto result = FrustumTest::Inside;
+    for (const auto& plane : frustum.planes)
+    {
+      float d = plane.x * cx + plane.y * cy + plane.z * cz + plane.w;
+      float r = std::abs(plane.x) * ex + std::abs(plane.y) * ey + std::abs(plane.z) * ez;
+      if (d + r < 0.0f)
+      {
+        return FrustumTest::Outside;
+      }
+      if (d - r < 0.0f)
+      {
+        result = FrustumTest::Intersect;
+      }
+    }
+    return result;
+  }
+
+  bool OverlapsSphere(const Aabb& a, const XMFLOAT3& center, float radiusSq)
+  {
+    float dx = (std::max)((std::max)(a.min.x - center.x, 0.0f), center.x - a.max.x);
+    float dy = (std::max)((std::max)(a.min.y - center.y, 0.0f), center.y - a.max.y);
+    float dz = (std::max)((std::max)(a.min.z - center.z, 0.0f), center.z - a.max.z);
+    return dx * dx + dy * dy + dz * dz <= radiusSq;
+  }
+
+  // スラブ法. 交差する場合は入射距離を返す.
+  bool IntersectRay(const Aabb& a, const XMFLOAT3& origin, const XMFLOAT3& invDir, float maxDistance, float& distance)
+  {
+    float t1 = (a.min.x - origin.x) * invDir.x, t2 = (a.max.x - origin.x) * invDir.x;
+    float tmin = (std::min)(t1, t2), tmax = (std::max)(t1, t2);
+    t1 = (a.min.y - origin.y) * invDir.y; t2 = (a.max.y - origin.y) * invDir.y;
+    tmin = (std::max)(tmin, (std::min)(t1, t2)); tmax = (std::min)(tmax, (std::max)(t1, t2));
+    t1 = (a.min.z - origin.z) * invDir.z; t2 = (a.max.z - origin.z) * invDir.z;
+    tmin = (std::max)(tmin, (std::min)(t1, t2)); tmax = (std::min)(tmax, (std::max)(t1, t2));
+    tmin = (std::max)(tmin, 0.0f);
+    if (tmin > tmax || tmin > maxDistance)
+    {
+      return false;
+    }
+    distance = tmin;
+    return true;
+  }
+}
+
+DynamicBvh::DynamicBvh(float margin) : m_margin(margin)
+{
+}
+
+int32_t DynamicBvh::AllocateNode()
+{
+  if (m_freeList == NullProxy)
+  {
+    m_nodes.emplace_back();
+    return int32_t(m_nodes.size() - 1);
+  }
+  auto node = m_freeList;
+  m_freeList = m_nodes[node].parent;
+  m_nodes[node] = Node{};
+  return node;
+}
+
+void DynamicBvh::FreeNode(int32_t node)
+{
+  m_nodes[node].parent = m_freeList;
+  m_nodes[node].height = -1;
+  m_nodes[node].child1 = NullProxy;
+  m_nodes[node].child2 = NullProxy;
+  m_freeList = node;
+}
+
+DynamicBvh::ProxyId DynamicBvh::CreateProxy(const Aabb& aabb, uint64_t userData)
+{
+  auto leaf = AllocateNode();
+  auto& node = m_nodes[leaf];
+  node.aabb = Aabb{
+    { aabb.min.x - m_margin, aabb.min.y - m_margin, aabb.min.z - m_margin },
+    { aabb.max.x + m_margin, aabb.max.y + m_margin, aabb.max.z + m_margin },
+  };
+  node.userData = userData;
+  node.height = 0;
+  InsertLeaf(leaf);
+  m_proxyCount++;
+  return leaf;
+}
+
+void DynamicBvh::DestroyProxy(ProxyId proxy)
+{
+  assert(m_nodes[proxy].IsLeaf());
+  RemoveLeaf(proxy);
+  FreeNode(proxy);
+  m_proxyCount--;
+}
+
+bool DynamicBvh::MoveProxy(ProxyId proxy, const Aabb& aabb)
+{
+  assert(m_nodes[proxy].IsLeaf());
+  if (Contains(m_nodes[proxy].aabb, aabb))
+  {
+    return false;
+  }
+  RemoveLeaf(proxy);
+  m_nodes[proxy].aabb = Aabb{
+    { aabb.min.x - m_margin, aabb.min.y - m_margin, aabb.min.z - m_margin },
+    { aabb.max.x + m_margin, aabb.max.y + m_margin, aabb.max.z + m_margin },
+  };
+  InsertLeaf(proxy);
+  return true;
+}
+
+void DynamicBvh::Clear()
+{
+  m_nodes.clear();
+  m_root = NullProxy;
+  m_freeList = NullProxy;
+  m_proxyCount = 0;
+}
+
+void DynamicBvh::InsertLeaf(int32_t leaf)
+{
+  if (m_root == NullProxy)
+  {
+    m_root = leaf;
+    m_nodes[leaf].parent = NullProxy;
+    return;
+  }
+
+  // 表面積の増加が最小となる兄弟を探す.
+  const auto leafAabb = m_nodes[leaf].aabb;
+  int32_t index = m_root;
+  while (!m_nodes[index].IsLeaf())
+  {
+    const auto& node = m_nodes[index];
+    float area = GetHalfArea(node.aabb);
+    float combinedArea = GetHalfArea(Combine(node.aabb, leafAabb));
+    // ここで兄弟とした場合のコスト.
+    float cost = 2.0f * combinedArea;
+    // 子へ降りた場合に祖先が負担するコスト.
+    float inheritanceCost = 2.0f * (combinedArea - area);
+
+    auto childCost = [&](int32_t child) {
+      const auto& childNode = m_nodes[child];
+      float newArea = GetHalfArea(Combine(childNode.aabb, leafAabb));
+      if (childNode.IsLeaf())
+      {
+        return newArea + inheritanceCost;
+      }
+      return (newArea - GetHalfArea(childNode.aabb)) + inheritanceCost;
+    };
+    float cost1 = childCost(node.child1);
+    float cost2 = childCost(node.child2);
+    if (cost < cost1 && cost < cost2)
+    {
+      break;
+    }
+    index = (cost1 < cost2) ? node.child1 : node.child2;
+  }
+
+  // 兄弟との間に新しい親を作る.
+  int32_t sibling = index;
+  int32_t oldParent = m_nodes[sibling].parent;
+  int32_t newParent = AllocateNode();
+  m_nodes[newParent].parent = oldParent;
+  m_nodes[newParent].aabb = Combine(leafAabb, m_nodes[sibling].aabb);
+  m_nodes[newParent].height = m_nodes[sibling].height + 1;
+  m_nodes[newParent].child1 = sibling;
+  m_nodes[newParent].child2 = leaf;
+  m_nodes[sibling].parent = newParent;
+  m_nodes[leaf].parent = newParent;
+  if (oldParent == NullProxy)
+  {
+    m_root = newParent;
+  }
+  else if (m_nodes[oldParent].child1 == sibling)
+  {
+    m_nodes[oldParent].child1 = newParent;
+  }
+  else
+  {
+    m_nodes[oldParent].child2 = newParent;
+  }
+  RefitAncestors(m_nodes[leaf].parent);
+}
+
+void DynamicBvh::RemoveLeaf(int32_t leaf)
+{
+  if (leaf == m_root)
+  {
+    m_root = NullProxy;
+    return;
+  }
+  int32_t parent = m_nodes[leaf].parent;
+  int32_t grandParent = m_nodes[parent].parent;
+  int32_t sibling = (m_nodes[parent].child1 == leaf) ? m_nodes[parent].child2 : m_nodes[parent].child1;
+
+  if (grandParent == NullProxy)
+  {
+    m_root = sibling;
+    m_nodes[sibling].parent = NullProxy;
+    FreeNode(parent);
+    return;
+  }
+  // 親を取り除き、兄弟を祖父に付け替える.
+  if (m_nodes[grandParent].child1 == parent)
+  {
+    m_nodes[grandParent].child1 = sibling;
+  }
+  else
+  {
+    m_nodes[grandParent].child2 = sibling;
+  }
+  m_nodes[sibling].parent = grandParent;
+  FreeNode(parent);
+  RefitAncestors(grandParent);
+}
+
+void DynamicBvh::RefitAncestors(int32_t node)
+{
+  while (node != NullProxy)
+  {
+    node = Balance(node);
+    auto& current = m_nodes[node];
+    const auto& child1 = m_nodes[current.child1];
+    const auto& child2 = m_nodes[current.child2];
+    current.height = 1 + (std::max)(child1.height, child2.height);
+    current.aabb = Combine(child1.aabb, child2.aabb);
+    node = current.parent;
+  }
+}
+
+// 左右の高さの差が 2 以上であれば回転する. 回転後に node の位置にあるノードを返す.
+int32_t DynamicBvh::Balance(int32_t iA)
+{
+  auto& A = m_nodes[iA];
+  if (A.IsLeaf() || A.height < 2)
+  {
+    return iA;
+  }
+  int32_t iB = A.child1;
+  int32_t iC = A.child2;
+  int32_t balance = m_nodes[iC].height - m_nodes[iB].height;
+
+  // 高い側の子 (X) を持ち上げ、A を X の子にする.
+  auto rotate = [&](int32_t iX, int32_t iOther, bool xIsChild2) {
+    auto& X = m_nodes[iX];
+    int32_t iF = X.child1;
+    int32_t iG = X.child2;
+
+    X.child1 = iA;
+    X.parent = A.parent;
+    A.parent = iX;
+    if (X.parent != NullProxy)
+    {
+      auto& xParent = m_nodes[X.parent];
+      if (xParent.child1 == iA)
+      {
+        xParent.child1 = iX;
+      }
+      else
+      {
+        xParent.child2 = iX;
+      }
+    }
+    else
+    {
+      m_root = iX;
+    }
+
+    // X の子のうち高い方を X に残し、低い方を A に渡す.
+    auto& F = m_nodes[iF];
+    auto& G = m_nodes[iG];
+    int32_t iKeep = (F.height > G.height) ? iF : iG;
+    int32_t iGive = (iKeep == iF) ? iG : iF;
+    X.child2 = iKeep;
+    if (xIsChild2)
+    {
+      A.child2 = iGive;
+    }
+    else
+    {
+      A.child1 = iGive;
+    }
+    m_nodes[iGive].parent = iA;
+    const auto& other = m_nodes[iOther];
+    const auto& give = m_nodes[iGive];
+    const auto& keep = m_nodes[iKeep];
+    A.aabb = Combine(other.aabb, give.aabb);
+    A.height = 1 + (std::max)(other.height, give.height);
+    X.aabb = Combine(A.aabb, keep.aabb);
+    X.height = 1 + (std::max)(A.height, keep.height);
+    return iX;
+  };
+
+  if (balance > 1)
+  {
+    return rotate(iC, iB, true);
+  }
+  if (balance < -1)
+  {
+    return rotate(iB, iC, false);
+  }
+  return iA;
+}
+
+void DynamicBvh::QueryFrustum(const Frustum& frustum, std::vector<ProxyId>& results) const
+{
+  if (m_root == NullProxy)
+  {
+    return;
+  }
+  // 完全に内側の部分木は判定せずに全ての葉を追加する.
+  auto addAll = [&](int32_t subtree) {
+    int32_t stack[MaxStackSize];
+    uint32_t count = 0;
+    stack[count++] = subtree;
+    while (count > 0)
+    {
+      const auto& node = m_nodes[stack[--count]];
+      if (node.IsLeaf())
+      {
+        results.push_back(int32_t(&node - m_nodes.data()));
+        continue;
+      }
+      assert(count + 2 <= MaxStackSize);
+      stack[count++] = node.child1;
+      stack[count++] = node.child2;
+    }
+  };
+
+  int32_t stack[MaxStackSize];
+  uint32_t count = 0;
+  stack[count++] = m_root;
+  while (count > 0)
+  {
+    int32_t index = stack[--count];
+    const auto& node = m_nodes[index];
+    auto test = TestFrustum(frustum, node.aabb);
+    if (test == FrustumTest::Outside)
+    {
+      continue;
+    }
+    if (test == FrustumTest::Inside || node.IsLeaf())
+    {
+      addAll(index);
+      continue;
+    }
+    assert(count + 2 <= MaxStackSize);
+    stack[count++] = node.child1;
+    stack[count++] = node.child2;
+  }
+}
+
+void DynamicBvh::QueryAabb(const Aabb& aabb, std::vector<ProxyId>& results) const
+{
+  if (m_root == NullProxy)
+  {
+    return;
+  }
+  int32_t stack[MaxStackSize];
+  uint32_t count = 0;
+  stack[count++] = m_root;
+  while (count > 0)
+  {
+    int32_t index = stack[--count];
+    const auto& node = m_nodes[index];
+    if (!Overlaps(node.aabb, aabb))
+    {
+      continue;
+    }
+    if (node.IsLeaf())
+    {
+      results.push_back(index);
+      continue;
+    }
+    assert(count + 2 <= MaxStackSize);
+    stack[count++] = node.child1;
+    stack[count++] = node.child2;
+  }
+}
+
+void DynamicBvh::QuerySphere(const XMFLOAT3& center, float radius, std::vector<ProxyId>& results) const
+{
+  if (m_root == NullProxy)
+  {
+    return;
+  }
+  const float radiusSq = radius * radius;
+  int32_t stack[MaxStackSize];
+  uint32_t count = 0;
+  stack[count++] = m_root;
+  while (count > 0)
+  {
+    int32_t index = stack[--count];
+    const auto& node = m_nodes[index];
+    if (!OverlapsSphere(node.aabb, center, radiusSq))
+    {
+      continue;
+    }
+    if (node.IsLeaf())
+    {
+      results.push_back(index);
+      continue;
+    }
+    assert(count + 2 <= MaxStackSize);
+    stack[count++] = node.child1;
+    stack[count++] = node.child2;
+  }
+}
+
+bool DynamicBvh::RayCast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, RayHit& hit) const
+{
+  if (m_root == NullProxy)
+  {
+    return false;
+  }
+  // 0 除算は無限大となり、スラブ判定はそのまま成立する.
+  XMFLOAT3 invDir{ 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z };
+  float closest = maxDistance;
+  ProxyId closestProxy = NullProxy;
+
+  int32_t stack[MaxStackSize];
+  uint32_t count = 0;
+  stack[count++] = m_root;
+  while (count > 0)
+  {
+    int32_t index = stack[--count];
+    const auto& node = m_nodes[index];
+    float distance;
+    if (!IntersectRay(node.aabb, origin, invDir, closest, distance))
+    {
+      continue;
+    }
+    if (node.IsLeaf())
+    {
+      closest = distance;
+      closestProxy = index;
+      continue;
+    }
+    // 近い方の子を先に調べると、遠い側を早く打ち切れる.
+    float d1, d2;
+    bool hit1 = IntersectRay(m_nodes[node.child1].aabb, origin, invDir, closest, d1);
+    bool hit2 = IntersectRay(m_nodes[node.child2].aabb, origin, invDir, closest, d2);
+    assert(count + 2 <= MaxStackSize);
+    if (hit1 && hit2)
+    {
+      stack[count++] = (d1 < d2) ? node.child2 : node.child1;
+      stack[count++] = (d1 < d2) ? node.child1 : node.child2;
+    }
+    else if (hit1)
+    {
+      stack[count++] = node.child1;
+    }
+    else if (hit2)
+    {
+      stack[count++] = node.child2;
+    }
+  }
+  if (closestProxy == NullProxy)
+  {
+    return false;
+  }
+  hit.proxy = closestProxy;
+  hit.distance = closest;
+  return true;
+}
+
+bool DynamicBvh::Validate() const
+{
+  if (m_root == NullProxy)
+  {
+    return m_proxyCount == 0;
+  }
+  return m_nodes[m_root].parent == NullProxy && ValidateNode(m_root);
+}
+
+bool DynamicBvh::ValidateNode(int32_t index) const
+{
+  const auto& node = m_nodes[index];
+  if (node.IsLeaf())
+  {
+    return node.height == 0 && node.child2 == NullProxy;
+  }
+  const auto& child1 = m_nodes[node.child1];
+  const auto& child2 = m_nodes[node.child2];
+  if (child1.parent != index || child2.parent != index)
+  {
+    return false;
+  }
+  if (node.height != 1 + (std::max)(child1.height, child2.height))
+  {
+    return false;
+  }
+  if (!Contains(node.aabb, child1.aabb) || !Contains(node.aabb, child2.aabb))
+  {
+    return false;
+  }
+  return ValidateNode(node.child1) && ValidateNode(node.child2);
+}
@@ -0,0 +1,83 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+
+#include "FrustumCulling.h"
+
+// 動的な BVH (Bounding Volume Hierarchy).
+// 葉に少し大きめ(余白付き)の AABB を持たせ、移動量がその範囲に収まる間は木を更新しない.
+// 範囲を超えた場合のみ葉を付け替え、回転により木の高さを保つ.
+// D3D12 には依存しないため CPU 上で単体で使用できる.
+class DynamicBvh
+{
+public:
+  using ProxyId = int32_t;
+  static constexpr ProxyId NullProxy = -1;
+
+  struct Aabb
+  {
+    DirectX::XMFLOAT3 min;
+    DirectX::XMFLOAT3 max;
+  };
+  struct RayHit
+  {
+    ProxyId proxy = NullProxy;
+    float distance = 0.0f;
+  };
+
+  // margin は葉の AABB に加える余白.
+  explicit DynamicBvh(float margin = 0.1f);
+
+  ProxyId CreateProxy(const Aabb& aabb, uint64_t userData);
+  void DestroyProxy(ProxyId proxy);
+  // AABB を更新. 余白付きの範囲を超えて木を付け替えた場合は true を返す.
+  bool MoveProxy(ProxyId proxy, const Aabb& aabb);
+  void Clear();
+
+  uint64_t GetUserData(ProxyId proxy) const { return m_nodes[proxy].userData; }
+  const Aabb& GetFatAabb(ProxyId proxy) const { return m_nodes[proxy].aabb; }
+  uint32_t GetProxyCount() const { return m_proxyCount; }
+  // 木の高さ (葉のみであれば 0, 空であれば -1).
+  int32_t GetHeight() const { return m_root == NullProxy ? -1 : m_nodes[m_root].height; }
+
+  // 視錐台と交差する葉を列挙. 完全に内側の部分木は個別の判定を省略する.
+  void QueryFrustum(const Frustum& frustum, std::vector<ProxyId>& results) const;
+  void QueryAabb(const Aabb& aabb, std::vector<ProxyId>& results) const;
+  void QuerySphere(const DirectX::XMFLOAT3& center, float radius, std::vector<ProxyId>& results) const;
+  // 最も近くで交差する葉を求める. direction は正規化されていること.
+  bool RayCast(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float maxDistance, RayHit& hit) const;
+
+  // 探索用スタックの上限. 回転で高さを抑えるため、この深さを超えることはない.
+  static constexpr uint32_t MaxStackSize = 256;
+
+  // 構造の整合性を検証 (デバッグ用).
+  bool Validate() const;
+
+private:
+  struct Node
+  {
+    Aabb aabb;
+    uint64_t userData = 0;
+    int32_t parent = NullProxy;  // 未使用時は空きリストの次.
+    int32_t child1 = NullProxy;
+    int32_t child2 = NullProxy;
+    int32_t height = -1;         // 葉は 0, 未使用は -1.
+    bool IsLeaf() const { return child1 == NullProxy; }
+  };
+
+  int32_t AllocateNode();
+  void FreeNode(int32_t node);
+  void InsertLeaf(int32_t leaf);
+  void RemoveLeaf(int32_t leaf);
+  int32_t Balance(int32_t node);
+  // node から親方向に高さと AABB を更新.
+  void RefitAncestors(int32_t node);
+  bool ValidateNode(int32_t node) const;
+
+  std::vector<Node> m_nodes;
+  int32_t m_root = NullProxy;
+  int32_t m_freeList = NullProxy;
+  uint32_t m_proxyCount = 0;
+  float m_margin;
+};
@@ -0,0 +1,248 @@
+﻿#include "FrustumCulling.h"
+#include "SceneTransforms.h"
+#include <cmath>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define CULLING_AVX2_FUNC
+#else
+#define CULLING_AVX2_FUNC __attribute__((target("avx2,fma")))
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+  XMFLOAT4 NormalizePlane(XMVECTOR plane)
+  {
+    XMFLOAT4 result;
+    XMStoreFloat4(&result, XMPlaneNormalize(plane));
+    return result;
+  }
+
+  CULLING_AVX2_FUNC uint32_t CullAabbsAvx2(const Frustum& frustum,
+    const float* centerX, const float* centerY, const float* centerZ,
+    const float* extentX, const float* extentY, const float* extentZ,
+    uint32_t count, uint32_t* out)
+  {
+    __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+    __m256 absX[6], absY[6], absZ[6];
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    for (int i = 0; i < 6; ++i)
+    {
+      const auto& plane = frustum.planes[i];
+      planeX[i] = _mm256_set1_ps(plane.x);
+      planeY[i] = _mm256_set1_ps(plane.y);
+      planeZ[i] = _mm256_set1_ps(plane.z);
+      planeW[i] = _mm256_set1_ps(plane.w);
+      absX[i] = _mm256_andnot_ps(signMask, planeX[i]);
+      absY[i] = _mm256_andnot_ps(signMask, planeY[i]);
+      absZ[i] = _mm256_andnot_ps(signMask, planeZ[i]);
+    }
+
+    uint32_t visibleCount = 0;
+    for (uint32_t base = 0; base < count; base += AabbCullingList::BatchSize)
+    {
+      __m256 cx = _mm256_loadu_ps(centerX + base);
+      __m256 cy = _mm256_loadu_ps(centerY + base);
+      __m256 cz = _mm256_loadu_ps(centerZ + base);
+      __m256 ex = _mm256_loadu_ps(extentX + base);
+      __m256 ey = _mm256_loadu_ps(extentY + base);
+      __m256 ez = _mm256_loadu_ps(extentZ + base);
+
+      // いずれかの平面の完全に外側であれば不可視.
+      //   dot(n, c) + w + dot(|n|, e) < 0
+      __m256 outside = _mm256_setzero_ps();
+      for (int i = 0; i < 6; ++i)
+      {
+        __m256 d = _mm256_fmadd_ps(planeX[i], cx, planeW[i]);
+        d = _mm256_fmadd_ps(planeY[i], cy, d);
+        d = _mm256_fmadd_ps(planeZ[i], cz, d);
+        d = _mm256_fmadd_ps(absX[i], ex, d);
+        d = _mm256_fmadd_ps(absY[i], ey, d);
+        d = _mm256_fmadd_ps(absZ[i], ez, d);
+        outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_LT_OQ));
+      }
+      uint32_t visibleMask = ~uint32_t(_mm256_movemask_ps(outside)) & 0xFF;
+      // 詰め物の分を除外.
+      if (count - base < AabbCullingList::BatchSize)
+      {
+        visibleMask &= (1u << (count - base)) - 1;
+      }
+      while (visibleMask)
+      {
+        unsigned long bit;
+#if defined(_MSC_VER)
+        _BitScanForward(&bit, visibleMask);
+#else
+        bit = __builtin_ctz(visibleMask);
+#endif
+        out[visibleCount++] = base + bit;
+        visibleMask &= visibleMask - 1;
+      }
+    }
+    return visibleCount;
+  }
+}
+
+Frustum Frustum::FromViewProjection(DirectX::FXMMATRIX mtxViewProj)
+{
+  // 行ベクトル形式のため、列ベクトルを取り出して平面を求める.
+  XMMATRIX m = XMMatrixTranspose(mtxViewProj);
+  Frustum frustum;
+  frustum.planes[0] = NormalizePlane(XMVectorAdd(m.r[3], m.r[0]));       // 左.
+  frustum.planes[1] = NormalizePlane(XMVectorSubtract(m.r[3], m.r[0]));  // 右.
+  frustum.planes[2] = NormalizePlane(XMVectorAdd(m.r[3], m.r[1]));       // 下.
+  frustum.planes[3] = NormalizePlane(XMVectorSubtract(m.r[3], m.r[1]));  // 上.
+  frustum.planes[4] = NormalizePlane(m.r[2]);                             // 近.
+  frustum.planes[5] = NormalizePlane(XMVectorSubtract(m.r[3], m.r[2]));  // 遠.
+  return frustum;
+}
+
+bool Frustum::IntersectsSphere(const DirectX::XMFLOAT3& center, float radius) const
+{
+  for (const auto& plane : planes)
+  {
+    if (plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void AabbCullingList::Clear()
+{
+  m_count = 0;
+  m_centerX.clear();
+  m_centerY.clear();
+  m_centerZ.clear();
+  m_extentX.clear();
+  m_extentY.clear();
+  m_extentZ.clear();
+}
+
+void AabbCullingList::Reserve(uint32_t count)
+{
+  auto padded = count + BatchSize;
+  m_centerX.reserve(padded);
+  m_centerY.reserve(padded);
+  m_centerZ.reserve(padded);
+  m_extentX.reserve(padded);
+  m_extentY.reserve(padded);
+  m_extentZ.reserve(padded);
+}
+
+uint32_t AabbCullingList::Add(const XMFLOAT3& aabbMin, const XMFLOAT3& aabbMax, const XMFLOAT4X4& world)
+{
+  XMFLOAT3 worldMin, worldMax;
+  culling_math::TransformAabb(aabbMin, aabbMax, world, worldMin, worldMax);
+  auto index = m_count++;
+  if (m_centerX.size() < m_count)
+  {
+    // 8 の倍数まで確保する. 詰め物は 0 で判定結果は使われない.
+    auto padded = (m_count + BatchSize - 1) / BatchSize * BatchSize;
+    m_centerX.resize(padded);
+    m_centerY.resize(padded);
+    m_centerZ.resize(padded);
+    m_extentX.resize(padded);
+    m_extentY.resize(padded);
+    m_extentZ.resize(padded);
+  }
+  m_centerX[index] = (worldMin.x + worldMax.x) * 0.5f;
+  m_centerY[index] = (worldMin.y + worldMax.y) * 0.5f;
+  m_centerZ[index] = (worldMin.z + worldMax.z) * 0.5f;
+  m_extentX[index] = (worldMax.x - worldMin.x) * 0.5f;
+  m_extentY[index] = (worldMax.y - worldMin.y) * 0.5f;
+  m_extentZ[index] = (worldMax.z - worldMin.z) * 0.5f;
+  return index;
+}
+
+void AabbCullingList::Cull(const Frustum& frustum, std::vector<uint32_t>& visibleIndices) const
+{
+  auto offset = visibleIndices.size();
+  visibleIndices.resize(offset + m_count);
+  auto visibleCount = culling_math::CullAabbs(frustum,
+    m_centerX.data(), m_centerY.data(), m_centerZ.data(),
+    m_extentX.data(), m_extentY.data(), m_extentZ.data(), m_count, visibleIndices.data() + offset);
+  visibleIndices.resize(offset + visibleCount);
+}
+
+void AabbCullingList::CullScalar(const Frustum& frustum, std::vector<uint32_t>& visibleIndices) const
+{
+  auto offset = visibleIndices.size();
+  visibleIndices.resize(offset + m_count);
+  auto visibleCount = culling_math::CullAabbsScalar(frustum,
+    m_centerX.data(), m_centerY.data(), m_centerZ.data(),
+    m_extentX.data(), m_extentY.data(), m_extentZ.data(), m_count, visibleIndices.data() + offset);
+  visibleIndices.resize(offset + visibleCount);
+}
+
+void culling_math::TransformAabb(const XMFLOAT3& aabbMin, const XMFLOAT3& aabbMax, const XMFLOAT4X4& world,
+  XMFLOAT3& outMin, XMFLOAT3& outMax)
+{
+  // 中心は行列で変換し、半径は行列の各要素の絶対値で変換する.
+  XMFLOAT3 center{ (aabbMin.x + aabbMax.x) * 0.5f, (aabbMin.y + aabbMax.y) * 0.5f, (aabbMin.z + aabbMax.z) * 0.5f };
+  XMFLOAT3 extent{ (aabbMax.x - aabbMin.x) * 0.5f, (aabbMax.y - aabbMin.y) * 0.5f, (aabbMax.z - aabbMin.z) * 0.5f };
+  const auto& m = world.m;
+  float cx = center.x * m[0][0] + center.y * m[1][0] + center.z * m[2][0] + m[3][0];
+  float cy = center.x * m[0][1] + center.y * m[1][1] + center.z * m[2][1] + m[3][1];
+  float cz = center.x * m[0][2] + center.y * m[1][2] + center.z * m[2][2] + m[3][2];
+  float ex = extent.x * std::abs(m[0][0]) + extent.y * std::abs(m[1][0]) + extent.z * std::abs(m[2][0]);
+  float ey = extent.x * std::abs(m[0][1]) + extent.y * std::abs(m[1][1]) + extent.z * std::abs(m[2][1]);
+  float ez = extent.x * std::abs(m[0][2]) + extent.y * std::abs(m[1][2]) + extent.z * std::abs(m[2][2]);
+  outMin = { cx - ex, cy - ey, cz - ez };
+  outMax = { cx + ex, cy + ey, cz + ez };
+}
+
+void culling_math::MergeTransformedAabb(const XMFLOAT3& aabbMin, const XMFLOAT3& aabbMax, const XMFLOAT4X4& world,
+  XMFLOAT3& boundsMin, XMFLOAT3& boundsMax)
+{
+  XMFLOAT3 transformedMin, transformedMax;
+  TransformAabb(aabbMin, aabbMax, world, transformedMin, transformedMax);
+  XMStoreFloat3(&boundsMin, XMVectorMin(XMLoadFloat3(&boundsMin), XMLoadFloat3(&transformedMin)));
+  XMStoreFloat3(&boundsMax, XMVectorMax(XMLoadFloat3(&boundsMax), XMLoadFloat3(&transformedMax)));
+}
+
+uint32_t culling_math::CullAabbs(const Frustum& frustum,
+  const float* centerX, const float* centerY, const float* centerZ,
+  const float* extentX, const float* extentY, const float* extentZ,
+  uint32_t count, uint32_t* out)
+{
+  if (transform_math::IsAvx2Supported())
+  {
+    return CullAabbsAvx2(frustum, centerX, centerY, centerZ, extentX, extentY, extentZ, count, out);
+  }
+  return CullAabbsScalar(frustum, centerX, centerY, centerZ, extentX, extentY, extentZ, count, out);
+}
+
+uint32_t culling_math::CullAabbsScalar(const Frustum& frustum,
+  const float* centerX, const float* centerY, const float* centerZ,
+  const float* extentX, const float* extentY, const float* extentZ,
+  uint32_t count, uint32_t* out)
+{
+  uint32_t visibleCount = 0;
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    bool visible = true;
+    for (const auto& plane : frustum.planes)
+    {
+      // AVX2 版と同じ順序で積和を行い、判定結果を一致させる.
+      float d = std::fma(plane.x, centerX[i], plane.w);
+      d = std::fma(plane.y, centerY[i], d);
+      d = std::fma(plane.z, centerZ[i], d);
+      d = std::fma(std::abs(plane.x), extentX[i], d);
+      d = std::fma(std::abs(plane.y), extentY[i], d);
+      d = std::fma(std::abs(plane.z), extentZ[i], d);
+      if (d < 0.0f)
+      {
+        visible = false;
+        break;
+      }
+    }
+    if (visible)
+    {
+      out[visibleCount++] = i;
+    }
+  }
+  return visibleCount;
+}
@@ -0,0 +1,68 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+
+// 視錐台による AABB のカリング.
+// AABB は中心と半径 (各軸の半分の長さ) の SoA 形式で保持し、8 個単位で判定する.
+// AVX2 が使用可能な環境ではそちらを使用する.
+struct Frustum
+{
+  // xyz: 内向きの法線, w: 距離. dot(n, p) + w >= 0 が内側.
+  DirectX::XMFLOAT4 planes[6];
+
+  // ビュー・プロジェクション行列から作成 (行ベクトル形式, 深度 0～1).
+  static Frustum FromViewProjection(DirectX::FXMMATRIX mtxViewProj);
+
+  // 球が視錐台と交差するか (平面の外側に完全に出ていないか).
+  bool IntersectsSphere(const DirectX::XMFLOAT3& center, float radius) const;
+};
+
+class AabbCullingList
+{
+public:
+  static constexpr uint32_t BatchSize = 8;
+
+  void Clear();
+  void Reserve(uint32_t count);
+  // ローカル空間の AABB を world で変換した AABB (変換後の包含箱) として登録.
+  // 戻り値は登録順のインデックス.
+  uint32_t Add(const DirectX::XMFLOAT3& aabbMin, const DirectX::XMFLOAT3& aabbMax, const DirectX::XMFLOAT4X4& world);
+
+  // 視錐台と交差するもののインデックスを昇順で visibleIndices に追加.
+  void Cull(const Frustum& frustum, std::vector<uint32_t>& visibleIndices) const;
+  // 比較用. AVX2 を使用しない.
+  void CullScalar(const Frustum& frustum, std::vector<uint32_t>& visibleIndices) const;
+
+  uint32_t GetCount() const { return m_count; }
+  DirectX::XMFLOAT3 GetCenter(uint32_t index) const { return { m_centerX[index], m_centerY[index], m_centerZ[index] }; }
+  DirectX::XMFLOAT3 GetExtent(uint32_t index) const { return { m_extentX[index], m_extentY[index], m_extentZ[index] }; }
+
+private:
+  uint32_t m_count = 0;
+  // 8 の倍数まで詰め物をしておく. 詰め物は判定後に除外する.
+  std::vector<float> m_centerX, m_centerY, m_centerZ;
+  std::vector<float> m_extentX, m_extentY, m_extentZ;
+};
+
+namespace culling_math
+{
+  // AABB を行列で変換し、変換後の AABB を包含する AABB を求める.
+  void TransformAabb(const DirectX::XMFLOAT3& aabbMin, const DirectX::XMFLOAT3& aabbMax, const DirectX::XMFLOAT4X4& world,
+    DirectX::XMFLOAT3& outMin, DirectX::XMFLOAT3& outMax);
+  // AABB を行列で変換し、boundsMin/boundsMax をそれを包含するように広げる.
+  // 最初は boundsMin を FLT_MAX, boundsMax を -FLT_MAX としておく.
+  void MergeTransformedAabb(const DirectX::XMFLOAT3& aabbMin, const DirectX::XMFLOAT3& aabbMax, const DirectX::XMFLOAT4X4& world,
+    DirectX::XMFLOAT3& boundsMin, DirectX::XMFLOAT3& boundsMax);
+
+  // 先頭から count 個のうち可視であるもののインデックスを out に書き込み、個数を返す.
+  // 配列は count を 8 の倍数に切り上げた位置まで読み込み可能であること.
+  uint32_t CullAabbs(const Frustum& frustum,
+    const float* centerX, const float* centerY, const float* centerZ,
+    const float* extentX, const float* extentY, const float* extentZ,
+    uint32_t count, uint32_t* out);
+  uint32_t CullAabbsScalar(const Frustum& frustum,
+    const float* centerX, const float* centerY, const float* centerZ,
+    const float* extentX, const float* extentY, const float* extentZ,
+    uint32_t count, uint32_t* out);
+}
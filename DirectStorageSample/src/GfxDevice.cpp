@@ -1,6 +1,7 @@
 ﻿#include "GfxDevice.h"
 #include "Win32Application.h"
 #include <stdexcept>
+#include <algorithm>
 
 #pragma comment(lib, "d3d12.lib")
 #pragma comment(lib, "dxgi.lib")
@@ -95,6 +96,11 @@ void GfxDevice::Submit(ID3D12CommandList* const commandList)
   m_commandQueue->ExecuteCommandLists(1, &commandList);
 }
 
+void GfxDevice::Submit(std::span<ID3D12CommandList* const> commandLists)
+{
+  m_commandQueue->ExecuteCommandLists(UINT(commandLists.size()), commandLists.data());
+}
+
 void GfxDevice::Present(UINT syncInterval, UINT flags)
 {
   if (m_swapchain)
@@ -102,6 +108,8 @@ void GfxDevice::Present(UINT syncInterval, UINT flags)
     m_swapchain->Present(syncInterval, flags);
     const UINT64 currentFenceValue = m_frameInfo[m_frameIndex].fenceValue;
     m_commandQueue->Signal(m_frameFence.Get(), currentFenceValue);
+    // 以降に解放されたものは次のフレームの完了を待つ. インデックスより先に更新しておく.
+    m_pendingFenceValue = currentFenceValue + 1;
 
     // インデックスを更新.
     m_frameIndex = m_swapchain->GetCurrentBackBufferIndex();
@@ -118,7 +126,19 @@ void GfxDevice::Present(UINT syncInterval, UINT flags)
 
 void GfxDevice::NewFrame()
 {
-  m_frameInfo[m_frameIndex].commandAllocator->Reset();
+  // GPU の処理が完了したフレームで解放されたディスクリプタを再利用可能にする.
+  auto completedFenceValue = GetCompletedFenceValue();
+  for (auto info : { &m_rtvDescriptorHeap, &m_dsvDescriptorHeap, &m_srvDescriptorHeap, &m_samplerDescriptorHeap })
+  {
+    info->allocator.ReleaseCompleted(completedFenceValue);
+  }
+
+  auto& frame = m_frameInfo[m_frameIndex];
+  frame.commandAllocator->Reset();
+  for (auto& allocator : frame.recordingAllocators)
+  {
+    allocator->Reset();
+  }
 }
 
 void GfxDevice::WaitForGPU()
@@ -212,6 +232,39 @@ GfxDevice::ComPtr<ID3D12GraphicsCommandList> GfxDevice::CreateCommandList()
   return commandList;
 }
 
+void GfxDevice::PrepareRecordingContexts(uint32_t count)
+{
+  for (UINT i = 0; i < BackBufferCount; ++i)
+  {
+    auto& frame = m_frameInfo[i];
+    for (uint32_t j = uint32_t(frame.recordingAllocators.size()); j < count; ++j)
+    {
+      ComPtr<ID3D12CommandAllocator> allocator;
+      HRESULT hr = m_d3d12Device->CreateCommandAllocator(
+        D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&allocator));
+      ThrowIfFailed(hr, "CreateCommandAllocatorに失敗");
+
+      // 記録前に Reset するため、クローズ状態で作成しておく.
+      ComPtr<ID3D12GraphicsCommandList> commandList;
+      hr = m_d3d12Device->CreateCommandList1(
+        0, D3D12_COMMAND_LIST_TYPE_DIRECT, D3D12_COMMAND_LIST_FLAG_NONE, IID_PPV_ARGS(&commandList));
+      ThrowIfFailed(hr, "CreateCommandList1に失敗");
+
+      frame.recordingAllocators.push_back(allocator);
+      frame.recordingCommandLists.push_back(commandList);
+    }
+  }
+  m_recordingContextCount = (std::max)(m_recordingContextCount, count);
+}
+
+GfxDevice::ComPtr<ID3D12GraphicsCommandList> GfxDevice::BeginRecording(uint32_t index)
+{
+  auto& frame = m_frameInfo[m_frameIndex];
+  auto commandList = frame.recordingCommandLists[index];
+  commandList->Reset(frame.recordingAllocators[index].Get(), nullptr);
+  return commandList;
+}
+
 GfxDevice::ComPtr<ID3D12Resource1> GfxDevice::CreateBuffer(const D3D12_RESOURCE_DESC& resDesc, D3D12_HEAP_TYPE heapType, D3D12_RESOURCE_STATES resourceState, const void* srcData)
 {
   bool useStaging = false;
@@ -342,79 +395,43 @@ GfxDevice::DescriptorHandle GfxDevice::CreateSampler(const D3D12_SAMPLER_DESC& s
 
 GfxDevice::DescriptorHandle GfxDevice::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE type)
 {
-  DescriptorHandle handle = { };
-  auto info = GetDescriptorHeapInfo(type);
-  if (!info->freeHandles.empty())
-  {
-    handle = info->freeHandles.back();
-    if (handle.count == 1)
-    {
-      info->freeHandles.pop_back();
-      return handle;
-    }
-  }
-
-  auto desc = info->heap->GetDesc();
-  if (desc.NumDescriptors <= info->usedIndex)
-  {
-    DebugBreak();
-  }
-
-  handle.count = 1;
-  handle.type = type;
-  handle.hCpu = info->heap->GetCPUDescriptorHandleForHeapStart();
-  handle.hCpu.ptr += info->handleSize * info->usedIndex;
-  handle.hGpu.ptr = 0;
-  if (desc.Flags & D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE)
-  {
-    handle.hGpu = info->heap->GetGPUDescriptorHandleForHeapStart();
-    handle.hGpu.ptr += info->handleSize * info->usedIndex;
-  }
-  info->usedIndex++;
-  return handle;
+  return AllocateDescriptors(type, 1);
 }
 
 GfxDevice::DescriptorHandle GfxDevice::AllocateDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE type, UINT num)
 {
   DescriptorHandle baseHandle = { };
   auto info = GetDescriptorHeapInfo(type);
-  std::lock_guard lock(info->mutexHeap);
-
-  if (!info->freeHandles.empty())
-  {
-    auto handle = info->freeHandles.back();
-    if (handle.count == num)
-    {
-      info->freeHandles.pop_back();
-      baseHandle = handle;
-      return baseHandle;
-    }
-  }
-
-  auto desc = info->heap->GetDesc();
-  if (desc.NumDescriptors <= info->usedIndex + num)
+  auto index = info->allocator.Allocate(num);
+  if (index == DescriptorAllocator::InvalidOffset)
   {
-    DebugBreak();
+    ThrowIfFailed(E_OUTOFMEMORY, "ディスクリプタの確保に失敗");
   }
 
   baseHandle.count = num;
   baseHandle.type = type;
   baseHandle.hCpu = info->heap->GetCPUDescriptorHandleForHeapStart();
-  baseHandle.hCpu.ptr += info->handleSize * info->usedIndex;
+  baseHandle.hCpu.ptr += info->handleSize * index;
   baseHandle.hGpu.ptr = 0;
-  if (desc.Flags & D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE)
+  if (info->heap->GetDesc().Flags & D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE)
   {
     baseHandle.hGpu = info->heap->GetGPUDescriptorHandleForHeapStart();
-    baseHandle.hGpu.ptr += info->handleSize * info->usedIndex;
+    baseHandle.hGpu.ptr += info->handleSize * index;
   }
-  info->usedIndex += num;
   return baseHandle;
 }
 
 void GfxDevice::DeallocateDescriptor(DescriptorHandle descriptor)
 {
+  // 現在のフレームまでのコマンドが参照している可能性があるため、フレームの完了後に再利用する.
   auto info = GetDescriptorHeapInfo(descriptor.type);
-  info->freeHandles.push_back(descriptor);
+  auto index = (descriptor.hCpu.ptr - info->heap->GetCPUDescriptorHandleForHeapStart().ptr) / info->handleSize;
+  info->allocator.FreeDeferred(uint32_t(index), descriptor.count, GetFrameFenceValue());
+}
+
+DescriptorAllocator::Stats GfxDevice::GetDescriptorStats(D3D12_DESCRIPTOR_HEAP_TYPE type)
+{
+  return GetDescriptorHeapInfo(type)->allocator.GetStats();
 }
 
 GfxDevice::ComPtr<ID3D12DescriptorHeap> GfxDevice::GetDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE type)
@@ -534,6 +551,11 @@ void GfxDevice::CreateDescriptorHeaps()
   hr = m_d3d12Device->CreateDescriptorHeap(&samplerHeapDesc, IID_PPV_ARGS(&m_samplerDescriptorHeap.heap));
   m_samplerDescriptorHeap.handleSize = m_d3d12Device->GetDescriptorHandleIncrementSize(samplerHeapDesc.Type);
   ThrowIfFailed(hr, "ID3D12DescriptorHeap(Sampler)作成失敗");
+
+  m_rtvDescriptorHeap.allocator.Reset(rtvHeapDesc.NumDescriptors);
+  m_dsvDescriptorHeap.allocator.Reset(dsvHeapDesc.NumDescriptors);
+  m_srvDescriptorHeap.allocator.Reset(srvHeapDesc.NumDescriptors);
+  m_samplerDescriptorHeap.allocator.Reset(samplerHeapDesc.NumDescriptors);
 }
 
 void GfxDevice::PrepareRenderTargetView()
@@ -581,7 +603,10 @@ void GfxDevice::DestroyCommandAllocators()
   {
     auto& frame = m_frameInfo[i];
     frame.commandAllocator.Reset();
+    frame.recordingCommandLists.clear();
+    frame.recordingAllocators.clear();
   }
+  m_recordingContextCount = 0;
 }
 
 GfxDevice::DescriptorHeapInfo* GfxDevice::GetDescriptorHeapInfo(D3D12_DESCRIPTOR_HEAP_TYPE type)
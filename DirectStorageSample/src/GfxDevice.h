@@ -1,14 +1,18 @@
 ﻿#pragma once
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <string>
 #include <mutex>
+#include <span>
 
 #define NOMINMAX
 #include <d3d12.h>
 #include <wrl.h>
 #include <dxgi1_6.h>
 
+#include "DescriptorAllocator.h"
+
 class GfxDevice
 {
 public:
@@ -33,10 +37,17 @@ public:
 
   // 現在処理対象フレームインデックスを取得.
   UINT GetFrameIndex() const { return m_frameIndex; }
+  // 現在のフレームの完了時(Present)にシグナルされるフェンス値.
+  // ワーカースレッドから呼び出してもよい.
+  UINT64 GetFrameFenceValue() const { return m_pendingFenceValue.load(); }
+  // GPU が処理を完了したフェンス値.
+  UINT64 GetCompletedFenceValue() const { return m_frameFence->GetCompletedValue(); }
   DescriptorHandle GetSwapchainBufferDescriptor();
   ComPtr<ID3D12Resource1>     GetSwapchainBufferResource();
 
   void Submit(ID3D12CommandList* const commandList);
+  // 複数のコマンドリストを指定順で 1 回の ExecuteCommandLists で実行.
+  void Submit(std::span<ID3D12CommandList* const> commandLists);
   void Present(UINT syncInterval, UINT flags = 0);
   void NewFrame();
   void WaitForGPU();
@@ -49,6 +60,13 @@ public:
   ComPtr<ID3D12PipelineState> CreateComputePipelineState(const D3D12_COMPUTE_PIPELINE_STATE_DESC& psoDesc);
   ComPtr<ID3D12GraphicsCommandList> CreateCommandList();
 
+  // 並列記録用のコマンドリスト. スレッド毎にフレーム数分のアロケータを持つ.
+  void PrepareRecordingContexts(uint32_t count);
+  uint32_t GetRecordingContextCount() const { return m_recordingContextCount; }
+  // 現在のフレームの index 番目のコマンドリストを記録開始状態にして返す.
+  // 同じ index を複数スレッドから同時に使用しないこと.
+  ComPtr<ID3D12GraphicsCommandList> BeginRecording(uint32_t index);
+
   ComPtr<ID3D12Resource1> CreateBuffer(const D3D12_RESOURCE_DESC& resDesc, D3D12_HEAP_TYPE heapType, D3D12_RESOURCE_STATES resourceState = D3D12_RESOURCE_STATE_GENERIC_READ, const void* srcData = nullptr);
   DescriptorHandle CreateDepthStencilView(ComPtr<ID3D12Resource1> depthImage, D3D12_DEPTH_STENCIL_VIEW_DESC& dsvDesc);
   DescriptorHandle CreateConstantBufferView(const D3D12_CONSTANT_BUFFER_VIEW_DESC& cbvDesc);
@@ -60,7 +78,9 @@ public:
   // ディスクリプタ関連.
   DescriptorHandle AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE type);
   DescriptorHandle AllocateDescriptors(D3D12_DESCRIPTOR_HEAP_TYPE type, UINT num);
+  // 解放は現在のフレームの GPU 処理が完了するまで遅延される. スレッドセーフ.
   void DeallocateDescriptor(DescriptorHandle descriptor);
+  DescriptorAllocator::Stats GetDescriptorStats(D3D12_DESCRIPTOR_HEAP_TYPE type);
   ComPtr<ID3D12DescriptorHeap> GetDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE type);
 
   // 内部オブジェクトを使うときに使用する.
@@ -90,27 +110,30 @@ private:
   UINT   m_frameIndex = 0;
   HANDLE m_waitFence;
   ComPtr<ID3D12Fence1> m_frameFence;
+  // 次の Present でシグナルされるフェンス値. m_frameInfo はメインスレッドでのみ扱い、
+  // 他のスレッドからはこちらを参照する.
+  std::atomic<UINT64> m_pendingFenceValue = 1;
 
   // 描画フレーム情報
   struct FrameInfo
   {
     UINT64 fenceValue = 0;
     ComPtr<ID3D12CommandAllocator> commandAllocator;
+    std::vector<ComPtr<ID3D12CommandAllocator>> recordingAllocators;
+    std::vector<ComPtr<ID3D12GraphicsCommandList>> recordingCommandLists;
 
     DescriptorHandle rtvDescriptor;       // 描画先のRTV
     ComPtr<ID3D12Resource1> targetBuffer; // 描画先バックバッファ.
   };
   FrameInfo m_frameInfo[BackBufferCount];
+  uint32_t m_recordingContextCount = 0;
 
   // DescriptorHeap
   struct DescriptorHeapInfo
   {
     ComPtr<ID3D12DescriptorHeap> heap;
     UINT handleSize = 0;
-    UINT usedIndex = 0;
-    std::vector<DescriptorHandle> freeHandles;
-
-    std::mutex mutexHeap;
+    DescriptorAllocator allocator;
   };
   DescriptorHeapInfo* GetDescriptorHeapInfo(D3D12_DESCRIPTOR_HEAP_TYPE);
   DescriptorHeapInfo m_rtvDescriptorHeap;
@@ -0,0 +1,56 @@
+﻿#include "InstanceBatcher.h"
+#include <algorithm>
+
+void InstanceBatcher::Clear()
+{
+  m_batches.clear();
+  m_batchIndices.clear();
+  m_instanceBatches.clear();
+  m_instanceTransforms.clear();
+  m_instanceSlots.clear();
+}
+
+void InstanceBatcher::Add(uint64_t key, const DrawPacket& packet, uint32_t transformIndex, float viewDepth, bool backToFront)
+{
+  uint32_t batchIndex = uint32_t(m_batches.size());
+  if (m_instancingEnabled && !backToFront)
+  {
+    auto [itr, inserted] = m_batchIndices.try_emplace(key, batchIndex);
+    batchIndex = itr->second;
+  }
+  if (batchIndex == m_batches.size())
+  {
+    m_batches.push_back(Batch{ packet, 0, 0, viewDepth, backToFront });
+  }
+  auto& batch = m_batches[batchIndex];
+  batch.instanceCount++;
+  batch.viewDepth = (std::min)(batch.viewDepth, viewDepth);
+  m_instanceBatches.push_back(batchIndex);
+  m_instanceTransforms.push_back(transformIndex);
+}
+
+void InstanceBatcher::Build()
+{
+  // 描画単位毎の開始位置を求め、追加順に書き込み先を割り当てる.
+  uint32_t offset = 0;
+  for (auto& batch : m_batches)
+  {
+    batch.firstInstance = offset;
+    offset += batch.instanceCount;
+  }
+  std::vector<uint32_t> cursors(m_batches.size());
+  m_instanceSlots.resize(m_instanceBatches.size());
+  for (size_t i = 0; i < m_instanceBatches.size(); ++i)
+  {
+    auto batchIndex = m_instanceBatches[i];
+    m_instanceSlots[i] = m_batches[batchIndex].firstInstance + cursors[batchIndex]++;
+  }
+}
+
+void InstanceBatcher::WriteInstanceData(InstanceData* dst) const
+{
+  for (size_t i = 0; i < m_instanceTransforms.size(); ++i)
+  {
+    dst[m_instanceSlots[i]] = m_instanceTransforms[i];
+  }
+}
@@ -0,0 +1,52 @@
+﻿#pragma once
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "DrawPacket.h"
+
+// 同じアセットの同じメッシュを 1 回のインスタンス描画にまとめる.
+// インスタンス毎の行列の位置は描画単位で連続するように詰め、
+// シェーダーでは StructuredBuffer を SV_InstanceID で参照し、その位置の行列を読み込む.
+// CPU のみで完結するため GPU 無しでも検証可能.
+class InstanceBatcher
+{
+public:
+  struct Batch
+  {
+    DrawPacket packet;        // meshConstants, instanceCount は呼び出し側で設定する.
+    uint32_t firstInstance;   // インスタンスデータ内の開始位置.
+    uint32_t instanceCount;
+    float    viewDepth;       // まとめた中で最も手前の深度.
+    bool     backToFront;
+  };
+  // インスタンスデータ 1 つ分. 行列バッファ内の位置.
+  using InstanceData = uint32_t;
+
+  void Clear();
+  // false の場合はまとめずに 1 インスタンス毎に描画する (比較用).
+  void SetInstancingEnabled(bool enabled) { m_instancingEnabled = enabled; }
+
+  // key が同じものを 1 つの描画にまとめる. key にはメッシュを一意に示す値を指定する.
+  // 奥から手前へ描画するもの(半透明)は描画順を保つためまとめない.
+  // transformIndex は行列バッファ内のワールド行列の位置.
+  void Add(uint64_t key, const DrawPacket& packet, uint32_t transformIndex, float viewDepth, bool backToFront);
+  // 描画単位毎にインスタンスの並びを確定する.
+  void Build();
+
+  std::span<const Batch> GetBatches() const { return m_batches; }
+  uint32_t GetInstanceCount() const { return uint32_t(m_instanceBatches.size()); }
+  // Build 後に呼び出す. GetInstanceCount() 個分のインスタンスデータを dst へ書き込む.
+  void WriteInstanceData(InstanceData* dst) const;
+
+private:
+  std::vector<Batch> m_batches;
+  std::unordered_map<uint64_t, uint32_t> m_batchIndices;
+  // 追加順のインスタンス.
+  std::vector<uint32_t> m_instanceBatches;
+  std::vector<uint32_t> m_instanceTransforms;
+  // Build で確定した書き込み先の位置 (追加順).
+  std::vector<uint32_t> m_instanceSlots;
+  bool m_instancingEnabled = true;
+};
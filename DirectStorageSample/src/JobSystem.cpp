@@ -0,0 +1,124 @@
+﻿#include "JobSystem.h"
+#include <algorithm>
+
+static std::unique_ptr<JobSystem> gJobSystem;
+
+std::unique_ptr<JobSystem>& GetJobSystem()
+{
+  // ベンチマーク用のスレッドからも呼ばれるため、作成は 1 度だけ行う.
+  static std::once_flag initialized;
+  std::call_once(initialized, []() { gJobSystem = std::make_unique<JobSystem>(); });
+  return gJobSystem;
+}
+
+JobSystem::JobSystem(uint32_t workerCount)
+{
+  if (workerCount == 0)
+  {
+    workerCount = (std::max)(1u, std::thread::hardware_concurrency()) - 1;
+  }
+  m_workers.reserve(workerCount);
+  for (uint32_t i = 0; i < workerCount; ++i)
+  {
+    m_workers.emplace_back([this]() { WorkerMain(); });
+  }
+}
+
+JobSystem::~JobSystem()
+{
+  {
+    std::lock_guard lock(m_mutex);
+    m_isShutdown = true;
+  }
+  m_cvWork.notify_all();
+  for (auto& worker : m_workers)
+  {
+    worker.join();
+  }
+}
+
+void JobSystem::ParallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& func)
+{
+  if (count == 0)
+  {
+    return;
+  }
+  grainSize = (std::max)(1u, grainSize);
+  const uint32_t chunkCount = (count + grainSize - 1) / grainSize;
+  if (chunkCount == 1 || m_workers.empty())
+  {
+    func(0, count);
+    return;
+  }
+
+  // キューへ積んだ後はロックを保持しない.
+  // 処理中に別スレッドや入れ子で ParallelFor が呼ばれても、それぞれのバッチとして並行して処理される.
+  auto batch = std::make_shared<Batch>();
+  batch->func = &func;
+  batch->count = count;
+  batch->grainSize = grainSize;
+  batch->remaining = chunkCount;
+  {
+    std::lock_guard lock(m_mutex);
+    m_batches.push_back(batch);
+  }
+  m_cvWork.notify_all();
+
+  // 呼び出しスレッドも処理に参加.
+  Execute(*batch);
+
+  std::unique_lock lock(m_mutex);
+  // 全ての範囲が取り出し済みのため、ワーカーが新たに拾うことはない.
+  std::erase(m_batches, batch);
+  m_cvDone.wait(lock, [&]() { return batch->remaining == 0; });
+}
+
+bool JobSystem::Execute(Batch& batch)
+{
+  bool isLast = false;
+  for (;;)
+  {
+    uint32_t begin = batch.next.fetch_add(batch.grainSize);
+    if (begin >= batch.count)
+    {
+      break;
+    }
+    uint32_t end = (std::min)(begin + batch.grainSize, batch.count);
+    (*batch.func)(begin, end);
+    isLast = batch.remaining.fetch_sub(1) == 1;
+  }
+  return isLast;
+}
+
+std::shared_ptr<JobSystem::Batch> JobSystem::FindPendingBatch() const
+{
+  for (const auto& batch : m_batches)
+  {
+    if (batch->HasWork())
+    {
+      return batch;
+    }
+  }
+  return nullptr;
+}
+
+void JobSystem::WorkerMain()
+{
+  for (;;)
+  {
+    std::shared_ptr<Batch> batch;
+    {
+      std::unique_lock lock(m_mutex);
+      m_cvWork.wait(lock, [&]() { return m_isShutdown || (batch = FindPendingBatch()) != nullptr; });
+      if (m_isShutdown)
+      {
+        return;
+      }
+    }
+    if (Execute(*batch))
+    {
+      std::lock_guard lock(m_mutex);
+      m_cvDone.notify_all();
+    }
+  }
+}
@@ -0,0 +1,55 @@
+﻿#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 固定数のワーカースレッドで処理を分割実行する簡易ジョブプール.
+// ParallelFor は呼び出しスレッドも処理に参加し、全ての範囲が終わるまで戻らない.
+// 複数のスレッドからの同時呼び出しや、ParallelFor の処理内からの入れ子の呼び出しも可能.
+// 呼び出しスレッドは自身の範囲を最後まで取り出して処理するため、ワーカーが全て埋まっていても完了する.
+class JobSystem
+{
+public:
+  // workerCount が 0 の場合は論理コア数-1 を使用.
+  explicit JobSystem(uint32_t workerCount = 0);
+  ~JobSystem();
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  // [0, count) を grainSize 毎に分割して func(begin, end) を並列に呼び出す.
+  void ParallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& func);
+
+  // 呼び出しスレッドを含めた並列数.
+  uint32_t GetConcurrency() const { return uint32_t(m_workers.size()) + 1; }
+
+private:
+  struct Batch
+  {
+    const std::function<void(uint32_t, uint32_t)>* func = nullptr;
+    uint32_t count = 0;
+    uint32_t grainSize = 1;
+    std::atomic<uint32_t> next = 0;
+    std::atomic<uint32_t> remaining = 0;  // 未完了の分割数.
+
+    bool HasWork() const { return next.load() < count; }
+  };
+  void WorkerMain();
+  // 取り出せる範囲が無くなるまで処理する. 最後の範囲を終えた場合は true.
+  static bool Execute(Batch& batch);
+  // 取り出せる範囲が残っているバッチ (m_mutex をロックして呼ぶ).
+  std::shared_ptr<Batch> FindPendingBatch() const;
+
+  std::vector<std::thread> m_workers;
+  std::mutex m_mutex;
+  std::condition_variable m_cvWork;
+  std::condition_variable m_cvDone;
+  std::vector<std::shared_ptr<Batch>> m_batches;  // 実行中のバッチ. 古いものから処理する.
+  bool m_isShutdown = false;
+};
+
+std::unique_ptr<JobSystem>& GetJobSystem();
@@ -0,0 +1,302 @@
+﻿#include "LoadTelemetry.h"
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <fstream>
+
+namespace
+{
+  // 各工程の計測起点となる工程.
+  // CPU/GPU データは並行してロードされるため、共にメタデータ完了を起点とする.
+  constexpr LoadTelemetry::Stage kPrecedingStage[] = {
+    LoadTelemetry::Stage::Request,         // Request (起点なし)
+    LoadTelemetry::Stage::Request,         // HeaderLoaded
+    LoadTelemetry::Stage::HeaderLoaded,    // MetadataLoaded
+    LoadTelemetry::Stage::MetadataLoaded,  // CpuDataLoaded
+    LoadTelemetry::Stage::MetadataLoaded,  // GpuDataLoaded
+    LoadTelemetry::Stage::Count,           // RenderingPrepared (CPU/GPU の遅い方)
+  };
+  static_assert(std::size(kPrecedingStage) == LoadTelemetry::StageCount);
+
+  double ToMilliseconds(LoadTelemetry::clock::duration d)
+  {
+    return std::chrono::duration<double, std::milli>(d).count();
+  }
+  double ToMicroseconds(LoadTelemetry::clock::duration d)
+  {
+    return std::chrono::duration<double, std::micro>(d).count();
+  }
+
+  // 最近傍順位法によるパーセンタイル.
+  double Percentile(const std::vector<double>& sorted, double p)
+  {
+    if (sorted.empty())
+    {
+      return 0.0;
+    }
+    auto rank = size_t(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+  }
+
+  std::string EscapeJson(const std::string& str)
+  {
+    std::string result;
+    result.reserve(str.size());
+    for (auto c : str)
+    {
+      switch (c)
+      {
+      case '"':  result += "\\\""; break;
+      case '\\': result += "\\\\"; break;
+      case '\n': result += "\\n"; break;
+      default:
+        if (uint8_t(c) < 0x20)
+        {
+          result += std::format("\\u{:04x}", uint32_t(uint8_t(c)));
+        }
+        else
+        {
+          result += c;
+        }
+        break;
+      }
+    }
+    return result;
+  }
+}
+
+void LoadTelemetry::RegionInfo::Add(uint64_t compressed, uint64_t uncompressed, Compression type)
+{
+  compression = (count == 0 || compression == type) ? type : Compression::Mixed;
+  compressedBytes += compressed;
+  uncompressedBytes += uncompressed;
+  count++;
+}
+
+void LoadTelemetry::Record::Mark(Stage stage)
+{
+  auto index = uint32_t(stage);
+  if (!reached[index])
+  {
+    stamps[index] = clock::now();
+    reached[index] = true;
+  }
+}
+
+double LoadTelemetry::GetStageDuration(const Record& record, Stage stage)
+{
+  if (stage == Stage::Request || !record.IsReached(stage))
+  {
+    return -1.0;
+  }
+  auto preceding = kPrecedingStage[uint32_t(stage)];
+  time_point start;
+  if (preceding == Stage::Count)
+  {
+    if (!record.IsReached(Stage::CpuDataLoaded) || !record.IsReached(Stage::GpuDataLoaded))
+    {
+      return -1.0;
+    }
+    start = std::max(record.GetStamp(Stage::CpuDataLoaded), record.GetStamp(Stage::GpuDataLoaded));
+  }
+  else
+  {
+    if (!record.IsReached(preceding))
+    {
+      return -1.0;
+    }
+    start = record.GetStamp(preceding);
+  }
+  return ToMilliseconds(record.GetStamp(stage) - start);
+}
+
+const char* LoadTelemetry::GetStageName(Stage stage)
+{
+  static const char* names[] = {
+    "Request", "Header", "Metadata", "CpuData", "GpuData", "RenderingPrepared",
+  };
+  static_assert(std::size(names) == StageCount);
+  return names[uint32_t(stage)];
+}
+
+const char* LoadTelemetry::GetRegionName(Region region)
+{
+  static const char* names[] = {
+    "CpuMetadata", "CpuData", "GpuBuffer", "Textures",
+  };
+  static_assert(std::size(names) == RegionCount);
+  return names[uint32_t(region)];
+}
+
+const char* LoadTelemetry::GetCompressionName(Compression compression)
+{
+  switch (compression)
+  {
+  case Compression::None: return "None";
+  case Compression::GDeflate: return "GDeflate";
+  default: return "Mixed";
+  }
+}
+
+std::vector<double> LoadTelemetry::GetStageDurations(Stage stage) const
+{
+  std::vector<double> durations;
+  durations.reserve(m_records.size());
+  for (const auto& record : m_records)
+  {
+    if (auto d = GetStageDuration(record, stage); d >= 0.0)
+    {
+      durations.push_back(d);
+    }
+  }
+  return durations;
+}
+
+LoadTelemetry::Percentiles LoadTelemetry::GetStagePercentiles(Stage stage) const
+{
+  auto durations = GetStageDurations(stage);
+  std::sort(durations.begin(), durations.end());
+
+  Percentiles result;
+  result.count = uint32_t(durations.size());
+  result.p50 = Percentile(durations, 50.0);
+  result.p95 = Percentile(durations, 95.0);
+  result.p99 = Percentile(durations, 99.0);
+  result.max = durations.empty() ? 0.0 : durations.back();
+  return result;
+}
+
+LoadTelemetry::Histogram LoadTelemetry::GetStageHistogram(Stage stage, uint32_t bucketCount) const
+{
+  Histogram result;
+  auto durations = GetStageDurations(stage);
+  if (durations.empty() || bucketCount == 0)
+  {
+    return result;
+  }
+
+  // 全て 0 の場合も幅が 0 にならないようにしておく.
+  auto maxMs = *std::max_element(durations.begin(), durations.end());
+  result.bucketWidthMs = std::max(maxMs, 1.0e-3) / bucketCount;
+  result.bucketCenters.resize(bucketCount);
+  result.counts.assign(bucketCount, 0.0);
+  for (uint32_t i = 0; i < bucketCount; ++i)
+  {
+    result.bucketCenters[i] = (i + 0.5) * result.bucketWidthMs;
+  }
+  for (auto d : durations)
+  {
+    auto bucket = std::min(uint32_t(d / result.bucketWidthMs), bucketCount - 1);
+    result.counts[bucket] += 1.0;
+  }
+  return result;
+}
+
+bool LoadTelemetry::ExportChromeTrace(const std::filesystem::path& filePath) const
+{
+  std::ofstream outfile(filePath);
+  if (!outfile)
+  {
+    return false;
+  }
+
+  // 最も早いロード要求をトレースの原点とする.
+  time_point origin = time_point::max();
+  for (const auto& record : m_records)
+  {
+    if (record.IsReached(Stage::Request))
+    {
+      origin = std::min(origin, record.GetStamp(Stage::Request));
+    }
+  }
+
+  outfile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool first = true;
+  auto writeEvent = [&](const std::string& event) {
+    outfile << (first ? "" : ",\n") << event;
+    first = false;
+  };
+  for (uint32_t tid = 0; tid < m_records.size(); ++tid)
+  {
+    const auto& record = m_records[tid];
+    if (!record.IsReached(Stage::Request))
+    {
+      continue;
+    }
+    // 1モデルを1スレッド行として表示する.
+    writeEvent(std::format(
+      "{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+      tid, EscapeJson(record.name)));
+
+    std::string regionArgs;
+    for (uint32_t i = 0; i < RegionCount; ++i)
+    {
+      const auto& region = record.regions[i];
+      regionArgs += std::format(",\"{0}Bytes\":{1},\"{0}CompressedBytes\":{2},\"{0}Compression\":\"{3}\"",
+        GetRegionName(Region(i)), region.uncompressedBytes, region.compressedBytes, GetCompressionName(region.compression));
+    }
+
+    for (uint32_t i = 1; i < StageCount; ++i)
+    {
+      auto stage = Stage(i);
+      auto duration = GetStageDuration(record, stage);
+      if (duration < 0.0)
+      {
+        continue;
+      }
+      auto end = ToMicroseconds(record.GetStamp(stage) - origin);
+      auto dur = duration * 1000.0;
+      writeEvent(std::format(
+        "{{\"name\":\"{}\",\"cat\":\"load\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f},\"args\":{{\"model\":\"{}\"{}}}}}",
+        GetStageName(stage), tid, end - dur, dur, EscapeJson(record.name), regionArgs));
+    }
+  }
+  outfile << "\n]}\n";
+  return bool(outfile);
+}
+
+bool LoadTelemetry::ExportCsv(const std::filesystem::path& filePath) const
+{
+  std::ofstream outfile(filePath);
+  if (!outfile)
+  {
+    return false;
+  }
+
+  outfile << "model";
+  for (uint32_t i = 1; i < StageCount; ++i)
+  {
+    outfile << "," << GetStageName(Stage(i)) << "_ms";
+  }
+  for (uint32_t i = 0; i < RegionCount; ++i)
+  {
+    auto name = GetRegionName(Region(i));
+    outfile << "," << name << "_bytes," << name << "_compressed_bytes," << name << "_compression";
+  }
+  outfile << "\n";
+
+  for (const auto& record : m_records)
+  {
+    std::string name;
+    for (auto c : record.name)
+    {
+      name += (c == '"') ? std::string("\"\"") : std::string(1, c);
+    }
+    outfile << "\"" << name << "\"";
+    for (uint32_t i = 1; i < StageCount; ++i)
+    {
+      auto duration = GetStageDuration(record, Stage(i));
+      outfile << ",";
+      if (duration >= 0.0)
+      {
+        outfile << std::format("{:.3f}", duration);
+      }
+    }
+    for (const auto& region : record.regions)
+    {
+      outfile << "," << region.uncompressedBytes << "," << region.compressedBytes << "," << GetCompressionName(region.compression);
+    }
+    outfile << "\n";
+  }
+  return bool(outfile);
+}
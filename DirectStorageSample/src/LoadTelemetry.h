@@ -0,0 +1,105 @@
+﻿#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// モデルのロード工程ごとの時間計測.
+// 各モデルの記録を集計して工程別のレイテンシ分布を求め、
+// Chrome トレース(JSON)/CSV として出力する.
+class LoadTelemetry
+{
+public:
+  using clock = std::chrono::high_resolution_clock;
+  using time_point = clock::time_point;
+
+  enum class Stage : uint32_t
+  {
+    Request = 0,        // ロード要求.
+    HeaderLoaded,       // ヘッダ読み込み完了.
+    MetadataLoaded,     // CPUメタデータ読み込み完了.
+    CpuDataLoaded,      // CPUデータ読み込み完了.
+    GpuDataLoaded,      // GPUデータ(テクスチャ/バッファ)読み込み完了.
+    RenderingPrepared,  // 描画用データ構築(CreateRenderingData)完了.
+    Count,
+  };
+  enum class Region : uint32_t
+  {
+    CpuMetadata = 0,
+    CpuData,
+    GpuBuffer,
+    Textures,
+    Count,
+  };
+  enum class Compression : uint8_t
+  {
+    None = 0,
+    GDeflate,
+    Mixed,  // 複数のデータで圧縮形式が混在.
+  };
+  static constexpr uint32_t StageCount = uint32_t(Stage::Count);
+  static constexpr uint32_t RegionCount = uint32_t(Region::Count);
+
+  struct RegionInfo
+  {
+    uint64_t compressedBytes = 0;
+    uint64_t uncompressedBytes = 0;
+    Compression compression = Compression::None;
+    uint32_t count = 0;
+
+    void Add(uint64_t compressed, uint64_t uncompressed, Compression type);
+  };
+
+  // モデル1つ分のロード記録.
+  struct Record
+  {
+    std::string name;
+    std::array<time_point, StageCount> stamps{};
+    std::array<bool, StageCount> reached{};
+    std::array<RegionInfo, RegionCount> regions{};
+
+    void Mark(Stage stage);
+    bool IsReached(Stage stage) const { return reached[uint32_t(stage)]; }
+    time_point GetStamp(Stage stage) const { return stamps[uint32_t(stage)]; }
+  };
+
+  // 工程の所要時間 (ミリ秒). 先行する工程の完了時点から計測する.
+  // 前後の工程が記録されていない場合は負値を返す.
+  static double GetStageDuration(const Record& record, Stage stage);
+  static const char* GetStageName(Stage stage);
+  static const char* GetRegionName(Region region);
+  static const char* GetCompressionName(Compression compression);
+
+  void Clear() { m_records.clear(); }
+  void AddRecord(const Record& record) { m_records.push_back(record); }
+  const std::vector<Record>& GetRecords() const { return m_records; }
+
+  struct Percentiles
+  {
+    uint32_t count = 0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+  };
+  Percentiles GetStagePercentiles(Stage stage) const;
+  // ヒストグラム表示用に工程の所要時間を列挙.
+  std::vector<double> GetStageDurations(Stage stage) const;
+
+  // 0 から最大値までを等幅に区切った工程の所要時間の度数分布.
+  struct Histogram
+  {
+    double bucketWidthMs = 0.0;
+    std::vector<double> bucketCenters;  // 各区間の中心 (ミリ秒).
+    std::vector<double> counts;         // 各区間の件数. 描画用に double で保持する.
+  };
+  Histogram GetStageHistogram(Stage stage, uint32_t bucketCount) const;
+
+  bool ExportChromeTrace(const std::filesystem::path& filePath) const;
+  bool ExportCsv(const std::filesystem::path& filePath) const;
+
+private:
+  std::vector<Record> m_records;
+};
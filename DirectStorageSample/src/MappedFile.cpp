@@ -0,0 +1,50 @@
+﻿#include "MappedFile.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+MappedFile::~MappedFile()
+{
+  if (m_view)
+  {
+    UnmapViewOfFile(m_view);
+  }
+  if (m_hMapping)
+  {
+    CloseHandle(m_hMapping);
+  }
+  if (m_hFile && m_hFile != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(m_hFile);
+  }
+}
+
+std::shared_ptr<const MappedFile> MappedFile::Open(const std::filesystem::path& filePath)
+{
+  std::shared_ptr<MappedFile> mappedFile(new MappedFile());
+  mappedFile->m_hFile = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ,
+    nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (mappedFile->m_hFile == INVALID_HANDLE_VALUE)
+  {
+    return nullptr;
+  }
+  LARGE_INTEGER fileSize{};
+  if (!GetFileSizeEx(mappedFile->m_hFile, &fileSize) || fileSize.QuadPart == 0)
+  {
+    return nullptr;
+  }
+  mappedFile->m_size = uint64_t(fileSize.QuadPart);
+
+  // 書き込みを行わないため、ページはプライベートコピーされずに共有される.
+  mappedFile->m_hMapping = CreateFileMappingW(mappedFile->m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mappedFile->m_hMapping == nullptr)
+  {
+    return nullptr;
+  }
+  mappedFile->m_view = static_cast<const char*>(MapViewOfFile(mappedFile->m_hMapping, FILE_MAP_READ, 0, 0, 0));
+  if (mappedFile->m_view == nullptr)
+  {
+    return nullptr;
+  }
+  return mappedFile;
+}
@@ -0,0 +1,29 @@
+﻿#pragma once
+#include <memory>
+#include <cstdint>
+#include <filesystem>
+
+// 読み取り専用でメモリマップしたファイル.
+// ページはOSのファイルキャッシュと共有されるため、同じファイルをマップした
+// 他のインスタンスやプロセスとも物理メモリを共有できる.
+class MappedFile
+{
+public:
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // マップに失敗した場合は nullptr を返す.
+  static std::shared_ptr<const MappedFile> Open(const std::filesystem::path& filePath);
+
+  const char* Data() const { return m_view; }
+  uint64_t GetSize() const { return m_size; }
+
+private:
+  MappedFile() = default;
+
+  void* m_hFile = nullptr;
+  void* m_hMapping = nullptr;
+  const char* m_view = nullptr;
+  uint64_t m_size = 0;
+};
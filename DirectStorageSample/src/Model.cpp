@@ -5,6 +5,7 @@
 #include <fstream>
 #include <map>
 #include <unordered_map>
+#include <algorithm>
 
 #include <d3d12.h>
 #include <d3dx12.h>
@@ -17,6 +18,7 @@
 #include "TextureUtility.h"
 
 #include "DStorageLoader.h"
+#include "ModelAssetCache.h"
 
 using model::ModelData;
 using namespace DirectX;
@@ -187,14 +189,6 @@ void model::DefaultTextures::Initialize()
   gDefaultTextures.defaultSampler = gfxDevice->CreateSampler(samplerDesc);
 }
 
-template<typename T1, typename T2>
-void Fixup(model::MemoryRegion<T1>& region, model::Ptr<T2>& ptr)
-{
-  auto offset = ptr.offset;
-  char* data = region.Data() + offset;
-  ptr.ptr = reinterpret_cast<T2*>(data);
-}
-
 DSTORAGE_COMPRESSION_FORMAT ToCompressionFormat(model::DataCompressionType type)
 {
   if (type == model::DataCompressionType::None)
@@ -208,15 +202,15 @@ DSTORAGE_COMPRESSION_FORMAT ToCompressionFormat(model::DataCompressionType type)
   throw std::runtime_error("Unknown Compresstion Type");
 }
 
-model::SimpleModel::SimpleModel()
+model::ModelAsset::ModelAsset()
 {
-  m_ewHeaderLoaded.Init<SimpleModel, &SimpleModel::OnHeaderLoaded>(this);
-  m_ewCpuMetadataLoaded.Init<SimpleModel, &SimpleModel::OnCpuMetadataLoaded>(this);
-  m_ewCpuDataLoaded.Init<SimpleModel, &SimpleModel::OnCpuDataLoaded>(this);
-  m_ewGpuDataLoaded.Init<SimpleModel, &SimpleModel::OnGpuDataLoaded>(this);
+  m_ewHeaderLoaded.Init<ModelAsset, &ModelAsset::OnHeaderLoaded>(this);
+  m_ewCpuMetadataLoaded.Init<ModelAsset, &ModelAsset::OnCpuMetadataLoaded>(this);
+  m_ewCpuDataLoaded.Init<ModelAsset, &ModelAsset::OnCpuDataLoaded>(this);
+  m_ewGpuDataLoaded.Init<ModelAsset, &ModelAsset::OnGpuDataLoaded>(this);
 }
 
-model::SimpleModel::~SimpleModel()
+model::ModelAsset::~ModelAsset()
 {
   auto& gfxDevice = GetGfxDevice();
   auto  d3d12Device = gfxDevice->GetD3D12Device();
@@ -232,7 +226,7 @@ model::SimpleModel::~SimpleModel()
 }
 
 template<typename T>
-void model::SimpleModel::EnqueueRead(uint64_t offset, T* dest)
+void model::ModelAsset::EnqueueRead(uint64_t offset, T* dest)
 {
   DSTORAGE_REQUEST r{};
   r.Options.SourceType = DSTORAGE_REQUEST_SOURCE_FILE;
@@ -250,8 +244,16 @@ void model::SimpleModel::EnqueueRead(uint64_t offset, T* dest)
   queue->EnqueueRequest(&r);
 }
 template<typename T>
-model::MemoryRegion<T> model::SimpleModel::EnqueueReadMemoryRegion(model::Region<T>const& region)
+model::MemoryRegion<T> model::ModelAsset::EnqueueReadMemoryRegion(model::Region<T>const& region)
 {
+  if (m_mappedFile && region.compressionType == model::DataCompressionType::None)
+  {
+    // 非圧縮であればマップ済みのファイルをそのまま参照する (読み込み不要).
+    if (region.data.offset + region.uncompressedSize <= m_mappedFile->GetSize())
+    {
+      return MemoryRegion<T>(m_mappedFile, region.data.offset);
+    }
+  }
   MemoryRegion<T> dest(std::make_unique<char[]>(region.uncompressedSize));
   DSTORAGE_REQUEST r{};
 
@@ -271,7 +273,7 @@ model::MemoryRegion<T> model::SimpleModel::EnqueueReadMemoryRegion(model::Region
   return dest;
 }
 
-model::SimpleModel::Buffer model::SimpleModel::EnqueueReadBufferRegion(ID3D12Heap* heap, uint64_t offset, const model::GpuRegion& region)
+model::ModelAsset::Buffer model::ModelAsset::EnqueueReadBufferRegion(ID3D12Heap* heap, uint64_t offset, const model::GpuRegion& region)
 {
   auto queue = GetDStorageLoader()->GetQueueGpuMemory();
   auto& gfxDevice = GetGfxDevice();
@@ -296,7 +298,7 @@ model::SimpleModel::Buffer model::SimpleModel::EnqueueReadBufferRegion(ID3D12Hea
   return resource;
 }
 
-model::SimpleModel::Buffer model::SimpleModel::EnqueueReadBufferRegion(ID3D12Heap* heap, const D3D12_RESOURCE_ALLOCATION_INFO1& allocationInfo, const model::GpuRegion& region)
+model::ModelAsset::Buffer model::ModelAsset::EnqueueReadBufferRegion(ID3D12Heap* heap, const D3D12_RESOURCE_ALLOCATION_INFO1& allocationInfo, const model::GpuRegion& region)
 {
   auto queue = GetDStorageLoader()->GetQueueGpuMemory();
   auto& gfxDevice = GetGfxDevice();
@@ -330,7 +332,7 @@ model::SimpleModel::Buffer model::SimpleModel::EnqueueReadBufferRegion(ID3D12Hea
 }
 
 
-Microsoft::WRL::ComPtr<ID3D12Resource1> model::SimpleModel::EnqueueReadTexture(ID3D12Heap* heap, uint64_t offset, const D3D12_RESOURCE_DESC& desc, const model::TextureMetadata& textureMetadata)
+Microsoft::WRL::ComPtr<ID3D12Resource1> model::ModelAsset::EnqueueReadTexture(ID3D12Heap* heap, uint64_t offset, const D3D12_RESOURCE_DESC& desc, const model::TextureMetadata& textureMetadata, const char* name)
 {
   auto queue = GetDStorageLoader()->GetQueueGpuMemory();
   auto& gfxDevice = GetGfxDevice();
@@ -346,8 +348,8 @@ Microsoft::WRL::ComPtr<ID3D12Resource1> model::SimpleModel::EnqueueReadTexture(I
     IID_PPV_ARGS(&resource)
   );
 
-  std::string name = textureMetadata.name.ptr;
-  std::wstring wname(name.begin(), name.end());
+  std::string_view nameView = name;
+  std::wstring wname(nameView.begin(), nameView.end());
   resource->SetName(wname.c_str());
 
   DSTORAGE_REQUEST r{};
@@ -368,13 +370,23 @@ Microsoft::WRL::ComPtr<ID3D12Resource1> model::SimpleModel::EnqueueReadTexture(I
   return resource;
 }
 
-bool model::SimpleModel::RequestLoad(std::filesystem::path filePath)
+bool model::ModelAsset::RequestLoad(std::filesystem::path filePath)
 {
+  m_isLoadRequested = true;
+  // ヘッダの先読みは推定サイズを求めるためにロード判断より前から行っているため、
+  // どちらのモードでもロード要求時点を起点とする.
+  m_loadRecord.name = filePath.stem().string();
+  m_loadRecord.Mark(LoadTelemetry::Stage::Request);
+  // ヒープは呼び出し側が CreatePreallocatedHeap でまとめて作成しておく.
+  // 作成されていなければ通常モードでロードする.
+  // CPU 側の非圧縮データ参照用. マップできなければ従来通り読み込む.
+  m_mappedFile = MappedFile::Open(filePath);
   auto factory = GetDStorageLoader()->GetFactory();
   factory->CreateStatusArray(DStorageStatusEntry::NumEntries, nullptr, IID_PPV_ARGS(&m_statusArray));
   auto hr = factory->OpenFile(filePath.wstring().c_str(), IID_PPV_ARGS(&m_file));
   if (FAILED(hr))
   {
+    m_isLoadFailed = true;
     return false;
   }
   // DirectStorage経由でデータ読み取りを開始.
@@ -388,185 +400,198 @@ bool model::SimpleModel::RequestLoad(std::filesystem::path filePath)
   return true;
 }
 
-bool model::SimpleModel::RequestLoadHeaderOnly(std::filesystem::path filePath)
+// 各データ領域のサイズと圧縮形式を記録.
+void model::ModelAsset::RecordRegionSizes()
 {
-  std::ifstream infile(filePath, std::ios::binary);
-  std::vector<char> workBuffer;
-  if (infile)
-  {
-    workBuffer.resize(sizeof(model::Header));
-    infile.read(workBuffer.data(), workBuffer.size());
-
-    const auto* header = reinterpret_cast<const model::Header*>(workBuffer.data());
-    const auto unstructuredGpuDataSize = header->unstructuredGpuData.uncompressedSize;
-
-    std::vector<char> decodeBuffer;
-    std::vector<D3D12_RESOURCE_DESC> resourceDescs;
-    uint32_t textureCount = 0;
-    if (header->cpuMetadata.compressionType == model::DataCompressionType::None)
+  auto record = [&](LoadTelemetry::Region region, auto const& src)
     {
-      size_t requestSize = header->cpuMetadata.uncompressedSize;
-      decodeBuffer.resize(requestSize);
-
-      auto offset = header->cpuMetadata.data.offset;
-      infile.seekg(offset, std::ios::beg).read(decodeBuffer.data(), requestSize);
+      auto compression = src.compressionType == model::DataCompressionType::GDeflate ?
+        LoadTelemetry::Compression::GDeflate : LoadTelemetry::Compression::None;
+      m_loadRecord.regions[uint32_t(region)].Add(src.compressedSize, src.uncompressedSize, compression);
+    };
+  record(LoadTelemetry::Region::CpuMetadata, m_header.cpuMetadata);
+  record(LoadTelemetry::Region::CpuData, m_header.cpuData);
+  record(LoadTelemetry::Region::GpuBuffer, m_header.unstructuredGpuData);
+  for (uint32_t i = 0; i < m_cpuMetadata.GetTextureCount(); ++i)
+  {
+    record(LoadTelemetry::Region::Textures, m_cpuMetadata.GetTexture(i).mipmap);
+  }
+}
 
-      auto* metadata = reinterpret_cast<model::CpuMetadataHeader*>(decodeBuffer.data());
-      textureCount = metadata->numTextures;
-      auto textureDescs = reinterpret_cast<D3D12_RESOURCE_DESC*>(decodeBuffer.data() + metadata->textureDescs.data.offset);
-      resourceDescs.assign(textureDescs, textureDescs + textureCount);
-    }
-    if (header->cpuMetadata.compressionType == model::DataCompressionType::GDeflate)
+// 事前確保モードと推定サイズの計算用にヘッダとメタデータのみを先読みする.
+// 読み込みと展開はスレッドプール上で行い、ヒープは CreatePreallocatedHeap で作成する.
+bool model::ModelAsset::RequestLoadHeaderOnly(std::filesystem::path filePath)
+{
+  m_isHeaderLoadRequested = true;
+  auto work = new std::function<void()>([self = shared_from_this(), filePath]() {
+    self->m_prefetch.succeeded = self->PrefetchMetadata(filePath);
+    self->m_prefetch.completed = true;
+  });
+  auto callback = [](TP_CALLBACK_INSTANCE*, void* context)
     {
-      decodeBuffer.resize(header->cpuMetadata.uncompressedSize);
-      std::vector<char> sourceBuffer(header->cpuMetadata.compressedSize);
-      auto offset = header->cpuMetadata.data.offset;
-      infile.seekg(offset, std::ios::beg).read(sourceBuffer.data(), sourceBuffer.size());
-
-      constexpr uint32_t NumCodecThread = 6;
-      ComPtr<IDStorageCompressionCodec> compressionCodec;
-      DStorageCreateCompressionCodec(
-        DSTORAGE_COMPRESSION_FORMAT_GDEFLATE, NumCodecThread, IID_PPV_ARGS(&compressionCodec)
-      );
-      size_t decompressedSize = 0;
-      compressionCodec->DecompressBuffer(
-        sourceBuffer.data(), sourceBuffer.size(),
-        decodeBuffer.data(), decodeBuffer.size(), &decompressedSize);
-
-      auto* metadata = reinterpret_cast<model::CpuMetadataHeader*>(decodeBuffer.data());
-      textureCount = metadata->numTextures;
-      auto textureDescs = reinterpret_cast<D3D12_RESOURCE_DESC*>(decodeBuffer.data() + metadata->textureDescs.data.offset);
-      resourceDescs.assign(textureDescs, textureDescs + metadata->numTextures);
-    }
-
-    auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(unstructuredGpuDataSize);
-    resourceDescs.push_back(bufferDesc);
-
-    ComPtr<ID3D12Device4> device4;
-    auto& gfxDevice = GetGfxDevice();
-    gfxDevice->GetD3D12Device().As(&device4);
+      std::unique_ptr<std::function<void()>> work(reinterpret_cast<std::function<void()>*>(context));
+      (*work)();
+    };
+  if (!TrySubmitThreadpoolCallback(callback, work, nullptr))
+  {
+    delete work;
+    // 先読みできなかったものは通常モードでロードさせる.
+    m_prefetch.completed = true;
+    return false;
+  }
+  return true;
+}
 
-    std::vector<D3D12_RESOURCE_ALLOCATION_INFO1> resourceAllocationInfos(resourceDescs.size());
-    D3D12_RESOURCE_ALLOCATION_INFO allocationInfo = device4->GetResourceAllocationInfo1(
-      0,
-      UINT(resourceDescs.size()),
-      resourceDescs.data(),
-      resourceAllocationInfos.data()
-    );
+// ヘッダとメタデータを読み込み、GPU 上に作成するリソース(テクスチャ群 + バッファ)の記述を求める.
+static bool ReadGpuResourceDescs(const std::filesystem::path& filePath, std::vector<D3D12_RESOURCE_DESC>& resourceDescs, uint32_t& textureCount)
+{
+  std::ifstream infile(filePath, std::ios::binary);
+  if (!infile)
+  {
+    return false;
+  }
+  model::Header header{};
+  infile.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!infile || header.Version != 0xFFFE)
+  {
+    return false;
+  }
 
-    m_overallTextureAllocationInfo = allocationInfo;    // 今回用意したバッファも対応するものにセット.
-    m_textureAllocationInfos = resourceAllocationInfos; // 今回用意したバッファも対応するものにセット.
-
-    // ヒープを確保済みにしておく.
-    D3D12_HEAP_DESC heapDesc{};
-    heapDesc.Alignment = allocationInfo.Alignment;
-    heapDesc.Flags = D3D12_HEAP_FLAG_NONE;
-    heapDesc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
-    heapDesc.SizeInBytes = allocationInfo.SizeInBytes;
-    HRESULT hr = device4->CreateHeap(&heapDesc, IID_PPV_ARGS(&m_localHeap));
-    if (FAILED(hr))
+  const auto metadataSize = header.cpuMetadata.uncompressedSize;
+  auto decodeBuffer = std::make_unique<char[]>(metadataSize);
+  auto offset = header.cpuMetadata.data.offset;
+  if (header.cpuMetadata.compressionType == model::DataCompressionType::None)
+  {
+    infile.seekg(offset, std::ios::beg).read(decodeBuffer.get(), metadataSize);
+  }
+  else if (header.cpuMetadata.compressionType == model::DataCompressionType::GDeflate)
+  {
+    std::vector<char> sourceBuffer(header.cpuMetadata.compressedSize);
+    infile.seekg(offset, std::ios::beg).read(sourceBuffer.data(), sourceBuffer.size());
+    if (!GetDStorageLoader()->DecompressGDeflate(
+      sourceBuffer.data(), sourceBuffer.size(), decodeBuffer.get(), metadataSize))
     {
       return false;
     }
+  }
+  else
+  {
+    return false;
+  }
+  if (!infile)
+  {
+    return false;
+  }
 
-    {
-      D3D12_HEAP_DESC heapDesc{};
-      heapDesc.Alignment = 64*1024;// allocationInfo.Alignment;
-      heapDesc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
-      heapDesc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
-      heapDesc.SizeInBytes = 8*1024*1024;
-      ComPtr<ID3D12Heap> sampleHeap;
-      HRESULT hr = device4->CreateHeap(&heapDesc, IID_PPV_ARGS(&sampleHeap));
-      if (FAILED(hr))
-      {
-        return false;
-      }
-
-      ComPtr<ID3D12Resource> tex;
-      auto resDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_BC7_UNORM, 512, 512, 1, 10);
-      resDesc.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
-
-      ComPtr<ID3D12InfoQueue> infoQueue;
-      device4.As(&infoQueue);
-      if (infoQueue)
-      {
-        D3D12_MESSAGE_ID denyIds[] = {
-            D3D12_MESSAGE_ID_CREATERESOURCE_INVALIDALIGNMENT_SMALLRESOURCE // WARNING #1380 を抑制
-        };
-        D3D12_INFO_QUEUE_FILTER filter{};
-        filter.DenyList.NumIDs = _countof(denyIds);
-        filter.DenyList.pIDList = denyIds;
-        infoQueue->AddStorageFilterEntries(&filter);
-      }
-
-      auto info = device4->GetResourceAllocationInfo(0, 1, &resDesc);
-
-      auto resDesc2 = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_BC7_UNORM, 256, 256, 1, 9);
-      //resDesc2.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
-      std::vector<D3D12_RESOURCE_DESC> resDescs = {
-        resDesc, resDesc2,
-      };
-
-      D3D12_RESOURCE_ALLOCATION_INFO1 allocInfo1[2] = { 0 };
-
-      info = device4->GetResourceAllocationInfo1(0, UINT(resDescs.size()), resDescs.data(), allocInfo1);
+  model::CpuMetadataView metadata(model::MemoryRegion<model::CpuMetadataHeader>(std::move(decodeBuffer)));
 
+  textureCount = metadata.GetTextureCount();
+  resourceDescs.assign(metadata.GetTextureDescs(), metadata.GetTextureDescs() + textureCount);
+  resourceDescs.push_back(CD3DX12_RESOURCE_DESC::Buffer(header.unstructuredGpuData.uncompressedSize));
+  return true;
+}
 
-      hr = device4->CreatePlacedResource(
-        sampleHeap.Get(),
-        16384,
-        &resDesc,
-        D3D12_RESOURCE_STATE_COPY_DEST,
-        nullptr,
-        IID_PPV_ARGS(&tex)
-      );
-      if (FAILED(hr))
-      {
-        return false;
-      }
+bool model::ModelAsset::GetPrefetchedGpuMemoryUsage(uint64_t& outBytes) const
+{
+  if (!m_prefetch.completed || !m_prefetch.succeeded || m_prefetch.overallAllocationInfo.SizeInBytes == UINT64_MAX)
+  {
+    return false;
+  }
+  outBytes = m_prefetch.overallAllocationInfo.SizeInBytes;
+  return true;
+}
 
-    }
+bool model::ModelAsset::PrefetchMetadata(const std::filesystem::path& filePath)
+{
+  std::vector<D3D12_RESOURCE_DESC> resourceDescs;
+  uint32_t textureCount = 0;
+  if (!ReadGpuResourceDescs(filePath, resourceDescs, textureCount))
+  {
+    return false;
+  }
 
+  // 配置情報の計算はデバイスのスレッドセーフなメソッドのみで完結する.
+  ComPtr<ID3D12Device4> device4;
+  GetGfxDevice()->GetD3D12Device().As(&device4);
+  m_prefetch.allocationInfos.resize(resourceDescs.size());
+  m_prefetch.overallAllocationInfo = device4->GetResourceAllocationInfo1(
+    0,
+    UINT(resourceDescs.size()),
+    resourceDescs.data(),
+    m_prefetch.allocationInfos.data()
+  );
+  m_prefetch.textureCount = textureCount;
+  return true;
+}
 
-    // ディスクリプタヒープの作成も先に済ませておく.
-    D3D12_DESCRIPTOR_HEAP_DESC descriptorHeapDesc{
-      .Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
-      .NumDescriptors = textureCount,
-      .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE,
-    };
-    hr = device4->CreateDescriptorHeap(&descriptorHeapDesc, IID_PPV_ARGS(&m_localDescriptorHeap));
-    if (FAILED(hr))
-    {
-      return false;
-    }
-    m_isPrepareAllocationMode = true;
+bool model::ModelAsset::CreatePreallocatedHeap()
+{
+  if (m_isPrepareAllocationMode)
+  {
     return true;
   }
-  return false;
+  if (m_isLoadRequested || !m_prefetch.completed || !m_prefetch.succeeded)
+  {
+    return false;
+  }
+  ComPtr<ID3D12Device4> device4;
+  GetGfxDevice()->GetD3D12Device().As(&device4);
+
+  m_overallTextureAllocationInfo = m_prefetch.overallAllocationInfo; // 今回用意したバッファも対応するものにセット.
+  m_textureAllocationInfos = m_prefetch.allocationInfos;             // 今回用意したバッファも対応するものにセット.
+
+  D3D12_HEAP_DESC heapDesc{};
+  heapDesc.Alignment = m_overallTextureAllocationInfo.Alignment;
+  heapDesc.Flags = D3D12_HEAP_FLAG_NONE;
+  heapDesc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+  heapDesc.SizeInBytes = m_overallTextureAllocationInfo.SizeInBytes;
+  HRESULT hr = device4->CreateHeap(&heapDesc, IID_PPV_ARGS(&m_localHeap));
+  if (FAILED(hr))
+  {
+    return false;
+  }
+
+  // ディスクリプタヒープの作成も先に済ませておく.
+  D3D12_DESCRIPTOR_HEAP_DESC descriptorHeapDesc{
+    .Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
+    .NumDescriptors = m_prefetch.textureCount,
+    .Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE,
+  };
+  hr = device4->CreateDescriptorHeap(&descriptorHeapDesc, IID_PPV_ARGS(&m_localDescriptorHeap));
+  if (FAILED(hr))
+  {
+    m_localHeap.Reset();
+    return false;
+  }
+  m_isPrepareAllocationMode = true;
+  return true;
 }
 
-bool model::SimpleModel::IsFinishLoading()
+bool model::ModelAsset::IsFinishLoading()
 {
   return m_isCpuDataLoaded && m_isGpuDataLoaded;
 }
 
-bool model::SimpleModel::IsRenderingPrepared()
+bool model::ModelAsset::IsRenderingPrepared()
 {
   return m_isRenderingPrepared;
 }
 
 // ヘッダ部がロード完了後に呼ばれる.
-void model::SimpleModel::OnHeaderLoaded()
+void model::ModelAsset::OnHeaderLoaded()
 {
+  m_loadRecord.Mark(LoadTelemetry::Stage::HeaderLoaded);
   auto status = m_statusArray->GetHResult(DStorageStatusEntry::Metadata);
   if (FAILED(status))
   {
     // ロードに失敗している.
+    m_isLoadFailed = true;
     return;
   }
   // ヘッダのチェック.
   if (m_header.Version != 0xFFFE)
   {
+    m_isLoadFailed = true;
     return;
   }
 
@@ -578,15 +603,10 @@ void model::SimpleModel::OnHeaderLoaded()
 }
 
 // CPUデータ部のメタデータロード完了後に呼ばれる.
-void model::SimpleModel::OnCpuMetadataLoaded()
+void model::ModelAsset::OnCpuMetadataLoaded()
 {
-  // メタデータ領域のセットアップ.
-  Fixup(m_cpuMetadata, m_cpuMetadata->textures.data);
-  Fixup(m_cpuMetadata, m_cpuMetadata->textureDescs.data);
-  for (uint32_t i = 0; i < m_cpuMetadata->numTextures; ++i)
-  {
-    Fixup(m_cpuMetadata, m_cpuMetadata->textures[i].name);
-  }
+  m_loadRecord.Mark(LoadTelemetry::Stage::MetadataLoaded);
+  RecordRegionSizes();
 
   // GPU用のリソースを確保するための準備を行う.
   if (!m_isPrepareAllocationMode)
@@ -594,11 +614,11 @@ void model::SimpleModel::OnCpuMetadataLoaded()
     auto& gfxDevice = GetGfxDevice();
     ComPtr<ID3D12Device4> device4;
     gfxDevice->GetD3D12Device().As(&device4);
-    m_textureAllocationInfos.resize(m_cpuMetadata->numTextures);
+    m_textureAllocationInfos.resize(m_cpuMetadata.GetTextureCount());
     m_overallTextureAllocationInfo = device4->GetResourceAllocationInfo1(
       0,
-      m_cpuMetadata->numTextures,
-      m_cpuMetadata->textureDescs.data.ptr,
+      m_cpuMetadata.GetTextureCount(),
+      m_cpuMetadata.GetTextureDescs(),
       m_textureAllocationInfos.data());
 
     D3D12_HEAP_DESC heapDesc{
@@ -611,7 +631,7 @@ void model::SimpleModel::OnCpuMetadataLoaded()
 
     D3D12_DESCRIPTOR_HEAP_DESC descriptorHeapDesc{
       .Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
-      .NumDescriptors = m_cpuMetadata->numTextures,
+      .NumDescriptors = m_cpuMetadata.GetTextureCount(),
     };
     device4->CreateDescriptorHeap(&descriptorHeapDesc, IID_PPV_ARGS(&m_localDescriptorHeap));
   }
@@ -631,14 +651,15 @@ void model::SimpleModel::OnCpuMetadataLoaded()
   {
     // GPU用
     auto queue = GetDStorageLoader()->GetQueueGpuMemory();
-    m_textureImages.resize(m_cpuMetadata->numTextures);
-    for (uint32_t i = 0; i < m_cpuMetadata->numTextures; ++i)
+    m_textureImages.resize(m_cpuMetadata.GetTextureCount());
+    for (uint32_t i = 0; i < m_cpuMetadata.GetTextureCount(); ++i)
     {
       m_textureImages[i].resource = EnqueueReadTexture(
         m_localHeap.Get(),
         m_textureAllocationInfos[i].Offset,
-        m_cpuMetadata->textureDescs[i],
-        m_cpuMetadata->textures[i]
+        m_cpuMetadata.GetTextureDesc(i),
+        m_cpuMetadata.GetTexture(i),
+        m_cpuMetadata.GetTextureName(i)
       );
     }
     if (!m_isPrepareAllocationMode)
@@ -652,7 +673,7 @@ void model::SimpleModel::OnCpuMetadataLoaded()
     else
     {
       m_gpuBufferBlock = EnqueueReadBufferRegion(
-        m_localHeap.Get(), m_textureAllocationInfos[m_cpuMetadata->numTextures], m_header.unstructuredGpuData
+        m_localHeap.Get(), m_textureAllocationInfos[m_cpuMetadata.GetTextureCount()], m_header.unstructuredGpuData
       );
     }
     queue->EnqueueStatus(m_statusArray.Get(), DStorageStatusEntry::GpuData);
@@ -680,21 +701,19 @@ void model::SimpleModel::OnCpuMetadataLoaded()
   accumulateSize(m_header.unstructuredGpuData);
   accumulateSize(m_header.cpuData);
   m_dataSizeProperty.texturesByteCount = 0;
-  for (uint32_t textureIndex = 0; textureIndex < m_cpuMetadata->numTextures; ++textureIndex)
+  for (uint32_t textureIndex = 0; textureIndex < m_cpuMetadata.GetTextureCount(); ++textureIndex)
   {
-    auto& texture = m_cpuMetadata->textures[textureIndex];
+    auto& texture = m_cpuMetadata.GetTexture(textureIndex);
     accumulateSize(texture.mipmap);
     m_dataSizeProperty.texturesByteCount += texture.mipmap.uncompressedSize;
   }
 }
 
 // CPU側データのロード完了後に呼ばれる.
-void model::SimpleModel::OnCpuDataLoaded()
+void model::ModelAsset::OnCpuDataLoaded()
 {
-  Fixup(m_cpuData, m_cpuData->sceneGraph.data);
-  Fixup(m_cpuData, m_cpuData->meshes);
-  Fixup(m_cpuData, m_cpuData->materials.data);
-  
+  m_loadRecord.Mark(LoadTelemetry::Stage::CpuDataLoaded);
+  std::vector<std::function<void()>> listeners;
   {
     std::unique_lock lock(m_mutex);
     // CPU側データは処理が完了.
@@ -702,51 +721,78 @@ void model::SimpleModel::OnCpuDataLoaded()
     if (m_isGpuDataLoaded)
     {
       // GPU側データは既に完了状態のため、最終工程を実行.
-      OnAllDataLoaded();
+      listeners = OnAllDataLoaded();
     }
   }
+  NotifyPrepared(listeners);
 }
 
 // GPU側データのロード完了後に呼ばれる.
-void model::SimpleModel::OnGpuDataLoaded()
+void model::ModelAsset::OnGpuDataLoaded()
 {
-  std::unique_lock lock(m_mutex);
-  // GPU側データがロードは完了.
-  m_isGpuDataLoaded = true;
-  if (m_isCpuDataLoaded)
+  m_loadRecord.Mark(LoadTelemetry::Stage::GpuDataLoaded);
+  std::vector<std::function<void()>> listeners;
   {
-    // CPU側データは既に完了状態のため、最終工程を実行.
-    OnAllDataLoaded();
+    std::unique_lock lock(m_mutex);
+    // GPU側データがロードは完了.
+    m_isGpuDataLoaded = true;
+    if (m_isCpuDataLoaded)
+    {
+      // CPU側データは既に完了状態のため、最終工程を実行.
+      listeners = OnAllDataLoaded();
+    }
   }
+  NotifyPrepared(listeners);
 }
 
 // ロード完了後の最後の工程.
 // ロード済みデータからディスクリプタを構築や描画用リソースの準備
-void model::SimpleModel::OnAllDataLoaded()
+// (呼び出し元で m_mutex をロック済み)
+// 通知先のリスナーを取り出して返す. 呼び出し元はロックを解放してから NotifyPrepared で通知する.
+std::vector<std::function<void()>> model::ModelAsset::OnAllDataLoaded()
 {
   auto resultLoadCPU = m_statusArray->GetHResult(uint32_t(DStorageStatusEntry::CpuData));
   auto resultLoadGPU = m_statusArray->GetHResult(uint32_t(DStorageStatusEntry::GpuData));
   if (FAILED(resultLoadCPU) || FAILED(resultLoadGPU))
   {
-    return;
-  }
-
-  if (m_callbackLoadingComplete)
-  {
-    m_callbackLoadingComplete(this);
+    m_isLoadFailed = true;
+    return {};
   }
 
   // 描画用のデータ構築を実行.
   CreateRenderingData();
+  m_loadRecord.Mark(LoadTelemetry::Stage::RenderingPrepared);
+
+  // 準備完了と同じロックの中で取り出すため、以降の AddPreparedListener は直接呼び出しになる.
+  auto listeners = std::move(m_preparedListeners);
+  m_preparedListeners.clear();
+  return listeners;
 }
 
+// 共有しているインスタンスへ通知.
+// リスナーから ModelAsset を呼び出せるよう、m_mutex はロックせずに呼び出す.
+void model::ModelAsset::NotifyPrepared(std::vector<std::function<void()>>& listeners)
+{
+  for (auto& listener : listeners)
+  {
+    listener();
+  }
+}
 
-void model::SimpleModel::SetLoadingCompleteCallback(std::function<void(SimpleModel*)> callback)
+void model::ModelAsset::AddPreparedListener(std::function<void()> listener)
 {
-  m_callbackLoadingComplete = callback;
+  {
+    std::unique_lock lock(m_mutex);
+    if (!m_isRenderingPrepared)
+    {
+      m_preparedListeners.push_back(std::move(listener));
+      return;
+    }
+  }
+  listener();
 }
 
-void model::SimpleModel::CreateRenderingData()
+void model::ModelAsset::CreateRenderingData()
 {
   // TextureDescriptorを作る.
   auto& gfxDevice = GetGfxDevice();
@@ -754,13 +800,13 @@ void model::SimpleModel::CreateRenderingData()
 
   auto increment = gfxDevice->GetD3D12Device()->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
   D3D12_CPU_DESCRIPTOR_HANDLE descriptors = m_localDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
-  for (uint32_t i = 0; i < m_cpuMetadata->numTextures; ++i)
+  for (uint32_t i = 0; i < m_cpuMetadata.GetTextureCount(); ++i)
   {
     D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
     srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
     srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
     srvDesc.Texture2D.MostDetailedMip = 0;
-    srvDesc.Texture2D.MipLevels = m_cpuMetadata->textureDescs[i].MipLevels;
+    srvDesc.Texture2D.MipLevels = m_cpuMetadata.GetTextureDesc(i).MipLevels;
 
     d3d12Device->CreateShaderResourceView(
       m_textureImages[i].resource.Get(),
@@ -768,11 +814,11 @@ void model::SimpleModel::CreateRenderingData()
       CD3DX12_CPU_DESCRIPTOR_HANDLE(descriptors, i, increment)
     );
   }
-  auto numMaterials = m_cpuMetadata->numMaterials;
+  auto numMaterials = m_cpuMetadata.GetMaterialCount();
   m_srvTables.resize(numMaterials);
   for (uint32_t matIdx = 0; matIdx < numMaterials; ++matIdx)
   {
-    const auto& srcMat = m_cpuData->materials[matIdx];
+    const auto& srcMat = m_cpuData.GetMaterial(matIdx);
     D3D12_CPU_DESCRIPTOR_HANDLE cpuDescriptors[model::kNumTextures] =
     {
       gDefaultTextures.descriptors[DefaultTextures::kDefaultWhite],
@@ -799,27 +845,14 @@ void model::SimpleModel::CreateRenderingData()
     m_srvTables[matIdx] = baseHandle;
   }
 
-  // 定数バッファの支度.
-  const auto cpuDataHeader = m_cpuData.Get();
-  const auto cpuMetadataHeader = m_cpuMetadata.Get();
-  auto meshConstantBufferSize = cpuDataHeader->numSceneGraphNodes * sizeof(MeshConstants);
-  auto resDesc = CD3DX12_RESOURCE_DESC::Buffer(meshConstantBufferSize);
-  m_meshConstantsCPU = gfxDevice->CreateBuffer(resDesc, D3D12_HEAP_TYPE_UPLOAD);
-  m_meshConstantsGPU = gfxDevice->CreateBuffer(resDesc, D3D12_HEAP_TYPE_DEFAULT);
-
   auto gpuBufferBaseAddress = m_gpuBufferBlock->GetGPUVirtualAddress();
-  auto materialConstantsGpuOffset = cpuDataHeader->materialConstantsGpuOffset;
-  auto textureCount = cpuMetadataHeader->numTextures;
-  auto materialCount = cpuMetadataHeader->numMaterials;
-  auto meshCount = cpuDataHeader->numMeshes;
+  auto materialConstantsGpuOffset = m_cpuData.GetMaterialConstantsGpuOffset();
+  auto meshCount = m_cpuData.GetMeshCount();
 
-  auto GetMeshPtr = [&](auto index){
-    return reinterpret_cast<const model::Mesh*>(m_cpuData.Get()->meshes.ptr)[index];
-  };
   // 描画用メッシュ情報の構築.
   for (uint32_t i = 0; i < meshCount; ++i)
   {
-    const auto& srcMesh = GetMeshPtr(i);
+    const auto& srcMesh = m_cpuData.GetMesh(i);
     auto& dstMesh = m_meshes.emplace_back();
     dstMesh.vbOffset = srcMesh.vbOffset;
     dstMesh.vbSize = srcMesh.vbSize;
@@ -828,100 +861,237 @@ void model::SimpleModel::CreateRenderingData()
     dstMesh.vbStride = srcMesh.vbStride;
     dstMesh.draw.primitiveCount = dstMesh.ibSize / sizeof(uint32_t);
     dstMesh.drawMode = srcMesh.drawMode;
+    dstMesh.aabbMin = srcMesh.aabbMin;
+    dstMesh.aabbMax = srcMesh.aabbMax;
 
     auto materialIndex = srcMesh.materialCBV;
     auto meshIndex = srcMesh.meshCBV;
-    dstMesh.meshCBV = m_meshConstantsGPU->GetGPUVirtualAddress() + sizeof(MeshConstants) * meshIndex;
+    dstMesh.meshConstantsIndex = meshIndex;
     dstMesh.materialCBV = gpuBufferBaseAddress + materialConstantsGpuOffset + sizeof(MaterialConstantData) * materialIndex;
 
     dstMesh.textureHandles = m_srvTables[materialIndex];
     dstMesh.samplerHandles = gDefaultTextures.defaultSampler;
   }
-  for (uint32_t i = 0; i < cpuDataHeader->numSceneGraphNodes; ++i)
+  m_isRenderingPrepared = true;
+}
+
+uint32_t model::ModelAsset::GetSceneGraphNodeCount() const
+{
+  return m_cpuData.GetSceneGraphNodeCount();
+}
+
+const model::GraphNode* model::ModelAsset::GetSceneGraph() const
+{
+  return m_cpuData.GetSceneGraph();
+}
+
+model::ModelAsset::GpuMemoryUsage model::ModelAsset::GetGpuMemoryUsage() const
+{
+  GpuMemoryUsage usage{};
+  if (m_localHeap)
   {
-    m_sceneGraph.push_back(cpuDataHeader->sceneGraph[i]);
+    // 事前確保モードではバッファもこのヒープ内に配置されている.
+    usage.texturesByteCount = m_localHeap->GetDesc().SizeInBytes;
   }
-  UpdateMatrices(XMMatrixIdentity());
-  m_isRenderingPrepared = true;
+  if (m_gpuBufferBlock && !m_isPrepareAllocationMode)
+  {
+    usage.buffersByteCount = m_gpuBufferBlock->GetDesc().Width;
+  }
+  return usage;
 }
 
-void model::SimpleModel::UpdateMatrices(DirectX::XMMATRIX transform)
+void model::ModelAsset::GetModelAABB(DirectX::XMFLOAT3& aabbMin, DirectX::XMFLOAT3& aabbMax) const
 {
-  if (m_sceneGraph.empty()) { return; }
-  assert(m_sceneGraph[0].parentIndex == UINT32_MAX);
+  aabbMin = m_header.aabbMin;
+  aabbMax = m_header.aabbMax;
+}
 
-  for (uint32_t i = 0; i < m_sceneGraph.size(); ++i)
+model::SimpleModel::SimpleModel()
+{
+}
+
+model::SimpleModel::~SimpleModel()
+{
+}
+
+bool model::SimpleModel::AcquireAsset(const std::filesystem::path& filePath)
+{
+  if (!m_asset)
   {
-    auto& node = m_sceneGraph[i];
-    XMMATRIX mtxLocal = XMLoadFloat4x4(&node.xform);
-    XMMATRIX mtxParent = transform;
-    if (node.parentIndex != UINT32_MAX)
-    {
-      const auto& parent = m_sceneGraph[node.parentIndex];
-      mtxParent = XMLoadFloat4x4(&parent.worldTransform);
-    }
-    XMMATRIX mtxWorld = XMMatrixMultiply(mtxLocal, mtxParent);
-    XMStoreFloat4x4(&node.worldTransform, mtxWorld);
+    m_asset = GetModelAssetCache()->Acquire(filePath);
   }
+  return m_asset != nullptr;
 }
 
-void model::SimpleModel::SubmitMatrices(ComPtr<ID3D12GraphicsCommandList> commandList)
+bool model::SimpleModel::RequestLoad(std::filesystem::path filePath)
 {
-  auto& gfxDevice = GetGfxDevice();
-  void* p = nullptr;
-  m_meshConstantsCPU->Map(0, nullptr, &p);
-  if (p)
+  if (!AcquireAsset(filePath))
+  {
+    m_isRequestFailed = true;
+    return false;
+  }
+  if (!m_asset->IsLoadRequested())
   {
-    MeshConstants* meshConstants = reinterpret_cast<MeshConstants*>(p);
-    for (uint32_t i = 0; i < m_sceneGraph.size(); ++i)
+    if (!m_asset->RequestLoad(filePath))
     {
-      auto mtx = XMLoadFloat4x4(&m_sceneGraph[i].worldTransform);
-      XMStoreFloat4x4(&meshConstants[i].mtxWorld, XMMatrixTranspose(mtx));  // 転置して転送.
+      return false;
     }
-    m_meshConstantsCPU->Unmap(0, nullptr);
   }
-  UINT64 bufferSize = m_meshConstantsCPU->GetDesc().Width;
-  D3D12_RESOURCE_BARRIER before = CD3DX12_RESOURCE_BARRIER::Transition(
-    m_meshConstantsGPU.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_DEST);
-  D3D12_RESOURCE_BARRIER after = CD3DX12_RESOURCE_BARRIER::Transition(
-    m_meshConstantsGPU.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
-  commandList->ResourceBarrier(1, &before);
-  commandList->CopyBufferRegion(m_meshConstantsGPU.Get(), 0, m_meshConstantsCPU.Get(), 0, bufferSize);
-  commandList->ResourceBarrier(1, &after);
+  // データ本体の準備が整った後で、インスタンス固有のデータを作成する.
+  std::weak_ptr<SimpleModel> weakThis = shared_from_this();
+  m_asset->AddPreparedListener([weakThis]() {
+    if (auto self = weakThis.lock())
+    {
+      self->CreateInstanceData();
+    }
+  });
+  return true;
 }
 
-void model::SimpleModel::Draw(ComPtr<ID3D12GraphicsCommandList> commandList, DrawMode drawMode)
+bool model::SimpleModel::RequestLoadHeaderOnly(std::filesystem::path filePath)
 {
-  for (const auto& mesh : m_meshes)
+  if (!AcquireAsset(filePath))
   {
-    if (drawMode != mesh.drawMode)
-    {
-      continue;
-    }
-    D3D12_INDEX_BUFFER_VIEW ibv{};
-    ibv.BufferLocation = m_gpuBufferBlock->GetGPUVirtualAddress() + mesh.ibOffset;
-    ibv.Format = DXGI_FORMAT_R32_UINT;
-    ibv.SizeInBytes = mesh.ibSize;
-    commandList->IASetIndexBuffer(&ibv);
+    m_isRequestFailed = true;
+    return false;
+  }
+  if (m_asset->IsLoadRequested() || m_asset->IsHeaderLoadRequested())
+  {
+    // 共有しているデータは既にロード処理中.
+    return true;
+  }
+  return m_asset->RequestLoadHeaderOnly(filePath);
+}
+
+bool model::SimpleModel::IsMetadataPrefetched() const
+{
+  if (!m_asset)
+  {
+    // 要求に失敗したものは待つ必要がない.
+    return m_isRequestFailed;
+  }
+  // 先読みを要求していないもの、既にロード中のものは待つ必要がない.
+  return m_asset->IsLoadRequested() || !m_asset->IsHeaderLoadRequested() || m_asset->IsMetadataPrefetched();
+}
+
+bool model::SimpleModel::CreatePreallocatedHeap()
+{
+  return m_asset && m_asset->CreatePreallocatedHeap();
+}
+
+bool model::SimpleModel::IsFinishLoading()
+{
+  return m_asset && m_asset->IsFinishLoading();
+}
 
-    D3D12_VERTEX_BUFFER_VIEW vbv{};
-    vbv.BufferLocation = m_gpuBufferBlock->GetGPUVirtualAddress() + mesh.vbOffset;
-    vbv.SizeInBytes = mesh.vbSize;
-    vbv.StrideInBytes = mesh.vbStride;
-    commandList->IASetVertexBuffers(0, 1, &vbv);
+bool model::SimpleModel::IsRenderingPrepared()
+{
+  return m_isRenderingPrepared;
+}
 
-    commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    commandList->SetGraphicsRootConstantBufferView(1, mesh.meshCBV);
-    commandList->SetGraphicsRootConstantBufferView(2, mesh.materialCBV);
-    commandList->SetGraphicsRootDescriptorTable(3, mesh.textureHandles.hGpu);
-    commandList->SetGraphicsRootDescriptorTable(4, mesh.samplerHandles.hGpu);
+bool model::SimpleModel::IsLoadFailed() const
+{
+  return m_isRequestFailed || (m_asset && m_asset->IsLoadFailed());
+}
 
-    commandList->DrawIndexedInstanced(mesh.draw.primitiveCount, 1, 0, 0, 0);
+void model::SimpleModel::SetLoadingCompleteCallback(std::function<void(SimpleModel*)> callback)
+{
+  m_callbackLoadingComplete = callback;
+}
+
+void model::SimpleModel::CreateInstanceData()
+{
+  // 行列は SoA 形式で保持する.
+  // GPU へはインスタンス描画用のバッファとしてフレーム毎にまとめて転送するため、個別のバッファは持たない.
+  auto nodeCount = m_asset->GetSceneGraphNodeCount();
+  auto sceneGraph = m_asset->GetSceneGraph();
+  std::vector<XMFLOAT4X4> localMatrices(nodeCount);
+  std::vector<uint32_t> parentIndices(nodeCount);
+  for (uint32_t i = 0; i < nodeCount; ++i)
+  {
+    localMatrices[i] = sceneGraph[i].xform;
+    parentIndices[i] = sceneGraph[i].parentIndex;
+  }
+  m_transforms.Initialize(localMatrices, parentIndices);
+  UpdateMatrices(XMMatrixIdentity());
+  m_isRenderingPrepared = true;
+
+  // 描画可能になった後で通知する.
+  if (m_callbackLoadingComplete)
+  {
+    m_callbackLoadingComplete(this);
   }
 }
 
+void model::SimpleModel::UpdateMatrices(DirectX::XMMATRIX transform)
+{
+  m_transforms.UpdateWorld(transform);
+}
+
+void model::SimpleModel::GetWorldAABB(DirectX::XMFLOAT3& aabbMin, DirectX::XMFLOAT3& aabbMax) const
+{
+  // ヘッダの AABB は各メッシュのノードローカルの AABB を合わせたもので、ノードの変換を含まない.
+  // そのため各メッシュの AABB をノードのワールド行列で変換して合わせる.
+  const auto& meshes = m_asset->GetMeshes();
+  if (meshes.empty())
+  {
+    XMFLOAT3 localMin, localMax;
+    m_asset->GetModelAABB(localMin, localMax);
+    culling_math::TransformAabb(localMin, localMax, m_transforms.GetRootTransform(), aabbMin, aabbMax);
+    return;
+  }
+  aabbMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+  aabbMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+  for (const auto& mesh : meshes)
+  {
+    culling_math::MergeTransformedAabb(mesh.aabbMin, mesh.aabbMax, m_transforms.GetWorldMatrix(mesh.meshConstantsIndex), aabbMin, aabbMax);
+  }
+}
+
+void model::SimpleModel::AddMeshBounds(AabbCullingList& bounds) const
+{
+  for (const auto& mesh : m_asset->GetMeshes())
+  {
+    bounds.Add(mesh.aabbMin, mesh.aabbMax, m_transforms.GetWorldMatrix(mesh.meshConstantsIndex));
+  }
+}
+
+model::DrawMode model::SimpleModel::GetMeshDrawMode(uint32_t meshIndex) const
+{
+  return m_asset->GetMeshes()[meshIndex].drawMode;
+}
+
+void model::SimpleModel::AddInstance(InstanceBatcher& batcher, uint32_t meshIndex, float viewDepth, uint32_t transformOffset) const
+{
+  const auto& mesh = m_asset->GetMeshes()[meshIndex];
+  if (mesh.drawMode == DrawModeUnknown)
+  {
+    return;
+  }
+  auto gpuBufferAddress = m_asset->GetGpuBufferAddress();
+  DrawPacket packet;
+  packet.indexBufferAddress = gpuBufferAddress + mesh.ibOffset;
+  packet.indexBufferSize = mesh.ibSize;
+  packet.vertexBufferAddress = gpuBufferAddress + mesh.vbOffset;
+  packet.vertexBufferSize = mesh.vbSize;
+  packet.vertexStride = mesh.vbStride;
+  packet.materialConstants = mesh.materialCBV;
+  packet.textureTable = mesh.textureHandles.hGpu.ptr;
+  packet.samplerTable = mesh.samplerHandles.hGpu.ptr;
+  packet.indexCount = mesh.draw.primitiveCount;
+  packet.pipeline = mesh.drawMode - DrawModeOpaque;
+  // 共有アセット内のメッシュのアドレスで同一メッシュを判別する.
+  batcher.Add(reinterpret_cast<uint64_t>(&mesh), packet, transformOffset + mesh.meshConstantsIndex,
+    viewDepth, mesh.drawMode == DrawModeBlend);
+}
+
+model::ModelAsset::GpuMemoryUsage model::SimpleModel::GetGpuMemoryUsage() const
+{
+  // 行列はアプリケーション側の共有の行列バッファに置くため、個別の確保はない.
+  return ModelAsset::GpuMemoryUsage{};
+}
+
 void model::SimpleModel::GetModelAABB(DirectX::XMFLOAT3& aabbMin, DirectX::XMFLOAT3& aabbMax)
 {
-  aabbMin = m_header.aabbMin;
-  aabbMax = m_header.aabbMax;
+  m_asset->GetModelAABB(aabbMin, aabbMax);
 }
\ No newline at end of file
@@ -14,6 +14,11 @@
 #include "GfxDevice.h"
 #include "EventWait.h"
 #include "DStorageLoader.h"
+#include "MappedFile.h"
+#include "LoadTelemetry.h"
+#include "SceneTransforms.h"
+#include "InstanceBatcher.h"
+#include "FrustumCulling.h"
 
 namespace model
 {
@@ -28,18 +33,12 @@ namespace model
     uint64_t offset;
     T* ptr;
   };
+  // 要素へは MemoryRegion::Resolve 経由でアクセスする.
+  // 領域をマップして参照する場合があるため、ポインタとしては扱わない.
   template<typename T>
   struct FixedArray
   {
     Ptr<T> data;
-    T& operator[](size_t index)
-    {
-      return data.ptr[index];
-    }
-    T const& operator[](size_t index) const
-    {
-      return data.ptr[index];
-    }
   };
   enum class DataCompressionType : uint32_t
   {
@@ -58,33 +57,43 @@ namespace model
   };
   using GpuRegion = Region<void>;
 
+  // CPU 側のデータ領域.
+  // Ptr のオフセットは書き換えず、アクセス時に領域先頭からの位置として解決する.
+  // 非圧縮のデータは読み取り専用でマップしたファイルを直接参照する.
   template<typename T>
   class MemoryRegion
   {
     std::unique_ptr<char[]> m_buffer;
+    std::shared_ptr<const MappedFile> m_mappedFile;
+    const char* m_base = nullptr;
   public:
     MemoryRegion() = default;
-    MemoryRegion(std::unique_ptr<char[]> buffer) : m_buffer(std::move(buffer)) {}
+    MemoryRegion(std::unique_ptr<char[]> buffer) : m_buffer(std::move(buffer)), m_base(m_buffer.get()) {}
+    MemoryRegion(std::shared_ptr<const MappedFile> mappedFile, uint64_t offset)
+      : m_mappedFile(std::move(mappedFile)), m_base(m_mappedFile->Data() + offset) {}
+    // 展開先の書き込み可能な領域. マップしている場合は nullptr.
     char* Data() { return m_buffer.get(); }
-    T* Get()
+    bool IsMapped() const { return m_mappedFile != nullptr; }
+    const T* Get() const
     {
-      return reinterpret_cast<T*>(m_buffer.get());
+      return reinterpret_cast<const T*>(m_base);
     }
-    const T* Get() const
+    T const* operator->() const
     {
-      return reinterpret_cast<const T*>(m_buffer.get());
+      return reinterpret_cast<const T*>(m_base);
     }
-    T* operator->()
+    template<typename U>
+    const U* Resolve(const Ptr<U>& ptr) const
     {
-      return reinterpret_cast<T*>(m_buffer.get());
+      return reinterpret_cast<const U*>(m_base + ptr.offset);
     }
-    T const* operator->() const
+    template<typename U>
+    const U& Resolve(const FixedArray<U>& array, size_t index) const
     {
-      return reinterpret_cast<const T*>(m_buffer.get());
+      return Resolve(array.data)[index];
     }
   };
 
-
   struct DefaultTextures
   {
     enum {
@@ -191,6 +200,42 @@ namespace model
     DirectX::XMFLOAT3 aabbMin, aabbMax{1.0f,1.0f,1.0f};
   };
 
+  // CpuMetadataHeader へのアクセス用.
+  class CpuMetadataView
+  {
+  public:
+    CpuMetadataView() = default;
+    CpuMetadataView(MemoryRegion<CpuMetadataHeader> region) : m_region(std::move(region)) {}
+
+    uint32_t GetTextureCount() const { return m_region->numTextures; }
+    uint32_t GetMaterialCount() const { return m_region->numMaterials; }
+    const TextureMetadata& GetTexture(uint32_t index) const { return m_region.Resolve(m_region->textures, index); }
+    const char* GetTextureName(uint32_t index) const { return m_region.Resolve(GetTexture(index).name); }
+    const D3D12_RESOURCE_DESC* GetTextureDescs() const { return m_region.Resolve(m_region->textureDescs.data); }
+    const D3D12_RESOURCE_DESC& GetTextureDesc(uint32_t index) const { return GetTextureDescs()[index]; }
+    bool IsMapped() const { return m_region.IsMapped(); }
+  private:
+    MemoryRegion<CpuMetadataHeader> m_region;
+  };
+
+  // CpuDataHeader へのアクセス用.
+  class CpuDataView
+  {
+  public:
+    CpuDataView() = default;
+    CpuDataView(MemoryRegion<CpuDataHeader> region) : m_region(std::move(region)) {}
+
+    uint32_t GetSceneGraphNodeCount() const { return m_region->numSceneGraphNodes; }
+    const GraphNode* GetSceneGraph() const { return m_region.Resolve(m_region->sceneGraph.data); }
+    uint32_t GetMeshCount() const { return m_region->numMeshes; }
+    const Mesh& GetMesh(uint32_t index) const { return reinterpret_cast<const Mesh*>(m_region.Resolve(m_region->meshes))[index]; }
+    uint32_t GetMaterialConstantsGpuOffset() const { return m_region->materialConstantsGpuOffset; }
+    const MaterialTextureData& GetMaterial(uint32_t index) const { return m_region.Resolve(m_region->materials, index); }
+    bool IsMapped() const { return m_region.IsMapped(); }
+  private:
+    MemoryRegion<CpuDataHeader> m_region;
+  };
+
   struct ModelData
   {
     std::vector<byte>   geometryData;
@@ -208,45 +253,48 @@ namespace model
   };
 
  
-  class SimpleModel
+  // pak ファイル1つ分のロード済みデータ.
+  // GPU/CPU 上の不変データのみを持ち、同じファイルを参照するインスタンス間で共有される.
+  class ModelAsset : public std::enable_shared_from_this<ModelAsset>
   {
     template<typename T>
     using ComPtr = Microsoft::WRL::ComPtr<T>;
     using Buffer = ComPtr<ID3D12Resource1>;
 
   public:
-    SimpleModel();
-    ~SimpleModel();
+    ModelAsset();
+    ~ModelAsset();
 
     // --------------------------------
     // ロード系.
     // --------------------------------
     // DirectStorage経由でデータをロード.
     bool RequestLoad(std::filesystem::path filePath);
+    // 事前確保モードと推定サイズの計算用に、ヘッダとメタデータを非同期で先読みする.
+    // IsMetadataPrefetched() が true になってから CreatePreallocatedHeap, RequestLoad の順に呼ぶこと.
     bool RequestLoadHeaderOnly(std::filesystem::path filePath);
-
+    bool IsMetadataPrefetched() const { return m_prefetch.completed; }
+    // 先読みした配置情報からヒープとディスクリプタヒープを作成する. RequestLoad の前に呼び出すこと.
+    // 作成できた場合、RequestLoad は事前確保モードでロードする.
+    bool CreatePreallocatedHeap();
+    // ロード要求が既に発行済みか.
+    bool IsLoadRequested() const { return m_isLoadRequested; }
+    bool IsHeaderLoadRequested() const { return m_isHeaderLoadRequested; }
+    // 先読みした配置情報から、ロード時に VRAM 上へ確保するサイズを求める.
+    // 先読みが完了していない、または失敗している場合は false.
+    bool GetPrefetchedGpuMemoryUsage(uint64_t& outBytes) const;
 
     bool IsFinishLoading();
     bool IsRenderingPrepared();
+    // ロードに失敗したか. 失敗したものは描画準備完了にならない.
+    bool IsLoadFailed() const { return m_isLoadFailed; }
 
-    // --------------------------------
-    // 描画系.
-    // --------------------------------
-    // 行列データの更新.
-    void UpdateMatrices(DirectX::XMMATRIX transform);
-    // 行列データを GPU (VRAM) へコピー転送.
-    void SubmitMatrices(ComPtr<ID3D12GraphicsCommandList> commandList);
-
-    // 描画コマンドの発行.
-    void Draw(ComPtr<ID3D12GraphicsCommandList> commandList, DrawMode drawMode);
-
-    void GetModelAABB(DirectX::XMFLOAT3& aabbMin, DirectX::XMFLOAT3& aabbMax);
-
-    // サンプル用 固有データなど.
-    DirectX::XMVECTOR m_tumbleAxis;
-    float m_tumbleAngle = 0.0f;
+    // 描画用データの準備完了時に呼ばれる関数を登録. 準備済みであれば即座に呼ばれる.
+    void AddPreparedListener(std::function<void()> listener);
 
-    void SetLoadingCompleteCallback(std::function<void(SimpleModel*)> callback);
+    void GetModelAABB(DirectX::XMFLOAT3& aabbMin, DirectX::XMFLOAT3& aabbMax) const;
+    uint32_t GetSceneGraphNodeCount() const;
+    const GraphNode* GetSceneGraph() const;
 
     struct DataSizeProperty
     {
@@ -256,13 +304,20 @@ namespace model
       size_t GDeflateByteCount;
       size_t uncompressedByteCount;
     } m_dataSizeProperty;
-  private:
-    void CreateRenderingData();
-    
-    __declspec(align(256)) struct MeshConstants
+
+    // VRAM 上に確保しているサイズ.
+    struct GpuMemoryUsage
     {
-      XMFLOAT4X4 mtxWorld;
+      size_t texturesByteCount;
+      size_t buffersByteCount;
+      size_t constantsByteCount;
+      size_t Total() const { return texturesByteCount + buffersByteCount + constantsByteCount; }
     };
+    GpuMemoryUsage GetGpuMemoryUsage() const;
+
+    // ロード工程の計測結果. IsRenderingPrepared() が true になった後に参照すること.
+    const LoadTelemetry::Record& GetLoadRecord() const { return m_loadRecord; }
+
     // 描画用メッシュの情報.
     struct MeshInstance
     {
@@ -279,7 +334,8 @@ namespace model
         uint32_t baseVertex;
       } draw;
 
-      D3D12_GPU_VIRTUAL_ADDRESS meshCBV;
+      uint32_t meshConstantsIndex;  // インスタンス側の行列 (SceneTransforms) 内の位置.
+      XMFLOAT3 aabbMin, aabbMax;    // ノードのローカル空間での AABB (カリング用).
       D3D12_GPU_VIRTUAL_ADDRESS materialCBV;
 
       GfxDevice::DescriptorHandle textureHandles;
@@ -287,13 +343,20 @@ namespace model
 
       DrawMode drawMode;
     };
+    const std::vector<MeshInstance>& GetMeshes() const { return m_meshes; }
+    D3D12_GPU_VIRTUAL_ADDRESS GetGpuBufferAddress() const { return m_gpuBufferBlock->GetGPUVirtualAddress(); }
+
+  private:
+    void CreateRenderingData();
+    bool PrefetchMetadata(const std::filesystem::path& filePath);
+    void RecordRegionSizes();
+
     struct Texture
     {
       ComPtr<ID3D12Resource1> resource;
       D3D12_CPU_DESCRIPTOR_HANDLE cpuDescriptor;
     };
     std::vector<MeshInstance> m_meshes;
-    std::vector<GraphNode>    m_sceneGraph;
     std::vector<std::string>  m_nodeNames;
     std::vector<std::string>  m_textureNames;
     std::vector<Texture>      m_textureImages;
@@ -304,16 +367,17 @@ namespace model
     std::vector<D3D12_RESOURCE_ALLOCATION_INFO1> m_textureAllocationInfos;
     D3D12_RESOURCE_ALLOCATION_INFO m_overallTextureAllocationInfo;
     std::atomic<bool> m_isRenderingPrepared = false;
+    std::atomic<bool> m_isLoadRequested = false;
+    std::atomic<bool> m_isHeaderLoadRequested = false;
+    std::atomic<bool> m_isLoadFailed = false;
     bool m_isPrepareAllocationMode = false;
 
     // モデルデータ関連.
     Header m_header = { };
-    MemoryRegion<CpuMetadataHeader> m_cpuMetadata;  // CPUデータに関するメタデータ情報.
-    MemoryRegion<CpuDataHeader>     m_cpuData;
-    MemoryRegion<void> m_gpuUnstructuredData;
+    CpuMetadataView m_cpuMetadata;  // CPUデータに関するメタデータ情報.
+    CpuDataView     m_cpuData;
+    std::shared_ptr<const MappedFile> m_mappedFile;  // 非圧縮の CPU データ参照用.
 
-    Buffer m_meshConstantsCPU;
-    Buffer m_meshConstantsGPU;
     Buffer m_materialConstants;
     Buffer m_gpuBufferBlock;
 
@@ -323,7 +387,7 @@ namespace model
     template<typename T>
     MemoryRegion<T> EnqueueReadMemoryRegion(model::Region<T>const& region);
     Buffer EnqueueReadBufferRegion(ID3D12Heap* heap, uint64_t offset, const model::GpuRegion& region);
-    ComPtr<ID3D12Resource1> EnqueueReadTexture(ID3D12Heap* heap, uint64_t offset, const D3D12_RESOURCE_DESC& desc, const model::TextureMetadata& textureMetadata);
+    ComPtr<ID3D12Resource1> EnqueueReadTexture(ID3D12Heap* heap, uint64_t offset, const D3D12_RESOURCE_DESC& desc, const model::TextureMetadata& textureMetadata, const char* name);
 
     Buffer EnqueueReadBufferRegion(ID3D12Heap* heap, const D3D12_RESOURCE_ALLOCATION_INFO1& allocationInfo, const model::GpuRegion& region);
 
@@ -345,13 +409,97 @@ namespace model
     void OnCpuMetadataLoaded();
     void OnCpuDataLoaded();
     void OnGpuDataLoaded();
-    void OnAllDataLoaded();
+    std::vector<std::function<void()>> OnAllDataLoaded();
+    void NotifyPrepared(std::vector<std::function<void()>>& listeners);
 
     std::mutex m_mutex;
     std::atomic<bool> m_isMeatadataLoaded = false;
     std::atomic<bool> m_isCpuDataLoaded = false;
     std::atomic<bool> m_isGpuDataLoaded = false;
 
+    std::vector<std::function<void()>> m_preparedListeners;
+    LoadTelemetry::Record m_loadRecord;
+
+    // 事前確保モードでの先読み結果.
+    struct PrefetchInfo
+    {
+      std::atomic<bool> completed = false;
+      std::atomic<bool> succeeded = false;
+      uint32_t textureCount = 0;
+      std::vector<D3D12_RESOURCE_ALLOCATION_INFO1> allocationInfos;
+      D3D12_RESOURCE_ALLOCATION_INFO overallAllocationInfo{};
+    } m_prefetch;
+  };
+
+  // 配置されたモデル1つ分.
+  // 行列など個別の状態のみを持ち、データ本体は ModelAsset を共有する.
+  class SimpleModel : public std::enable_shared_from_this<SimpleModel>
+  {
+    template<typename T>
+    using ComPtr = Microsoft::WRL::ComPtr<T>;
+    using Buffer = ComPtr<ID3D12Resource1>;
+
+  public:
+    SimpleModel();
+    ~SimpleModel();
+
+    // --------------------------------
+    // ロード系.
+    // --------------------------------
+    // DirectStorage経由でデータをロード.
+    // 同じファイルがロード済み(ロード中)であれば、そのデータを共有する.
+    bool RequestLoad(std::filesystem::path filePath);
+    bool RequestLoadHeaderOnly(std::filesystem::path filePath);
+    // 先読みが完了しており RequestLoad を呼べる状態か.
+    bool IsMetadataPrefetched() const;
+    // 先読みした配置情報からヒープを作成. 共有データが作成済み・ロード中であれば何もしない.
+    bool CreatePreallocatedHeap();
+
+    bool IsFinishLoading();
+    bool IsRenderingPrepared();
+    // ロード要求の発行、または共有データのロードに失敗したか.
+    bool IsLoadFailed() const;
+
+    // --------------------------------
+    // 描画系.
+    // --------------------------------
+    // 行列データの更新.
+    void UpdateMatrices(DirectX::XMMATRIX transform);
+    // 複数モデルをまとめて更新する場合に使用.
+    SceneTransforms& GetTransforms() { return m_transforms; }
+
+    // モデル全体の AABB をワールド空間で取得. 各メッシュの AABB をノードの行列で変換して合わせたもの.
+    void GetWorldAABB(DirectX::XMFLOAT3& aabbMin, DirectX::XMFLOAT3& aabbMax) const;
+    // カリング用に、全メッシュの AABB をワールド空間でメッシュ順に登録.
+    void AddMeshBounds(AabbCullingList& bounds) const;
+    // 描画するメッシュの追加. 同じアセットを共有するモデルの同じメッシュは 1 回の描画にまとめられる.
+    // viewDepth はメッシュのビュー空間での深度.
+    // transformOffset は行列バッファ内でこのモデルのノード 0 の行列を置いた位置.
+    void AddInstance(InstanceBatcher& batcher, uint32_t meshIndex, float viewDepth, uint32_t transformOffset) const;
+    // メッシュの描画モード. 遮蔽物には不透明のものだけを使う.
+    DrawMode GetMeshDrawMode(uint32_t meshIndex) const;
+
+    void GetModelAABB(DirectX::XMFLOAT3& aabbMin, DirectX::XMFLOAT3& aabbMax);
+
+    // サンプル用 固有データなど.
+    DirectX::XMVECTOR m_tumbleAxis;
+    float m_tumbleAngle = 0.0f;
+
+    void SetLoadingCompleteCallback(std::function<void(SimpleModel*)> callback);
+
+    std::shared_ptr<const ModelAsset> GetAsset() const { return m_asset; }
+
+    // 本インスタンスが個別に VRAM 上に確保しているサイズ (共有データは含まない).
+    ModelAsset::GpuMemoryUsage GetGpuMemoryUsage() const;
+  private:
+    bool AcquireAsset(const std::filesystem::path& filePath);
+    void CreateInstanceData();
+
+    std::shared_ptr<ModelAsset> m_asset;
+    SceneTransforms m_transforms;
+    std::atomic<bool> m_isRenderingPrepared = false;
+    bool m_isRequestFailed = false;
+
     std::function<void(SimpleModel*)> m_callbackLoadingComplete;
   };
 }
@@ -0,0 +1,70 @@
+﻿#include "ModelAssetCache.h"
+#include <Windows.h>
+#include <format>
+
+static std::unique_ptr<ModelAssetCache> gModelAssetCache;
+
+std::unique_ptr<ModelAssetCache>& GetModelAssetCache()
+{
+  if (gModelAssetCache == nullptr)
+  {
+    gModelAssetCache = std::make_unique<ModelAssetCache>();
+  }
+  return gModelAssetCache;
+}
+
+std::shared_ptr<model::ModelAsset> ModelAssetCache::Acquire(const std::filesystem::path& filePath)
+{
+  auto key = MakeFileKey(filePath);
+
+  std::lock_guard lock(m_mutex);
+  auto itr = m_assets.find(key);
+  if (itr != m_assets.end())
+  {
+    if (auto asset = itr->second.lock())
+    {
+      m_stats.hitCount++;
+      return asset;
+    }
+  }
+  m_stats.missCount++;
+  auto asset = std::make_shared<model::ModelAsset>();
+  m_assets[key] = asset;
+  return asset;
+}
+
+void ModelAssetCache::Clear()
+{
+  std::lock_guard lock(m_mutex);
+  m_assets.clear();
+  m_stats = Stats{};
+}
+
+ModelAssetCache::Stats ModelAssetCache::GetStats()
+{
+  std::lock_guard lock(m_mutex);
+  // 解放済みのエントリはここで掃除しておく.
+  std::erase_if(m_assets, [](const auto& kv) { return kv.second.expired(); });
+  m_stats.liveAssetCount = uint32_t(m_assets.size());
+  return m_stats;
+}
+
+std::wstring ModelAssetCache::MakeFileKey(const std::filesystem::path& filePath)
+{
+  HANDLE hFile = CreateFileW(filePath.c_str(), 0,
+    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (hFile != INVALID_HANDLE_VALUE)
+  {
+    BY_HANDLE_FILE_INFORMATION info{};
+    auto success = GetFileInformationByHandle(hFile, &info);
+    CloseHandle(hFile);
+    if (success)
+    {
+      return std::format(L"{:08x}:{:08x}{:08x}", info.dwVolumeSerialNumber, info.nFileIndexHigh, info.nFileIndexLow);
+    }
+  }
+  // ファイル情報が取れない場合はパスで判定する.
+  std::error_code ec;
+  auto canonicalPath = std::filesystem::weakly_canonical(filePath, ec);
+  return ec ? filePath.wstring() : canonicalPath.wstring();
+}
@@ -0,0 +1,37 @@
+﻿#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+#include <filesystem>
+#include <unordered_map>
+
+#include "Model.h"
+
+// 同じ pak ファイルを参照するモデル間でロード済みデータを共有するためのキャッシュ.
+// 参照が無くなったデータは自動的に解放され、次回の要求で再ロードされる.
+class ModelAssetCache
+{
+public:
+  // ファイルに対応するアセットを取得. 未登録(解放済み)であれば新規作成する.
+  // 新規作成時はロード要求を発行していない状態で返す.
+  std::shared_ptr<model::ModelAsset> Acquire(const std::filesystem::path& filePath);
+  void Clear();
+
+  struct Stats
+  {
+    uint64_t hitCount = 0;
+    uint64_t missCount = 0;
+    uint32_t liveAssetCount = 0;  // 現在共有中のアセット数.
+  };
+  Stats GetStats();
+
+private:
+  // ハードリンクや相対パスの違いでも同一と判定できるようファイルIDをキーとする.
+  static std::wstring MakeFileKey(const std::filesystem::path& filePath);
+
+  std::mutex m_mutex;
+  std::unordered_map<std::wstring, std::weak_ptr<model::ModelAsset>> m_assets;
+  Stats m_stats;
+};
+
+std::unique_ptr<ModelAssetCache>& GetModelAssetCache();
@@ -0,0 +1,85 @@
+﻿#include "OcclusionBenchmark.h"
+#include "OcclusionCulling.h"
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+OcclusionBenchmarkResult RunOcclusionBenchmark(uint32_t occluderCount, uint32_t testCount, uint32_t iterations)
+{
+  OcclusionBenchmarkResult result;
+  result.iterations = iterations;
+
+  SoftwareOcclusion occlusion;
+  occlusion.Initialize(320, 180);
+  result.width = occlusion.GetWidth();
+  result.height = occlusion.GetHeight();
+
+  // 原点から -Z を向くカメラ. z = -20 に視界を覆う壁を置く.
+  auto mtxViewProj = XMMatrixPerspectiveFovRH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 200.0f);
+  const XMFLOAT3 wallMin{ -30.0f, -20.0f, -21.0f }, wallMax{ 30.0f, 20.0f, -20.0f };
+
+  // 壁の手前に小さな遮蔽物を並べて負荷とする.
+  std::default_random_engine rng;
+  std::uniform_real_distribution<float> spread(-1.0f, 1.0f);
+  std::uniform_real_distribution<float> size(0.1f, 1.0f);
+  std::vector<XMFLOAT3> occluderMins, occluderMaxs;
+  for (uint32_t i = 1; i < occluderCount; ++i)
+  {
+    float z = -19.0f + spread(rng) * 5.0f - 5.0f;
+    XMFLOAT3 center{ spread(rng) * 8.0f, spread(rng) * 4.0f, z };
+    float s = size(rng);
+    occluderMins.push_back({ center.x - s, center.y - s, center.z - s });
+    occluderMaxs.push_back({ center.x + s, center.y + s, center.z + s });
+  }
+
+  // 判定対象. 半分は壁の奥(遮蔽される), 半分はカメラと壁の間でかつ遮蔽物より手前.
+  std::vector<XMFLOAT3> testMins(testCount), testMaxs(testCount);
+  std::vector<uint8_t> visible(testCount);
+  for (uint32_t i = 0; i < testCount; ++i)
+  {
+    bool hidden = (i % 2) == 0;
+    float z = hidden ? -40.0f + spread(rng) * 15.0f : -6.0f + spread(rng) * 2.0f;
+    float extent = hidden ? 8.0f : 1.5f;
+    XMFLOAT3 center{ spread(rng) * extent, spread(rng) * extent * 0.5f, z };
+    float s = size(rng) * 0.5f;
+    testMins[i] = { center.x - s, center.y - s, center.z - s };
+    testMaxs[i] = { center.x + s, center.y + s, center.z + s };
+  }
+
+  for (uint32_t iteration = 0; iteration < iterations; ++iteration)
+  {
+    occlusion.BeginFrame(mtxViewProj);
+    occlusion.AddOccluder(wallMin, wallMax);
+    for (size_t i = 0; i < occluderMins.size(); ++i)
+    {
+      occlusion.AddOccluder(occluderMins[i], occluderMaxs[i]);
+    }
+    // ベンチマークでは時間制限なしで全遮蔽物を処理する.
+    occlusion.Rasterize(std::chrono::seconds(1));
+    occlusion.TestAabbs(testMins.data(), testMaxs.data(), testCount, visible.data());
+
+    const auto& stats = occlusion.GetStats();
+    result.occluderCount = stats.rasterizedCount;
+    result.rasterizeMs += stats.rasterizeMs / iterations;
+    result.testMs += stats.testMs / iterations;
+  }
+
+  result.hiddenCount = 0;
+  result.frontCount = 0;
+  result.frontAllVisible = true;
+  for (uint32_t i = 0; i < testCount; ++i)
+  {
+    if ((i % 2) == 0)
+    {
+      result.hiddenCount++;
+      result.hiddenOccludedCount += visible[i] ? 0 : 1;
+    }
+    else
+    {
+      result.frontCount++;
+      result.frontAllVisible &= visible[i] != 0;
+    }
+  }
+  return result;
+}
@@ -0,0 +1,21 @@
+﻿#pragma once
+#include <cstdint>
+
+// ソフトウェア遮蔽カリングの CPU ベンチマーク.
+// 壁の前後に箱を置いた合成シーンで、処理時間と判定結果を検証する.
+struct OcclusionBenchmarkResult
+{
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t occluderCount = 0;
+  uint32_t iterations = 0;
+  // 1回あたりの平均時間 (ミリ秒).
+  double rasterizeMs = 0.0;
+  double testMs = 0.0;
+  uint32_t hiddenCount = 0;     // 壁の奥に置いた箱.
+  uint32_t hiddenOccludedCount = 0;
+  uint32_t frontCount = 0;      // 壁の手前に置いた箱.
+  bool     frontAllVisible = false;  // 手前の箱が 1 つも遮蔽と判定されていないこと.
+};
+
+OcclusionBenchmarkResult RunOcclusionBenchmark(uint32_t occluderCount = 256, uint32_t testCount = 10000, uint32_t iterations = 20);
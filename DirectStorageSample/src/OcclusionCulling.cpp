@@ -0,0 +1,295 @@
+﻿#include "OcclusionCulling.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <emmintrin.h>
+
+using namespace DirectX;
+
+namespace
+{
+  // 箱の 12 三角形. 頂点番号は bit0:x, bit1:y, bit2:z が max 側.
+  constexpr uint8_t BoxTriangles[12][3] = {
+    { 0, 2, 6 }, { 0, 6, 4 },  // -X
+    { 1, 5, 7 }, { 1, 7, 3 },  // +X
+    { 0, 4, 5 }, { 0, 5, 1 },  // -Y
+    { 2, 3, 7 }, { 2, 7, 6 },  // +Y
+    { 0, 1, 3 }, { 0, 3, 2 },  // -Z
+    { 4, 6, 7 }, { 4, 7, 5 },  // +Z
+  };
+  // 判定時の1ジョブあたりの個数.
+  constexpr uint32_t TestGrainSize = 32;
+}
+
+void SoftwareOcclusion::Initialize(uint32_t width, uint32_t height)
+{
+  m_width = (width + TileSize - 1) / TileSize * TileSize;
+  m_height = (height + TileSize - 1) / TileSize * TileSize;
+  m_tilesX = m_width / TileSize;
+  m_tilesY = m_height / TileSize;
+  m_depth.assign(size_t(m_width) * m_height, 1.0f);
+  m_hiz.assign(size_t(m_tilesX) * m_tilesY, 1.0f);
+}
+
+void SoftwareOcclusion::BeginFrame(DirectX::FXMMATRIX mtxViewProj)
+{
+  XMStoreFloat4x4(&m_viewProj, mtxViewProj);
+  m_occluders.clear();
+  m_stats = Stats{};
+}
+
+bool SoftwareOcclusion::ProjectBox(const XMFLOAT3& aabbMin, const XMFLOAT3& aabbMax, ScreenVertex* out) const
+{
+  const auto& m = m_viewProj.m;
+  for (uint32_t i = 0; i < 8; ++i)
+  {
+    float x = (i & 1) ? aabbMax.x : aabbMin.x;
+    float y = (i & 2) ? aabbMax.y : aabbMin.y;
+    float z = (i & 4) ? aabbMax.z : aabbMin.z;
+    float cx = x * m[0][0] + y * m[1][0] + z * m[2][0] + m[3][0];
+    float cy = x * m[0][1] + y * m[1][1] + z * m[2][1] + m[3][1];
+    float cz = x * m[0][2] + y * m[1][2] + z * m[2][2] + m[3][2];
+    float cw = x * m[0][3] + y * m[1][3] + z * m[2][3] + m[3][3];
+    // 近平面より手前の頂点があればクリッピングせずに扱いを呼び出し側に任せる.
+    if (cz < 0.0f || cw <= 1e-5f)
+    {
+      return false;
+    }
+    float invW = 1.0f / cw;
+    out[i].x = (cx * invW * 0.5f + 0.5f) * m_width;
+    out[i].y = (0.5f - cy * invW * 0.5f) * m_height;
+    out[i].z = cz * invW;
+  }
+  return true;
+}
+
+void SoftwareOcclusion::AddOccluder(const XMFLOAT3& aabbMin, const XMFLOAT3& aabbMax)
+{
+  m_stats.occluderCount++;
+  Occluder occluder;
+  // 近平面をまたぐ遮蔽物は使わない (遮蔽が減るだけで安全側).
+  if (!ProjectBox(aabbMin, aabbMax, occluder.vertices))
+  {
+    return;
+  }
+  float minX = occluder.vertices[0].x, maxX = minX;
+  float minY = occluder.vertices[0].y, maxY = minY;
+  for (const auto& v : occluder.vertices)
+  {
+    minX = (std::min)(minX, v.x);
+    maxX = (std::max)(maxX, v.x);
+    minY = (std::min)(minY, v.y);
+    maxY = (std::max)(maxY, v.y);
+  }
+  minX = (std::max)(minX, 0.0f);
+  maxX = (std::min)(maxX, float(m_width));
+  minY = (std::max)(minY, 0.0f);
+  maxY = (std::min)(maxY, float(m_height));
+  if (minX >= maxX || minY >= maxY)
+  {
+    return;
+  }
+  occluder.area = (maxX - minX) * (maxY - minY);
+  occluder.minY = minY;
+  occluder.maxY = maxY;
+  m_occluders.push_back(occluder);
+}
+
+void SoftwareOcclusion::Rasterize(std::chrono::microseconds budget)
+{
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + budget;
+
+  // 画面上で大きいものほど遮蔽効果が高いため先に処理する.
+  std::sort(m_occluders.begin(), m_occluders.end(),
+    [](const Occluder& a, const Occluder& b) { return a.area > b.area; });
+
+  // HiZ の 1 タイル行を 1 つの帯とし、帯毎に全遮蔽物を処理する.
+  std::vector<uint32_t> rasterizedCounts(m_tilesY);
+  GetJobSystem()->ParallelFor(m_tilesY, 1, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t band = begin; band < end; ++band)
+    {
+      rasterizedCounts[band] = RasterizeBand(band, deadline);
+      BuildHiZ(band, band + 1);
+    }
+  });
+
+  m_stats.rasterizedCount = rasterizedCounts.empty() ? 0 :
+    *std::min_element(rasterizedCounts.begin(), rasterizedCounts.end());
+  m_stats.budgetExceeded = m_stats.rasterizedCount < m_occluders.size();
+  m_stats.rasterizeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint32_t SoftwareOcclusion::RasterizeBand(uint32_t bandIndex, std::chrono::steady_clock::time_point deadline)
+{
+  const uint32_t rowBegin = bandIndex * TileSize;
+  const uint32_t rowEnd = rowBegin + TileSize;
+  std::fill(m_depth.begin() + size_t(rowBegin) * m_width, m_depth.begin() + size_t(rowEnd) * m_width, 1.0f);
+
+  uint32_t processed = 0;
+  for (const auto& occluder : m_occluders)
+  {
+    if (std::chrono::steady_clock::now() > deadline)
+    {
+      break;
+    }
+    processed++;
+    if (occluder.maxY <= float(rowBegin) || occluder.minY >= float(rowEnd))
+    {
+      continue;
+    }
+    for (const auto& tri : BoxTriangles)
+    {
+      RasterizeTriangle(occluder.vertices[tri[0]], occluder.vertices[tri[1]], occluder.vertices[tri[2]], rowBegin, rowEnd);
+    }
+  }
+  return processed;
+}
+
+void SoftwareOcclusion::RasterizeTriangle(const ScreenVertex& v0, const ScreenVertex& in1, const ScreenVertex& in2, uint32_t rowBegin, uint32_t rowEnd)
+{
+  // 辺関数 E_ab(p) = (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x).
+  float area = (in1.x - v0.x) * (in2.y - v0.y) - (in1.y - v0.y) * (in2.x - v0.x);
+  if (std::abs(area) < 1e-6f)
+  {
+    return;
+  }
+  // 面積が正となる向きにそろえる.
+  const ScreenVertex& v1 = area > 0.0f ? in1 : in2;
+  const ScreenVertex& v2 = area > 0.0f ? in2 : in1;
+  area = std::abs(area);
+
+  float minX = (std::min)({ v0.x, v1.x, v2.x });
+  float maxX = (std::max)({ v0.x, v1.x, v2.x });
+  float minY = (std::min)({ v0.y, v1.y, v2.y });
+  float maxY = (std::max)({ v0.y, v1.y, v2.y });
+  int32_t x0 = (std::max)(int32_t(std::floor(minX)), 0) & ~3;
+  int32_t x1 = (std::min)(int32_t(std::ceil(maxX)), int32_t(m_width) - 1);
+  int32_t y0 = (std::max)(int32_t(std::floor(minY)), int32_t(rowBegin));
+  int32_t y1 = (std::min)(int32_t(std::ceil(maxY)), int32_t(rowEnd) - 1);
+  if (x0 > x1 || y0 > y1)
+  {
+    return;
+  }
+
+  // E(p) = A * px + B * py + C の形で各辺を表す.
+  auto makeEdge = [](const ScreenVertex& a, const ScreenVertex& b, float& A, float& B, float& C) {
+    A = -(b.y - a.y);
+    B = (b.x - a.x);
+    C = (b.y - a.y) * a.x - (b.x - a.x) * a.y;
+  };
+  float A0, B0, C0, A1, B1, C1, A2, B2, C2;
+  makeEdge(v1, v2, A0, B0, C0);  // v0 の重み.
+  makeEdge(v2, v0, A1, B1, C1);  // v1 の重み.
+  makeEdge(v0, v1, A2, B2, C2);  // v2 の重み.
+
+  // 深度は画面空間で線形なため平面として補間できる.
+  float invArea = 1.0f / area;
+  float dz1 = (v1.z - v0.z) * invArea, dz2 = (v2.z - v0.z) * invArea;
+  float zA = A1 * dz1 + A2 * dz2;
+  float zB = B1 * dz1 + B2 * dz2;
+  float zC = v0.z + C1 * dz1 + C2 * dz2;
+
+  const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 stepX = _mm_set1_ps(4.0f);
+  for (int32_t y = y0; y <= y1; ++y)
+  {
+    float py = float(y) + 0.5f;
+    __m128 px = _mm_add_ps(_mm_set1_ps(float(x0)), offsets);
+    float* row = m_depth.data() + size_t(y) * m_width;
+    for (int32_t x = x0; x <= x1; x += 4)
+    {
+      __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A0), px), _mm_set1_ps(B0 * py + C0));
+      __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A1), px), _mm_set1_ps(B1 * py + C1));
+      __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A2), px), _mm_set1_ps(B2 * py + C2));
+      __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+      if (_mm_movemask_ps(inside))
+      {
+        __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zA), px), _mm_set1_ps(zB * py + zC));
+        __m128 current = _mm_loadu_ps(row + x);
+        __m128 nearer = _mm_min_ps(current, z);
+        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+      }
+      px = _mm_add_ps(px, stepX);
+    }
+  }
+}
+
+void SoftwareOcclusion::BuildHiZ(uint32_t tileRowBegin, uint32_t tileRowEnd)
+{
+  for (uint32_t ty = tileRowBegin; ty < tileRowEnd; ++ty)
+  {
+    for (uint32_t tx = 0; tx < m_tilesX; ++tx)
+    {
+      __m128 farthest = _mm_setzero_ps();
+      for (uint32_t y = 0; y < TileSize; ++y)
+      {
+        const float* row = m_depth.data() + size_t(ty * TileSize + y) * m_width + tx * TileSize;
+        farthest = _mm_max_ps(farthest, _mm_max_ps(_mm_loadu_ps(row), _mm_loadu_ps(row + 4)));
+      }
+      farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+      farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(2, 3, 0, 1)));
+      m_hiz[ty * m_tilesX + tx] = _mm_cvtss_f32(farthest);
+    }
+  }
+}
+
+bool SoftwareOcclusion::IsOccluded(const XMFLOAT3& aabbMin, const XMFLOAT3& aabbMax) const
+{
+  ScreenVertex vertices[8];
+  if (!ProjectBox(aabbMin, aabbMax, vertices))
+  {
+    return false;
+  }
+  float minX = vertices[0].x, maxX = minX, minY = vertices[0].y, maxY = minY, minZ = vertices[0].z;
+  for (const auto& v : vertices)
+  {
+    minX = (std::min)(minX, v.x);
+    maxX = (std::max)(maxX, v.x);
+    minY = (std::min)(minY, v.y);
+    maxY = (std::max)(maxY, v.y);
+    minZ = (std::min)(minZ, v.z);
+  }
+  if (maxX <= 0.0f || maxY <= 0.0f || minX >= float(m_width) || minY >= float(m_height))
+  {
+    // 画面外は視錐台カリングに任せる.
+    return false;
+  }
+  int32_t tx0 = (std::max)(int32_t(minX) / int32_t(TileSize), 0);
+  int32_t tx1 = (std::min)(int32_t(maxX) / int32_t(TileSize), int32_t(m_tilesX) - 1);
+  int32_t ty0 = (std::max)(int32_t(minY) / int32_t(TileSize), 0);
+  int32_t ty1 = (std::min)(int32_t(maxY) / int32_t(TileSize), int32_t(m_tilesY) - 1);
+  for (int32_t ty = ty0; ty <= ty1; ++ty)
+  {
+    for (int32_t tx = tx0; tx <= tx1; ++tx)
+    {
+      // タイル内の最遠の遮蔽物より手前にあれば見えている可能性がある.
+      if (minZ <= m_hiz[ty * m_tilesX + tx])
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void SoftwareOcclusion::TestAabbs(const XMFLOAT3* aabbMins, const XMFLOAT3* aabbMaxs, uint32_t count, uint8_t* visible)
+{
+  auto start = std::chrono::steady_clock::now();
+  std::atomic<uint32_t> occludedCount = 0;
+  GetJobSystem()->ParallelFor(count, TestGrainSize, [&](uint32_t begin, uint32_t end) {
+    uint32_t occluded = 0;
+    for (uint32_t i = begin; i < end; ++i)
+    {
+      bool isOccluded = IsOccluded(aabbMins[i], aabbMaxs[i]);
+      visible[i] = isOccluded ? 0 : 1;
+      occluded += isOccluded ? 1 : 0;
+    }
+    occludedCount += occluded;
+  });
+  m_stats.testedCount += count;
+  m_stats.occludedCount += occludedCount;
+  m_stats.testMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
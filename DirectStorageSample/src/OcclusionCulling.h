@@ -0,0 +1,74 @@
+﻿#pragma once
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+
+// CPU で遮蔽物を低解像度の深度バッファへラスタライズし、遮蔽判定を行う.
+// 深度は D3D と同じ 0(近)～1(遠) で、タイル毎の最遠値を階層深度(HiZ)として保持する.
+// 判定は保守的で、判定できない場合(カメラの近くなど)は常に可視とする.
+// 画面を横方向の帯に分け、帯毎にワーカースレッドでラスタライズする.
+class SoftwareOcclusion
+{
+public:
+  static constexpr uint32_t TileSize = 8;
+
+  struct Stats
+  {
+    uint32_t occluderCount = 0;      // 登録された遮蔽物.
+    uint32_t rasterizedCount = 0;    // 時間内にラスタライズできた遮蔽物 (帯の中で最小のもの).
+    uint32_t testedCount = 0;
+    uint32_t occludedCount = 0;
+    double   rasterizeMs = 0.0;
+    double   testMs = 0.0;
+    bool     budgetExceeded = false;
+  };
+
+  // width, height は TileSize の倍数に切り上げる.
+  void Initialize(uint32_t width, uint32_t height);
+  uint32_t GetWidth() const { return m_width; }
+  uint32_t GetHeight() const { return m_height; }
+
+  // フレーム開始. 遮蔽物の登録をリセットする.
+  void BeginFrame(DirectX::FXMMATRIX mtxViewProj);
+  // ワールド空間の AABB を遮蔽物として登録. 中身の詰まった箱として扱われる.
+  void AddOccluder(const DirectX::XMFLOAT3& aabbMin, const DirectX::XMFLOAT3& aabbMax);
+  // 登録した遮蔽物を画面上の大きい順にラスタライズし HiZ を構築.
+  // budget を超えた帯ではそれ以降の遮蔽物を打ち切る (遮蔽が減るだけで結果は保守的なまま).
+  void Rasterize(std::chrono::microseconds budget);
+
+  // ワールド空間の AABB が遮蔽されているか.
+  bool IsOccluded(const DirectX::XMFLOAT3& aabbMin, const DirectX::XMFLOAT3& aabbMax) const;
+  // まとめて判定し、可視であれば visible[i] に 1 を設定. ワーカースレッドで分担する.
+  void TestAabbs(const DirectX::XMFLOAT3* aabbMins, const DirectX::XMFLOAT3* aabbMaxs, uint32_t count, uint8_t* visible);
+
+  const Stats& GetStats() const { return m_stats; }
+  const std::vector<float>& GetDepthBuffer() const { return m_depth; }
+
+private:
+  struct ScreenVertex
+  {
+    float x, y, z;
+  };
+  struct Occluder
+  {
+    ScreenVertex vertices[8];
+    float area;  // 画面上の外接矩形の面積 (並べ替え用).
+    float minY, maxY;
+  };
+  // AABB の 8 頂点を画面座標へ. いずれかが近平面より手前であれば false.
+  bool ProjectBox(const DirectX::XMFLOAT3& aabbMin, const DirectX::XMFLOAT3& aabbMax, ScreenVertex* out) const;
+  uint32_t RasterizeBand(uint32_t bandIndex, std::chrono::steady_clock::time_point deadline);
+  void RasterizeTriangle(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2, uint32_t rowBegin, uint32_t rowEnd);
+  void BuildHiZ(uint32_t tileRowBegin, uint32_t tileRowEnd);
+
+  uint32_t m_width = 0;
+  uint32_t m_height = 0;
+  uint32_t m_tilesX = 0;
+  uint32_t m_tilesY = 0;
+  DirectX::XMFLOAT4X4 m_viewProj{};
+  std::vector<float> m_depth;  // 各ピクセルで最も近い遮蔽物の深度.
+  std::vector<float> m_hiz;    // タイル内の最遠の深度.
+  std::vector<Occluder> m_occluders;
+  Stats m_stats;
+};
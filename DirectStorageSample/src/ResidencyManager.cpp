@@ -0,0 +1,189 @@
+﻿#include "ResidencyManager.h"
+#include <algorithm>
+#include <cassert>
+
+ResidencyManager::EntryId ResidencyManager::AddEntry(uint64_t estimatedBytes)
+{
+  auto id = EntryId(m_entries.size());
+  auto& entry = m_entries.emplace_back();
+  entry.bytes = estimatedBytes;
+  return id;
+}
+
+void ResidencyManager::Clear()
+{
+  m_entries.clear();
+  auto totalEvictCount = m_stats.totalEvictCount;
+  auto totalLoadRequestCount = m_stats.totalLoadRequestCount;
+  m_stats = Stats{};
+  m_stats.totalEvictCount = totalEvictCount;
+  m_stats.totalLoadRequestCount = totalLoadRequestCount;
+}
+
+void ResidencyManager::BeginFrame(uint64_t frameIndex)
+{
+  assert(frameIndex != NeverVisible);
+  m_frameIndex = frameIndex;
+}
+
+void ResidencyManager::MarkVisible(EntryId id)
+{
+  m_entries[id].lastVisibleFrame = m_frameIndex;
+}
+
+void ResidencyManager::UpdateEstimate(EntryId id, uint64_t estimatedBytes)
+{
+  auto& entry = m_entries[id];
+  if (entry.state == State::Resident)
+  {
+    return;
+  }
+  entry.bytes = estimatedBytes;
+  UpdateStats();
+}
+
+void ResidencyManager::OnLoaded(EntryId id, uint64_t actualBytes)
+{
+  auto& entry = m_entries[id];
+  if (entry.state != State::Loading)
+  {
+    return;
+  }
+  entry.bytes = actualBytes;
+  entry.state = State::Resident;
+  UpdateStats();
+}
+
+void ResidencyManager::OnLoadFailed(EntryId id)
+{
+  auto& entry = m_entries[id];
+  if (entry.state != State::Loading)
+  {
+    return;
+  }
+  entry.state = State::Failed;
+  UpdateStats();
+}
+
+void ResidencyManager::Evaluate(Decision& decision)
+{
+  decision.evictList.clear();
+  decision.loadList.clear();
+  UpdateStats();
+  m_stats.deferredCount = 0;
+
+  // 常駐しているものを最後に可視だった順(古い順)に並べる.
+  // 同じフレームのものは ID の大きいものから追い出す(結果を決定的にするため).
+  std::vector<EntryId> lruList;
+  for (EntryId id = 0; id < m_entries.size(); ++id)
+  {
+    if (m_entries[id].state == State::Resident)
+    {
+      lruList.push_back(id);
+    }
+  }
+  std::stable_sort(lruList.begin(), lruList.end(), [&](EntryId a, EntryId b) {
+    auto keyA = GetLruKey(m_entries[a]), keyB = GetLruKey(m_entries[b]);
+    if (keyA != keyB) { return keyA < keyB; }
+    return a > b;
+  });
+
+  // 予算を超えている場合には古いものから追い出す.
+  // (予算の変更や、推定サイズより実サイズが大きかった場合に発生)
+  auto itr = lruList.begin();
+  for (; itr != lruList.end() && GetCommittedBytes() > m_budgetBytes; ++itr)
+  {
+    Evict(*itr, decision);
+  }
+  lruList.erase(lruList.begin(), itr);
+
+  // 追い出し候補は現在フレームで不可視のもののみ.
+  // 可視のものを追い出してまでロードすると毎フレーム入れ替わりが発生するため.
+  lruList.erase(std::remove_if(lruList.begin(), lruList.end(), [&](EntryId id) { return IsVisibleNow(m_entries[id]); }), lruList.end());
+  uint64_t evictableBytes = 0;
+  for (auto id : lruList)
+  {
+    evictableBytes += m_entries[id].bytes;
+  }
+
+  // 可視だが常駐していないものをロード要求する.
+  uint32_t requestCount = 0;
+  auto victim = lruList.begin();
+  for (EntryId id = 0; id < m_entries.size(); ++id)
+  {
+    auto& entry = m_entries[id];
+    if (entry.state != State::NonResident || !IsVisibleNow(entry))
+    {
+      continue;
+    }
+    if (m_maxLoadRequestsPerFrame != 0 && requestCount >= m_maxLoadRequestsPerFrame)
+    {
+      m_stats.deferredCount++;
+      continue;
+    }
+    auto required = GetCommittedBytes() + entry.bytes;
+    if (required > m_budgetBytes && required - evictableBytes > m_budgetBytes)
+    {
+      // 追い出しても収まらないため見送り.
+      m_stats.deferredCount++;
+      continue;
+    }
+    while (GetCommittedBytes() + entry.bytes > m_budgetBytes)
+    {
+      assert(victim != lruList.end());
+      evictableBytes -= m_entries[*victim].bytes;
+      Evict(*victim, decision);
+      ++victim;
+    }
+    entry.state = State::Loading;
+    m_stats.loadingBytes += entry.bytes;
+    m_stats.loadingCount++;
+    m_stats.totalLoadRequestCount++;
+    decision.loadList.push_back(id);
+    requestCount++;
+  }
+}
+
+uint64_t ResidencyManager::GetLruKey(const Entry& entry) const
+{
+  // 一度も可視になっていないものは最も古い扱い.
+  return entry.lastVisibleFrame == NeverVisible ? 0 : entry.lastVisibleFrame + 1;
+}
+
+void ResidencyManager::Evict(EntryId id, Decision& decision)
+{
+  auto& entry = m_entries[id];
+  assert(entry.state == State::Resident);
+  entry.state = State::NonResident;
+  m_stats.residentBytes -= entry.bytes;
+  m_stats.residentCount--;
+  m_stats.totalEvictCount++;
+  decision.evictList.push_back(id);
+}
+
+void ResidencyManager::UpdateStats()
+{
+  m_stats.budgetBytes = m_budgetBytes;
+  m_stats.residentBytes = 0;
+  m_stats.loadingBytes = 0;
+  m_stats.residentCount = 0;
+  m_stats.loadingCount = 0;
+  m_stats.failedCount = 0;
+  for (const auto& entry : m_entries)
+  {
+    if (entry.state == State::Resident)
+    {
+      m_stats.residentBytes += entry.bytes;
+      m_stats.residentCount++;
+    }
+    if (entry.state == State::Loading)
+    {
+      m_stats.loadingBytes += entry.bytes;
+      m_stats.loadingCount++;
+    }
+    if (entry.state == State::Failed)
+    {
+      m_stats.failedCount++;
+    }
+  }
+}
@@ -0,0 +1,90 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+
+// VRAM の使用量を予算内に収めるための常駐管理.
+// どのモデルをロード/追い出しするかの判断のみを行い、D3D12 のリソースには触れない.
+// そのため入力(可視情報, サイズ)を与えるだけで CPU 上でシミュレーションが可能.
+class ResidencyManager
+{
+public:
+  using EntryId = uint32_t;
+  static constexpr uint64_t UnlimitedBudget = UINT64_MAX;
+
+  enum class State : uint8_t
+  {
+    NonResident = 0,  // VRAM 上に存在しない.
+    Loading,          // ロード要求済み.
+    Resident,         // 描画可能な状態で常駐.
+    Failed,           // ロードに失敗. 予算を消費せず、再度ロード要求もしない.
+  };
+
+  struct Decision
+  {
+    std::vector<EntryId> evictList; // 追い出すもの(この順に処理).
+    std::vector<EntryId> loadList;  // ロードを要求するもの.
+  };
+
+  struct Stats
+  {
+    uint64_t budgetBytes = 0;
+    uint64_t residentBytes = 0;
+    uint64_t loadingBytes = 0;
+    uint32_t residentCount = 0;
+    uint32_t loadingCount = 0;
+    uint32_t deferredCount = 0;     // 予算不足でロードを見送っているもの.
+    uint32_t failedCount = 0;
+    uint64_t totalEvictCount = 0;
+    uint64_t totalLoadRequestCount = 0;
+  };
+
+  void SetBudget(uint64_t budgetBytes) { m_budgetBytes = budgetBytes; }
+  uint64_t GetBudget() const { return m_budgetBytes; }
+
+  // 1フレームで発行するロード要求数の上限 (0 で無制限).
+  void SetMaxLoadRequestsPerFrame(uint32_t count) { m_maxLoadRequestsPerFrame = count; }
+
+  // 管理対象を登録. 実サイズが判明するまでは推定サイズで扱う.
+  EntryId AddEntry(uint64_t estimatedBytes);
+  void Clear();
+
+  // フレーム開始時に呼び出す.
+  void BeginFrame(uint64_t frameIndex);
+  // そのフレームで可視(描画対象)であることを通知.
+  void MarkVisible(EntryId id);
+  // 推定サイズを更新. ロード完了後は実サイズを保持するため無視される.
+  void UpdateEstimate(EntryId id, uint64_t estimatedBytes);
+  // ロード完了を通知. 実際に確保されたサイズで置き換える.
+  void OnLoaded(EntryId id, uint64_t actualBytes);
+  // ロード失敗を通知. ロード中として確保していた予算を解放する.
+  void OnLoadFailed(EntryId id);
+
+  // 現在の状態からロード/追い出しの判断を行う.
+  // 結果は状態に反映済みとなるため、呼び出し側は Decision の内容を必ず実行すること.
+  void Evaluate(Decision& decision);
+
+  State GetState(EntryId id) const { return m_entries[id].state; }
+  uint64_t GetBytes(EntryId id) const { return m_entries[id].bytes; }
+  uint32_t GetEntryCount() const { return uint32_t(m_entries.size()); }
+  const Stats& GetStats() const { return m_stats; }
+
+private:
+  static constexpr uint64_t NeverVisible = UINT64_MAX;
+  struct Entry
+  {
+    uint64_t bytes = 0;
+    uint64_t lastVisibleFrame = NeverVisible;
+    State    state = State::NonResident;
+  };
+  bool IsVisibleNow(const Entry& entry) const { return entry.lastVisibleFrame == m_frameIndex; }
+  uint64_t GetCommittedBytes() const { return m_stats.residentBytes + m_stats.loadingBytes; }
+  uint64_t GetLruKey(const Entry& entry) const;
+  void Evict(EntryId id, Decision& decision);
+  void UpdateStats();
+
+  std::vector<Entry> m_entries;
+  uint64_t m_budgetBytes = UnlimitedBudget;
+  uint64_t m_frameIndex = 0;
+  uint32_t m_maxLoadRequestsPerFrame = 0;
+  Stats m_stats;
+};
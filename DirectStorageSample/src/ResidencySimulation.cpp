@@ -0,0 +1,172 @@
+﻿#include "ResidencySimulation.h"
+#include "ResidencyManager.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace
+{
+  using EntryId = ResidencyManager::EntryId;
+  constexpr uint64_t NeverVisible = UINT64_MAX;
+
+  struct TraceEntry
+  {
+    uint64_t estimatedBytes;
+    uint64_t actualBytes;
+    bool     fails;
+  };
+
+  bool IsVisible(const ResidencyTraceDesc& desc, uint32_t frame, EntryId id)
+  {
+    auto first = (frame / desc.framesPerStep) % desc.entryCount;
+    return (id + desc.entryCount - first) % desc.entryCount < desc.visibleCount;
+  }
+
+  // 判断の内容を畳み込んだハッシュ (FNV-1a).
+  void HashDecision(uint64_t& hash, const ResidencyManager::Decision& decision)
+  {
+    auto mix = [&](uint64_t value) {
+      hash = (hash ^ value) * 1099511628211ull;
+    };
+    for (auto id : decision.evictList) { mix(id); }
+    mix(0xFFFFFFFF);
+    for (auto id : decision.loadList) { mix(id); }
+    mix(0xFFFFFFFE);
+  }
+
+  uint64_t RunTrace(const ResidencyTraceDesc& desc, const std::vector<TraceEntry>& entries, uint64_t budgetBytes,
+    ResidencyTraceResult& result)
+  {
+    ResidencyManager residency;
+    residency.SetBudget(budgetBytes);
+    residency.SetMaxLoadRequestsPerFrame(desc.maxLoadRequestsPerFrame);
+    for (const auto& entry : entries)
+    {
+      residency.AddEntry(entry.estimatedBytes);
+    }
+
+    std::vector<uint64_t> lastVisible(entries.size(), NeverVisible);
+    std::vector<uint32_t> loadCompleteFrame(entries.size(), UINT32_MAX);
+    std::vector<uint8_t> failed(entries.size(), 0);
+    ResidencyManager::Decision decision;
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t frame = 0; frame < desc.frameCount; ++frame)
+    {
+      residency.BeginFrame(frame);
+      for (EntryId id = 0; id < entries.size(); ++id)
+      {
+        if (loadCompleteFrame[id] == frame && entries[id].fails)
+        {
+          // ロード中として数えていた分がそのまま解放されること.
+          auto loadingBytes = residency.GetStats().loadingBytes;
+          auto bytes = residency.GetBytes(id);
+          residency.OnLoadFailed(id);
+          result.failedChargeErrors += loadingBytes - residency.GetStats().loadingBytes != bytes ? 1 : 0;
+          failed[id] = 1;
+          loadCompleteFrame[id] = UINT32_MAX;
+        }
+        else if (loadCompleteFrame[id] == frame)
+        {
+          residency.OnLoaded(id, entries[id].actualBytes);
+          loadCompleteFrame[id] = UINT32_MAX;
+        }
+        if (IsVisible(desc, frame, id))
+        {
+          residency.MarkVisible(id);
+          lastVisible[id] = frame;
+        }
+      }
+
+      residency.Evaluate(decision);
+      HashDecision(hash, decision);
+
+      // 追い出したものより古い不可視の常駐物が残っていないこと.
+      // 一度も可視になっていないものは最も古い扱い.
+      auto lruKey = [&](EntryId id) { return lastVisible[id] == NeverVisible ? 0 : lastVisible[id] + 1; };
+      for (auto evicted : decision.evictList)
+      {
+        result.visibleEvictCount += IsVisible(desc, frame, evicted) ? 1 : 0;
+        for (EntryId id = 0; id < entries.size(); ++id)
+        {
+          if (residency.GetState(id) == ResidencyManager::State::Resident && !IsVisible(desc, frame, id) &&
+            lruKey(id) < lruKey(evicted))
+          {
+            result.lruViolationCount++;
+            break;
+          }
+        }
+      }
+      for (auto id : decision.loadList)
+      {
+        result.failedRequestCount += failed[id];
+        loadCompleteFrame[id] = frame + desc.loadLatencyFrames;
+      }
+
+      const auto& stats = residency.GetStats();
+      auto committed = stats.residentBytes + stats.loadingBytes;
+      result.peakCommittedBytes = (std::max)(result.peakCommittedBytes, committed);
+      result.budgetExceededFrames += committed > budgetBytes ? 1 : 0;
+      for (EntryId id = 0; id < entries.size(); ++id)
+      {
+        if (IsVisible(desc, frame, id) && !failed[id])
+        {
+          result.visibleCount++;
+          result.missingVisibleCount += residency.GetState(id) != ResidencyManager::State::Resident ? 1 : 0;
+        }
+      }
+    }
+    result.loadRequestCount = residency.GetStats().totalLoadRequestCount;
+    result.evictCount = residency.GetStats().totalEvictCount;
+    result.failedCount = residency.GetStats().failedCount;
+    return hash;
+  }
+}
+
+ResidencyTraceResult RunResidencyTraceSimulation(const ResidencyTraceDesc& desc)
+{
+  ResidencyTraceResult result;
+  result.frameCount = desc.frameCount;
+  if (desc.entryCount == 0 || desc.framesPerStep == 0)
+  {
+    return result;
+  }
+
+  // 推定サイズは 4～64 MiB, 実サイズはそこから 0.8～1.25 倍.
+  std::default_random_engine rng(desc.seed);
+  std::uniform_int_distribution<uint64_t> sizeDist(4ull << 20, 64ull << 20);
+  std::uniform_real_distribution<double> ratioDist(0.8, 1.25);
+  std::vector<TraceEntry> entries(desc.entryCount);
+  for (uint32_t i = 0; i < desc.entryCount; ++i)
+  {
+    auto& entry = entries[i];
+    entry.estimatedBytes = sizeDist(rng);
+    entry.actualBytes = uint64_t(entry.estimatedBytes * ratioDist(rng));
+    entry.fails = desc.failingEntryInterval != 0 && i % desc.failingEntryInterval == 0;
+  }
+
+  // ロード中は推定サイズ、完了後は実サイズで数えられるため、大きい方で見積もる.
+  uint64_t maxVisibleBytes = 0;
+  for (uint32_t first = 0; first < desc.entryCount; ++first)
+  {
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < (std::min)(desc.visibleCount, desc.entryCount); ++i)
+    {
+      const auto& entry = entries[(first + i) % desc.entryCount];
+      bytes += (std::max)(entry.estimatedBytes, entry.actualBytes);
+    }
+    maxVisibleBytes = (std::max)(maxVisibleBytes, bytes);
+  }
+  result.budgetBytes = maxVisibleBytes * 3 / 2;
+
+  auto start = std::chrono::high_resolution_clock::now();
+  auto hash = RunTrace(desc, entries, result.budgetBytes, result);
+  auto end = std::chrono::high_resolution_clock::now();
+  result.elapsedMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+  ResidencyTraceResult replay;
+  result.deterministic = RunTrace(desc, entries, result.budgetBytes, replay) == hash &&
+    replay.evictCount == result.evictCount && replay.loadRequestCount == result.loadRequestCount &&
+    replay.failedCount == result.failedCount;
+  return result;
+}
@@ -0,0 +1,40 @@
+﻿#pragma once
+#include <cstdint>
+
+// ResidencyManager を擬似的な可視トレースで動かし、判断を検証する.
+// 環状に並んだエントリを、連続した範囲の視野が一定フレーム毎に 1 つずつ移動しながら見る状況を再現する.
+// ロードは指定フレーム数だけ遅れて完了し、実サイズは推定サイズから 0.8～1.25 倍ずれた値とする.
+// 予算は可視範囲の実サイズ合計の最大値の 1.5 倍とし、可視のものだけで予算を超えることは無い.
+// 一部のエントリはロードに失敗させ、予算が解放され再要求されないことを確認する.
+struct ResidencyTraceDesc
+{
+  uint32_t entryCount = 200;
+  uint32_t frameCount = 4000;
+  uint32_t visibleCount = 24;         // 同時に可視となるエントリ数.
+  uint32_t framesPerStep = 4;         // 視野が 1 エントリ分移動するフレーム数.
+  uint32_t loadLatencyFrames = 3;
+  uint32_t maxLoadRequestsPerFrame = 8;
+  uint32_t failingEntryInterval = 13; // ID がこの値で割り切れるエントリはロードに失敗する (0 で失敗なし).
+  uint32_t seed = 1;
+};
+
+struct ResidencyTraceResult
+{
+  uint32_t frameCount = 0;
+  uint64_t budgetBytes = 0;
+  uint64_t peakCommittedBytes = 0;    // 常駐 + ロード中の最大値.
+  uint64_t loadRequestCount = 0;
+  uint64_t evictCount = 0;
+  uint64_t budgetExceededFrames = 0;  // Evaluate 後に予算を超えていたフレーム数 (0 であること).
+  uint64_t visibleEvictCount = 0;     // そのフレームで可視のものを追い出した回数 (0 であること).
+  uint64_t lruViolationCount = 0;     // より古い不可視の常駐物を残して追い出した回数 (0 であること).
+  uint64_t missingVisibleCount = 0;   // Evaluate 後に可視だが常駐していなかったエントリ数の合計 (失敗したものを除く). ロード遅延の分は発生する.
+  uint32_t failedCount = 0;           // ロードに失敗したエントリ数.
+  uint64_t failedRequestCount = 0;    // 失敗したエントリを再度ロード要求した回数 (0 であること).
+  uint64_t failedChargeErrors = 0;    // 失敗時にロード中の確保分が解放されなかった回数 (0 であること).
+  uint64_t visibleCount = 0;          // 可視のエントリ数の合計.
+  bool     deterministic = false;     // 同じトレースを 2 回実行して判断が一致したか.
+  double   elapsedMs = 0.0;           // 1 回分の実行時間.
+};
+
+ResidencyTraceResult RunResidencyTraceSimulation(const ResidencyTraceDesc& desc = {});
@@ -0,0 +1,477 @@
+﻿#include "SceneTransforms.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TRANSFORM_AVX2_FUNC
+#else
+#include <cpuid.h>
+#define TRANSFORM_AVX2_FUNC __attribute__((target("avx2,fma")))
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+  // 1つの深さをジョブに分割する際の最小ノード数.
+  constexpr uint32_t kLevelGrainSize = 1024;
+  // モデル単位で分割する際の1ジョブあたりのモデル数.
+  constexpr uint32_t kModelGrainSize = 16;
+
+  bool DetectAvx2()
+  {
+#if defined(_MSC_VER)
+    int info[4]{};
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+      return false;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || !fma)
+    {
+      return false;
+    }
+    // OS が YMM レジスタを保存するか.
+    if ((_xgetbv(0) & 0x6) != 0x6)
+    {
+      return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+  }
+
+  // 2行ずつ 256bit レジスタで処理する 4x4 行列積.
+  TRANSFORM_AVX2_FUNC inline void MultiplyAvx2(float* out, const float* a, __m256 b0, __m256 b1, __m256 b2, __m256 b3)
+  {
+    for (int row = 0; row < 4; row += 2)
+    {
+      __m256 va = _mm256_loadu_ps(a + row * 4);
+      __m256 r = _mm256_mul_ps(_mm256_shuffle_ps(va, va, 0x00), b0);
+      r = _mm256_fmadd_ps(_mm256_shuffle_ps(va, va, 0x55), b1, r);
+      r = _mm256_fmadd_ps(_mm256_shuffle_ps(va, va, 0xAA), b2, r);
+      r = _mm256_fmadd_ps(_mm256_shuffle_ps(va, va, 0xFF), b3, r);
+      _mm256_storeu_ps(out + row * 4, r);
+    }
+  }
+
+  // 右側の行列が共通の count 個の行列積.
+  // 右側の行は 1 回だけ読み込み、2 個ずつ (4 本の独立した積和の連鎖) まとめて処理する.
+  TRANSFORM_AVX2_FUNC void MultiplyRunAvx2(XMFLOAT4X4* out, const XMFLOAT4X4* a, const float* m, uint32_t count)
+  {
+    __m256 b0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(m + 0));
+    __m256 b1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(m + 4));
+    __m256 b2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(m + 8));
+    __m256 b3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(m + 12));
+    uint32_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+      const float* a0 = &a[i].m[0][0];
+      __m256 va0 = _mm256_loadu_ps(a0 + 0);
+      __m256 va1 = _mm256_loadu_ps(a0 + 8);
+      __m256 va2 = _mm256_loadu_ps(a0 + 16);
+      __m256 va3 = _mm256_loadu_ps(a0 + 24);
+      __m256 r0 = _mm256_mul_ps(_mm256_shuffle_ps(va0, va0, 0x00), b0);
+      __m256 r1 = _mm256_mul_ps(_mm256_shuffle_ps(va1, va1, 0x00), b0);
+      __m256 r2 = _mm256_mul_ps(_mm256_shuffle_ps(va2, va2, 0x00), b0);
+      __m256 r3 = _mm256_mul_ps(_mm256_shuffle_ps(va3, va3, 0x00), b0);
+      r0 = _mm256_fmadd_ps(_mm256_shuffle_ps(va0, va0, 0x55), b1, r0);
+      r1 = _mm256_fmadd_ps(_mm256_shuffle_ps(va1, va1, 0x55), b1, r1);
+      r2 = _mm256_fmadd_ps(_mm256_shuffle_ps(va2, va2, 0x55), b1, r2);
+      r3 = _mm256_fmadd_ps(_mm256_shuffle_ps(va3, va3, 0x55), b1, r3);
+      r0 = _mm256_fmadd_ps(_mm256_shuffle_ps(va0, va0, 0xAA), b2, r0);
+      r1 = _mm256_fmadd_ps(_mm256_shuffle_ps(va1, va1, 0xAA), b2, r1);
+      r2 = _mm256_fmadd_ps(_mm256_shuffle_ps(va2, va2, 0xAA), b2, r2);
+      r3 = _mm256_fmadd_ps(_mm256_shuffle_ps(va3, va3, 0xAA), b2, r3);
+      r0 = _mm256_fmadd_ps(_mm256_shuffle_ps(va0, va0, 0xFF), b3, r0);
+      r1 = _mm256_fmadd_ps(_mm256_shuffle_ps(va1, va1, 0xFF), b3, r1);
+      r2 = _mm256_fmadd_ps(_mm256_shuffle_ps(va2, va2, 0xFF), b3, r2);
+      r3 = _mm256_fmadd_ps(_mm256_shuffle_ps(va3, va3, 0xFF), b3, r3);
+      float* o = &out[i].m[0][0];
+      _mm256_storeu_ps(o + 0, r0);
+      _mm256_storeu_ps(o + 8, r1);
+      _mm256_storeu_ps(o + 16, r2);
+      _mm256_storeu_ps(o + 24, r3);
+    }
+    if (i < count)
+    {
+      MultiplyAvx2(&out[i].m[0][0], &a[i].m[0][0], b0, b1, b2, b3);
+    }
+  }
+
+  TRANSFORM_AVX2_FUNC void MultiplyIndexedAvx2(XMFLOAT4X4* out, const XMFLOAT4X4* a, const XMFLOAT4X4* b, const uint32_t* parents, uint32_t count)
+  {
+    // 兄弟は連続して並んでいるため、同じ親を持つ範囲をまとめて処理する.
+    for (uint32_t begin = 0; begin < count;)
+    {
+      uint32_t end = begin + 1;
+      while (end < count && parents[end] == parents[begin])
+      {
+        ++end;
+      }
+      MultiplyRunAvx2(out + begin, a + begin, &b[parents[begin]].m[0][0], end - begin);
+      begin = end;
+    }
+  }
+
+  TRANSFORM_AVX2_FUNC void MultiplyUniformAvx2(XMFLOAT4X4* out, const XMFLOAT4X4* a, const XMFLOAT4X4& m, uint32_t count)
+  {
+    MultiplyRunAvx2(out, a, &m.m[0][0], count);
+  }
+}
+
+bool transform_math::IsAvx2Supported()
+{
+  static const bool supported = DetectAvx2();
+  return supported;
+}
+
+void transform_math::MultiplyMatricesIndexed(XMFLOAT4X4* out, const XMFLOAT4X4* a, const XMFLOAT4X4* b, const uint32_t* parents, uint32_t count)
+{
+  if (IsAvx2Supported())
+  {
+    MultiplyIndexedAvx2(out, a, b, parents, count);
+    return;
+  }
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    XMStoreFloat4x4(&out[i], XMMatrixMultiply(XMLoadFloat4x4(&a[i]), XMLoadFloat4x4(&b[parents[i]])));
+  }
+}
+
+void transform_math::MultiplyMatricesUniform(XMFLOAT4X4* out, const XMFLOAT4X4* a, const XMFLOAT4X4& m, uint32_t count)
+{
+  if (IsAvx2Supported())
+  {
+    MultiplyUniformAvx2(out, a, m, count);
+    return;
+  }
+  XMMATRIX mtx = XMLoadFloat4x4(&m);
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    XMStoreFloat4x4(&out[i], XMMatrixMultiply(XMLoadFloat4x4(&a[i]), mtx));
+  }
+}
+
+void SceneTransforms::Initialize(std::span<const XMFLOAT4X4> localMatrices, std::span<const uint32_t> parentIndices)
+{
+  assert(localMatrices.size() == parentIndices.size());
+  const auto nodeCount = uint32_t(localMatrices.size());
+
+  // 各ノードの深さを求める. 親が後ろにある場合にも対応するため再帰的に辿る.
+  std::vector<uint32_t> depths(nodeCount, InvalidIndex);
+  uint32_t maxDepth = 0;
+  for (uint32_t i = 0; i < nodeCount; ++i)
+  {
+    uint32_t depth = 0;
+    for (auto p = parentIndices[i]; p != InvalidIndex; p = parentIndices[p])
+    {
+      if (depths[p] != InvalidIndex)
+      {
+        depth += depths[p] + 1;
+        break;
+      }
+      depth++;
+    }
+    depths[i] = depth;
+    maxDepth = (std::max)(maxDepth, depth);
+  }
+  const uint32_t levelCount = nodeCount ? maxDepth + 1 : 0;
+
+  // 深さ順に並べる. 同じ深さの中では親の並び順に従うことで、兄弟が連続する.
+  std::vector<std::vector<uint32_t>> levels(levelCount);
+  for (uint32_t i = 0; i < nodeCount; ++i)
+  {
+    if (depths[i] == 0)
+    {
+      levels[0].push_back(i);
+    }
+  }
+  std::vector<std::vector<uint32_t>> children(nodeCount);
+  for (uint32_t i = 0; i < nodeCount; ++i)
+  {
+    if (parentIndices[i] != InvalidIndex)
+    {
+      children[parentIndices[i]].push_back(i);
+    }
+  }
+  for (uint32_t level = 1; level < levelCount; ++level)
+  {
+    for (auto parent : levels[level - 1])
+    {
+      levels[level].insert(levels[level].end(), children[parent].begin(), children[parent].end());
+    }
+  }
+
+  m_nodeIndices.clear();
+  m_nodeIndices.reserve(nodeCount);
+  m_levelOffsets.assign(1, 0);
+  for (const auto& nodes : levels)
+  {
+    m_nodeIndices.insert(m_nodeIndices.end(), nodes.begin(), nodes.end());
+    m_levelOffsets.push_back(uint32_t(m_nodeIndices.size()));
+  }
+  m_sortedIndices.resize(nodeCount);
+  for (uint32_t i = 0; i < nodeCount; ++i)
+  {
+    m_sortedIndices[m_nodeIndices[i]] = i;
+  }
+
+  m_localMatrices.resize(nodeCount);
+  m_worldMatrices.resize(nodeCount);
+  m_parents.resize(nodeCount);
+  m_childBegin.assign(nodeCount, 0);
+  m_childCount.assign(nodeCount, 0);
+  for (uint32_t i = 0; i < nodeCount; ++i)
+  {
+    auto src = m_nodeIndices[i];
+    m_localMatrices[i] = localMatrices[src];
+    auto parent = parentIndices[src];
+    m_parents[i] = parent == InvalidIndex ? InvalidIndex : m_sortedIndices[parent];
+    if (!children[src].empty())
+    {
+      m_childBegin[i] = m_sortedIndices[children[src].front()];
+      m_childCount[i] = uint32_t(children[src].size());
+    }
+  }
+
+  m_dirtyMarks.assign(nodeCount, 0);
+  m_dirtyLists.assign(levelCount, {});
+  m_levelAllDirty.assign(levelCount, 0);
+  m_changedMarks.assign(nodeCount, 0);
+  m_changedNodes.clear();
+  XMStoreFloat4x4(&m_rootTransform, XMMatrixIdentity());
+  // 初回は全て計算する.
+  if (levelCount > 0)
+  {
+    MarkLevelDirty(0);
+  }
+}
+
+void SceneTransforms::Clear()
+{
+  m_localMatrices.clear();
+  m_worldMatrices.clear();
+  m_parents.clear();
+  m_levelOffsets.assign(1, 0);
+  m_nodeIndices.clear();
+  m_sortedIndices.clear();
+  m_childBegin.clear();
+  m_childCount.clear();
+  m_dirtyMarks.clear();
+  m_dirtyLists.clear();
+  m_levelAllDirty.clear();
+  m_changedMarks.clear();
+  m_changedNodes.clear();
+}
+
+void SceneTransforms::SetRootTransform(FXMMATRIX rootTransform)
+{
+  XMFLOAT4X4 mtx;
+  XMStoreFloat4x4(&mtx, rootTransform);
+  if (std::memcmp(&mtx, &m_rootTransform, sizeof(mtx)) == 0)
+  {
+    return;
+  }
+  m_rootTransform = mtx;
+  if (GetLevelCount() > 0)
+  {
+    MarkLevelDirty(0);
+  }
+}
+
+void SceneTransforms::SetLocalMatrix(uint32_t nodeIndex, const XMFLOAT4X4& localMatrix)
+{
+  auto sortedIndex = m_sortedIndices[nodeIndex];
+  m_localMatrices[sortedIndex] = localMatrix;
+  MarkDirty(sortedIndex);
+}
+
+void SceneTransforms::MarkDirty(uint32_t sortedIndex)
+{
+  if (m_dirtyMarks[sortedIndex])
+  {
+    return;
+  }
+  m_dirtyMarks[sortedIndex] = 1;
+  auto level = uint32_t(std::upper_bound(m_levelOffsets.begin(), m_levelOffsets.end(), sortedIndex) - m_levelOffsets.begin()) - 1;
+  if (!m_levelAllDirty[level])
+  {
+    m_dirtyLists[level].push_back(sortedIndex);
+  }
+}
+
+void SceneTransforms::MarkLevelDirty(uint32_t level)
+{
+  m_levelAllDirty[level] = 1;
+  m_dirtyLists[level].clear();
+}
+
+void SceneTransforms::RecordChanged(uint32_t sortedIndex)
+{
+  if (!m_changedMarks[sortedIndex])
+  {
+    m_changedMarks[sortedIndex] = 1;
+    m_changedNodes.push_back(m_nodeIndices[sortedIndex]);
+  }
+}
+
+void SceneTransforms::ClearChangedNodes()
+{
+  for (auto nodeIndex : m_changedNodes)
+  {
+    m_changedMarks[m_sortedIndices[nodeIndex]] = 0;
+  }
+  m_changedNodes.clear();
+}
+
+void SceneTransforms::ComputeRange(uint32_t level, uint32_t begin, uint32_t end)
+{
+  auto offset = m_levelOffsets[level] + begin;
+  auto count = end - begin;
+  if (level == 0)
+  {
+    // ルートノードはモデル全体の変換を親とする.
+    transform_math::MultiplyMatricesUniform(&m_worldMatrices[offset], &m_localMatrices[offset], m_rootTransform, count);
+    return;
+  }
+  transform_math::MultiplyMatricesIndexed(&m_worldMatrices[offset], &m_localMatrices[offset],
+    m_worldMatrices.data(), &m_parents[offset], count);
+}
+
+void SceneTransforms::UpdateLevel(uint32_t level, bool parallel)
+{
+  const auto levelBegin = m_levelOffsets[level];
+  const auto levelEnd = m_levelOffsets[level + 1];
+  const bool hasNextLevel = level + 1 < GetLevelCount();
+
+  if (m_levelAllDirty[level])
+  {
+    // 深さ全体を連続領域としてまとめて計算.
+    auto levelSize = levelEnd - levelBegin;
+    if (parallel)
+    {
+      GetJobSystem()->ParallelFor(levelSize, kLevelGrainSize, [&](uint32_t begin, uint32_t end) {
+        ComputeRange(level, begin, end);
+      });
+    }
+    else
+    {
+      ComputeRange(level, 0, levelSize);
+    }
+    for (auto i = levelBegin; i < levelEnd; ++i)
+    {
+      m_dirtyMarks[i] = 0;
+      RecordChanged(i);
+    }
+    m_levelAllDirty[level] = 0;
+    if (hasNextLevel)
+    {
+      MarkLevelDirty(level + 1);
+    }
+    return;
+  }
+
+  // 変更のあったノードのみ計算し、子を次の深さの対象に加える.
+  auto& dirtyList = m_dirtyLists[level];
+  std::sort(dirtyList.begin(), dirtyList.end());
+  for (auto i : dirtyList)
+  {
+    ComputeRange(level, i - levelBegin, i - levelBegin + 1);
+    m_dirtyMarks[i] = 0;
+    RecordChanged(i);
+    if (hasNextLevel)
+    {
+      for (uint32_t c = 0; c < m_childCount[i]; ++c)
+      {
+        MarkDirty(m_childBegin[i] + c);
+      }
+    }
+  }
+  dirtyList.clear();
+}
+
+void SceneTransforms::UpdateWorld(FXMMATRIX rootTransform)
+{
+  SetRootTransform(rootTransform);
+  for (uint32_t level = 0; level < GetLevelCount(); ++level)
+  {
+    if (IsLevelDirty(level))
+    {
+      UpdateLevel(level, false);
+    }
+  }
+}
+
+void SceneTransforms::UpdateWorldFull(FXMMATRIX rootTransform)
+{
+  XMStoreFloat4x4(&m_rootTransform, rootTransform);
+  for (uint32_t level = 0; level < GetLevelCount(); ++level)
+  {
+    MarkLevelDirty(level);
+    UpdateLevel(level, false);
+  }
+}
+
+void SceneTransforms::UpdateWorldBatch(std::span<SceneTransforms* const> transforms, std::span<const XMFLOAT4X4> rootTransforms)
+{
+  assert(transforms.size() == rootTransforms.size());
+  auto& jobSystem = GetJobSystem();
+
+  // 小さなモデルはモデル単位で並列に処理.
+  // 1つの深さに多数のノードを持つ大きなモデルは、深さ毎にノード範囲を分割して並列化する.
+  std::vector<uint32_t> largeModels;
+  std::vector<uint32_t> smallModels;
+  for (uint32_t i = 0; i < transforms.size(); ++i)
+  {
+    auto* target = transforms[i];
+    target->SetRootTransform(XMLoadFloat4x4(&rootTransforms[i]));
+    bool isDirty = false;
+    bool isLarge = false;
+    for (uint32_t level = 0; level < target->GetLevelCount(); ++level)
+    {
+      isDirty |= target->IsLevelDirty(level);
+      isLarge |= target->GetLevelSize(level) >= kLevelGrainSize * 2;
+    }
+    if (!isDirty)
+    {
+      // 変更が無ければ何もしない.
+      continue;
+    }
+    (isLarge ? largeModels : smallModels).push_back(i);
+  }
+
+  jobSystem->ParallelFor(uint32_t(smallModels.size()), kModelGrainSize, [&](uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end; ++i)
+    {
+      auto* target = transforms[smallModels[i]];
+      for (uint32_t level = 0; level < target->GetLevelCount(); ++level)
+      {
+        if (target->IsLevelDirty(level))
+        {
+          target->UpdateLevel(level, false);
+        }
+      }
+    }
+  });
+  for (auto index : largeModels)
+  {
+    auto* target = transforms[index];
+    for (uint32_t level = 0; level < target->GetLevelCount(); ++level)
+    {
+      if (target->IsLevelDirty(level))
+      {
+        target->UpdateLevel(level, true);
+      }
+    }
+  }
+}
@@ -0,0 +1,90 @@
+﻿#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <DirectXMath.h>
+
+// シーングラフの行列を SoA (Structure of Arrays) で保持する.
+// ノードは深さ順に並べ替えて格納するため、同じ深さのノードは連続した領域で
+// まとめて処理でき、親は必ず子よりも前に計算済みとなる.
+// 同じ深さの中では親の順に並べるため、あるノードの子は連続した範囲となる.
+//
+// 変更のあったノードとその子孫のみを再計算する (ダーティフラグ方式).
+// 再計算されたワールド行列は変更ノードとして記録し、転送側で差分のみを扱える.
+class SceneTransforms
+{
+public:
+  static constexpr uint32_t InvalidIndex = UINT32_MAX;
+
+  // parentIndices は元のノード順で親のインデックス (ルートは InvalidIndex).
+  void Initialize(std::span<const DirectX::XMFLOAT4X4> localMatrices, std::span<const uint32_t> parentIndices);
+  void Clear();
+
+  uint32_t GetNodeCount() const { return uint32_t(m_localMatrices.size()); }
+  uint32_t GetLevelCount() const { return uint32_t(m_levelOffsets.size()) - 1; }
+
+  // ワールド行列を更新. 変更のあった部分のみ深さ単位で順に処理する.
+  void UpdateWorld(DirectX::FXMMATRIX rootTransform);
+  // 変更の有無に関わらず全ノードを再計算する.
+  void UpdateWorldFull(DirectX::FXMMATRIX rootTransform);
+  uint32_t GetLevelSize(uint32_t level) const { return m_levelOffsets[level + 1] - m_levelOffsets[level]; }
+
+  // モデル全体の変換を設定. 値が変わった場合のみルート以下がダーティとなる.
+  void SetRootTransform(DirectX::FXMMATRIX rootTransform);
+  // ノードのローカル行列を設定 (元のノード順). 子孫がダーティとなる.
+  void SetLocalMatrix(uint32_t nodeIndex, const DirectX::XMFLOAT4X4& localMatrix);
+
+  // 前回 ClearChangedNodes() を呼んでから再計算されたノード (元のノード順).
+  std::span<const uint32_t> GetChangedNodes() const { return m_changedNodes; }
+  void ClearChangedNodes();
+
+  // 元のノード順でのワールド行列.
+  const DirectX::XMFLOAT4X4& GetWorldMatrix(uint32_t nodeIndex) const { return m_worldMatrices[m_sortedIndices[nodeIndex]]; }
+  // 並べ替え後の配列と元のノード番号の対応.
+  std::span<const DirectX::XMFLOAT4X4> GetSortedWorldMatrices() const { return m_worldMatrices; }
+  std::span<const uint32_t> GetNodeIndices() const { return m_nodeIndices; }
+  const DirectX::XMFLOAT4X4& GetRootTransform() const { return m_rootTransform; }
+
+  // 複数モデルの行列をまとめて更新.
+  // モデル間と、大きな深さ内のノード範囲をジョブプールで並列化する.
+  static void UpdateWorldBatch(std::span<SceneTransforms* const> transforms, std::span<const DirectX::XMFLOAT4X4> rootTransforms);
+
+private:
+  void MarkDirty(uint32_t sortedIndex);
+  void MarkLevelDirty(uint32_t level);
+  bool IsLevelDirty(uint32_t level) const { return m_levelAllDirty[level] || !m_dirtyLists[level].empty(); }
+  // 1つの深さのダーティなノードを再計算し、子へ伝搬する.
+  // parallel が true であれば深さ全体の再計算をジョブプールで分割する.
+  void UpdateLevel(uint32_t level, bool parallel);
+  void ComputeRange(uint32_t level, uint32_t begin, uint32_t end);
+  void RecordChanged(uint32_t sortedIndex);
+
+  std::vector<DirectX::XMFLOAT4X4> m_localMatrices;   // 深さ順.
+  std::vector<DirectX::XMFLOAT4X4> m_worldMatrices;   // 深さ順.
+  std::vector<uint32_t> m_parents;                    // 深さ順での親の位置.
+  std::vector<uint32_t> m_levelOffsets;               // 深さ毎の開始位置 (末尾は総数).
+  std::vector<uint32_t> m_nodeIndices;                // 並べ替え後 -> 元のノード番号.
+  std::vector<uint32_t> m_sortedIndices;              // 元のノード番号 -> 並べ替え後.
+  std::vector<uint32_t> m_childBegin;                 // 子の開始位置 (深さ順).
+  std::vector<uint32_t> m_childCount;
+  DirectX::XMFLOAT4X4 m_rootTransform{};
+
+  // ダーティ管理.
+  std::vector<uint8_t>  m_dirtyMarks;                 // 再計算予定 (深さ順).
+  std::vector<std::vector<uint32_t>> m_dirtyLists;    // 深さ毎の再計算対象.
+  std::vector<uint8_t>  m_levelAllDirty;              // 深さ全体が再計算対象.
+  std::vector<uint8_t>  m_changedMarks;               // 変更記録済み (深さ順).
+  std::vector<uint32_t> m_changedNodes;               // 変更されたノード (元のノード順).
+};
+
+namespace transform_math
+{
+  // out[i] = a[i] * b[parents[i]] (行ベクトル形式, XMMatrixMultiply と同じ順序) をまとめて計算.
+  // AVX2 が使用可能な環境ではそちらを使用する.
+  void MultiplyMatricesIndexed(DirectX::XMFLOAT4X4* out, const DirectX::XMFLOAT4X4* a,
+    const DirectX::XMFLOAT4X4* b, const uint32_t* parents, uint32_t count);
+  // out[i] = a[i] * m
+  void MultiplyMatricesUniform(DirectX::XMFLOAT4X4* out, const DirectX::XMFLOAT4X4* a,
+    const DirectX::XMFLOAT4X4& m, uint32_t count);
+  bool IsAvx2Supported();
+}
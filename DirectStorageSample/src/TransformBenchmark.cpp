@@ -0,0 +1,167 @@
+﻿#include "TransformBenchmark.h"
+#include "SceneTransforms.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+  // 従来の GraphNode 相当.
+  struct NodeAoS
+  {
+    XMFLOAT4X4 xform;
+    XMFLOAT4X4 worldTransform;
+    uint32_t matrixIdx;
+    uint32_t nodeNameIndex;
+    uint32_t parentIndex;
+  };
+
+  void MakeRandomTree(uint32_t nodeCount, std::vector<XMFLOAT4X4>& localMatrices, std::vector<uint32_t>& parentIndices)
+  {
+    std::default_random_engine rng;
+    std::uniform_real_distribution<float> d(-1.0f, 1.0f);
+    localMatrices.resize(nodeCount);
+    parentIndices.resize(nodeCount);
+    for (uint32_t i = 0; i < nodeCount; ++i)
+    {
+      auto mtx = XMMatrixRotationY(d(rng)) * XMMatrixTranslation(d(rng), d(rng), d(rng));
+      XMStoreFloat4x4(&localMatrices[i], mtx);
+      parentIndices[i] = (i == 0) ? SceneTransforms::InvalidIndex : uint32_t(rng() % i);
+    }
+  }
+
+  template<typename Func>
+  double MeasureMilliseconds(uint32_t iterations, Func func)
+  {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+      func(i);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+  }
+}
+
+TransformBenchmarkResult RunTransformBenchmark(uint32_t modelCount, uint32_t nodeCount, uint32_t iterations)
+{
+  TransformBenchmarkResult result;
+  result.modelCount = modelCount;
+  result.nodeCount = nodeCount;
+  result.iterations = iterations;
+  result.avx2 = transform_math::IsAvx2Supported();
+
+  // ランダムな木構造を1つ作り、全モデルで共有する.
+  std::vector<XMFLOAT4X4> localMatrices;
+  std::vector<uint32_t> parentIndices;
+  MakeRandomTree(nodeCount, localMatrices, parentIndices);
+
+  std::vector<std::vector<NodeAoS>> aosModels(modelCount);
+  std::vector<SceneTransforms> soaModels(modelCount);
+  std::vector<SceneTransforms*> soaPointers(modelCount);
+  for (uint32_t m = 0; m < modelCount; ++m)
+  {
+    auto& nodes = aosModels[m];
+    nodes.resize(nodeCount);
+    for (uint32_t i = 0; i < nodeCount; ++i)
+    {
+      nodes[i].xform = localMatrices[i];
+      nodes[i].parentIndex = parentIndices[i];
+    }
+    soaModels[m].Initialize(localMatrices, parentIndices);
+    soaPointers[m] = &soaModels[m];
+  }
+  std::vector<XMFLOAT4X4> rootTransforms(modelCount);
+  auto updateRoots = [&](uint32_t frame) {
+    for (uint32_t m = 0; m < modelCount; ++m)
+    {
+      XMStoreFloat4x4(&rootTransforms[m], XMMatrixRotationY(0.01f * frame) * XMMatrixTranslation(float(m), 0.0f, 0.0f));
+    }
+  };
+
+  result.aosScalarMs = MeasureMilliseconds(iterations, [&](uint32_t frame) {
+    updateRoots(frame);
+    for (uint32_t m = 0; m < modelCount; ++m)
+    {
+      auto& nodes = aosModels[m];
+      XMMATRIX transform = XMLoadFloat4x4(&rootTransforms[m]);
+      for (auto& node : nodes)
+      {
+        XMMATRIX mtxParent = transform;
+        if (node.parentIndex != SceneTransforms::InvalidIndex)
+        {
+          mtxParent = XMLoadFloat4x4(&nodes[node.parentIndex].worldTransform);
+        }
+        XMStoreFloat4x4(&node.worldTransform, XMMatrixMultiply(XMLoadFloat4x4(&node.xform), mtxParent));
+      }
+    }
+  });
+
+  result.soaSingleThreadMs = MeasureMilliseconds(iterations, [&](uint32_t frame) {
+    updateRoots(frame);
+    for (uint32_t m = 0; m < modelCount; ++m)
+    {
+      soaModels[m].UpdateWorld(XMLoadFloat4x4(&rootTransforms[m]));
+    }
+  });
+
+  result.soaParallelMs = MeasureMilliseconds(iterations, [&](uint32_t frame) {
+    updateRoots(frame);
+    SceneTransforms::UpdateWorldBatch(soaPointers, rootTransforms);
+  });
+  return result;
+}
+
+std::vector<IncrementalTransformBenchmarkResult> RunIncrementalTransformBenchmark(
+  std::span<const float> changeRatios, uint32_t modelCount, uint32_t nodeCount, uint32_t iterations)
+{
+  std::vector<XMFLOAT4X4> localMatrices;
+  std::vector<uint32_t> parentIndices;
+  MakeRandomTree(nodeCount, localMatrices, parentIndices);
+
+  std::vector<SceneTransforms> models(modelCount);
+  for (auto& model : models)
+  {
+    model.Initialize(localMatrices, parentIndices);
+  }
+
+  std::vector<IncrementalTransformBenchmarkResult> results;
+  for (auto ratio : changeRatios)
+  {
+    auto& result = results.emplace_back();
+    result.changeRatio = ratio;
+    // 先頭から指定割合のモデルのみ毎フレーム動かす.
+    const auto movingCount = uint32_t(modelCount * std::clamp(ratio, 0.0f, 1.0f));
+    auto getRoot = [&](uint32_t m, uint32_t frame) {
+      float angle = (m < movingCount) ? 0.01f * (frame + 1) : 0.0f;
+      return XMMatrixRotationY(angle) * XMMatrixTranslation(float(m), 0.0f, 0.0f);
+    };
+    for (uint32_t m = 0; m < modelCount; ++m)
+    {
+      models[m].UpdateWorldFull(getRoot(m, 0));
+    }
+
+    result.fullMs = MeasureMilliseconds(iterations, [&](uint32_t frame) {
+      for (uint32_t m = 0; m < modelCount; ++m)
+      {
+        models[m].UpdateWorldFull(getRoot(m, frame));
+        models[m].ClearChangedNodes();
+      }
+    });
+
+    uint64_t changedNodes = 0;
+    result.incrementalMs = MeasureMilliseconds(iterations, [&](uint32_t frame) {
+      for (uint32_t m = 0; m < modelCount; ++m)
+      {
+        models[m].UpdateWorld(getRoot(m, frame + iterations));
+        changedNodes += models[m].GetChangedNodes().size();
+        models[m].ClearChangedNodes();
+      }
+    });
+    result.changedNodesPerFrame = changedNodes / iterations;
+  }
+  return results;
+}
@@ -0,0 +1,33 @@
+﻿#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// シーングラフ行列更新の CPU ベンチマーク.
+// 従来の AoS 形式での逐次更新と、SoA 形式 (単一スレッド/並列) を比較する.
+struct TransformBenchmarkResult
+{
+  uint32_t modelCount = 0;
+  uint32_t nodeCount = 0;
+  uint32_t iterations = 0;
+  bool     avx2 = false;
+  // 1回あたりの平均時間 (ミリ秒).
+  double aosScalarMs = 0.0;
+  double soaSingleThreadMs = 0.0;
+  double soaParallelMs = 0.0;
+};
+
+TransformBenchmarkResult RunTransformBenchmark(uint32_t modelCount = 10000, uint32_t nodeCount = 100, uint32_t iterations = 10);
+
+// 全ノード再計算と、変更ノードのみの差分更新の比較.
+// changeRatio はフレーム毎にルート変換が変化するモデルの割合.
+struct IncrementalTransformBenchmarkResult
+{
+  float  changeRatio = 0.0f;
+  double fullMs = 0.0;
+  double incrementalMs = 0.0;
+  uint64_t changedNodesPerFrame = 0;
+};
+
+std::vector<IncrementalTransformBenchmarkResult> RunIncrementalTransformBenchmark(
+  std::span<const float> changeRatios, uint32_t modelCount = 10000, uint32_t nodeCount = 100, uint32_t iterations = 10);
@@ -0,0 +1,42 @@
+﻿#pragma once
+#include <cstdint>
+#include <deque>
+
+// フレーム単位で使い捨てるアップロード領域の割り当て管理 (リングバッファ).
+// 各フレームの割り当ては FinishFrame で GPU のフェンス値と紐付けられ、
+// そのフェンス値の完了が ReleaseCompleted で通知されるまで再利用されない.
+// オフセットの管理のみを行うため、GPU 無しでもフェンスを模擬して動作確認できる.
+class UploadRingAllocator
+{
+public:
+  static constexpr uint64_t InvalidOffset = UINT64_MAX;
+
+  void Reset(uint64_t capacity);
+
+  // 割り当てに失敗した場合は InvalidOffset を返す.
+  uint64_t Allocate(uint64_t size, uint64_t alignment);
+  // 現在のフレームで割り当てた領域を fenceValue の完了後に解放されるよう登録.
+  void FinishFrame(uint64_t fenceValue);
+  // completedFenceValue までに完了したフレームの領域を解放.
+  void ReleaseCompleted(uint64_t completedFenceValue);
+
+  uint64_t GetCapacity() const { return m_capacity; }
+  // 使用中(GPU 待ちを含む)のサイズ. アライメントや折り返しによる未使用領域も含む.
+  uint64_t GetUsedBytes() const { return m_usedBytes; }
+  uint32_t GetPendingFrameCount() const { return uint32_t(m_frames.size()); }
+
+private:
+  struct FrameSegment
+  {
+    uint64_t fenceValue;
+    uint64_t endOffset;  // このフレームの割り当て終端 (解放後の tail).
+    uint64_t bytes;      // このフレームで消費したサイズ.
+  };
+
+  uint64_t m_capacity = 0;
+  uint64_t m_head = 0;        // 次に割り当てる位置.
+  uint64_t m_tail = 0;        // 使用中の先頭位置.
+  uint64_t m_usedBytes = 0;
+  uint64_t m_frameBytes = 0;  // 現在のフレームで消費したサイズ.
+  std::deque<FrameSegment> m_frames;
+};
@@ -0,0 +1,119 @@
+﻿#include "UploadRingBuffer.h"
+#include "GfxDevice.h"
+#include <d3dx12.h>
+#include <algorithm>
+
+void UploadRingBuffer::Initialize(UINT64 capacity)
+{
+  CreateBuffer(capacity);
+  m_requiredCapacity = 0;
+  m_growCount = 0;
+}
+
+void UploadRingBuffer::CreateBuffer(UINT64 capacity)
+{
+  auto& gfxDevice = GetGfxDevice();
+  auto resDesc = CD3DX12_RESOURCE_DESC::Buffer(capacity);
+  m_buffer = gfxDevice->CreateBuffer(resDesc, D3D12_HEAP_TYPE_UPLOAD);
+
+  // アップロードヒープは CPU から読まないため、マップしたままで使用する.
+  void* p = nullptr;
+  D3D12_RANGE readRange{ 0, 0 };
+  m_buffer->Map(0, &readRange, &p);
+  m_mapped = reinterpret_cast<UINT8*>(p);
+  m_allocator.Reset(capacity);
+}
+
+void UploadRingBuffer::Shutdown()
+{
+  if (m_buffer)
+  {
+    m_buffer->Unmap(0, nullptr);
+  }
+  m_mapped = nullptr;
+  m_buffer.Reset();
+  m_allocator.Reset(0);
+  m_pendingCopies.clear();
+  m_retiredBuffers.clear();
+}
+
+void UploadRingBuffer::BeginFrame()
+{
+  auto& gfxDevice = GetGfxDevice();
+  auto completedFenceValue = gfxDevice->GetCompletedFenceValue();
+  m_allocator.ReleaseCompleted(completedFenceValue);
+  std::erase_if(m_retiredBuffers, [&](const auto& v) { return v.fenceValue <= completedFenceValue; });
+  if (m_requiredCapacity <= m_allocator.GetCapacity())
+  {
+    return;
+  }
+  // 使用中の領域は古いバッファに残したまま、新しいバッファを空の状態から使う.
+  // 古いバッファは以前のフレームの処理が全て終わる、このフレームのフェンス値の完了まで保持する.
+  m_buffer->Unmap(0, nullptr);
+  m_retiredBuffers.emplace_back(RetiredBuffer{ m_buffer, gfxDevice->GetFrameFenceValue() });
+  CreateBuffer(m_requiredCapacity);
+  m_growCount++;
+}
+
+bool UploadRingBuffer::Allocate(UINT64 size, UINT64 alignment, Allocation& allocation)
+{
+  m_frameRequestedBytes += size + alignment;
+  auto offset = m_allocator.Allocate(size, alignment);
+  if (offset == UploadRingAllocator::InvalidOffset)
+  {
+    m_frameAllocationFailed = true;
+    return false;
+  }
+  allocation.cpuAddress = m_mapped + offset;
+  allocation.gpuAddress = m_buffer->GetGPUVirtualAddress() + offset;
+  allocation.offset = offset;
+  return true;
+}
+
+void UploadRingBuffer::EnqueueCopy(ID3D12Resource* dst, UINT64 dstOffset, const Allocation& src, UINT64 size)
+{
+  m_pendingCopies.emplace_back(CopyCommand{ dst, dstOffset, src.offset, size });
+}
+
+void UploadRingBuffer::FlushCopies(ID3D12GraphicsCommandList* commandList, D3D12_RESOURCE_STATES dstState)
+{
+  if (m_pendingCopies.empty())
+  {
+    return;
+  }
+  // 転送先毎にまとめて、バリアを重複させないようにする.
+  std::sort(m_pendingCopies.begin(), m_pendingCopies.end(),
+    [](const CopyCommand& a, const CopyCommand& b) { return a.dst < b.dst; });
+  m_barriers.clear();
+  for (const auto& copy : m_pendingCopies)
+  {
+    // バッファは ExecuteCommandLists の完了時に COMMON へ戻り、コピー先へは暗黙に昇格する.
+    // そのためコピー後の遷移のみを行う.
+    commandList->CopyBufferRegion(copy.dst, copy.dstOffset, m_buffer.Get(), copy.srcOffset, copy.size);
+    if (m_barriers.empty() || m_barriers.back().Transition.pResource != copy.dst)
+    {
+      m_barriers.emplace_back(CD3DX12_RESOURCE_BARRIER::Transition(copy.dst, D3D12_RESOURCE_STATE_COPY_DEST, dstState));
+    }
+  }
+  commandList->ResourceBarrier(UINT(m_barriers.size()), m_barriers.data());
+  m_pendingCopies.clear();
+}
+
+void UploadRingBuffer::EndFrame()
+{
+  // このフレームの割り当ては Present 時にシグナルされるフェンス値の完了で解放される.
+  m_allocator.FinishFrame(GetGfxDevice()->GetFrameFenceValue());
+
+  // 不足したフレームの要求が、GPU が処理中のフレームの分と合わせても収まる大きさを求める.
+  if (m_frameAllocationFailed)
+  {
+    auto capacity = (std::max)(m_allocator.GetCapacity(), UINT64(1));
+    while (capacity < m_frameRequestedBytes * (GfxDevice::BackBufferCount + 1))
+    {
+      capacity *= 2;
+    }
+    m_requiredCapacity = (std::max)(m_requiredCapacity, capacity);
+  }
+  m_frameRequestedBytes = 0;
+  m_frameAllocationFailed = false;
+}
@@ -0,0 +1,69 @@
+﻿#pragma once
+#include <vector>
+#include <wrl.h>
+#include <d3d12.h>
+
+#include "UploadRingAllocator.h"
+
+// 毎フレーム更新するデータ転送用のアップロードバッファ.
+// 常時マップした 1 つのバッファをリングとして使い、GPU が参照中の領域はフェンスで保護する.
+// 割り当てに失敗したフレームがあれば、次のフレームの開始時にそのフレームの要求が収まる大きさへ拡張する.
+class UploadRingBuffer
+{
+public:
+  template<class T>
+  using ComPtr = Microsoft::WRL::ComPtr<T>;
+
+  struct Allocation
+  {
+    void* cpuAddress = nullptr;
+    D3D12_GPU_VIRTUAL_ADDRESS gpuAddress = 0;
+    UINT64 offset = 0;
+  };
+
+  void Initialize(UINT64 capacity);
+  void Shutdown();
+
+  // フレーム開始時に呼び出す. GPU の処理が完了した領域を再利用可能にする.
+  // 前のフレームで領域が不足していた場合はバッファを拡張する.
+  void BeginFrame();
+  // 領域が不足している場合は false を返す. 不足分は次のフレームの拡張サイズに反映される.
+  bool Allocate(UINT64 size, UINT64 alignment, Allocation& allocation);
+  // 割り当て領域から dst へのコピーを予約.
+  void EnqueueCopy(ID3D12Resource* dst, UINT64 dstOffset, const Allocation& src, UINT64 size);
+  // 予約したコピーをまとめて発行し、転送先を dstState へ遷移する. バリアは転送先毎に 1 回とする.
+  // 転送先はバッファであること (COMMON からの暗黙の昇格を利用する).
+  void FlushCopies(ID3D12GraphicsCommandList* commandList, D3D12_RESOURCE_STATES dstState);
+  // フレームのコマンドを Submit した後に呼び出す.
+  void EndFrame();
+
+  const UploadRingAllocator& GetAllocator() const { return m_allocator; }
+  uint32_t GetGrowCount() const { return m_growCount; }
+private:
+  void CreateBuffer(UINT64 capacity);
+
+  struct CopyCommand
+  {
+    ID3D12Resource* dst;
+    UINT64 dstOffset;
+    UINT64 srcOffset;
+    UINT64 size;
+  };
+  ComPtr<ID3D12Resource1> m_buffer;
+  UINT8* m_mapped = nullptr;
+  UploadRingAllocator m_allocator;
+  std::vector<CopyCommand> m_pendingCopies;
+  std::vector<D3D12_RESOURCE_BARRIER> m_barriers;
+
+  UINT64 m_frameRequestedBytes = 0;   // 現在のフレームで要求されたサイズ (失敗分を含む).
+  bool   m_frameAllocationFailed = false;
+  UINT64 m_requiredCapacity = 0;      // 次のフレーム開始時に必要な容量.
+  uint32_t m_growCount = 0;
+  // 拡張前のバッファは GPU が参照し終わるまで保持しておく.
+  struct RetiredBuffer
+  {
+    ComPtr<ID3D12Resource1> buffer;
+    UINT64 fenceValue;
+  };
+  std::vector<RetiredBuffer> m_retiredBuffers;
+};
@@ -0,0 +1,121 @@
+﻿#include "UploadRingStress.h"
+#include "UploadRingAllocator.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace
+{
+  struct LiveRange
+  {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t fenceValue;
+  };
+
+  bool IsOverlapped(const LiveRange& a, uint64_t offset, uint64_t size)
+  {
+    return offset < a.offset + a.size && a.offset < offset + size;
+  }
+
+  // 定数バッファ相当の小さなものを中心に、まれに容量の半分程度の大きなものを混ぜる.
+  uint64_t RandomSize(std::default_random_engine& rng, uint64_t capacity)
+  {
+    auto r = rng() % 100;
+    if (r < 80) return 16 + rng() % 512;
+    if (r < 98) return 1024 + rng() % 4096;
+    return capacity / 4 + rng() % (capacity / 4);
+  }
+}
+
+UploadRingStressResult RunUploadRingStress(uint32_t frameCount, uint64_t capacity)
+{
+  UploadRingStressResult result;
+  result.frameCount = frameCount;
+
+  UploadRingAllocator allocator;
+  allocator.Reset(capacity);
+  std::default_random_engine rng(1);
+  std::vector<LiveRange> live;
+  uint64_t fenceValue = 0;
+  uint64_t completedFenceValue = 0;
+  uint64_t lastOffset = 0;
+
+  auto start = std::chrono::high_resolution_clock::now();
+  for (uint32_t frame = 0; frame < frameCount; ++frame)
+  {
+    // GPU は 0～3 フレーム遅れて完了する.
+    auto latency = rng() % 4;
+    completedFenceValue = (std::max)(completedFenceValue, fenceValue > latency ? fenceValue - latency : 0);
+    allocator.ReleaseCompleted(completedFenceValue);
+    std::erase_if(live, [&](const LiveRange& r) { return r.fenceValue <= completedFenceValue; });
+
+    const auto signalValue = fenceValue + 1;
+    const auto allocationsInFrame = rng() % 8;
+    for (uint32_t i = 0; i < allocationsInFrame; ++i)
+    {
+      auto size = RandomSize(rng, capacity);
+      uint64_t alignment = (rng() % 2) ? 256 : 16;
+      auto usedBefore = allocator.GetUsedBytes();
+      auto offset = allocator.Allocate(size, alignment);
+      if (offset == UploadRingAllocator::InvalidOffset)
+      {
+        result.failedCount++;
+        result.accountingErrors += allocator.GetUsedBytes() != usedBefore ? 1 : 0;
+        continue;
+      }
+      result.allocationCount++;
+      result.misalignedCount += (offset % alignment != 0 || offset + size > capacity) ? 1 : 0;
+      result.wrapCount += (offset < lastOffset) ? 1 : 0;
+      lastOffset = offset;
+      for (const auto& range : live)
+      {
+        result.overlapCount += IsOverlapped(range, offset, size) ? 1 : 0;
+      }
+      live.push_back(LiveRange{ offset, size, signalValue });
+    }
+
+    uint64_t liveBytes = 0;
+    for (const auto& range : live)
+    {
+      liveBytes += range.size;
+    }
+    auto usedBytes = allocator.GetUsedBytes();
+    result.accountingErrors += (usedBytes < liveBytes || usedBytes > capacity) ? 1 : 0;
+
+    allocator.FinishFrame(signalValue);
+    fenceValue = signalValue;
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  result.elapsedMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+  // 容量を超える要求は、使用中の領域があっても無くても失敗し状態を変えない.
+  {
+    auto usedBefore = allocator.GetUsedBytes();
+    auto pendingBefore = allocator.GetPendingFrameCount();
+    result.oversizeRejected =
+      allocator.Allocate(capacity + 1, 16) == UploadRingAllocator::InvalidOffset &&
+      allocator.GetUsedBytes() == usedBefore && allocator.GetPendingFrameCount() == pendingBefore;
+  }
+
+  // GPU が止まったまま埋め尽くし、失敗後も状態が変わらないこと.
+  // 完了後は全て解放される.
+  {
+    uint64_t signalValue = fenceValue + 1;
+    while (allocator.Allocate(256, 256) != UploadRingAllocator::InvalidOffset)
+    {
+    }
+    auto usedBefore = allocator.GetUsedBytes();
+    result.failureKeepsState =
+      allocator.Allocate(256, 256) == UploadRingAllocator::InvalidOffset &&
+      allocator.Allocate(16, 16) == UploadRingAllocator::InvalidOffset &&
+      allocator.GetUsedBytes() == usedBefore;
+    allocator.FinishFrame(signalValue);
+    allocator.ReleaseCompleted(signalValue);
+    result.fullyReleased = allocator.GetUsedBytes() == 0 && allocator.GetPendingFrameCount() == 0;
+  }
+  result.oversizeRejected = result.oversizeRejected &&
+    allocator.Allocate(capacity + 1, 16) == UploadRingAllocator::InvalidOffset && allocator.GetUsedBytes() == 0;
+  return result;
+}
@@ -0,0 +1,23 @@
+﻿#pragma once
+#include <cstdint>
+
+// UploadRingAllocator の動作検証.
+// GPU の完了が数フレーム遅れる状況をフェンス値で模擬し、ランダムなサイズの割り当てを繰り返す.
+// 折り返しを含めて使用中の領域と重ならないこと、フェンスの完了前に再利用されないこと、
+// 容量を超える要求や満杯時の失敗が状態を変えないことを確認する.
+struct UploadRingStressResult
+{
+  uint32_t frameCount = 0;
+  uint64_t allocationCount = 0;
+  uint64_t failedCount = 0;        // 空きが無く失敗した回数.
+  uint64_t wrapCount = 0;          // 先頭へ折り返した回数.
+  uint64_t overlapCount = 0;       // GPU 待ちを含む使用中の領域と重なった回数 (0 であること).
+  uint64_t misalignedCount = 0;    // アライメントや範囲が不正だった回数 (0 であること).
+  uint64_t accountingErrors = 0;   // 使用量が生存中の割り当ての合計未満、または容量超過だった回数 (0 であること).
+  bool     oversizeRejected = false;   // 容量を超える要求が失敗し、状態が変わらないか.
+  bool     failureKeepsState = false;  // 満杯時の失敗で状態が変わらないか.
+  bool     fullyReleased = false;      // 全フェンスの完了後に使用量が 0 に戻るか.
+  double   elapsedMs = 0.0;
+};
+
+UploadRingStressResult RunUploadRingStress(uint32_t frameCount = 200000, uint64_t capacity = 64 * 1024);
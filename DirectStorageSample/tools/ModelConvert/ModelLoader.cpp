@@ -1,4 +1,5 @@
 ﻿#include "ModelConvert.h"
+#include "SinglePassDownsampler.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
@@ -331,6 +332,49 @@ static void BuildNode(uint32_t nodeIndex, model::ModelData& modelData, const aiN
   }
 }
 
+// 1 ピクセルが 8bit x 4 のフォーマットか. チャンネルの並びは縮小結果に影響しない.
+static bool IsByte4Format(DXGI_FORMAT format)
+{
+  switch (format)
+  {
+  case DXGI_FORMAT_R8G8B8A8_UNORM:
+  case DXGI_FORMAT_B8G8R8A8_UNORM:
+  case DXGI_FORMAT_B8G8R8X8_UNORM:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// SinglePassDownsampler でミップマップを作成する.
+// ベースレベルの読み込みが 1 回で済み、タイル単位で全コアを使う.
+static HRESULT GenerateMipMapsSinglePass(const DirectX::ScratchImage& image, DirectX::ScratchImage& mipChain)
+{
+  const auto& metadata = image.GetMetadata();
+  size_t mipLevels = 1;
+  while ((std::max(metadata.width, metadata.height) >> mipLevels) != 0)
+  {
+    ++mipLevels;
+  }
+  HRESULT hr = mipChain.Initialize2D(metadata.format, metadata.width, metadata.height, 1, mipLevels);
+  if (FAILED(hr))
+  {
+    return hr;
+  }
+
+  uint8_t* dstBase = mipChain.GetPixels();
+  std::vector<MipLevelLayout> levels(mipLevels);
+  for (size_t i = 0; i < mipLevels; ++i)
+  {
+    const auto dstImage = mipChain.GetImage(i, 0, 0);
+    levels[i] = MipLevelLayout{ uint32_t(dstImage->width), uint32_t(dstImage->height), uint64_t(dstImage->pixels - dstBase), uint32_t(dstImage->rowPitch) };
+  }
+  const auto srcImage = image.GetImage(0, 0, 0);
+  SinglePassDownsampler downsampler;
+  downsampler.Build(srcImage->pixels, uint32_t(srcImage->rowPitch), dstBase, levels, MipColorSpace::Linear, true);
+  return S_OK;
+}
+
 static std::vector<byte> LoadTextureCore(const uint8_t* data, size_t size)
 {
   std::vector<byte> buffer;
@@ -356,10 +400,18 @@ static std::vector<byte> LoadTextureCore(const uint8_t* data, size_t size)
   if (metadata.mipLevels == 1)
   {
     // ミップマップを作成する.
+    // 8bit x 4 の 2D テクスチャは SinglePassDownsampler で、それ以外は DirectXTex で作成する.
     DirectX::ScratchImage mipChain;
-    TEX_FILTER_FLAGS flags = DirectX::TEX_FILTER_DEFAULT;
-    flags |= DirectX::TEX_FILTER_BOX | TEX_FILTER_FORCE_NON_WIC;
-    hr = DirectX::GenerateMipMaps(image.GetImages(), image.GetImageCount(), image.GetMetadata(), flags, 0, mipChain);
+    if (IsByte4Format(metadata.format) && metadata.dimension == TEX_DIMENSION_TEXTURE2D && metadata.arraySize == 1)
+    {
+      hr = GenerateMipMapsSinglePass(image, mipChain);
+    }
+    else
+    {
+      TEX_FILTER_FLAGS flags = DirectX::TEX_FILTER_DEFAULT;
+      flags |= DirectX::TEX_FILTER_BOX | TEX_FILTER_FORCE_NON_WIC;
+      hr = DirectX::GenerateMipMaps(image.GetImages(), image.GetImageCount(), image.GetMetadata(), flags, 0, mipChain);
+    }
     image = std::move(mipChain);
     metadata = image.GetMetadata();
   }
@@ -0,0 +1,164 @@
+﻿#pragma once
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+// 使用するワーカー数を決める. 0 の場合はハードウェアスレッド数.
+inline uint32_t ResolveWorkerCount(uint32_t workerCount, uint32_t taskCount)
+{
+  if (workerCount == 0)
+  {
+    workerCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+  return std::max(1u, std::min(workerCount, taskCount));
+}
+
+// ParallelFor で使い回すワーカースレッド群.
+// 呼び出し毎にスレッドを作成すると小さな処理ではその時間が支配的になるため、初回使用時に作成して保持する.
+// 複数のスレッドからの同時呼び出しや、処理内からの入れ子の呼び出しも可能.
+class ParallelForPool
+{
+public:
+  using Func = std::function<void(uint32_t, uint32_t)>;
+
+  static ParallelForPool& Get()
+  {
+    static ParallelForPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+  }
+
+  explicit ParallelForPool(uint32_t threadCount)
+  {
+    m_threads.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+      m_threads.emplace_back([this]() { WorkerMain(); });
+    }
+  }
+  ~ParallelForPool()
+  {
+    {
+      std::lock_guard lock(m_mutex);
+      m_isShutdown = true;
+    }
+    m_cvWork.notify_all();
+    for (auto& thread : m_threads)
+    {
+      thread.join();
+    }
+  }
+  ParallelForPool(const ParallelForPool&) = delete;
+  ParallelForPool& operator=(const ParallelForPool&) = delete;
+
+  // [0, count) を最大 workerCount 個のスレッドで分担する. 呼び出しスレッドはワーカー番号 0 として参加する.
+  void Run(uint32_t count, uint32_t workerCount, const Func& func)
+  {
+    auto batch = std::make_shared<Batch>();
+    batch->func = &func;
+    batch->count = count;
+    batch->workerCount = workerCount;
+    if (workerCount > 1 && !m_threads.empty())
+    {
+      std::lock_guard lock(m_mutex);
+      m_batches.push_back(batch);
+    }
+    m_cvWork.notify_all();
+
+    Execute(*batch, 0);
+
+    // 全ての要素が取り出し済みのため、以降にワーカーが参加することはない.
+    std::unique_lock lock(m_mutex);
+    std::erase(m_batches, batch);
+    m_cvDone.wait(lock, [&]() { return batch->activeCount == 0; });
+  }
+
+private:
+  struct Batch
+  {
+    const Func* func = nullptr;
+    uint32_t count = 0;
+    uint32_t workerCount = 1;
+    std::atomic<uint32_t> next = 0;
+    uint32_t joinedCount = 1;   // 参加したスレッド数 (呼び出しスレッドを含む). m_mutex で保護.
+    uint32_t activeCount = 0;   // 処理中のワーカー数 (呼び出しスレッドを除く). m_mutex で保護.
+
+    bool CanJoin() const { return next.load() < count && joinedCount < workerCount; }
+  };
+
+  static void Execute(Batch& batch, uint32_t workerIndex)
+  {
+    for (uint32_t index = batch.next++; index < batch.count; index = batch.next++)
+    {
+      (*batch.func)(index, workerIndex);
+    }
+  }
+
+  void WorkerMain()
+  {
+    for (;;)
+    {
+      std::shared_ptr<Batch> batch;
+      uint32_t workerIndex = 0;
+      {
+        std::unique_lock lock(m_mutex);
+        m_cvWork.wait(lock, [&]() {
+          if (m_isShutdown)
+          {
+            return true;
+          }
+          auto itr = std::find_if(m_batches.begin(), m_batches.end(), [](const auto& v) { return v->CanJoin(); });
+          batch = itr != m_batches.end() ? *itr : nullptr;
+          return batch != nullptr;
+        });
+        if (m_isShutdown)
+        {
+          return;
+        }
+        workerIndex = batch->joinedCount++;
+        batch->activeCount++;
+      }
+      Execute(*batch, workerIndex);
+      {
+        std::lock_guard lock(m_mutex);
+        batch->activeCount--;
+      }
+      m_cvDone.notify_all();
+    }
+  }
+
+  std::vector<std::thread> m_threads;
+  std::mutex m_mutex;
+  std::condition_variable m_cvWork;
+  std::condition_variable m_cvDone;
+  std::vector<std::shared_ptr<Batch>> m_batches;  // 実行中の呼び出し. 古いものから参加する.
+  bool m_isShutdown = false;
+};
+
+// [0, count) の各要素をワーカースレッドで分担して処理する. 呼び出しスレッドも処理に参加する.
+// func(index, workerIndex) は複数のスレッドから同時に呼ばれる. workerIndex は [0, workerCount) の範囲.
+// スレッドは ParallelForPool のものを使い回す.
+template<class Func>
+void ParallelFor(uint32_t count, uint32_t workerCount, Func&& func)
+{
+  if (count == 0)
+  {
+    return;
+  }
+  workerCount = ResolveWorkerCount(workerCount, count);
+  if (workerCount == 1)
+  {
+    for (uint32_t index = 0; index < count; ++index)
+    {
+      func(index, 0u);
+    }
+    return;
+  }
+  const ParallelForPool::Func task = [&](uint32_t index, uint32_t workerIndex) { func(index, workerIndex); };
+  ParallelForPool::Get().Run(count, workerCount, task);
+}
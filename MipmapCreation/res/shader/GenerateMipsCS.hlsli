@@ -55,6 +55,7 @@ cbuffer CB0 : register(b0)
     uint SrcMipLevel;	// Texture level of source mip
     uint NumMipLevels;	// Number of OutMips to write: [1, 4]
     float2 TexelSize;	// 1.0 / OutMip1.Dimensions
+    uint2 GroupOffset;	// First thread group of this dispatch (for partial updates)
 }
 
 // The reason for separating channels is to reduce bank conflicts in the
@@ -107,6 +108,8 @@ float4 PackColor(float4 Linear)
 [numthreads( 8, 8, 1 )]
 void main( uint GI : SV_GroupIndex, uint3 DTid : SV_DispatchThreadID )
 {
+    DTid.xy += GroupOffset * 8;
+
     // One bilinear sample is insufficient when scaling down by more than 2x.
     // You will slightly undersample in the case where the source dimension
     // is odd.  This is why it's a really good idea to only generate mips on
@@ -9,8 +9,14 @@
 #include "imgui/backends/imgui_impl_win32.h"
 
 #include "TextureUtility.h"
+#include "TextureDecodeBenchmark.h"
+#include "GenerateMipsCPU.h"
+#include "SinglePassDownsampler.h"
+#include "MipBenchmark.h"
+#include "UploadStagingStress.h"
 #include <DirectXTex.h>
 #include <fstream>
+#include <format>
 
 #include <windows.h>
 #include <d3dx12.h>
@@ -572,14 +578,40 @@ void MyApplication::PrepareModelData()
   }
 
   auto& gfxDevice = GetGfxDevice();
+
+  // テクスチャはまとめて登録し、デコードとミップマップ作成を並列に行う.
+  // 複数のマテリアルから参照されるファイルは 1 回だけ読み込まれる.
+  // デコードとミップマップ作成の結果はキャッシュへ保存し、次回以降の起動ではそれを使う.
+  m_textureCache.Initialize("texcache", 1024ull * 1024 * 1024);
+  TextureBatchLoader textureLoader;
+  textureLoader.SetCache(&m_textureCache);
+  std::vector<TextureBatchLoader::TextureId> embeddedTextureIds;
   for (const auto& embeddedInfo : modelEmbeddedTextures)
   {
-    auto& texture = m_model.embeddedTextures.emplace_back();
-    auto success = CreateTextureFromMemory(texture.texResource, embeddedInfo.data.data(), embeddedInfo.data.size(), true);
-    assert(success);
+    embeddedTextureIds.push_back(textureLoader.AddMemory(embeddedInfo.data.data(), embeddedInfo.data.size(), true));
   }
+  std::vector<TextureBatchLoader::TextureId> materialTextureIds;
   for (const auto& material : modelMaterials)
   {
+    auto id = TextureBatchLoader::InvalidId;
+    if (material.texDiffuse.embeddedIndex == -1)
+    {
+      id = textureLoader.AddFile(material.texDiffuse.filePath, true);
+    }
+    materialTextureIds.push_back(id);
+  }
+  textureLoader.Execute();
+  m_textureLoadStats = textureLoader.GetStats();
+
+  for (auto id : embeddedTextureIds)
+  {
+    auto& texture = m_model.embeddedTextures.emplace_back();
+    texture.texResource = textureLoader.GetTexture(id);
+    assert(texture.texResource);
+  }
+  for (size_t materialIndex = 0; materialIndex < modelMaterials.size(); ++materialIndex)
+  {
+    const auto& material = modelMaterials[materialIndex];
     auto& dstMaterial = m_model.materials.emplace_back();
 
     dstMaterial.alphaMode = material.alphaMode;
@@ -613,18 +645,25 @@ void MyApplication::PrepareModelData()
     };
     GfxDevice::DescriptorHandle diffuseSrvDescriptor;
 
-    bool success;
     if (material.texDiffuse.embeddedIndex == -1)
     {
-      // ファイルから読み込み.
-      auto& info = m_model.textureList.emplace_back();
-      info.filePath = material.texDiffuse.filePath;
-
-      success = CreateTextureFromFile(info.texResource, info.filePath, true);
+      // ファイルから読み込んだテクスチャ. 同じファイルは 1 つのエントリを共有する.
+      // TextureBatchLoader と同じく、表記を揃えたパスで判定する.
+      auto filePath = TextureBatchLoader::NormalizePath(material.texDiffuse.filePath);
+      auto itr = std::find_if(m_model.textureList.begin(), m_model.textureList.end(),
+        [&](const auto& v) { return v.filePath == filePath; });
+      if (itr == m_model.textureList.end())
+      {
+        auto& info = m_model.textureList.emplace_back();
+        info.filePath = filePath;
+        info.texResource = textureLoader.GetTexture(materialTextureIds[materialIndex]);
+        itr = std::prev(m_model.textureList.end());
+      }
+      const auto& info = *itr;
+      assert(info.texResource);
       const auto texDesc = info.texResource->GetDesc();
       srvDesc.Format = texDesc.Format;
       srvDesc.Texture2D.MipLevels = texDesc.MipLevels;
-      assert(success);
       diffuseSrvDescriptor = gfxDevice->CreateShaderResourceView(info.texResource, &srvDesc);
     }
     else
@@ -641,70 +680,98 @@ void MyApplication::PrepareModelData()
     dstMaterial.samplerDiffuse = gfxDevice->CreateSampler(samplerDesc);
   }
 
+  // 全メッシュの頂点/インデックスをストリーム毎に 1 つの配列へ詰める.
+  // ストリーム毎に 1 つのバッファとしてまとめて転送し、各メッシュのビューはその中の範囲を参照する.
+  struct MeshRange
+  {
+    UINT baseVertex;
+    UINT vertexCount;
+    UINT firstIndex;
+    UINT indexCount;
+  };
+  std::vector<MeshRange> meshRanges;
+  std::vector<XMFLOAT3> packedPositions, packedNormals;
+  std::vector<XMFLOAT2> packedTexcoords;
+  std::vector<uint32_t> packedIndices;
+  size_t totalVertexCount = 0, totalIndexCount = 0;
   for (const auto& mesh : modelMeshes)
   {
-    auto& dstMesh = m_model.meshes.emplace_back();
+    totalVertexCount += mesh.positions.size();
+    totalIndexCount += mesh.indices.size();
+  }
+  meshRanges.reserve(modelMeshes.size());
+  packedPositions.reserve(totalVertexCount);
+  packedNormals.reserve(totalVertexCount);
+  packedTexcoords.reserve(totalVertexCount);
+  packedIndices.reserve(totalIndexCount);
+  for (const auto& mesh : modelMeshes)
+  {
+    meshRanges.push_back({
+      .baseVertex = UINT(packedPositions.size()),
+      .vertexCount = UINT(mesh.positions.size()),
+      .firstIndex = UINT(packedIndices.size()),
+      .indexCount = UINT(mesh.indices.size()),
+    });
+    packedPositions.insert(packedPositions.end(), mesh.positions.begin(), mesh.positions.end());
+    packedNormals.insert(packedNormals.end(), mesh.normals.begin(), mesh.normals.end());
+    packedTexcoords.insert(packedTexcoords.end(), mesh.texcoords.begin(), mesh.texcoords.end());
+    packedIndices.insert(packedIndices.end(), mesh.indices.begin(), mesh.indices.end());
+  }
+
+  auto createMeshBuffer = [&](const void* srcData, UINT64 bufferSize, D3D12_RESOURCE_STATES resourceState) {
     D3D12_RESOURCE_DESC resDesc{
       .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
       .Alignment = 0,
-      .Width = 0,
+      .Width = bufferSize,
       .Height = 1, .DepthOrArraySize = 1, .MipLevels = 1,
       .Format = DXGI_FORMAT_UNKNOWN,
       .SampleDesc = {.Count = 1, .Quality = 0 },
       .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
       .Flags = D3D12_RESOURCE_FLAG_NONE,
     };
-    UINT stride = 0;
-    auto resourceState = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER;
-    UINT vertexCount = UINT(mesh.positions.size());
-    UINT indexCount = UINT(mesh.indices.size());
+    return gfxDevice->CreateBuffer(resDesc, D3D12_HEAP_TYPE_DEFAULT, resourceState, srcData);
+  };
+  auto vertexState = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER;
+  m_model.positionBuffer = createMeshBuffer(packedPositions.data(), packedPositions.size() * sizeof(XMFLOAT3), vertexState);
+  m_model.normalBuffer = createMeshBuffer(packedNormals.data(), packedNormals.size() * sizeof(XMFLOAT3), vertexState);
+  m_model.texcoordBuffer = createMeshBuffer(packedTexcoords.data(), packedTexcoords.size() * sizeof(XMFLOAT2), vertexState);
+  m_model.indexBuffer = createMeshBuffer(packedIndices.data(), packedIndices.size() * sizeof(uint32_t), D3D12_RESOURCE_STATE_INDEX_BUFFER);
 
-    stride = sizeof(XMFLOAT3);
-    resDesc.Width = stride * vertexCount;
-    dstMesh.position = gfxDevice->CreateBuffer(resDesc,
-      D3D12_HEAP_TYPE_DEFAULT, resourceState,
-      mesh.positions.data());
+  for (size_t i = 0; i < modelMeshes.size(); ++i)
+  {
+    const auto& range = meshRanges[i];
+    auto& dstMesh = m_model.meshes.emplace_back();
+
+    UINT stride = sizeof(XMFLOAT3);
     dstMesh.vbViews[0] = {
-      .BufferLocation = dstMesh.position->GetGPUVirtualAddress(),
-      .SizeInBytes = UINT(resDesc.Width),
+      .BufferLocation = m_model.positionBuffer->GetGPUVirtualAddress() + UINT64(range.baseVertex) * stride,
+      .SizeInBytes = range.vertexCount * stride,
       .StrideInBytes = stride,
     };
 
     stride = sizeof(XMFLOAT3);
-    resDesc.Width = stride * vertexCount;
-    dstMesh.normal = gfxDevice->CreateBuffer(resDesc,
-      D3D12_HEAP_TYPE_DEFAULT, resourceState,
-      mesh.normals.data());
     dstMesh.vbViews[1] = {
-      .BufferLocation = dstMesh.normal->GetGPUVirtualAddress(),
-      .SizeInBytes = UINT(resDesc.Width),
+      .BufferLocation = m_model.normalBuffer->GetGPUVirtualAddress() + UINT64(range.baseVertex) * stride,
+      .SizeInBytes = range.vertexCount * stride,
       .StrideInBytes = stride,
     };
 
     stride = sizeof(XMFLOAT2);
-    resDesc.Width = stride * vertexCount;
-    dstMesh.texcoord0 = gfxDevice->CreateBuffer(resDesc,
-      D3D12_HEAP_TYPE_DEFAULT, resourceState,
-      mesh.texcoords.data());
     dstMesh.vbViews[2] = {
-      .BufferLocation = dstMesh.texcoord0->GetGPUVirtualAddress(),
-      .SizeInBytes = UINT(resDesc.Width),
+      .BufferLocation = m_model.texcoordBuffer->GetGPUVirtualAddress() + UINT64(range.baseVertex) * stride,
+      .SizeInBytes = range.vertexCount * stride,
       .StrideInBytes = stride,
     };
 
-    resDesc.Width = indexCount * sizeof(uint32_t);
-    dstMesh.indices = gfxDevice->CreateBuffer(resDesc,
-      D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_INDEX_BUFFER,
-      mesh.indices.data());
     dstMesh.ibv = {
-      .BufferLocation = dstMesh.indices->GetGPUVirtualAddress(),
-      .SizeInBytes = UINT(resDesc.Width),
+      .BufferLocation = m_model.indexBuffer->GetGPUVirtualAddress() + UINT64(range.firstIndex) * sizeof(uint32_t),
+      .SizeInBytes = UINT(range.indexCount * sizeof(uint32_t)),
       .Format = DXGI_FORMAT_R32_UINT,
     };
 
-    dstMesh.indexCount = indexCount;
-    dstMesh.vertexCount = vertexCount;
-    dstMesh.materialIndex = mesh.materialIndex;
+    dstMesh.indexCount = range.indexCount;
+    dstMesh.vertexCount = range.vertexCount;
+    dstMesh.materialIndex = modelMeshes[i].materialIndex;
   }
 
   // メッシュ単位の描画情報を組み立てる.
@@ -801,34 +868,119 @@ void MyApplication::OnUpdate()
   ImGui::SetNextItemOpen(true, ImGuiCond_Always);
   if (ImGui::CollapsingHeader("Control"))
   {
-    ImGui::BeginDisabled(m_bSaveRequestButton);
+    ImGui::Combo("Save Format", (int*)&m_saveCompression, "RGBA8\0BC1\0BC3\0\0");
+    ImGui::BeginDisabled(!m_saveTextureRequests.empty());
     if (ImGui::Button("Save MipmapTexture"))
     {
-      m_bSaveRequestButton = true;
+      m_saveTextureRequests.push_back({ m_mipmapRT.resColorBuffer, L"Color_MipmapsRT.dds" });
+      m_saveTextureRequests.push_back({ m_mipmapCS.resColorBuffer, L"Color_MipmapsCS.dds" });
+      m_saveTextureRequests.push_back({ m_mipmapSPD.resColorBuffer, L"Color_MipmapsSPD.dds" });
     }
     ImGui::EndDisabled();
+    auto saveStats = m_readbackContext.GetStats();
+    ImGui::Text("Saving: %u (saved %llu, failed %llu, rejected %llu), last write %.1f ms",
+      m_readbackContext.GetPendingCount(), saveStats.savedCount, saveStats.failedCount, saveStats.rejectCount, saveStats.lastWriteMs);
 
     if (ImGui::Button("Save MipmapTexture (Capture)"))
     {
       m_bSaveRequestButton2 = true;
     }
   }
+
+  ImGui::SetNextItemOpen(true, ImGuiCond_Once);
+  if (ImGui::CollapsingHeader("Texture Loading"))
+  {
+    const auto& stats = m_textureLoadStats;
+    ImGui::Text("Textures: %u (requests %u, failed %u)", stats.textureCount, stats.requestCount, stats.failedCount);
+    ImGui::Text("Total: %.1f ms, Decode: %.1f ms (%u workers)", stats.totalMs, stats.decodeMs, stats.workerCount);
+    const auto cacheStats = m_textureCache.GetStats();
+    ImGui::Text("Cache: hit %llu, miss %llu, evict %llu, %.1f MB",
+      cacheStats.hitCount, cacheStats.missCount, cacheStats.evictCount, cacheStats.totalBytes / (1024.0 * 1024.0));
+
+    if (ImGui::Button("Texture Decode Benchmark"))
+    {
+      auto result = RunTextureDecodeBenchmark("res/model/sponza");
+      m_strTextureDecodeBenchmark = std::format(
+        "{} images: serial {:.1f} ms, parallel {:.1f} ms ({} workers, x{:.2f}), {:.1f} MPixel/s, mismatch {}",
+        result.imageCount, result.serialMs, result.parallelMs, result.workerCount, result.GetSpeedup(), result.GetMPixelsPerSec(),
+        result.mismatchCount);
+    }
+    ImGui::TextUnformatted(m_strTextureDecodeBenchmark.c_str());
+
+    if (ImGui::Button("Upload Staging Stress"))
+    {
+      auto result = RunUploadStagingStress();
+      m_strUploadStagingStress = std::format(
+        "{} steps: {} allocs, {} submits, {} stalls, {} dedicated, {} wraps, {:.1f} ms\n"
+        "overlap {}, misaligned {}, accounting {}, fallback {}, oversize {}, tickets {}, released {}",
+        result.stepCount, result.allocationCount, result.submitCount, result.stallCount, result.dedicatedCount, result.wrapCount,
+        result.elapsedMs, result.overlapCount, result.misalignedCount, result.accountingErrors, result.unexpectedFallbackCount,
+        result.oversizeStateChanges, result.ticketsValid ? "yes" : "NO", result.fullyReleased ? "yes" : "NO");
+    }
+    ImGui::TextUnformatted(m_strUploadStagingStress.c_str());
+  }
+
+  if (ImGui::CollapsingHeader("CPU Mipmap"))
+  {
+    if (ImGui::Button("GenerateMips CPU Benchmark"))
+    {
+      auto result = RunGenerateMipsCPUBenchmark(RenderTexWidth, RenderTexHeight, 8);
+      m_strGenerateMipsCPUBenchmark = std::format(
+        "{}x{} ({} passes): 1 thread {:.2f} ms, {} workers {:.2f} ms (x{:.2f}), {:.1f} MPixel/s per core",
+        result.width, result.height, result.passCount, result.singleThreadMs,
+        result.workerCount, result.multiThreadMs, result.GetSpeedup(), result.GetMPixelsPerSecPerCore());
+    }
+    ImGui::TextUnformatted(m_strGenerateMipsCPUBenchmark.c_str());
+
+    if (ImGui::Button("Single Pass Downsampler Benchmark"))
+    {
+      m_strSinglePassBenchmark.clear();
+      for (uint32_t size : { 4096u, 8192u })
+      {
+        auto result = RunSinglePassDownsamplerBenchmark(size, size, 4);
+        m_strSinglePassBenchmark += std::format(
+          "{}x{}: level by level {:.1f} ms ({:.1f} GB/s), single pass {:.1f} ms ({:.1f} GB/s), {} workers {:.1f} ms\n",
+          result.width, result.height, result.levelByLevelMs, result.GetGBytesPerSec(result.levelByLevelMs),
+          result.singleThreadMs, result.GetGBytesPerSec(result.singleThreadMs), result.workerCount, result.multiThreadMs);
+      }
+    }
+    ImGui::TextUnformatted(m_strSinglePassBenchmark.c_str());
+  }
+
+  if (ImGui::CollapsingHeader("Mipmap Benchmark"))
+  {
+    // GPU の計測は描画フレームの完了後に行う.
+    ImGui::BeginDisabled(m_bMipBenchmarkRequest);
+    if (ImGui::Button("Mip Benchmark (RT / CS / SPD)"))
+    {
+      m_bMipBenchmarkRequest = true;
+    }
+    ImGui::EndDisabled();
+    ImGui::TextUnformatted(m_strMipBenchmark.c_str());
+  }
   ImGui::End();
 
   auto& gfxDevice = GetGfxDevice();
   gfxDevice->NewFrame();
+  m_mipmapCSDispatchCount = 0;
+  // 置き換えた定数バッファは、それを使った全フレームの完了を待ってから解放する.
+  std::erase_if(m_mipmapCS.retiredCbBuffers, [](auto& retired) { return --retired.remainingFrames == 0; });
 
   // 描画のコマンドを作成.
   auto commandList = MakeCommandList();
 
   // 作成したコマンドを実行.
   gfxDevice->Submit(commandList.Get());
+  // 記録したリードバックの完了を通知し、完了済みの保存をワーカーへ渡す.
+  m_readbackContext.Submit(gfxDevice->GetD3D12CommandQueue().Get());
+  m_readbackContext.Update();
   // 描画した内容を画面へ反映.
   gfxDevice->Present(1);
 
-  if (m_bSaveRequestButton)
+  if (m_bMipBenchmarkRequest)
   {
-    ProcessSaveTexture();
+    RunMipBenchmarks();
+    m_bMipBenchmarkRequest = false;
   }
 
 
@@ -868,6 +1020,9 @@ void MyApplication::Shutdown()
   auto& gfxDevice = GetGfxDevice();
   gfxDevice->WaitForGPU();
 
+  // 保存中のテクスチャの書き出しを待つ.
+  m_readbackContext.Shutdown();
+
   // リソースを解放.
   m_drawOpaquePipeline.Reset();
   m_modelRootSignature.Reset();
@@ -1092,11 +1247,32 @@ void MyApplication::PrepareMipmapGenShaderCS()
   m_mipmapCS.rootSignature = gfxDevice->CreateRootSignature(blob);
 
   // 定数バッファも使用するため作成.
-  // MaxMipmapExecLevel x バックバッファ数 のサイズで確保し、オフセット付きでアクセスとする.
-  auto cbBufferSize = sizeof(MipmapGenConstants) * MaxMipmapExecLevel;
+  // cbDispatchCapacity x バックバッファ数 のサイズで確保し、オフセット付きでアクセスとする.
+  // フレーム内の全ての GenerateMipmapCS で cbDispatchCapacity 個の領域を順に使う. 足りなければ GrowMipmapCSConstantBuffer で拡張する.
+  m_mipmapCS.cbDispatchCapacity = MaxMipmapCSDispatch;
+  auto cbBufferSize = sizeof(MipmapGenConstants) * m_mipmapCS.cbDispatchCapacity;
+  cbBufferSize *= GfxDevice::BackBufferCount;
+  auto cbResDesc = CD3DX12_RESOURCE_DESC::Buffer(cbBufferSize);
+  m_mipmapCS.cbMinGenBuffer = gfxDevice->CreateBuffer(cbResDesc, D3D12_HEAP_TYPE_UPLOAD);
+}
+
+void MyApplication::GrowMipmapCSConstantBuffer(UINT requiredCount)
+{
+  auto& gfxDevice = GetGfxDevice();
+  const auto newCapacity = (std::max)(requiredCount, m_mipmapCS.cbDispatchCapacity * 2);
+  OutputDebugStringA(std::format(
+    "GenerateMipmapCS: constant buffer slots exhausted ({} required, capacity {}). Growing to {}.\n",
+    requiredCount, m_mipmapCS.cbDispatchCapacity, newCapacity).c_str());
+
+  // 今フレームで記録済みのディスパッチは古いバッファを参照しているため、このフレームが GPU で完了するまで保持する.
+  // NewFrame をバックバッファ数だけ経れば、このフレームの完了は待機済みとなる.
+  m_mipmapCS.retiredCbBuffers.push_back({ m_mipmapCS.cbMinGenBuffer, UINT(GfxDevice::BackBufferCount) });
+
+  auto cbBufferSize = sizeof(MipmapGenConstants) * newCapacity;
   cbBufferSize *= GfxDevice::BackBufferCount;
   auto cbResDesc = CD3DX12_RESOURCE_DESC::Buffer(cbBufferSize);
   m_mipmapCS.cbMinGenBuffer = gfxDevice->CreateBuffer(cbResDesc, D3D12_HEAP_TYPE_UPLOAD);
+  m_mipmapCS.cbDispatchCapacity = newCapacity;
 }
 
 void MyApplication::PrepareMipmapGenShaderSPD()
@@ -1146,11 +1322,9 @@ void MyApplication::PrepareReadbackObjects()
 {
   auto& gfxDevice = GetGfxDevice();
 
-  // リードバックヒープにバッファを作成.
-  auto bufferSize = 128 * 1024 * 1024;
-  auto resDesc = CD3DX12_RESOURCE_DESC::Buffer(bufferSize);
-  m_readbackInfo.resReadbackBuffer = gfxDevice->CreateBuffer(resDesc, D3D12_HEAP_TYPE_READBACK, D3D12_RESOURCE_STATE_COPY_DEST);
-  m_readbackInfo.fence = gfxDevice->CreateFence();
+  // リードバックヒープのバッファをリングとして使い、保存の要求を複数同時に扱う.
+  const UINT64 bufferSize = 128 * 1024 * 1024;
+  m_readbackContext.Initialize(gfxDevice->GetD3D12Device().Get(), bufferSize);
 }
 
 ComPtr<ID3D12GraphicsCommandList>  MyApplication::MakeCommandList()
@@ -1208,15 +1382,15 @@ ComPtr<ID3D12GraphicsCommandList>  MyApplication::MakeCommandList()
 
   if (!m_skipGenMipmapRT)
   {
-    GenerateMipmapRT(commandList);
+    GenerateMipmapRT(commandList, m_mipmapRT.resColorBuffer, m_mipmapRT.rtvColorMip, m_mipmapRT.srvColorMip);
   }
   if (!m_skipGenMipmapCS)
   {
-    GenerateMipmapCS(commandList);
+    GenerateMipmapCS(commandList, m_mipmapCS.resColorBuffer, m_mipmapCS.srvColorMip, m_mipmapCS.uavColorMip);
   }
   if (!m_skipGenMipmapSPD)
   {
-    GenerateMipmapSPD(commandList);
+    GenerateMipmapSPD(commandList, m_mipmapSPD.resColorBuffer);
   }
 
   if(m_skipGenMipmapRT)
@@ -1278,29 +1452,8 @@ ComPtr<ID3D12GraphicsCommandList>  MyApplication::MakeCommandList()
   };
   commandList->ResourceBarrier(1, &barrierToPresent);
 
-  // テクスチャの保存要求があればリードバックバッファに書込み.
-  if (m_bSaveRequestButton && m_saveTextureRequests.empty())
-  {
-    // RenderTarget実装版のテクスチャを保存.
-    UINT64 bufferOffset = 0;
-    SaveTextureRequest request{};
-    request.resTexture = m_mipmapRT.resColorBuffer;
-    request.name = L"Color_MipmapsRT.dds";
-    WriteToReadbackBuffer(commandList, &request, &bufferOffset);
-    m_saveTextureRequests.push_back(request);
-
-    // ComputeShader実装版のテクスチャを保存.
-    request.resTexture = m_mipmapCS.resColorBuffer;
-    request.name = L"Color_MipmapsCS.dds";
-    WriteToReadbackBuffer(commandList, &request, &bufferOffset);
-    m_saveTextureRequests.push_back(request);
-
-    // SinglePassDownsampler実装版のテクスチャを保存.
-    request.resTexture = m_mipmapSPD.resColorBuffer;
-    request.name = L"Color_MipmapsSPD.dds";
-    WriteToReadbackBuffer(commandList, &request, &bufferOffset);
-    m_saveTextureRequests.push_back(request);
-  }
+  // テクスチャの保存要求があればリードバックバッファへのコピーを記録.
+  RecordSaveTextureRequests(commandList);
 
   commandList->Close();
   return commandList;
@@ -1616,13 +1769,14 @@ void MyApplication::DrawDefaultTarget(ComPtr<ID3D12GraphicsCommandList> commandL
   commandList->DrawInstanced(4, 1, 0, 0);
 }
 
-void MyApplication::GenerateMipmapRT(ComPtr<ID3D12GraphicsCommandList> commandList)
+void MyApplication::GenerateMipmapRT(ComPtr<ID3D12GraphicsCommandList> commandList, ComPtr<ID3D12Resource1> texture,
+  std::span<const GfxDevice::DescriptorHandle> rtvMips, std::span<const GfxDevice::DescriptorHandle> srvMips)
 {
   PIXBeginEvent(commandList.Get(), PIX_COLOR(255, 128, 0), L"WriteMipRT");
 
   // ベースレベルのテクスチャはシェーダーリソース状態.
   // 他のレベルを描画して、次の段の入力として使う.
-  const auto texDesc = m_mipmapRT.resColorBuffer->GetDesc();
+  const auto texDesc = texture->GetDesc();
   const auto MipLevels = texDesc.MipLevels;
 
   commandList->SetGraphicsRootSignature(m_mipmapRT.rootSignature.Get());
@@ -1641,8 +1795,8 @@ void MyApplication::GenerateMipmapRT(ComPtr<ID3D12GraphicsCommandList> commandLi
       .right = LONG(width), .bottom = LONG(height),
     };
 
-    auto rtv = m_mipmapRT.rtvColorMip[mip].hCpu;
-    auto srv = m_mipmapRT.srvColorMip[mip - 1].hGpu;
+    auto rtv = rtvMips[mip].hCpu;
+    auto srv = srvMips[mip - 1].hGpu;
     commandList->OMSetRenderTargets(1, &rtv, FALSE, nullptr);
     commandList->ClearRenderTargetView(rtv, colorBlack, 0, nullptr);
     commandList->RSSetViewports(1, &viewport);
@@ -1653,7 +1807,7 @@ void MyApplication::GenerateMipmapRT(ComPtr<ID3D12GraphicsCommandList> commandLi
 
     // 描画先のデータは次の段の入力で使うためバリアを設定する.
     auto barrier = CD3DX12_RESOURCE_BARRIER::Transition(
-      m_mipmapRT.resColorBuffer.Get(),
+      texture.Get(),
       D3D12_RESOURCE_STATE_RENDER_TARGET,
       D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE,
       mip
@@ -1664,22 +1818,46 @@ void MyApplication::GenerateMipmapRT(ComPtr<ID3D12GraphicsCommandList> commandLi
   PIXEndEvent(commandList.Get());
 }
 
-void MyApplication::GenerateMipmapCS(ComPtr<ID3D12GraphicsCommandList> commandList)
+void MyApplication::GenerateMipmapCS(ComPtr<ID3D12GraphicsCommandList> commandList, ComPtr<ID3D12Resource1> texture,
+  std::span<const GfxDevice::DescriptorHandle> srvMips, std::span<const GfxDevice::DescriptorHandle> uavMips,
+  std::span<const MipRect> dirtyRects)
 {
   auto& gfxDevice = GetGfxDevice();
   auto frameIndex = gfxDevice->GetFrameIndex();
 
+  // パス毎のディスパッチを求める. 範囲の指定が無い場合はテクスチャ全体.
+  const auto texDesc = texture->GetDesc();
+  const auto MipLevels = texDesc.MipLevels;
+  const MipRect wholeRect{ 0, 0, UINT(texDesc.Width), texDesc.Height };
+  if (dirtyRects.empty())
+  {
+    dirtyRects = std::span(&wholeRect, 1);
+  }
+  std::vector<GenerateMipsDispatch> dispatches;
+  MakeGenerateMipsDispatches(UINT(texDesc.Width), texDesc.Height, MipLevels, dirtyRects, dispatches);
+  if (dispatches.empty())
+  {
+    return;
+  }
+  // 定数はこのフレームで使用済みの続きへ書き込む.
+  // 部分更新の矩形数やテクスチャ数によっては領域が不足するため、その場合はバッファを拡張して新しいバッファの先頭から使う.
+  if (m_mipmapCSDispatchCount + dispatches.size() > m_mipmapCS.cbDispatchCapacity)
+  {
+    GrowMipmapCSConstantBuffer(m_mipmapCSDispatchCount + UINT(dispatches.size()));
+    m_mipmapCSDispatchCount = 0;
+  }
+  const auto firstSlot = m_mipmapCSDispatchCount;
+  m_mipmapCSDispatchCount += UINT(dispatches.size());
+
   PIXBeginEvent(commandList.Get(), PIX_COLOR(32, 255, 0), L"WriteMipCS");
   // ベースレベルのテクスチャはシェーダーリソース状態.
   // サブのレベルを全てアンオーダードアクセス状態に変更する.
-  const auto texDesc = m_mipmapCS.resColorBuffer->GetDesc();
-  const auto MipLevels = texDesc.MipLevels;
   std::vector<D3D12_RESOURCE_BARRIER> beforeBarriers;
   for (UINT i = 1; i < MipLevels; ++i)
   {
     beforeBarriers.push_back(
       CD3DX12_RESOURCE_BARRIER::Transition(
-        m_mipmapCS.resColorBuffer.Get(),
+        texture.Get(),
         D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE,
         D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
         i
@@ -1693,46 +1871,30 @@ void MyApplication::GenerateMipmapCS(ComPtr<ID3D12GraphicsCommandList> commandLi
   commandList->SetPipelineState(m_mipmapCS.writeMipmapPso->Get());
   void* p = nullptr;
   m_mipmapCS.cbMinGenBuffer->Map(0, nullptr, &p);
-  auto frameOffset = frameIndex * (sizeof(MipmapGenConstants) * MaxMipmapExecLevel);
+  auto frameOffset = frameIndex * (sizeof(MipmapGenConstants) * m_mipmapCS.cbDispatchCapacity);
   auto writePtr = reinterpret_cast<char*>(p) + frameOffset;
 
-  for (UINT topMip = 0; topMip < UINT(MipLevels - 1);)
+  for (size_t passBegin = 0; passBegin < dispatches.size();)
   {
-    UINT srcWidth = UINT(texDesc.Width >> topMip);
-    UINT srcHeight = UINT(texDesc.Height >> topMip);
-    UINT dstWidth = srcWidth >> 1, dstHeight = srcHeight >> 1;
-
-    uint32_t AdditionalMips;
-    UINT value = (dstWidth == 1 ? dstHeight : dstWidth) | (dstHeight == 1 ? dstWidth : dstHeight);
-    _BitScanForward((unsigned long*)&AdditionalMips, value);
-    UINT numMips = 1 + std::min(3u, AdditionalMips); // 合計4枚がMAX.
-    if (topMip + numMips > MipLevels)
+    const UINT topMip = dispatches[passBegin].topMip;
+    const UINT numMips = dispatches[passBegin].mipCount;  // 合計4枚がMAX.
+    size_t passEnd = passBegin;
+    while (passEnd < dispatches.size() && dispatches[passEnd].topMip == topMip)
     {
-      numMips = MipLevels - topMip;
+      ++passEnd;
     }
-    dstWidth = std::max(1u, dstWidth);
-    dstHeight = std::max(1u, dstHeight);
+    UINT srcWidth = std::max(1u, UINT(texDesc.Width >> topMip));
+    UINT srcHeight = std::max(1u, UINT(texDesc.Height >> topMip));
+    UINT dstWidth = std::max(1u, srcWidth >> 1);
+    UINT dstHeight = std::max(1u, srcHeight >> 1);
 
     // ソース解像度のタイプに合わせてパイプラインを選択.
     uint32_t nonPowerOfTwo = (srcWidth & 1) | (srcHeight & 1) << 1;
     auto csPso = m_mipmapCS.writeMipmapPso[nonPowerOfTwo];
     commandList->SetPipelineState(csPso.Get());
 
-    MipmapGenConstants mipmapGenParams{};
-    mipmapGenParams.SrcMipLevel = topMip;
-    mipmapGenParams.NumMipLevels = numMips;
-    mipmapGenParams.TexelSize.x = 1.0f / float(dstWidth);
-    mipmapGenParams.TexelSize.y = 1.0f / float(dstHeight);
-    auto bufferOffset = sizeof(MipmapGenConstants) * topMip;
-    memcpy(writePtr + bufferOffset, &mipmapGenParams, sizeof(mipmapGenParams));
-
-    auto cbGpuAddress = m_mipmapCS.cbMinGenBuffer->GetGPUVirtualAddress();
-    cbGpuAddress += frameOffset;
-    cbGpuAddress += bufferOffset;
-    commandList->SetComputeRootConstantBufferView(0, cbGpuAddress);
-
     // 読み込み元になるミップマップ画像をセット.
-    commandList->SetComputeRootDescriptorTable(1, m_mipmapCS.srvColorMip[topMip].hGpu);
+    commandList->SetComputeRootDescriptorTable(1, srvMips[topMip].hGpu);
 
     // 書込み先をセット.
     for (UINT i = 0; i < numMips; ++i)
@@ -1740,23 +1902,39 @@ void MyApplication::GenerateMipmapCS(ComPtr<ID3D12GraphicsCommandList> commandLi
       constexpr auto slotIndex = 2; 
       commandList->SetComputeRootDescriptorTable(
         slotIndex + i,
-        m_mipmapCS.uavColorMip[topMip + i + 1].hGpu
+        uavMips[topMip + i + 1].hGpu
       );
     }
 
-    // 書込みの実行.
-    auto x = UINT(std::ceil(dstWidth / 8.0)), y = UINT(std::ceil(dstHeight / 8.0));
-    commandList->Dispatch(x, y, 1);
+    // 書込みの実行. 同じパスのディスパッチは互いに依存しないため、間にバリアは不要.
+    for (size_t i = passBegin; i < passEnd; ++i)
+    {
+      const auto& dispatch = dispatches[i];
+      MipmapGenConstants mipmapGenParams{};
+      mipmapGenParams.SrcMipLevel = topMip;
+      mipmapGenParams.NumMipLevels = numMips;
+      mipmapGenParams.TexelSize.x = 1.0f / float(dstWidth);
+      mipmapGenParams.TexelSize.y = 1.0f / float(dstHeight);
+      mipmapGenParams.GroupOffset = DirectX::XMUINT2(dispatch.groupOffsetX, dispatch.groupOffsetY);
+      auto bufferOffset = sizeof(MipmapGenConstants) * (firstSlot + i);
+      memcpy(writePtr + bufferOffset, &mipmapGenParams, sizeof(mipmapGenParams));
+
+      auto cbGpuAddress = m_mipmapCS.cbMinGenBuffer->GetGPUVirtualAddress();
+      cbGpuAddress += frameOffset;
+      cbGpuAddress += bufferOffset;
+      commandList->SetComputeRootConstantBufferView(0, cbGpuAddress);
+      commandList->Dispatch(dispatch.groupCountX, dispatch.groupCountY, 1);
+    }
 
     // UAVバリアを発行後、書き込んだミップレベルをシェーダーリソース状態へ更新.
-    auto uavBarrier = CD3DX12_RESOURCE_BARRIER::UAV(m_mipmapCS.resColorBuffer.Get());
+    auto uavBarrier = CD3DX12_RESOURCE_BARRIER::UAV(texture.Get());
     std::vector<D3D12_RESOURCE_BARRIER> toSrvBarriers;
     toSrvBarriers.reserve(numMips);
     for (UINT i = 0; i < numMips; ++i)
     {
       toSrvBarriers.push_back(
         CD3DX12_RESOURCE_BARRIER::Transition(
-          m_mipmapCS.resColorBuffer.Get(),
+          texture.Get(),
           D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
           D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE,
           topMip + i + 1
@@ -1765,21 +1943,21 @@ void MyApplication::GenerateMipmapCS(ComPtr<ID3D12GraphicsCommandList> commandLi
     }
     commandList->ResourceBarrier(UINT(toSrvBarriers.size()), toSrvBarriers.data());
 
-    topMip += numMips;
+    passBegin = passEnd;
   }
   D3D12_RANGE writeRange{};
   writeRange.Begin = frameOffset;
-  writeRange.End = frameOffset + sizeof(MipmapGenConstants) * MaxMipmapExecLevel;
+  writeRange.End = frameOffset + sizeof(MipmapGenConstants) * dispatches.size();
   m_mipmapCS.cbMinGenBuffer->Unmap(0, &writeRange);
 
   // ここに到達時にはミップマップ全てのレベルで SHADER_RESOURCE になっている.
   PIXEndEvent(commandList.Get());
 }
 
-void MyApplication::GenerateMipmapSPD(ComPtr<ID3D12GraphicsCommandList> commandList)
+void MyApplication::GenerateMipmapSPD(ComPtr<ID3D12GraphicsCommandList> commandList, ComPtr<ID3D12Resource1> texture)
 {
   PIXBeginEvent(commandList.Get(), PIX_COLOR(255, 32, 16), L"GenSPD");
-  auto texResource = m_mipmapSPD.resColorBuffer;
+  auto texResource = texture;
   FfxResource resTexture{
     .resource = texResource.Get(),
     .description = ffxGetResourceDescriptionDX12(texResource.Get()),
@@ -1795,162 +1973,263 @@ void MyApplication::GenerateMipmapSPD(ComPtr<ID3D12GraphicsCommandList> commandL
   PIXEndEvent(commandList.Get());
 }
 
-void MyApplication::WriteToReadbackBuffer(ComPtr<ID3D12GraphicsCommandList> commandList, SaveTextureRequest* request, UINT64* pBufferOffset)
+// GPU のタイムスタンプで各手法を計測するバックエンド.
+// ケース毎にテクスチャとディスクリプタを作り、ベースレベルを転送してから手法を iterations 回実行し、
+// 結果のミップチェーンをリードバックする. 呼び出し側で GPU がアイドルであること.
+class MyApplication::GpuMipBenchmarkBackend : public MipBenchmarkBackend
 {
-  auto& gfxDevice = GetGfxDevice();
-  auto d3d12Device = gfxDevice->GetD3D12Device();
-  if (request == nullptr || pBufferOffset == nullptr)
+public:
+  explicit GpuMipBenchmarkBackend(MyApplication* app) : m_app(app)
   {
-    return;
+    auto& gfxDevice = GetGfxDevice();
+    auto d3d12Device = gfxDevice->GetD3D12Device();
+    HRESULT hr = d3d12Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_allocator));
+    assert(SUCCEEDED(hr));
+    gfxDevice->GetD3D12CommandQueue()->GetTimestampFrequency(&m_timestampFrequency);
   }
-  auto resTexture = request->resTexture;
-
-  // 対象リソースをコピー元のステートへ.
-  auto toCopySource = CD3DX12_RESOURCE_BARRIER::Transition(
-    resTexture.Get(),
-    D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE,
-    D3D12_RESOURCE_STATE_COPY_SOURCE
-  );
-  commandList->ResourceBarrier(1, &toCopySource);
-
-  // メモリ配置情報を取得.
-  auto& layouts = request->layouts;
-  auto resDesc = resTexture->GetDesc();
-  UINT numSubresources = resDesc.MipLevels * resDesc.DepthOrArraySize;
-  layouts.resize(numSubresources);
-  UINT64 requestdSize = 0;
-  d3d12Device->GetCopyableFootprints(&resDesc, 0, numSubresources, 0, layouts.data(), nullptr, nullptr, &requestdSize);
-  auto bufferBase = *pBufferOffset;
-
-  // コピー
-  for (UINT m = 0; m < numSubresources; ++m)
-  {
-    D3D12_TEXTURE_COPY_LOCATION srcLoc{}, dstLoc{};
-    srcLoc.pResource = request->resTexture.Get();
-    srcLoc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-    srcLoc.SubresourceIndex = m;
 
-    dstLoc.pResource = m_readbackInfo.resReadbackBuffer.Get();
-    dstLoc.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-    layouts[m].Offset += bufferBase;
-    dstLoc.PlacedFootprint = layouts[m];
+  const char* GetName() const override { return "GPU"; }
 
-    commandList->CopyTextureRegion(&dstLoc, 0, 0, 0, &srcLoc, nullptr);
-  }
-  bufferBase += requestdSize;
-  *pBufferOffset = bufferBase;
-
-  // 対象リソースをシェーダーリソースに戻す.
-  auto toShaderResource = CD3DX12_RESOURCE_BARRIER::Transition(
-    resTexture.Get(),
-    D3D12_RESOURCE_STATE_COPY_SOURCE,
-    D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE
-  );
-  commandList->ResourceBarrier(1, &toShaderResource);
-
-}
-
-void MyApplication::ProcessSaveTexture()
-{
-  auto& gfxDevice = GetGfxDevice();
-  if (!m_readbackInfo.saveState.has_value())
+  // 用意しているシェーダー/パイプラインは UNORM 用のみ.
+  bool IsSupported(MipGenPath, const MipBenchmarkCase& benchCase) const override
   {
-    // 保存の開始. フェンスを設定する.
-    m_readbackInfo.nextFenceValue++;
-    gfxDevice->GetD3D12CommandQueue()->Signal(
-      m_readbackInfo.fence.Get(),
-      m_readbackInfo.nextFenceValue
-    );
-    m_readbackInfo.saveState = SaveTextureState::StateWaitForReadback;
+    return benchCase.format == MipBenchmarkFormat::RGBA8Unorm;
   }
 
-  if (m_readbackInfo.saveState == SaveTextureState::StateWaitForReadback)
+  double Run(MipGenPath path, const MipBenchmarkCase& benchCase,
+    uint8_t* data, std::span<const MipLevelLayout> levels, uint32_t iterations) override
   {
-    if (m_readbackInfo.fence->GetCompletedValue() == m_readbackInfo.nextFenceValue)
+    auto& gfxDevice = GetGfxDevice();
+    auto d3d12Device = gfxDevice->GetD3D12Device();
+    const UINT mipLevels = UINT(levels.size());
+    iterations = (std::max)(1u, iterations);
+
+    D3D12_HEAP_PROPERTIES defaultHeap{
+      .Type = D3D12_HEAP_TYPE_DEFAULT,
+      .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+      .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+      .CreationNodeMask = 1, .VisibleNodeMask = 1,
+    };
+    auto texDesc = D3D12_RESOURCE_DESC{
+      .Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+      .Width = benchCase.width, .Height = benchCase.height,
+      .DepthOrArraySize = 1,
+      .MipLevels = UINT16(mipLevels),
+      .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
+      .SampleDesc = {.Count = 1, .Quality = 0},
+      .Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN,
+      .Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS
+    };
+    // ベースレベルはコピーキューで転送するため COMMON で作成する. 完了後も COMMON に戻る.
+    auto texture = gfxDevice->CreateImage2D(texDesc, defaultHeap, D3D12_RESOURCE_STATE_COMMON, nullptr);
+    if (texture == nullptr || m_allocator == nullptr)
+    {
+      return -1.0;
+    }
+    texture->SetName(L"MipBenchmarkTexture");
+
+    // 各レベルのディスクリプタ.
+    std::vector<GfxDevice::DescriptorHandle> rtvMips(mipLevels), srvMips(mipLevels), uavMips(mipLevels);
+    for (UINT16 mipLevel = 0; mipLevel < mipLevels; ++mipLevel)
     {
-      // リードバックバッファへの書込みが完了したのでテクスチャの保存
-      void* p;
-      m_readbackInfo.resReadbackBuffer->Map(0, nullptr, &p);
-      using ScratchImageList = std::vector<DirectX::ScratchImage>;
-      auto imageList = std::make_shared<ScratchImageList>();
+      D3D12_RENDER_TARGET_VIEW_DESC rtvDesc{
+        .Format = texDesc.Format,
+        .ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D,
+        .Texture2D = {.MipSlice = mipLevel },
+      };
+      D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{
+        .Format = texDesc.Format,
+        .ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D,
+        .Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING,
+        .Texture2D = {.MostDetailedMip = mipLevel, .MipLevels = 1, },
+      };
+      D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc{
+        .Format = texDesc.Format,
+        .ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D,
+        .Texture2D = {.MipSlice = mipLevel, }
+      };
+      rtvMips[mipLevel] = gfxDevice->CreateRenderTargetView(texture, &rtvDesc);
+      srvMips[mipLevel] = gfxDevice->CreateShaderResourceView(texture, &srvDesc);
+      uavMips[mipLevel] = gfxDevice->CreateUnorderedAccessView(texture, &uavDesc);
+    }
 
-      for (auto request : m_saveTextureRequests)
+    // ベースレベルの転送. 描画キューへの発行時に完了を待つ.
+    const auto& top = levels[0];
+    D3D12_SUBRESOURCE_DATA baseData{
+      .pData = data + top.offset,
+      .RowPitch = LONG_PTR(top.rowPitch),
+      .SlicePitch = LONG_PTR(top.rowPitch) * top.height,
+    };
+    gfxDevice->GetUploadContext().UploadTexture(texture.Get(), 0, std::span(&baseData, 1));
+
+    // リードバック先. ミップチェーン全体とタイムスタンプを置く.
+    std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints(mipLevels);
+    std::vector<UINT> rowCounts(mipLevels);
+    UINT64 textureBytes = 0;
+    d3d12Device->GetCopyableFootprints(&texDesc, 0, mipLevels, 0, footprints.data(), rowCounts.data(), nullptr, &textureBytes);
+    const UINT queryCount = iterations * 2;
+    const UINT64 timestampOffset = (textureBytes + 7) & ~UINT64(7);
+    auto readbackBuffer = gfxDevice->CreateBuffer(
+      CD3DX12_RESOURCE_DESC::Buffer(timestampOffset + sizeof(UINT64) * queryCount),
+      D3D12_HEAP_TYPE_READBACK, D3D12_RESOURCE_STATE_COPY_DEST);
+
+    ComPtr<ID3D12QueryHeap> queryHeap;
+    D3D12_QUERY_HEAP_DESC queryHeapDesc{
+      .Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP,
+      .Count = queryCount,
+    };
+    d3d12Device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&queryHeap));
+
+    m_allocator->Reset();
+    ComPtr<ID3D12GraphicsCommandList> commandList;
+    d3d12Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_allocator.Get(), nullptr, IID_PPV_ARGS(&commandList));
+
+    // TransitionUploadedTexture と同じく、コピーキューでの転送後の COMMON から遷移する.
+    auto toShaderResource = CD3DX12_RESOURCE_BARRIER::Transition(
+      texture.Get(), D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE);
+    commandList->ResourceBarrier(1, &toShaderResource);
+
+    auto generate = [&]() {
+      ID3D12DescriptorHeap* heaps[] = {
+        gfxDevice->GetDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV).Get(),
+        gfxDevice->GetDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER).Get(),
+      };
+      commandList->SetDescriptorHeaps(_countof(heaps), heaps);
+      switch (path)
       {
-        auto& image = imageList->emplace_back();
-        CreateScratchImageFromRequest(image, &request, p);
+      case MipGenPath::RenderTarget:
+        m_app->GenerateMipmapRT(commandList, texture, rtvMips, srvMips);
+        break;
+      case MipGenPath::Compute:
+        m_app->GenerateMipmapCS(commandList, texture, srvMips, uavMips);
+        break;
+      case MipGenPath::SinglePass:
+        m_app->GenerateMipmapSPD(commandList, texture);
+        break;
+      default:
+        break;
       }
-      m_readbackInfo.resReadbackBuffer->Unmap(0, nullptr);
-
-      // ファイルIOは時間が掛かることを想定し、別スレッドで処理.
-      std::thread saveThread([=, this]() {
-        // imageList の各要素を取り出してファイルに保存.
-        for (uint32_t i = 0; i < m_saveTextureRequests.size(); ++i)
-        {
-          auto& image = (*imageList)[i];
-          auto& fname = m_saveTextureRequests[i].name;
+    };
+    // RT の手法は書き込むレベルがレンダーターゲット状態であることを前提としている.
+    auto prepare = [&]() {
+      if (path != MipGenPath::RenderTarget)
+      {
+        return;
+      }
+      std::vector<D3D12_RESOURCE_BARRIER> barriers;
+      for (UINT i = 1; i < mipLevels; ++i)
+      {
+        barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(
+          texture.Get(), D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET, i));
+      }
+      if (!barriers.empty())
+      {
+        commandList->ResourceBarrier(UINT(barriers.size()), barriers.data());
+      }
+    };
 
-          auto saveFilePath = std::filesystem::path(L"./saveTextures");
-          if (!std::filesystem::exists(saveFilePath))
-          {
-            std::filesystem::create_directories(saveFilePath);
-          }
-          saveFilePath = saveFilePath / fname;
+    prepare();
+    generate(); // ウォームアップ.
+    for (UINT i = 0; i < iterations; ++i)
+    {
+      prepare();
+      commandList->EndQuery(queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, i * 2);
+      generate();
+      commandList->EndQuery(queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, i * 2 + 1);
+    }
+    commandList->ResolveQueryData(queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 0, queryCount, readbackBuffer.Get(), timestampOffset);
 
-          DirectX::SaveToDDSFile(
-            image.GetImages(), image.GetImageCount(),
-            image.GetMetadata(),
-            DirectX::DDS_FLAGS_NONE, saveFilePath.c_str());
+    // 結果をリードバック.
+    auto toCopySource = CD3DX12_RESOURCE_BARRIER::Transition(
+      texture.Get(), D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    commandList->ResourceBarrier(1, &toCopySource);
+    for (UINT m = 0; m < mipLevels; ++m)
+    {
+      D3D12_TEXTURE_COPY_LOCATION srcLoc{}, dstLoc{};
+      srcLoc.pResource = texture.Get();
+      srcLoc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+      srcLoc.SubresourceIndex = m;
+      dstLoc.pResource = readbackBuffer.Get();
+      dstLoc.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+      dstLoc.PlacedFootprint = footprints[m];
+      commandList->CopyTextureRegion(&dstLoc, 0, 0, 0, &srcLoc, nullptr);
+    }
+    commandList->Close();
+    gfxDevice->Submit(commandList.Get());
+    gfxDevice->WaitForGPU();
+    // GPU の完了を待ったため、GenerateMipmapCS の定数バッファ領域は先頭から再利用でき、置き換えたバッファも不要.
+    m_app->m_mipmapCSDispatchCount = 0;
+    m_app->m_mipmapCS.retiredCbBuffers.clear();
+
+    double totalMs = -1.0;
+    void* mapped = nullptr;
+    if (SUCCEEDED(readbackBuffer->Map(0, nullptr, &mapped)))
+    {
+      auto src = static_cast<const uint8_t*>(mapped);
+      for (UINT m = 1; m < mipLevels; ++m)
+      {
+        const auto& level = levels[m];
+        for (UINT y = 0; y < rowCounts[m]; ++y)
+        {
+          memcpy(data + level.offset + UINT64(level.rowPitch) * y,
+            src + footprints[m].Offset + UINT64(footprints[m].Footprint.RowPitch) * y, level.width * 4);
         }
+      }
+      auto timestamps = reinterpret_cast<const UINT64*>(src + timestampOffset);
+      UINT64 ticks = 0;
+      for (UINT i = 0; i < iterations; ++i)
+      {
+        ticks += timestamps[i * 2 + 1] - timestamps[i * 2];
+      }
+      totalMs = double(ticks) * 1000.0 / double(m_timestampFrequency);
+      D3D12_RANGE writeRange{};
+      readbackBuffer->Unmap(0, &writeRange);
+    }
 
-        // 時間が掛かる処理を模してスリープ.
-        std::this_thread::sleep_for(std::chrono::seconds(5));
-
-        // ステータス情報をクリア.
-        m_bSaveRequestButton = false;
-        m_saveTextureRequests.clear();
-        m_readbackInfo.saveState.reset();
-      });
-      saveThread.detach();
-      m_readbackInfo.saveState = SaveTextureState::StateWaitForWriteComplete;
+    for (UINT i = 0; i < mipLevels; ++i)
+    {
+      gfxDevice->DeallocateDescriptor(rtvMips[i]);
+      gfxDevice->DeallocateDescriptor(srvMips[i]);
+      gfxDevice->DeallocateDescriptor(uavMips[i]);
     }
+    return totalMs < 0.0 ? totalMs : totalMs / iterations;
   }
-}
 
-bool MyApplication::CreateScratchImageFromRequest(DirectX::ScratchImage& scratchImage, const SaveTextureRequest* request, const void* readbackBuffer)
+private:
+  MyApplication* m_app;
+  ComPtr<ID3D12CommandAllocator> m_allocator;
+  UINT64 m_timestampFrequency = 0;
+};
+
+void MyApplication::RunMipBenchmarks()
 {
-  if (request == nullptr || readbackBuffer == nullptr)
-  {
-    return false;
-  }
-  const auto resDesc = request->resTexture->GetDesc();
-  const auto& layouts = request->layouts;
+  auto& gfxDevice = GetGfxDevice();
+  // 描画中のフレームと定数バッファ等を共有するため、GPU がアイドルの状態で実行する.
+  gfxDevice->WaitForGPU();
 
-  if (resDesc.DepthOrArraySize == 6)
-  {
-    auto cubemaps = resDesc.DepthOrArraySize / 6;
-    scratchImage.InitializeCube(
-      resDesc.Format, size_t(resDesc.Width), size_t(resDesc.Height), cubemaps, resDesc.MipLevels);
-  } else
-  {
-    scratchImage.Initialize2D(
-      resDesc.Format, size_t(resDesc.Width), size_t(resDesc.Height), resDesc.DepthOrArraySize, resDesc.MipLevels);
-  }
-  for (UINT item = 0; item < resDesc.DepthOrArraySize; ++item)
+  const auto cases = MakeMipBenchmarkCases();
+  GpuMipBenchmarkBackend gpuBackend(this);
+  auto gpuResults = RunMipBenchmark(gpuBackend, cases, 8);
+  CpuMipBenchmarkBackend cpuBackend;
+  auto cpuResults = RunMipBenchmark(cpuBackend, cases, 2);
+  m_strMipBenchmark = FormatMipBenchmarkTable(gpuBackend.GetName(), gpuResults);
+  m_strMipBenchmark += FormatMipBenchmarkTable(cpuBackend.GetName(), cpuResults);
+}
+
+void MyApplication::RecordSaveTextureRequests(ComPtr<ID3D12GraphicsCommandList> commandList)
+{
+  // リードバックの領域が足りない分は、先に要求した保存の書き出しが終わってから次のフレーム以降で記録する.
+  DdsWriteOptions options{};
+  options.compression = m_saveCompression;
+  while (!m_saveTextureRequests.empty())
   {
-    for (UINT i = 0; i < resDesc.MipLevels; ++i)
+    const auto& request = m_saveTextureRequests.front();
+    auto filePath = std::filesystem::path(L"./saveTextures") / request.name;
+    if (!m_readbackContext.RequestSave(commandList.Get(), request.resTexture.Get(),
+      D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE, filePath, options))
     {
-      const auto& layout = layouts[i + resDesc.MipLevels * item];
-      auto* image = scratchImage.GetImage(i, item, 0);
-
-      const auto* pSrc = static_cast<const uint8_t*>(readbackBuffer) + layout.Offset;
-      auto* pDst = image->pixels;
-      for (UINT row = 0; row < layout.Footprint.Height; ++row)
-      {
-        memcpy(pDst, pSrc, image->rowPitch);
-        pSrc += layout.Footprint.RowPitch;
-        pDst += image->rowPitch;
-      }
+      break;
     }
+    m_saveTextureRequests.pop_front();
   }
-  return true;
 }
@@ -1,7 +1,9 @@
 ﻿#pragma once
 #define NOMINMAX
 
+#include <deque>
 #include <memory>
+#include <span>
 #include <string>
 #include <vector>
 #include <wrl.h>
@@ -11,6 +13,9 @@
 
 #include "GfxDevice.h"
 #include "Model.h"
+#include "TextureBatchLoader.h"
+#include "ReadbackContext.h"
+#include "MipDirtyRegion.h"
 
 #include "FidelityFX/host/ffx_spd.h"
 #include "FidelityFX/host/backends/dx12/ffx_dx12.h"
@@ -66,13 +71,25 @@ private:
   void DrawDefaultTarget(ComPtr<ID3D12GraphicsCommandList> commandList);
 
   // テクスチャレンダリングを繰り返してミップマップ生成.
-  void GenerateMipmapRT(ComPtr<ID3D12GraphicsCommandList> commandList);
+  // texture のベースレベルはシェーダーリソース、その他のレベルはレンダーターゲット状態であること.
+  void GenerateMipmapRT(ComPtr<ID3D12GraphicsCommandList> commandList, ComPtr<ID3D12Resource1> texture,
+    std::span<const GfxDevice::DescriptorHandle> rtvMips, std::span<const GfxDevice::DescriptorHandle> srvMips);
   
   // コンピュートシェーダーによるミップマップ生成 (Microsoftサンプルのシェーダーを活用).
-  void GenerateMipmapCS(ComPtr<ID3D12GraphicsCommandList> commandList);
+  // texture の全レベルがシェーダーリソース状態であること.
+  // dirtyRects を指定した場合は、ミップ 0 のその範囲に影響するテクセルを含むグループだけを実行する.
+  void GenerateMipmapCS(ComPtr<ID3D12GraphicsCommandList> commandList, ComPtr<ID3D12Resource1> texture,
+    std::span<const GfxDevice::DescriptorHandle> srvMips, std::span<const GfxDevice::DescriptorHandle> uavMips,
+    std::span<const MipRect> dirtyRects = {});
+  // GenerateMipmapCS の定数バッファを、1 フレームあたり requiredCount 個以上の領域を持つものへ作り直す.
+  void GrowMipmapCSConstantBuffer(UINT requiredCount);
 
   // SPDによるミップマップ生成.
-  void GenerateMipmapSPD(ComPtr<ID3D12GraphicsCommandList> commandList);
+  void GenerateMipmapSPD(ComPtr<ID3D12GraphicsCommandList> commandList, ComPtr<ID3D12Resource1> texture);
+
+  // ミップマップ作成手法のベンチマーク (GPU タイムスタンプと CPU 実装).
+  class GpuMipBenchmarkBackend;
+  void RunMipBenchmarks();
 
   struct Vertex
   {
@@ -114,6 +131,7 @@ private:
     uint32_t SrcMipLevel;   // ソースとなるミップレベル
     uint32_t NumMipLevels;  // 書込みMip数
     DirectX::XMFLOAT2 TexelSize;  // テクセルサイズ. (1.0/OutMip1)
+    DirectX::XMUINT2 GroupOffset; // 先頭のスレッドグループの位置 (部分更新用).
   };
   // コンピュートシェーダーDownsample
   struct {
@@ -131,8 +149,20 @@ private:
     ComPtr<ID3D12RootSignature> rootSignature;
 
     ComPtr<ID3D12Resource1> cbMinGenBuffer;
+    UINT cbDispatchCapacity = 0;  // cbMinGenBuffer の 1 フレームあたりの領域数.
+
+    // 容量不足で置き換えた定数バッファ. 記録済みのコマンドが参照するため、残りフレーム数が 0 になるまで保持する.
+    struct RetiredBuffer
+    {
+      ComPtr<ID3D12Resource1> buffer;
+      UINT remainingFrames;
+    };
+    std::vector<RetiredBuffer> retiredCbBuffers;
   } m_mipmapCS;
   const UINT MaxMipmapExecLevel = 14; // 2^14:16384なので14段用意.
+  const UINT MaxMipmapCSDispatch = MaxMipmapExecLevel * MaxMipDirtyRects; // 定数バッファの初期容量. 部分更新では各段で最大 MaxMipDirtyRects 回.
+  // 今フレームの定数バッファ領域で使用済みの個数. 同じフレームで複数回生成しても上書きしないよう、続きから使う.
+  UINT m_mipmapCSDispatchCount = 0;
 
   // FidelityFX-SPD
   struct {
@@ -167,12 +197,7 @@ private:
   struct PolygonMesh
   {
     D3D12_VERTEX_BUFFER_VIEW vbViews[3];
-    D3D12_INDEX_BUFFER_VIEW  ibv;
-
-    ComPtr<ID3D12Resource1>  position;
-    ComPtr<ID3D12Resource1>  normal;
-    ComPtr<ID3D12Resource1>  texcoord0;
-    ComPtr<ID3D12Resource1>  indices;
+    D3D12_INDEX_BUFFER_VIEW  ibv;   // ビューは ModelData のストリーム毎のバッファ内を指す.
 
     uint32_t indexCount;
     uint32_t vertexCount;
@@ -207,7 +232,7 @@ private:
 
   struct TextureInfo
   {
-    std::string filePath;
+    std::string filePath;   // TextureBatchLoader::NormalizePath で表記を揃えたもの.
     ComPtr<ID3D12Resource1> texResource;
     GfxDevice::DescriptorHandle srvDescriptor;
   };
@@ -227,6 +252,12 @@ private:
     std::vector<TextureInfo> textureList;
     std::vector<TextureInfo> embeddedTextures;
     DirectX::XMMATRIX mtxWorld;
+
+    // 全メッシュの頂点/インデックスをストリーム毎にまとめたバッファ.
+    ComPtr<ID3D12Resource1> positionBuffer;
+    ComPtr<ID3D12Resource1> normalBuffer;
+    ComPtr<ID3D12Resource1> texcoordBuffer;
+    ComPtr<ID3D12Resource1> indexBuffer;
   } m_model;
 
   DirectX::XMFLOAT4 m_lightDir = { 0.0f, 0.5f, 1.0f, 0 };  // 平行光源(World空間).各点において光が来る方向ベクトル(真上から光が来ているなら(0,1,0)
@@ -257,36 +288,29 @@ private:
   };
   MipTextureSource m_drawMipSource = FromRenderTarget;
 
-  // 
+  // 保存待ちのテクスチャ. リードバックの領域が空き次第コマンドリストへ記録する.
   struct SaveTextureRequest
   {
     ComPtr<ID3D12Resource1> resTexture; // 保存対象のテクスチャ.
-    std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts;
     std::wstring name;
   };
-  std::vector<SaveTextureRequest> m_saveTextureRequests;
-  enum SaveTextureState {
-    StateWaitForReadback = 0,
-    StateWaitForWriteComplete = 1,
-  };
-  struct {
-    ComPtr<ID3D12Resource1> resReadbackBuffer;
-    ComPtr<ID3D12Fence1> fence;
-    UINT64 nextFenceValue = 0;
-    std::optional<SaveTextureState>  saveState;
-  } m_readbackInfo;
+  std::deque<SaveTextureRequest> m_saveTextureRequests;
+  ReadbackContext m_readbackContext;
+  DdsCompression m_saveCompression = DdsCompression::None;
 
-  bool m_bSaveRequestButton = false;  // GUIからSaveボタンが押されたときtrue
   bool m_bSaveRequestButton2 = false;  // GUIからSaveボタンが押されたときtrue
 
-  // 保存対象をリードバックバッファに書込み.
-  void WriteToReadbackBuffer(ComPtr<ID3D12GraphicsCommandList> commandList, SaveTextureRequest* request, UINT64* pBufferOffset);
-
-  // テクスチャ保存に関する処理.
-  void ProcessSaveTexture();
-
-  // リードバックバッファからScratchImageの作成.
-  bool CreateScratchImageFromRequest(DirectX::ScratchImage& scratchImage, const SaveTextureRequest* request, const void* readbackBuffer);
+  TextureBatchLoader::Stats m_textureLoadStats;  // モデルのテクスチャ作成の計測結果.
+  TextureCache m_textureCache;  // 加工済みテクスチャのディスクキャッシュ.
+  std::string m_strTextureDecodeBenchmark;
+  std::string m_strUploadStagingStress;
+  std::string m_strGenerateMipsCPUBenchmark;
+  std::string m_strSinglePassBenchmark;
+  std::string m_strMipBenchmark;
+  bool m_bMipBenchmarkRequest = false;  // GUIからベンチマークが要求されたときtrue
+
+  // 保存待ちのテクスチャのリードバックを記録.
+  void RecordSaveTextureRequests(ComPtr<ID3D12GraphicsCommandList> commandList);
 };
 
 std::unique_ptr<MyApplication>& GetApplication();
@@ -0,0 +1,276 @@
+﻿#include "BlockCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+  constexpr uint32_t BlockTexels = 16;
+
+  struct Color
+  {
+    float r, g, b;
+  };
+
+  uint16_t ToRGB565(const Color& c)
+  {
+    auto quantize = [](float v, uint32_t maxValue) {
+      return uint32_t(std::clamp(v, 0.0f, 255.0f) * maxValue / 255.0f + 0.5f);
+    };
+    return uint16_t((quantize(c.r, 31) << 11) | (quantize(c.g, 63) << 5) | quantize(c.b, 31));
+  }
+
+  Color FromRGB565(uint16_t v)
+  {
+    const uint32_t r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    return Color{ float((r << 3) | (r >> 2)), float((g << 2) | (g >> 4)), float((b << 3) | (b >> 2)) };
+  }
+
+  float DistanceSquared(const Color& a, const uint8_t* texel)
+  {
+    const float dr = a.r - texel[0], dg = a.g - texel[1], db = a.b - texel[2];
+    return dr * dr + dg * dg + db * db;
+  }
+
+  // c0 > c1 の 4 色モードで各テクセルに最も近いパレットを選ぶ. 戻り値は二乗誤差の合計.
+  float FitColorIndices(const uint8_t* texels, uint16_t c0, uint16_t c1, uint8_t* indices)
+  {
+    const Color e0 = FromRGB565(c0), e1 = FromRGB565(c1);
+    const Color palette[4] = {
+      e0, e1,
+      Color{ (2 * e0.r + e1.r) / 3, (2 * e0.g + e1.g) / 3, (2 * e0.b + e1.b) / 3 },
+      Color{ (e0.r + 2 * e1.r) / 3, (e0.g + 2 * e1.g) / 3, (e0.b + 2 * e1.b) / 3 },
+    };
+    float error = 0.0f;
+    for (uint32_t i = 0; i < BlockTexels; ++i)
+    {
+      float best = DistanceSquared(palette[0], texels + i * 4);
+      uint8_t bestIndex = 0;
+      for (uint8_t p = 1; p < 4; ++p)
+      {
+        const float d = DistanceSquared(palette[p], texels + i * 4);
+        if (d < best)
+        {
+          best = d;
+          bestIndex = p;
+        }
+      }
+      indices[i] = bestIndex;
+      error += best;
+    }
+    return error;
+  }
+
+  // インデックスを固定して、誤差が最小となる端点を最小二乗で求める.
+  bool RefineEndpoints(const uint8_t* texels, const uint8_t* indices, Color& e0, Color& e1)
+  {
+    static constexpr float Weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f }; // e0 側の重み.
+    float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+    Color ax{}, bx{};
+    for (uint32_t i = 0; i < BlockTexels; ++i)
+    {
+      const float a = Weights[indices[i]], b = 1.0f - a;
+      const uint8_t* t = texels + i * 4;
+      aa += a * a;
+      bb += b * b;
+      ab += a * b;
+      ax.r += a * t[0]; ax.g += a * t[1]; ax.b += a * t[2];
+      bx.r += b * t[0]; bx.g += b * t[1]; bx.b += b * t[2];
+    }
+    const float det = aa * bb - ab * ab;
+    if (std::abs(det) < 1e-6f)
+    {
+      return false;
+    }
+    const float inv = 1.0f / det;
+    e0 = Color{ (ax.r * bb - bx.r * ab) * inv, (ax.g * bb - bx.g * ab) * inv, (ax.b * bb - bx.b * ab) * inv };
+    e1 = Color{ (bx.r * aa - ax.r * ab) * inv, (bx.g * aa - ax.g * ab) * inv, (bx.b * aa - ax.b * ab) * inv };
+    return true;
+  }
+
+  void StoreColorBlock(uint16_t c0, uint16_t c1, const uint8_t* indices, uint8_t* out)
+  {
+    uint32_t bits = 0;
+    for (uint32_t i = 0; i < BlockTexels; ++i)
+    {
+      bits |= uint32_t(indices[i]) << (i * 2);
+    }
+    out[0] = uint8_t(c0); out[1] = uint8_t(c0 >> 8);
+    out[2] = uint8_t(c1); out[3] = uint8_t(c1 >> 8);
+    memcpy(out + 4, &bits, sizeof(bits));
+  }
+
+  // 端点を c0 > c1 の順に並べてインデックスを決める. 同じ値になった場合は単色.
+  float EncodeEndpoints(const uint8_t* texels, const Color& e0, const Color& e1, uint16_t& c0, uint16_t& c1, uint8_t* indices)
+  {
+    c0 = ToRGB565(e0);
+    c1 = ToRGB565(e1);
+    if (c0 < c1)
+    {
+      std::swap(c0, c1);
+    }
+    if (c0 == c1)
+    {
+      memset(indices, 0, BlockTexels);
+      float error = 0.0f;
+      const Color solid = FromRGB565(c0);
+      for (uint32_t i = 0; i < BlockTexels; ++i)
+      {
+        error += DistanceSquared(solid, texels + i * 4);
+      }
+      return error;
+    }
+    return FitColorIndices(texels, c0, c1, indices);
+  }
+
+  void EncodeColorBlock(const uint8_t* texels, uint8_t* out)
+  {
+    // 平均と共分散.
+    Color mean{};
+    for (uint32_t i = 0; i < BlockTexels; ++i)
+    {
+      mean.r += texels[i * 4 + 0];
+      mean.g += texels[i * 4 + 1];
+      mean.b += texels[i * 4 + 2];
+    }
+    mean = Color{ mean.r / BlockTexels, mean.g / BlockTexels, mean.b / BlockTexels };
+    float cov[6] = {};  // rr, rg, rb, gg, gb, bb
+    for (uint32_t i = 0; i < BlockTexels; ++i)
+    {
+      const float r = texels[i * 4 + 0] - mean.r, g = texels[i * 4 + 1] - mean.g, b = texels[i * 4 + 2] - mean.b;
+      cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+      cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+
+    // 主成分の軸をべき乗法で求める.
+    Color axis{ 1.0f, 1.0f, 1.0f };
+    for (uint32_t iteration = 0; iteration < 4; ++iteration)
+    {
+      const Color next{
+        cov[0] * axis.r + cov[1] * axis.g + cov[2] * axis.b,
+        cov[1] * axis.r + cov[3] * axis.g + cov[4] * axis.b,
+        cov[2] * axis.r + cov[4] * axis.g + cov[5] * axis.b,
+      };
+      const float length = std::max({ std::abs(next.r), std::abs(next.g), std::abs(next.b) });
+      if (length < 1e-6f)
+      {
+        break;
+      }
+      axis = Color{ next.r / length, next.g / length, next.b / length };
+    }
+
+    // 軸上で両端となるテクセルを端点とする.
+    uint32_t minIndex = 0, maxIndex = 0;
+    float minProj = 0.0f, maxProj = 0.0f;
+    for (uint32_t i = 0; i < BlockTexels; ++i)
+    {
+      const float proj = texels[i * 4 + 0] * axis.r + texels[i * 4 + 1] * axis.g + texels[i * 4 + 2] * axis.b;
+      if (i == 0 || proj < minProj) { minProj = proj; minIndex = i; }
+      if (i == 0 || proj > maxProj) { maxProj = proj; maxIndex = i; }
+    }
+    auto texelColor = [&](uint32_t i) {
+      return Color{ float(texels[i * 4 + 0]), float(texels[i * 4 + 1]), float(texels[i * 4 + 2]) };
+    };
+
+    uint16_t c0, c1;
+    uint8_t indices[BlockTexels];
+    const float error = EncodeEndpoints(texels, texelColor(maxIndex), texelColor(minIndex), c0, c1, indices);
+
+    // 端点を補正して誤差が減る場合はそちらを使う.
+    Color e0, e1;
+    if (error > 0.0f && c0 != c1 && RefineEndpoints(texels, indices, e0, e1))
+    {
+      uint16_t refined0, refined1;
+      uint8_t refinedIndices[BlockTexels];
+      if (EncodeEndpoints(texels, e0, e1, refined0, refined1, refinedIndices) < error)
+      {
+        StoreColorBlock(refined0, refined1, refinedIndices, out);
+        return;
+      }
+    }
+    StoreColorBlock(c0, c1, indices, out);
+  }
+
+  void EncodeAlphaBlock(const uint8_t* texels, uint8_t* out)
+  {
+    uint8_t a0 = 0, a1 = 255;
+    for (uint32_t i = 0; i < BlockTexels; ++i)
+    {
+      a0 = std::max(a0, texels[i * 4 + 3]);
+      a1 = std::min(a1, texels[i * 4 + 3]);
+    }
+    out[0] = a0;
+    out[1] = a1;
+
+    uint64_t bits = 0;
+    if (a0 != a1)
+    {
+      // a0 > a1 の 8 段階モード.
+      int32_t palette[8] = { a0, a1 };
+      for (int32_t i = 0; i < 6; ++i)
+      {
+        palette[i + 2] = ((6 - i) * a0 + (1 + i) * a1) / 7;
+      }
+      for (uint32_t i = 0; i < BlockTexels; ++i)
+      {
+        const int32_t alpha = texels[i * 4 + 3];
+        uint64_t bestIndex = 0;
+        int32_t best = std::abs(palette[0] - alpha);
+        for (uint32_t p = 1; p < 8; ++p)
+        {
+          const int32_t d = std::abs(palette[p] - alpha);
+          if (d < best)
+          {
+            best = d;
+            bestIndex = p;
+          }
+        }
+        bits |= bestIndex << (i * 3);
+      }
+    }
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+      out[2 + i] = uint8_t(bits >> (i * 8));
+    }
+  }
+}
+
+void EncodeBC1Block(const uint8_t* texels, uint8_t* out)
+{
+  EncodeColorBlock(texels, out);
+}
+
+void EncodeBC3Block(const uint8_t* texels, uint8_t* out)
+{
+  EncodeAlphaBlock(texels, out);
+  EncodeColorBlock(texels, out + 8);
+}
+
+void CompressBlockRow(
+  const uint8_t* src, uint32_t width, uint32_t rows, uint32_t rowPitch,
+  BlockFormat format, uint8_t* dst)
+{
+  const uint32_t blockBytes = GetBlockBytes(format);
+  const uint32_t blockCountX = (width + 3) / 4;
+  uint8_t texels[BlockTexels * 4];
+  for (uint32_t bx = 0; bx < blockCountX; ++bx)
+  {
+    for (uint32_t y = 0; y < 4; ++y)
+    {
+      const uint8_t* row = src + uint64_t(rowPitch) * std::min(y, rows - 1);
+      for (uint32_t x = 0; x < 4; ++x)
+      {
+        memcpy(texels + (y * 4 + x) * 4, row + uint64_t(std::min(bx * 4 + x, width - 1)) * 4, 4);
+      }
+    }
+    if (format == BlockFormat::BC1)
+    {
+      EncodeBC1Block(texels, dst + uint64_t(bx) * blockBytes);
+    }
+    else
+    {
+      EncodeBC3Block(texels, dst + uint64_t(bx) * blockBytes);
+    }
+  }
+}
@@ -0,0 +1,29 @@
+﻿#pragma once
+#include <cstdint>
+
+// RGBA8 の 4x4 ブロックを BC1 / BC3 へ圧縮する簡易エンコーダー.
+// 色は主成分の軸上で両端となるテクセルを端点とし、インデックスを決めた後に最小二乗で端点を 1 度だけ補正する.
+// BC1 は不透明として扱い、アルファは捨てる. BC3 のアルファは最小/最大値を端点とする 8 段階のモード.
+// 品質よりも速度を優先した実装で、保存/キャプチャ用途を想定している.
+// D3D12 には依存しない.
+
+enum class BlockFormat
+{
+  BC1,  // 8 バイト/ブロック.
+  BC3,  // 16 バイト/ブロック.
+};
+
+inline uint32_t GetBlockBytes(BlockFormat format)
+{
+  return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+// texels は 4x4 テクセル分の RGBA8 (行優先, 64 バイト).
+void EncodeBC1Block(const uint8_t* texels, uint8_t* out);
+void EncodeBC3Block(const uint8_t* texels, uint8_t* out);
+
+// src の 4 行以下 (rows) を 1 行分のブロック列として圧縮する.
+// 幅/高さが 4 で割り切れない端のブロックは、端のテクセルを繰り返して埋める.
+void CompressBlockRow(
+  const uint8_t* src, uint32_t width, uint32_t rows, uint32_t rowPitch,
+  BlockFormat format, uint8_t* dst);
@@ -0,0 +1,244 @@
+﻿#include "DdsStreamWriter.h"
+#include "BlockCompression.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+  constexpr size_t BufferBytes = 1024 * 1024;
+  constexpr uint32_t BandBlockRows = 16;   // 圧縮時にワーカーへ渡す単位 (ブロック行数).
+  constexpr uint32_t BandsPerWorker = 4;   // 一度に圧縮する帯の数 (ワーカー毎).
+
+  // DXGI_FORMAT の値.
+  constexpr uint32_t FormatR8G8B8A8Unorm = 28;
+  constexpr uint32_t FormatR8G8B8A8UnormSRGB = 29;
+  constexpr uint32_t FormatBC1Unorm = 71;
+  constexpr uint32_t FormatBC1UnormSRGB = 72;
+  constexpr uint32_t FormatBC3Unorm = 77;
+  constexpr uint32_t FormatBC3UnormSRGB = 78;
+
+  // DDS ヘッダーのフラグ.
+  constexpr uint32_t DdsMagic = 0x20534444;   // "DDS "
+  constexpr uint32_t FourCCDX10 = 0x30315844; // "DX10"
+  constexpr uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PITCH = 0x8;
+  constexpr uint32_t DDSD_PIXELFORMAT = 0x1000, DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+  constexpr uint32_t DDPF_FOURCC = 0x4;
+  constexpr uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+  constexpr uint32_t DDSCAPS2_CUBEMAP_ALLFACES = 0xFE00;
+  constexpr uint32_t ResourceDimensionTexture2D = 3;
+  constexpr uint32_t ResourceMiscTextureCube = 0x4;
+
+  bool IsCompressed(DdsCompression compression)
+  {
+    return compression != DdsCompression::None;
+  }
+}
+
+DdsStreamWriter::~DdsStreamWriter()
+{
+  if (m_file.is_open())
+  {
+    Close();
+  }
+}
+
+uint32_t DdsStreamWriter::GetOutputFormat(uint32_t format, DdsCompression compression)
+{
+  if (!IsCompressed(compression))
+  {
+    return format;
+  }
+  const bool isBC1 = compression == DdsCompression::BC1;
+  switch (format)
+  {
+  case FormatR8G8B8A8Unorm: return isBC1 ? FormatBC1Unorm : FormatBC3Unorm;
+  case FormatR8G8B8A8UnormSRGB: return isBC1 ? FormatBC1UnormSRGB : FormatBC3UnormSRGB;
+  default: return 0;
+  }
+}
+
+bool DdsStreamWriter::Open(const std::filesystem::path& filePath, const DdsTextureDesc& desc, const DdsWriteOptions& options)
+{
+  const uint32_t outputFormat = GetOutputFormat(desc.format, options.compression);
+  if (outputFormat == 0 || desc.width == 0 || desc.height == 0 || desc.mipLevels == 0 || desc.arraySize == 0 ||
+    (desc.isCubemap && (desc.arraySize % 6) != 0))
+  {
+    return false;
+  }
+  m_file.open(filePath, std::ios::binary | std::ios::trunc);
+  if (!m_file)
+  {
+    return false;
+  }
+  m_desc = desc;
+  m_options = options;
+  m_nextSubresource = 0;
+  m_bytesWritten = 0;
+  m_failed = false;
+  m_buffer.clear();
+  m_buffer.reserve(BufferBytes);
+
+  const bool compressed = IsCompressed(options.compression);
+  uint32_t header[1 + 31 + 5] = {};
+  header[0] = DdsMagic;
+  uint32_t* dds = header + 1;
+  dds[0] = 124;
+  dds[1] = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT |
+    (compressed ? DDSD_LINEARSIZE : DDSD_PITCH);
+  dds[2] = desc.height;
+  dds[3] = desc.width;
+  dds[4] = compressed ?
+    ((desc.width + 3) / 4) * ((desc.height + 3) / 4) * GetBlockBytes(options.compression == DdsCompression::BC1 ? BlockFormat::BC1 : BlockFormat::BC3) :
+    desc.width * desc.bytesPerPixel;
+  dds[6] = desc.mipLevels;
+  dds[18] = 32;           // ピクセルフォーマットは DX10 拡張ヘッダーで指定する.
+  dds[19] = DDPF_FOURCC;
+  dds[20] = FourCCDX10;
+  dds[26] = DDSCAPS_TEXTURE | (desc.mipLevels > 1 ? DDSCAPS_MIPMAP | DDSCAPS_COMPLEX : 0) | (desc.isCubemap || desc.arraySize > 1 ? DDSCAPS_COMPLEX : 0);
+  dds[27] = desc.isCubemap ? DDSCAPS2_CUBEMAP_ALLFACES : 0;
+  uint32_t* dx10 = dds + 31;
+  dx10[0] = outputFormat;
+  dx10[1] = ResourceDimensionTexture2D;
+  dx10[2] = desc.isCubemap ? ResourceMiscTextureCube : 0;
+  dx10[3] = desc.isCubemap ? desc.arraySize / 6 : desc.arraySize;
+  Append(header, sizeof(header));
+  return true;
+}
+
+bool DdsStreamWriter::WriteSubresources(std::span<const DdsSubresourceSource> sources)
+{
+  const uint32_t subresourceCount = m_desc.mipLevels * m_desc.arraySize;
+  if (!m_file.is_open() || m_failed || m_nextSubresource + sources.size() > subresourceCount)
+  {
+    return false;
+  }
+  if (IsCompressed(m_options.compression))
+  {
+    WriteCompressed(sources);
+  }
+  else
+  {
+    for (const auto& source : sources)
+    {
+      const uint32_t mip = m_nextSubresource % m_desc.mipLevels;
+      WriteUncompressed(source, std::max(1u, m_desc.width >> mip), std::max(1u, m_desc.height >> mip));
+      m_nextSubresource++;
+    }
+  }
+  return !m_failed;
+}
+
+bool DdsStreamWriter::Close()
+{
+  if (!m_file.is_open())
+  {
+    return false;
+  }
+  Flush();
+  const bool completed = m_nextSubresource == m_desc.mipLevels * m_desc.arraySize;
+  m_file.close();
+  m_buffer = {};
+  m_blockBuffer = {};
+  return completed && !m_failed && !m_file.fail();
+}
+
+void DdsStreamWriter::Append(const void* data, size_t size)
+{
+  if (m_buffer.size() + size > BufferBytes)
+  {
+    Flush();
+  }
+  if (size >= BufferBytes)
+  {
+    m_file.write(static_cast<const char*>(data), std::streamsize(size));
+    m_failed |= !m_file;
+  }
+  else
+  {
+    auto p = static_cast<const uint8_t*>(data);
+    m_buffer.insert(m_buffer.end(), p, p + size);
+  }
+  m_bytesWritten += size;
+}
+
+void DdsStreamWriter::Flush()
+{
+  if (!m_buffer.empty())
+  {
+    m_file.write(reinterpret_cast<const char*>(m_buffer.data()), std::streamsize(m_buffer.size()));
+    m_failed |= !m_file;
+    m_buffer.clear();
+  }
+}
+
+void DdsStreamWriter::WriteUncompressed(const DdsSubresourceSource& source, uint32_t width, uint32_t height)
+{
+  const size_t rowBytes = size_t(width) * m_desc.bytesPerPixel;
+  for (uint32_t y = 0; y < height; ++y)
+  {
+    Append(source.pixels + uint64_t(source.rowPitch) * y, rowBytes);
+  }
+}
+
+void DdsStreamWriter::WriteCompressed(std::span<const DdsSubresourceSource> sources)
+{
+  const BlockFormat blockFormat = m_options.compression == DdsCompression::BC1 ? BlockFormat::BC1 : BlockFormat::BC3;
+  const uint32_t blockBytes = GetBlockBytes(blockFormat);
+
+  // 全サブリソースのブロック行を帯に分け、書き出し順に並べる.
+  struct Band
+  {
+    const DdsSubresourceSource* source;
+    uint32_t width;
+    uint32_t height;
+    uint32_t blockRowBegin;
+    uint32_t blockRowCount;
+    uint64_t bytes;
+  };
+  std::vector<Band> bands;
+  for (const auto& source : sources)
+  {
+    const uint32_t mip = m_nextSubresource % m_desc.mipLevels;
+    const uint32_t width = std::max(1u, m_desc.width >> mip), height = std::max(1u, m_desc.height >> mip);
+    const uint32_t blockRows = (height + 3) / 4;
+    const uint64_t blockRowBytes = uint64_t((width + 3) / 4) * blockBytes;
+    for (uint32_t row = 0; row < blockRows; row += BandBlockRows)
+    {
+      const uint32_t count = std::min(BandBlockRows, blockRows - row);
+      bands.push_back(Band{ &source, width, height, row, count, blockRowBytes * count });
+    }
+    m_nextSubresource++;
+  }
+
+  // 一度に圧縮する帯の数を制限して、一時領域をテクスチャ全体より十分小さく抑える.
+  const uint32_t workerCount = ResolveWorkerCount(m_options.workerCount, ~0u);
+  const size_t bandsPerWave = size_t(workerCount) * BandsPerWorker;
+  std::vector<uint64_t> offsets;
+  for (size_t first = 0; first < bands.size(); first += bandsPerWave)
+  {
+    const size_t count = std::min(bandsPerWave, bands.size() - first);
+    offsets.resize(count);
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+      offsets[i] = total;
+      total += bands[first + i].bytes;
+    }
+    m_blockBuffer.resize(total);
+
+    ParallelFor(uint32_t(count), workerCount, [&](uint32_t index, uint32_t) {
+      const auto& band = bands[first + index];
+      const uint64_t blockRowBytes = band.bytes / band.blockRowCount;
+      for (uint32_t i = 0; i < band.blockRowCount; ++i)
+      {
+        const uint32_t y = (band.blockRowBegin + i) * 4;
+        CompressBlockRow(
+          band.source->pixels + uint64_t(band.source->rowPitch) * y, band.width, std::min(4u, band.height - y), band.source->rowPitch,
+          blockFormat, m_blockBuffer.data() + offsets[index] + blockRowBytes * i);
+      }
+    });
+    Append(m_blockBuffer.data(), m_blockBuffer.size());
+  }
+}
@@ -0,0 +1,79 @@
+﻿#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <vector>
+
+// DDS ファイルをサブリソース単位で順に書き出すライター.
+// 入力はリードバックバッファのフットプリント等の行ピッチ付きのメモリをそのまま受け取り、
+// 行を小さな書き出しバッファへ詰めてファイルへ流すため、テクスチャ全体の中間イメージを持たない.
+// BC 圧縮する場合は 4 行単位のブロック行を帯にまとめ、ワーカーで並列に圧縮してから順に書き出す.
+// ヘッダーは DX10 拡張ヘッダー付きの形式で、DirectXTex (texconv 等) で読み込める.
+// D3D12 には依存しない.
+
+enum class DdsCompression
+{
+  None,
+  BC1,
+  BC3,
+};
+
+struct DdsTextureDesc
+{
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t mipLevels = 1;
+  uint32_t arraySize = 1;     // キューブマップの場合は面の数 (6 の倍数).
+  uint32_t format = 0;        // DXGI_FORMAT の値.
+  uint32_t bytesPerPixel = 4;
+  bool isCubemap = false;
+};
+
+struct DdsWriteOptions
+{
+  // 圧縮は R8G8B8A8_UNORM / R8G8B8A8_UNORM_SRGB のみ対応.
+  DdsCompression compression = DdsCompression::None;
+  uint32_t workerCount = 0;   // 圧縮に使うワーカー数. 0 の場合はハードウェアスレッド数.
+};
+
+// 1 サブリソース分の入力. 幅/高さは desc とサブリソースの番号から決まる.
+struct DdsSubresourceSource
+{
+  const uint8_t* pixels;
+  uint32_t rowPitch;
+};
+
+class DdsStreamWriter
+{
+public:
+  ~DdsStreamWriter();
+
+  bool Open(const std::filesystem::path& filePath, const DdsTextureDesc& desc, const DdsWriteOptions& options);
+
+  // 続きのサブリソースを書き出す. 順序は D3D12 のサブリソース番号と同じく、配列要素毎にミップ 0 から.
+  bool WriteSubresources(std::span<const DdsSubresourceSource> sources);
+
+  // 全サブリソースを書き出していない場合や書き出しに失敗した場合は false.
+  bool Close();
+
+  uint64_t GetBytesWritten() const { return m_bytesWritten; }
+
+  // ファイルに記録するフォーマット. 圧縮できない組み合わせの場合は 0.
+  static uint32_t GetOutputFormat(uint32_t format, DdsCompression compression);
+
+private:
+  void Append(const void* data, size_t size);
+  void Flush();
+  void WriteUncompressed(const DdsSubresourceSource& source, uint32_t width, uint32_t height);
+  void WriteCompressed(std::span<const DdsSubresourceSource> sources);
+
+  std::ofstream m_file;
+  DdsTextureDesc m_desc;
+  DdsWriteOptions m_options;
+  uint32_t m_nextSubresource = 0;
+  uint64_t m_bytesWritten = 0;
+  bool m_failed = false;
+  std::vector<uint8_t> m_buffer;      // 書き出しバッファ.
+  std::vector<uint8_t> m_blockBuffer; // 圧縮した帯の一時領域.
+};
@@ -0,0 +1,403 @@
+﻿#include "GenerateMipsCPU.h"
+#include "ParallelFor.h"
+
+#include <immintrin.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+  constexpr uint32_t PixelBytes = 4;
+  constexpr uint32_t GroupSize = 8;     // numthreads(8, 8, 1)
+  constexpr uint32_t MaxPassMips = 4;   // OutMip1 - OutMip4
+
+  enum class PackMode
+  {
+    Linear,     // そのまま書き出す.
+    SRGBCurve,  // ApplySRGBCurve (CONVERT_TO_SRGB).
+    SRGBExact,  // sRGB フォーマットの RTV への書き出し.
+  };
+
+  struct SrcLevel
+  {
+    const uint8_t* data;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowPitch;
+    const float* srgbToLinear;  // sRGB の SRV として読む場合の変換テーブル. UNORM なら nullptr.
+  };
+  struct DstLevel
+  {
+    uint8_t* data;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowPitch;
+  };
+
+  struct PassDesc
+  {
+    SrcLevel src;
+    DstLevel dst[MaxPassMips];
+    uint32_t numMips;
+    uint32_t variant;
+    float texelSizeX; // 1.0 / OutMip1.Dimensions
+    float texelSizeY;
+    PackMode packMode;
+  };
+
+  const float* GetSRGBToLinearTable()
+  {
+    static const auto table = []() {
+      std::array<float, 256> values;
+      for (uint32_t i = 0; i < 256; ++i)
+      {
+        const double c = i / 255.0;
+        values[i] = float(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+      }
+      return values;
+    }();
+    return table.data();
+  }
+
+  // UNORM8 -> float. GPU と同じく c / 255 を正しく丸めた値にするため除算を使う.
+  // sRGB の場合は RGB をリニアへ変換する.
+  inline __m128 LoadTexel(const SrcLevel& src, uint32_t x, uint32_t y)
+  {
+    const uint8_t* texel = src.data + size_t(y) * src.rowPitch + size_t(x) * PixelBytes;
+    if (src.srgbToLinear)
+    {
+      const auto table = src.srgbToLinear;
+      return _mm_setr_ps(table[texel[0]], table[texel[1]], table[texel[2]], float(texel[3]) / 255.0f);
+    }
+    int32_t packed;
+    memcpy(&packed, texel, sizeof(packed));
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_cvtsi32_si128(packed);
+    v = _mm_unpacklo_epi8(v, zero);
+    v = _mm_unpacklo_epi16(v, zero);
+    return _mm_div_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(255.0f));
+  }
+
+  // float -> UNORM8. [0,1] に飽和させて最近接偶数へ丸める. 範囲外のスレッドの書き込みは捨てられる.
+  inline void StoreTexel(const DstLevel& dst, uint32_t x, uint32_t y, __m128 color)
+  {
+    if (x >= dst.width || y >= dst.height)
+    {
+      return;
+    }
+    color = _mm_min_ps(_mm_max_ps(color, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    __m128i v = _mm_cvtps_epi32(_mm_mul_ps(color, _mm_set1_ps(255.0f)));
+    v = _mm_packs_epi32(v, v);
+    v = _mm_packus_epi16(v, v);
+    const int32_t packed = _mm_cvtsi128_si32(v);
+    memcpy(dst.data + size_t(y) * dst.rowPitch + size_t(x) * PixelBytes, &packed, sizeof(packed));
+  }
+
+  // HLSL の lerp(a, b, t) = a + t * (b - a).
+  inline __m128 Lerp(__m128 a, __m128 b, __m128 t)
+  {
+    return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+  }
+
+  // 4 値の平均. シェーダーと同じく 0.25 * (((a + b) + c) + d) の順で計算する.
+  inline __m128 Average4(__m128 a, __m128 b, __m128 c, __m128 d)
+  {
+    return _mm_mul_ps(_mm_set1_ps(0.25f), _mm_add_ps(_mm_add_ps(_mm_add_ps(a, b), c), d));
+  }
+
+  // テクセル座標をサブテクセル 8bit の固定小数に変換し、整数部と重みに分ける.
+  inline void ToFixedCoord(float uv, uint32_t size, int32_t& index, float& weight)
+  {
+    const float t = uv * float(size) - 0.5f;
+    const int32_t fixed = int32_t(std::floor(t * 256.0f + 0.5f));
+    index = fixed >> 8;
+    weight = float(fixed & 0xFF) * (1.0f / 256.0f);
+  }
+
+  // SrcMip.SampleLevel(BilinearClamp, uv, SrcMipLevel)
+  __m128 SampleBilinearClamp(const SrcLevel& src, float u, float v)
+  {
+    int32_t ix, iy;
+    float wx, wy;
+    ToFixedCoord(u, src.width, ix, wx);
+    ToFixedCoord(v, src.height, iy, wy);
+    const int32_t maxX = int32_t(src.width) - 1;
+    const int32_t maxY = int32_t(src.height) - 1;
+    const uint32_t x0 = uint32_t(std::clamp(ix, 0, maxX));
+    const uint32_t x1 = uint32_t(std::clamp(ix + 1, 0, maxX));
+    const uint32_t y0 = uint32_t(std::clamp(iy, 0, maxY));
+    const uint32_t y1 = uint32_t(std::clamp(iy + 1, 0, maxY));
+
+    const __m128 fx = _mm_set1_ps(wx);
+    const __m128 top = Lerp(LoadTexel(src, x0, y0), LoadTexel(src, x1, y0), fx);
+    const __m128 bottom = Lerp(LoadTexel(src, x0, y1), LoadTexel(src, x1, y1), fx);
+    return Lerp(top, bottom, _mm_set1_ps(wy));
+  }
+
+  // NON_POWER_OF_TWO の各バリエーションの Src1.
+  __m128 ComputeSrc1(const PassDesc& pass, uint32_t x, uint32_t y)
+  {
+    const float fx = float(x);
+    const float fy = float(y);
+    const float tsx = pass.texelSizeX;
+    const float tsy = pass.texelSizeY;
+    switch (pass.variant)
+    {
+    case 0:
+    default:
+      return SampleBilinearClamp(pass.src, tsx * (fx + 0.5f), tsy * (fy + 0.5f));
+    case 1:
+    {
+      // 幅が 2:1 を超えるため、横方向に 2 サンプル.
+      const float u1 = tsx * (fx + 0.25f), v1 = tsy * (fy + 0.5f);
+      const float offX = tsx * 0.5f;
+      return _mm_mul_ps(_mm_set1_ps(0.5f),
+        _mm_add_ps(SampleBilinearClamp(pass.src, u1, v1), SampleBilinearClamp(pass.src, u1 + offX, v1)));
+    }
+    case 2:
+    {
+      // 高さが 2:1 を超えるため、縦方向に 2 サンプル.
+      const float u1 = tsx * (fx + 0.5f), v1 = tsy * (fy + 0.25f);
+      const float offY = tsy * 0.5f;
+      return _mm_mul_ps(_mm_set1_ps(0.5f),
+        _mm_add_ps(SampleBilinearClamp(pass.src, u1, v1), SampleBilinearClamp(pass.src, u1, v1 + offY)));
+    }
+    case 3:
+    {
+      const float u1 = tsx * (fx + 0.25f), v1 = tsy * (fy + 0.25f);
+      const float ox = tsx * 0.5f, oy = tsy * 0.5f;
+      __m128 src1 = SampleBilinearClamp(pass.src, u1, v1);
+      src1 = _mm_add_ps(src1, SampleBilinearClamp(pass.src, u1 + ox, v1));
+      src1 = _mm_add_ps(src1, SampleBilinearClamp(pass.src, u1, v1 + oy));
+      src1 = _mm_add_ps(src1, SampleBilinearClamp(pass.src, u1 + ox, v1 + oy));
+      return _mm_mul_ps(src1, _mm_set1_ps(0.25f));
+    }
+    }
+  }
+
+  // 2:1 ちょうどの縮小で、グループ内のサンプル位置がすべてテクスチャ内にある場合の Src1.
+  // 重みは常に 0.5 となるため、SampleBilinearClamp と同じ計算順で座標計算を省く.
+  inline __m128 ComputeSrc1Box(const SrcLevel& src, uint32_t x, uint32_t y)
+  {
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 top = Lerp(LoadTexel(src, 2 * x, 2 * y), LoadTexel(src, 2 * x + 1, 2 * y), half);
+    const __m128 bottom = Lerp(LoadTexel(src, 2 * x, 2 * y + 1), LoadTexel(src, 2 * x + 1, 2 * y + 1), half);
+    return Lerp(top, bottom, half);
+  }
+
+  // PackColor. RGB に sRGB のカーブを適用する. アルファはそのまま.
+  inline __m128 PackColor(__m128 color, PackMode packMode)
+  {
+    if (packMode == PackMode::Linear)
+    {
+      return color;
+    }
+    if (packMode == PackMode::SRGBExact)
+    {
+      alignas(16) float values[4];
+      _mm_store_ps(values, color);
+      for (int i = 0; i < 3; ++i)
+      {
+        const double x = std::clamp(double(values[i]), 0.0, 1.0);
+        values[i] = float(x <= 0.0031308 ? x * 12.92 : 1.055 * std::pow(x, 1.0 / 2.4) - 0.055);
+      }
+      return _mm_load_ps(values);
+    }
+    // lerp(1.13005 * sqrt(abs(x - 0.00228)) - 0.13448 * x + 0.005719, 12.92 * x, step(x, 0.0031308))
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 x = color;
+    const __m128 root = _mm_sqrt_ps(_mm_and_ps(_mm_sub_ps(x, _mm_set1_ps(0.00228f)), absMask));
+    __m128 curve = _mm_mul_ps(_mm_set1_ps(1.13005f), root);
+    curve = _mm_sub_ps(curve, _mm_mul_ps(_mm_set1_ps(0.13448f), x));
+    curve = _mm_add_ps(curve, _mm_set1_ps(0.005719f));
+    const __m128 linear = _mm_mul_ps(_mm_set1_ps(12.92f), x);
+    const __m128 step = _mm_and_ps(_mm_cmple_ps(x, _mm_set1_ps(0.0031308f)), _mm_set1_ps(1.0f));
+    const __m128 rgb = Lerp(curve, linear, step);
+
+    // アルファはそのまま.
+    const __m128 alphaMask = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+    return _mm_or_ps(_mm_andnot_ps(alphaMask, rgb), _mm_and_ps(alphaMask, color));
+  }
+
+  // 1 スレッドグループ分の処理. gs_R/G/B/A の代わりにグループ内の値を lds に保持する.
+  void RunGroup(const PassDesc& pass, uint32_t groupX, uint32_t groupY)
+  {
+    __m128 lds[GroupSize * GroupSize];
+    const uint32_t baseX = groupX * GroupSize;
+    const uint32_t baseY = groupY * GroupSize;
+
+    const bool boxPath = pass.variant == 0 &&
+      (baseX + GroupSize) * 2 <= pass.src.width && (baseY + GroupSize) * 2 <= pass.src.height;
+    for (uint32_t gi = 0; gi < GroupSize * GroupSize; ++gi)
+    {
+      const uint32_t x = baseX + (gi & 7);
+      const uint32_t y = baseY + (gi >> 3);
+      const __m128 src1 = boxPath ? ComputeSrc1Box(pass.src, x, y) : ComputeSrc1(pass, x, y);
+      StoreTexel(pass.dst[0], x, y, PackColor(src1, pass.packMode));
+      lds[gi] = src1;
+    }
+
+    // 2 レベル目以降. (offset, 左上を表すビットマスク, 座標のシフト量)
+    struct Reduction { uint32_t offset; uint32_t mask; uint32_t shift; };
+    constexpr Reduction reductions[] = {
+      { 0x01, 0x09, 1 },  // X, Y が偶数.
+      { 0x02, 0x1B, 2 },  // X, Y が 4 の倍数.
+      { 0x04, 0x3F, 3 },  // GI == 0.
+    };
+    for (uint32_t level = 1; level < pass.numMips; ++level)
+    {
+      const auto& r = reductions[level - 1];
+      for (uint32_t gi = 0; gi < GroupSize * GroupSize; ++gi)
+      {
+        if ((gi & r.mask) != 0)
+        {
+          continue;
+        }
+        const __m128 src1 = Average4(lds[gi], lds[gi + r.offset], lds[gi + r.offset * 8], lds[gi + r.offset * 9]);
+        const uint32_t x = (baseX + (gi & 7)) >> r.shift;
+        const uint32_t y = (baseY + (gi >> 3)) >> r.shift;
+        StoreTexel(pass.dst[level], x, y, PackColor(src1, pass.packMode));
+        lds[gi] = src1;
+      }
+    }
+  }
+
+  void RunPass(const PassDesc& pass, uint32_t workerCount)
+  {
+    const uint32_t groupCountX = (pass.dst[0].width + GroupSize - 1) / GroupSize;
+    const uint32_t groupCountY = (pass.dst[0].height + GroupSize - 1) / GroupSize;
+    // 行単位で分配すると小さいレベルで偏るため、グループ単位で分配する.
+    ParallelFor(groupCountX * groupCountY, workerCount, [&](uint32_t index, uint32_t) {
+      RunGroup(pass, index % groupCountX, index / groupCountX);
+    });
+  }
+
+  using Clock = std::chrono::high_resolution_clock;
+  double ElapsedMs(Clock::time_point start, Clock::time_point end)
+  {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  }
+}
+
+uint32_t GetGenerateMipsPassMipCount(uint32_t srcWidth, uint32_t srcHeight)
+{
+  const uint32_t dstWidth = srcWidth >> 1, dstHeight = srcHeight >> 1;
+  const uint32_t value = (dstWidth == 1 ? dstHeight : dstWidth) | (dstHeight == 1 ? dstWidth : dstHeight);
+  uint32_t additionalMips = 0;
+  if (value != 0)
+  {
+    while (((value >> additionalMips) & 1) == 0)
+    {
+      ++additionalMips;
+    }
+  }
+  return 1 + std::min(3u, additionalMips);
+}
+
+uint32_t GenerateMipsCPU(uint8_t* data, std::span<const MipLevelLayout> levels, const GenerateMipsCPUOptions& options)
+{
+  const uint32_t mipLevels = uint32_t(levels.size());
+  const uint32_t baseWidth = levels.empty() ? 0 : levels[0].width;
+  const uint32_t baseHeight = levels.empty() ? 0 : levels[0].height;
+  uint32_t passCount = 0;
+
+  // GenerateMipmapCS と同じ順にパスを実行する. パスの間はディスパッチ間のバリアに相当.
+  for (uint32_t topMip = 0; topMip + 1 < mipLevels;)
+  {
+    const uint32_t srcWidth = baseWidth >> topMip;
+    const uint32_t srcHeight = baseHeight >> topMip;
+    const uint32_t numMips = std::min(GetGenerateMipsPassMipCount(srcWidth, srcHeight), mipLevels - 1 - topMip);
+
+    const auto& srcLayout = levels[topMip];
+    PassDesc pass{};
+    pass.src = SrcLevel{ data + srcLayout.offset, srcLayout.width, srcLayout.height, srcLayout.rowPitch,
+      options.convertToSRGB ? GetSRGBToLinearTable() : nullptr };
+    for (uint32_t i = 0; i < numMips; ++i)
+    {
+      const auto& dstLayout = levels[topMip + 1 + i];
+      pass.dst[i] = DstLevel{ data + dstLayout.offset, dstLayout.width, dstLayout.height, dstLayout.rowPitch };
+    }
+    pass.numMips = numMips;
+    pass.variant = GetGenerateMipsVariant(srcWidth, srcHeight);
+    pass.texelSizeX = 1.0f / float(pass.dst[0].width);
+    pass.texelSizeY = 1.0f / float(pass.dst[0].height);
+    pass.packMode = options.convertToSRGB ? PackMode::SRGBCurve : PackMode::Linear;
+    RunPass(pass, options.workerCount);
+
+    topMip += numMips;
+    ++passCount;
+  }
+  return passCount;
+}
+
+void GenerateMipsRenderTargetCPU(uint8_t* data, std::span<const MipLevelLayout> levels, const GenerateMipsCPUOptions& options)
+{
+  // GenerateMipmapRT と同じく、1 つ前のレベルをテクセル中心でバイリニアサンプルして 1 レベルずつ描画する.
+  for (uint32_t mip = 1; mip < uint32_t(levels.size()); ++mip)
+  {
+    const auto& srcLayout = levels[mip - 1];
+    const auto& dstLayout = levels[mip];
+    PassDesc pass{};
+    pass.src = SrcLevel{ data + srcLayout.offset, srcLayout.width, srcLayout.height, srcLayout.rowPitch,
+      options.convertToSRGB ? GetSRGBToLinearTable() : nullptr };
+    pass.dst[0] = DstLevel{ data + dstLayout.offset, dstLayout.width, dstLayout.height, dstLayout.rowPitch };
+    pass.numMips = 1;
+    pass.variant = 0;
+    pass.texelSizeX = 1.0f / float(dstLayout.width);
+    pass.texelSizeY = 1.0f / float(dstLayout.height);
+    pass.packMode = options.convertToSRGB ? PackMode::SRGBExact : PackMode::Linear;
+    RunPass(pass, options.workerCount);
+  }
+}
+
+GenerateMipsCPUBenchmarkResult RunGenerateMipsCPUBenchmark(uint32_t width, uint32_t height, uint32_t iterations, bool convertToSRGB)
+{
+  GenerateMipsCPUBenchmarkResult result;
+  result.width = width;
+  result.height = height;
+  result.mipCount = 1;
+  while ((std::max(width, height) >> result.mipCount) != 0)
+  {
+    result.mipCount++;
+  }
+  iterations = std::max(1u, iterations);
+
+  std::vector<MipLevelLayout> levels;
+  const auto totalBytes = MakeMipChainLayout(width, height, result.mipCount, 1, 16, levels);
+  std::vector<uint8_t> data(totalBytes);
+
+  // 適当なノイズで埋める.
+  uint32_t state = 0x12345678u;
+  for (uint32_t y = 0; y < height; ++y)
+  {
+    auto row = data.data() + levels[0].offset + size_t(y) * levels[0].rowPitch;
+    for (uint32_t i = 0; i < width * PixelBytes; ++i)
+    {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      row[i] = uint8_t(state >> 24);
+    }
+  }
+
+  auto measure = [&](uint32_t workerCount) {
+    GenerateMipsCPUOptions options;
+    options.convertToSRGB = convertToSRGB;
+    options.workerCount = workerCount;
+    result.passCount = GenerateMipsCPU(data.data(), levels, options); // ウォームアップ.
+    const auto start = Clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+      GenerateMipsCPU(data.data(), levels, options);
+    }
+    return ElapsedMs(start, Clock::now()) / iterations;
+  };
+  result.workerCount = ResolveWorkerCount(0, ~0u);
+  result.singleThreadMs = measure(1);
+  result.multiThreadMs = measure(result.workerCount);
+  return result;
+}
@@ -0,0 +1,74 @@
+﻿#pragma once
+#include <cstdint>
+#include <span>
+
+#include "MipChainBuilder.h"
+
+// GenerateMipsCS.hlsli (GenerateMipmapCS) と同じフィルタ処理でミップマップを作成する CPU 実装.
+// GPU 結果の検証用のリファレンス、およびオフラインでのミップ作成に使う.
+// 8x8 のスレッドグループ単位で各ワーカーへ分配し、1 テクセル(RGBA)を SSE の 1 レジスタで処理する.
+//  - NON_POWER_OF_TWO の 4 種類のバリエーションをソースサイズから選択する.
+//  - 1 パスで最大 4 レベル(NumMipLevels)を作成し、パス内の 2 レベル目以降は量子化前の値から平均する.
+//  - グループ内でテクスチャ範囲外になるスレッドも、クランプしたサンプル値を平均に含める.
+//  - バイリニアサンプルは D3D12 の最低保証と同じサブテクセル精度 8bit で重みを量子化する.
+// GPU との差はサンプラー実装依存の丸め程度で、2 のべき乗サイズでは一致する.
+// D3D12 には依存しない.
+
+struct GenerateMipsCPUOptions
+{
+  // sRGB のテクスチャとして扱う. 読み込みは sRGB の SRV と同じくリニアへ変換し、
+  // 書き出しは PackColor で ApplySRGBCurve を適用する (CONVERT_TO_SRGB 相当).
+  bool convertToSRGB = false;
+  uint32_t workerCount = 0;   // 0 の場合はハードウェアスレッド数.
+};
+
+// GenerateMipmapCS と同じ規則で 1 パスに書き出すレベル数 (NumMipLevels) を求める.
+// srcWidth/srcHeight はベースサイズを topMip だけシフトした値.
+uint32_t GetGenerateMipsPassMipCount(uint32_t srcWidth, uint32_t srcHeight);
+
+// シェーダーのバリエーション (NON_POWER_OF_TWO). 1: 幅が奇数, 2: 高さが奇数, 3: 両方.
+inline uint32_t GetGenerateMipsVariant(uint32_t srcWidth, uint32_t srcHeight)
+{
+  return (srcWidth & 1) | (srcHeight & 1) << 1;
+}
+
+// data + levels[0].offset の RGBA8 イメージを元に levels[1] 以降を作成する.
+// 戻り値はパス数(GPU でのディスパッチ回数に相当).
+uint32_t GenerateMipsCPU(uint8_t* data, std::span<const MipLevelLayout> levels, const GenerateMipsCPUOptions& options);
+
+// GenerateMipmapRT (MipmapWritePS) と同じ処理で levels[1] 以降を作成する.
+// 各レベルを 1 つ前のレベルからバイリニア 1 サンプルで作成するため、奇数サイズではサンプルが不足する.
+// convertToSRGB の場合は sRGB フォーマットの RTV と同じく、正確な sRGB のカーブで書き出す.
+void GenerateMipsRenderTargetCPU(uint8_t* data, std::span<const MipLevelLayout> levels, const GenerateMipsCPUOptions& options);
+
+struct GenerateMipsCPUBenchmarkResult
+{
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t mipCount = 0;
+  uint32_t passCount = 0;
+  uint32_t workerCount = 0;
+  double singleThreadMs = 0.0;
+  double multiThreadMs = 0.0;
+
+  // ベースレベルのピクセル数を処理時間で割ったもの.
+  double GetMPixelsPerSec() const
+  {
+    return multiThreadMs > 0.0 ? (double(width) * height / 1000000.0) / (multiThreadMs / 1000.0) : 0.0;
+  }
+  double GetMPixelsPerSecPerCore() const
+  {
+    return workerCount > 0 ? GetMPixelsPerSec() / workerCount : 0.0;
+  }
+  double GetSingleThreadMPixelsPerSec() const
+  {
+    return singleThreadMs > 0.0 ? (double(width) * height / 1000000.0) / (singleThreadMs / 1000.0) : 0.0;
+  }
+  double GetSpeedup() const
+  {
+    return multiThreadMs > 0.0 ? singleThreadMs / multiThreadMs : 0.0;
+  }
+};
+
+// width x height の RGBA8 イメージのフルチェーン作成を、1 スレッドと全ワーカーでそれぞれ iterations 回計測する.
+GenerateMipsCPUBenchmarkResult RunGenerateMipsCPUBenchmark(uint32_t width, uint32_t height, uint32_t iterations, bool convertToSRGB = false);
@@ -12,6 +12,8 @@
 #include <wrl.h>
 #include <dxgi1_6.h>
 
+#include "UploadContext.h"
+
 class GfxDevice
 {
 public:
@@ -39,9 +41,11 @@ public:
   DescriptorHandle GetSwapchainBufferDescriptor();
   ComPtr<ID3D12Resource1>     GetSwapchainBufferResource();
 
+  // アップロードコンテキストで記録済みの転送は、描画キュー上で完了を待ってから実行される.
   void Submit(ID3D12CommandList* const commandList);
   void Present(UINT syncInterval, UINT flags = 0);
   void NewFrame();
+  // 描画キューとアップロードの全ての処理の完了を待つ.
   void WaitForGPU();
 
   ComPtr<ID3D12Resource1> CreateBuffer(const D3D12_RESOURCE_DESC& resDesc, const D3D12_HEAP_PROPERTIES& heapProps);
@@ -52,6 +56,7 @@ public:
   ComPtr<ID3D12PipelineState> CreateComputePipelineState(const D3D12_COMPUTE_PIPELINE_STATE_DESC& psoDesc);
   ComPtr<ID3D12GraphicsCommandList> CreateCommandList();
 
+  // デフォルトヒープへの srcData の転送はアップロードコンテキストへ記録され、完了を待たずに戻る.
   ComPtr<ID3D12Resource1> CreateBuffer(const D3D12_RESOURCE_DESC& resDesc, D3D12_HEAP_TYPE heapType, D3D12_RESOURCE_STATES resourceState = D3D12_RESOURCE_STATE_GENERIC_READ, const void* srcData = nullptr);
   DescriptorHandle CreateRenderTargetView(ComPtr<ID3D12Resource1> renderTargetResource, D3D12_RENDER_TARGET_VIEW_DESC* rtvDesc);
   DescriptorHandle CreateDepthStencilView(ComPtr<ID3D12Resource1> depthImage, D3D12_DEPTH_STENCIL_VIEW_DESC* dsvDesc);
@@ -74,6 +79,7 @@ public:
   ComPtr<ID3D12Device5> GetD3D12Device() { return m_d3d12Device; }
   ComPtr<ID3D12CommandQueue> GetD3D12CommandQueue() { return m_commandQueue; }
   ComPtr<ID3D12CommandAllocator> GetD3D12CommandAllocator(int index);
+  UploadContext& GetUploadContext() { return m_uploadContext; }
 
 private:
   void ThrowIfFailed(HRESULT hr, const std::string& errorMsg);
@@ -96,6 +102,12 @@ private:
   UINT   m_frameIndex = 0;
   HANDLE m_waitFence;
   ComPtr<ID3D12Fence1> m_frameFence;
+  ComPtr<ID3D12Fence1> m_gpuWaitFence;  // WaitForGPU 用.
+  UINT64 m_gpuWaitValue = 0;
+
+  // 初期化時のデータ転送用.
+  UploadContext m_uploadContext;
+  UploadContext::Ticket m_uploadWaitTicket = UploadStagingRing::NullTicket;  // 描画キューで待機済みのチケット.
 
   // 描画フレーム情報
   struct FrameInfo
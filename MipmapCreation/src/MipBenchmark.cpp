@@ -0,0 +1,383 @@
+﻿#include "MipBenchmark.h"
+#include "GenerateMipsCPU.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+  constexpr uint32_t PixelBytes = 4;
+
+  using Clock = std::chrono::high_resolution_clock;
+  double ElapsedMs(Clock::time_point start, Clock::time_point end)
+  {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  }
+
+  uint32_t GetFullMipCount(uint32_t width, uint32_t height)
+  {
+    uint32_t mipCount = 1;
+    while ((std::max(width, height) >> mipCount) != 0)
+    {
+      mipCount++;
+    }
+    return mipCount;
+  }
+
+  double SRGBToLinear(double c)
+  {
+    return c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+  }
+  double LinearToSRGB(double c)
+  {
+    c = std::clamp(c, 0.0, 1.0);
+    return c <= 0.0031308 ? c * 12.92 : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055;
+  }
+
+  // 縮小先の 1 テクセルが覆う縮小元の範囲 [dst * srcSize / dstSize, (dst + 1) * srcSize / dstSize) を、
+  // 重なる長さで重み付けしたタップにする. 2:1 なら 2 タップ、奇数サイズなら 3 タップになる.
+  struct AxisTap
+  {
+    uint32_t index[3];
+    float weight[3];
+    uint32_t count;
+  };
+  std::vector<AxisTap> MakeAxisTaps(uint32_t srcSize, uint32_t dstSize)
+  {
+    std::vector<AxisTap> taps(dstSize);
+    for (uint32_t i = 0; i < dstSize; ++i)
+    {
+      const double begin = double(i) * srcSize / dstSize;
+      const double end = double(i + 1) * srcSize / dstSize;
+      auto& tap = taps[i];
+      tap.count = 0;
+      for (uint32_t s = uint32_t(begin); s < srcSize && double(s) < end && tap.count < 3; ++s)
+      {
+        const double overlap = std::min(end, double(s + 1)) - std::max(begin, double(s));
+        if (overlap > 0.0)
+        {
+          tap.index[tap.count] = s;
+          tap.weight[tap.count] = float(overlap / (end - begin));
+          tap.count++;
+        }
+      }
+    }
+    return taps;
+  }
+}
+
+const char* GetMipGenPathName(MipGenPath path)
+{
+  switch (path)
+  {
+  case MipGenPath::RenderTarget: return "RT";
+  case MipGenPath::Compute: return "CS";
+  case MipGenPath::SinglePass: return "SPD";
+  default: return "?";
+  }
+}
+
+const char* GetMipBenchmarkFormatName(MipBenchmarkFormat format)
+{
+  switch (format)
+  {
+  case MipBenchmarkFormat::RGBA8Unorm: return "RGBA8";
+  case MipBenchmarkFormat::RGBA8UnormSRGB: return "RGBA8_SRGB";
+  default: return "?";
+  }
+}
+
+std::vector<MipBenchmarkCase> MakeMipBenchmarkCases()
+{
+  const struct { uint32_t width, height; } sizes[] = {
+    { 4096, 4096 }, { 2048, 2048 }, { 1024, 1024 }, // 2 のべき乗.
+    { 1023, 1023 }, { 513, 257 },                   // 奇数.
+    { 2048, 512 }, { 1000, 600 },                   // 非正方形.
+  };
+  std::vector<MipBenchmarkCase> cases;
+  for (const auto& size : sizes)
+  {
+    for (uint32_t format = 0; format < uint32_t(MipBenchmarkFormat::Count); ++format)
+    {
+      cases.push_back(MipBenchmarkCase{ size.width, size.height, MipBenchmarkFormat(format) });
+    }
+  }
+  return cases;
+}
+
+bool CpuMipBenchmarkBackend::IsSupported(MipGenPath, const MipBenchmarkCase&) const
+{
+  return true;
+}
+
+double CpuMipBenchmarkBackend::Run(MipGenPath path, const MipBenchmarkCase& benchCase,
+  uint8_t* data, std::span<const MipLevelLayout> levels, uint32_t iterations)
+{
+  if (levels.empty())
+  {
+    return -1.0;
+  }
+  const bool isSRGB = benchCase.format == MipBenchmarkFormat::RGBA8UnormSRGB;
+  GenerateMipsCPUOptions options;
+  options.convertToSRGB = isSRGB;
+  options.workerCount = m_workerCount;
+
+  // SinglePassDownsampler はベースレベルもコピーするため、入力は別のバッファに取っておく.
+  const auto& top = levels[0];
+  std::vector<uint8_t> base;
+  if (path == MipGenPath::SinglePass)
+  {
+    base.resize(uint64_t(top.width) * top.height * PixelBytes);
+    for (uint32_t y = 0; y < top.height; ++y)
+    {
+      memcpy(base.data() + uint64_t(top.width) * PixelBytes * y, data + top.offset + uint64_t(top.rowPitch) * y, top.width * PixelBytes);
+    }
+  }
+
+  auto generate = [&]() {
+    switch (path)
+    {
+    case MipGenPath::RenderTarget:
+      GenerateMipsRenderTargetCPU(data, levels, options);
+      break;
+    case MipGenPath::Compute:
+      GenerateMipsCPU(data, levels, options);
+      break;
+    case MipGenPath::SinglePass:
+      m_downsampler.Build(base.data(), top.width * PixelBytes, data, levels,
+        isSRGB ? MipColorSpace::SRGB : MipColorSpace::Linear, true, m_workerCount);
+      break;
+    default:
+      break;
+    }
+  };
+  generate(); // ウォームアップ.
+  const auto start = Clock::now();
+  for (uint32_t i = 0; i < iterations; ++i)
+  {
+    generate();
+  }
+  return ElapsedMs(start, Clock::now()) / std::max(1u, iterations);
+}
+
+void MipReference::Build(const uint8_t* base, uint32_t baseRowPitch, std::span<const MipLevelLayout> levels, MipBenchmarkFormat format)
+{
+  m_format = format;
+  m_levels.clear();
+  if (levels.empty())
+  {
+    return;
+  }
+  const bool isSRGB = format == MipBenchmarkFormat::RGBA8UnormSRGB;
+
+  // ベースレベルを 0..1 のリニアな値にする.
+  uint32_t srcWidth = levels[0].width, srcHeight = levels[0].height;
+  std::vector<float> src(size_t(srcWidth) * srcHeight * 4);
+  for (uint32_t y = 0; y < srcHeight; ++y)
+  {
+    const uint8_t* row = base + uint64_t(baseRowPitch) * y;
+    for (uint32_t i = 0; i < srcWidth * 4; ++i)
+    {
+      const double c = row[i] / 255.0;
+      src[size_t(y) * srcWidth * 4 + i] = float((isSRGB && (i & 3) != 3) ? SRGBToLinear(c) : c);
+    }
+  }
+
+  // 各レベルは 1 つ前の(量子化していない)レベルから作成する.
+  for (size_t mip = 1; mip < levels.size(); ++mip)
+  {
+    const uint32_t dstWidth = levels[mip].width, dstHeight = levels[mip].height;
+    const auto tapsX = MakeAxisTaps(srcWidth, dstWidth);
+    const auto tapsY = MakeAxisTaps(srcHeight, dstHeight);
+    std::vector<float> dst(size_t(dstWidth) * dstHeight * 4);
+    for (uint32_t y = 0; y < dstHeight; ++y)
+    {
+      const auto& ty = tapsY[y];
+      for (uint32_t x = 0; x < dstWidth; ++x)
+      {
+        const auto& tx = tapsX[x];
+        double sum[4] = {};
+        for (uint32_t j = 0; j < ty.count; ++j)
+        {
+          for (uint32_t i = 0; i < tx.count; ++i)
+          {
+            const double w = double(ty.weight[j]) * tx.weight[i];
+            const float* texel = src.data() + (size_t(ty.index[j]) * srcWidth + tx.index[i]) * 4;
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+              sum[c] += w * texel[c];
+            }
+          }
+        }
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+          dst[(size_t(y) * dstWidth + x) * 4 + c] = float(sum[c]);
+        }
+      }
+    }
+    src = dst;
+    srcWidth = dstWidth;
+    srcHeight = dstHeight;
+    m_levels.push_back(std::move(dst));
+  }
+}
+
+MipErrorMetrics MipReference::Compare(const uint8_t* data, std::span<const MipLevelLayout> levels) const
+{
+  MipErrorMetrics metrics;
+  const bool isSRGB = m_format == MipBenchmarkFormat::RGBA8UnormSRGB;
+  double sumSquared = 0.0;
+  uint64_t count = 0;
+  for (size_t mip = 1; mip < levels.size() && mip - 1 < m_levels.size(); ++mip)
+  {
+    const auto& layout = levels[mip];
+    const auto& reference = m_levels[mip - 1];
+    for (uint32_t y = 0; y < layout.height; ++y)
+    {
+      const uint8_t* row = data + layout.offset + uint64_t(layout.rowPitch) * y;
+      for (uint32_t i = 0; i < layout.width * 4; ++i)
+      {
+        const double value = reference[size_t(y) * layout.width * 4 + i];
+        const double expected = ((isSRGB && (i & 3) != 3) ? LinearToSRGB(value) : std::clamp(value, 0.0, 1.0)) * 255.0;
+        const double error = std::abs(double(row[i]) - expected);
+        metrics.maxError = std::max(metrics.maxError, error);
+        sumSquared += error * error;
+        count++;
+      }
+    }
+  }
+  if (count > 0)
+  {
+    metrics.rmse = std::sqrt(sumSquared / double(count));
+    metrics.psnr = metrics.rmse > 0.0 ? 20.0 * std::log10(255.0 / metrics.rmse) : 0.0;
+  }
+  return metrics;
+}
+
+void FillMipBenchmarkImage(uint8_t* data, uint32_t width, uint32_t height, uint32_t rowPitch)
+{
+  // 滑らかなグラデーションに、1 テクセル単位の市松模様とノイズを重ねる.
+  // 縮小で平均される高周波成分を含めることで、フィルタの違いが誤差に現れるようにする.
+  uint32_t state = 0x12345678u;
+  for (uint32_t y = 0; y < height; ++y)
+  {
+    uint8_t* row = data + uint64_t(rowPitch) * y;
+    for (uint32_t x = 0; x < width; ++x)
+    {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      const uint32_t checker = ((x ^ y) & 1) ? 48 : 0;
+      const uint32_t gradientX = uint32_t(uint64_t(x) * 200 / std::max(1u, width - 1));
+      const uint32_t gradientY = uint32_t(uint64_t(y) * 200 / std::max(1u, height - 1));
+      uint8_t* texel = row + uint64_t(x) * PixelBytes;
+      texel[0] = uint8_t(gradientX + checker / 2 + (state & 7));
+      texel[1] = uint8_t(gradientY + ((state >> 8) & 31));
+      texel[2] = uint8_t(255 - gradientX / 2 - checker);
+      texel[3] = uint8_t(255 - checker - ((state >> 16) & 15));
+    }
+  }
+}
+
+std::vector<MipBenchmarkResult> RunMipBenchmark(MipBenchmarkBackend& backend, std::span<const MipBenchmarkCase> cases, uint32_t iterations)
+{
+  std::vector<MipBenchmarkResult> results;
+  for (const auto& benchCase : cases)
+  {
+    std::vector<MipLevelLayout> levels;
+    const auto totalBytes = MakeMipChainLayout(benchCase.width, benchCase.height,
+      GetFullMipCount(benchCase.width, benchCase.height), 256, 512, levels);
+    const auto& top = levels[0];
+
+    std::vector<uint8_t> base(uint64_t(top.rowPitch) * top.height);
+    FillMipBenchmarkImage(base.data(), top.width, top.height, top.rowPitch);
+    MipReference reference;
+    reference.Build(base.data(), top.rowPitch, levels, benchCase.format);
+
+    std::vector<uint8_t> data(totalBytes);
+    for (uint32_t path = 0; path < uint32_t(MipGenPath::Count); ++path)
+    {
+      MipBenchmarkResult result;
+      result.benchCase = benchCase;
+      result.path = MipGenPath(path);
+      result.supported = backend.IsSupported(result.path, benchCase);
+      if (result.supported)
+      {
+        // 手法毎に前の結果が残らないよう作り直す.
+        std::fill(data.begin(), data.end(), uint8_t(0));
+        memcpy(data.data() + top.offset, base.data(), base.size());
+        result.ms = backend.Run(result.path, benchCase, data.data(), levels, iterations);
+        result.supported = result.ms >= 0.0;
+        if (result.supported)
+        {
+          result.error = reference.Compare(data.data(), levels);
+        }
+      }
+      results.push_back(result);
+    }
+  }
+  return results;
+}
+
+std::string FormatMipBenchmarkTable(const char* backendName, std::span<const MipBenchmarkResult> results)
+{
+  std::string text;
+  char line[256];
+  snprintf(line, sizeof(line), "[%s]\n%-11s %-10s %-4s %9s %9s %7s %7s %7s\n",
+    backendName, "Size", "Format", "Path", "ms", "MPix/s", "MaxErr", "RMSE", "PSNR");
+  text += line;
+
+  for (size_t i = 0; i < results.size();)
+  {
+    // 同じケースの結果をまとめて、最も速い手法を求める.
+    size_t end = i;
+    size_t fastest = results.size();
+    while (end < results.size() &&
+      results[end].benchCase.width == results[i].benchCase.width &&
+      results[end].benchCase.height == results[i].benchCase.height &&
+      results[end].benchCase.format == results[i].benchCase.format)
+    {
+      if (results[end].supported && (fastest == results.size() || results[end].ms < results[fastest].ms))
+      {
+        fastest = end;
+      }
+      ++end;
+    }
+
+    for (size_t j = i; j < end; ++j)
+    {
+      const auto& result = results[j];
+      char size[32];
+      snprintf(size, sizeof(size), "%ux%u", result.benchCase.width, result.benchCase.height);
+      if (!result.supported)
+      {
+        snprintf(line, sizeof(line), "%-11s %-10s %-4s %9s\n",
+          size, GetMipBenchmarkFormatName(result.benchCase.format), GetMipGenPathName(result.path), "n/a");
+      }
+      else
+      {
+        const double mpixels = double(result.benchCase.width) * result.benchCase.height / 1000000.0;
+        char psnr[16];
+        if (result.error.rmse > 0.0)
+        {
+          snprintf(psnr, sizeof(psnr), "%.1f", result.error.psnr);
+        }
+        else
+        {
+          snprintf(psnr, sizeof(psnr), "inf");
+        }
+        snprintf(line, sizeof(line), "%-11s %-10s %-4s %8.3f%c %9.1f %7.2f %7.3f %7s\n",
+          size, GetMipBenchmarkFormatName(result.benchCase.format), GetMipGenPathName(result.path),
+          result.ms, j == fastest ? '*' : ' ',
+          result.ms > 0.0 ? mpixels / (result.ms / 1000.0) : 0.0,
+          result.error.maxError, result.error.rmse, psnr);
+      }
+      text += line;
+    }
+    i = end;
+  }
+  return text;
+}
@@ -0,0 +1,113 @@
+﻿#pragma once
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "MipChainBuilder.h"
+#include "SinglePassDownsampler.h"
+
+// ミップマップ作成手法 (RT / CS / SPD) のベンチマーク.
+// サイズとフォーマットの組み合わせ毎に、計測用のバックエンドで各手法を実行して時間を計り、
+// 基準のミップチェーンとの誤差を求めて比較表にする.
+// バックエンドは差し替えられるようにしており、Windows では GPU のタイムスタンプで計測し、
+// それ以外の環境では CPU の実装 (GenerateMipsCPU / SinglePassDownsampler) で計測する.
+// D3D12 には依存しない.
+
+enum class MipGenPath : uint32_t
+{
+  RenderTarget, // GenerateMipmapRT
+  Compute,      // GenerateMipmapCS
+  SinglePass,   // GenerateMipmapSPD
+  Count,
+};
+
+enum class MipBenchmarkFormat : uint32_t
+{
+  RGBA8Unorm,
+  RGBA8UnormSRGB,
+  Count,
+};
+
+const char* GetMipGenPathName(MipGenPath path);
+const char* GetMipBenchmarkFormatName(MipBenchmarkFormat format);
+
+struct MipBenchmarkCase
+{
+  uint32_t width = 0;
+  uint32_t height = 0;
+  MipBenchmarkFormat format = MipBenchmarkFormat::RGBA8Unorm;
+};
+
+// 2 のべき乗 / 奇数 / 非正方形のサイズと、各フォーマットの組み合わせ.
+std::vector<MipBenchmarkCase> MakeMipBenchmarkCases();
+
+// 計測用のバックエンド.
+class MipBenchmarkBackend
+{
+public:
+  virtual ~MipBenchmarkBackend() = default;
+  virtual const char* GetName() const = 0;
+  virtual bool IsSupported(MipGenPath path, const MipBenchmarkCase& benchCase) const = 0;
+
+  // data + levels[0].offset のベースレベルから path の手法で levels[1] 以降を作成する.
+  // iterations 回実行した 1 回あたりの時間 (ms) を返す. 失敗した場合は負の値.
+  virtual double Run(MipGenPath path, const MipBenchmarkCase& benchCase,
+    uint8_t* data, std::span<const MipLevelLayout> levels, uint32_t iterations) = 0;
+};
+
+// CPU の実装で計測するバックエンド.
+//  RT: GenerateMipsRenderTargetCPU, CS: GenerateMipsCPU, SPD: SinglePassDownsampler
+class CpuMipBenchmarkBackend : public MipBenchmarkBackend
+{
+public:
+  explicit CpuMipBenchmarkBackend(uint32_t workerCount = 0) : m_workerCount(workerCount) {}
+
+  const char* GetName() const override { return "CPU"; }
+  bool IsSupported(MipGenPath path, const MipBenchmarkCase& benchCase) const override;
+  double Run(MipGenPath path, const MipBenchmarkCase& benchCase,
+    uint8_t* data, std::span<const MipLevelLayout> levels, uint32_t iterations) override;
+
+private:
+  uint32_t m_workerCount;
+  SinglePassDownsampler m_downsampler;
+};
+
+// 誤差. 単位は 8bit の値 (LSB). レベル 1 以降の全テクセル/全チャンネルが対象.
+struct MipErrorMetrics
+{
+  double maxError = 0.0;
+  double rmse = 0.0;
+  double psnr = 0.0;  // dB. 誤差が無い場合は 0.
+};
+
+// 基準のミップチェーン. 各レベルを前のレベルから面積比で重み付けして float のまま作成する.
+// sRGB はリニアに変換して平均する.
+class MipReference
+{
+public:
+  void Build(const uint8_t* base, uint32_t baseRowPitch, std::span<const MipLevelLayout> levels, MipBenchmarkFormat format);
+  MipErrorMetrics Compare(const uint8_t* data, std::span<const MipLevelLayout> levels) const;
+
+private:
+  MipBenchmarkFormat m_format = MipBenchmarkFormat::RGBA8Unorm;
+  std::vector<std::vector<float>> m_levels; // レベル 1 以降. RGBA の float.
+};
+
+struct MipBenchmarkResult
+{
+  MipBenchmarkCase benchCase;
+  MipGenPath path = MipGenPath::RenderTarget;
+  bool supported = false;
+  double ms = 0.0;
+  MipErrorMetrics error;
+};
+
+// ベンチマーク用のベースイメージ. グラデーションと細かい模様を含む.
+void FillMipBenchmarkImage(uint8_t* data, uint32_t width, uint32_t height, uint32_t rowPitch);
+
+// cases の各ケースで、全手法を backend で実行する.
+std::vector<MipBenchmarkResult> RunMipBenchmark(MipBenchmarkBackend& backend, std::span<const MipBenchmarkCase> cases, uint32_t iterations);
+
+// 結果の比較表. ケース毎に最も速い手法には '*' を付ける.
+std::string FormatMipBenchmarkTable(const char* backendName, std::span<const MipBenchmarkResult> results);
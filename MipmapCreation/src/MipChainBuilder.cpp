@@ -0,0 +1,475 @@
+﻿#include "MipChainBuilder.h"
+#include "MipDirtyRegion.h"
+
+#include <immintrin.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define MIP_TARGET_AVX2
+#else
+#define MIP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace
+{
+  constexpr uint32_t PixelBytes = 4;
+
+  bool DetectAVX2()
+  {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+      return false;
+    }
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+    {
+      return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+  }
+  const bool HasAVX2 = DetectAVX2();
+
+  // 変換テーブル.
+  struct ColorTables
+  {
+    // [0,256): RGB 用, [256,512): アルファ用. バイト値を [0,1] の値へ変換する.
+    alignas(32) float srgbToLinear[512];
+    alignas(32) float unormToFloat[512];
+    // 16bit に量子化したリニア値から sRGB8 への変換. AVX2 の gather は 4 バイト読むため余白を持たせる.
+    uint8_t linearToSRGB[65536 + 4];
+  };
+
+  std::unique_ptr<ColorTables> MakeColorTables()
+  {
+    auto tables = std::make_unique<ColorTables>();
+    for (int i = 0; i < 256; ++i)
+    {
+      const float c = i / 255.0f;
+      tables->srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+      tables->srgbToLinear[256 + i] = c;
+      tables->unormToFloat[i] = c;
+      tables->unormToFloat[256 + i] = c;
+    }
+    for (int i = 0; i < 65536; ++i)
+    {
+      const double l = i / 65535.0;
+      const double s = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+      tables->linearToSRGB[i] = uint8_t(std::lround(std::clamp(s, 0.0, 1.0) * 255.0));
+    }
+    std::fill_n(tables->linearToSRGB + 65536, 4, uint8_t(255));
+    return tables;
+  }
+
+  const ColorTables& GetColorTables()
+  {
+    static const auto tables = MakeColorTables();
+    return *tables;
+  }
+
+  // [0,1] の値をバイトへ戻す. SIMD と同じ丸め(最近接偶数)を使う.
+  uint8_t EncodeUnorm(float v)
+  {
+    return uint8_t(std::clamp(std::lrintf(v * 255.0f), 0L, 255L));
+  }
+  uint8_t EncodeSRGB(const ColorTables& tables, float v)
+  {
+    return tables.linearToSRGB[std::clamp(std::lrintf(v * 65535.0f), 0L, 65535L)];
+  }
+
+  // 縮小方向 1 軸分の参照範囲と重み.
+  struct AxisTaps
+  {
+    uint32_t first;
+    uint32_t count;
+    float weight[3];
+  };
+
+  // 出力 dst 個に対する各テクセルの参照範囲を求める.
+  // 入力が奇数 2n+1 のとき、出力 x は入力の [x(2n+1)/n, (x+1)(2n+1)/n) を覆うので
+  // 2x, 2x+1, 2x+2 の 3 テクセルを (n-x) : n : (x+1) で重み付けする.
+  void MakeAxisTaps(uint32_t srcSize, uint32_t dstSize, std::vector<AxisTaps>& taps)
+  {
+    taps.resize(dstSize);
+    for (uint32_t x = 0; x < dstSize; ++x)
+    {
+      auto& t = taps[x];
+      if (srcSize == 1)
+      {
+        t = { 0, 1, { 1.0f, 0.0f, 0.0f } };
+      }
+      else if ((srcSize & 1) == 0)
+      {
+        t = { 2 * x, 2, { 0.5f, 0.5f, 0.0f } };
+      }
+      else
+      {
+        const float n = float(dstSize);
+        const float total = float(srcSize);
+        t = { 2 * x, 3, { (n - x) / total, n / total, (x + 1) / total } };
+      }
+    }
+  }
+
+  // 任意サイズ(奇数を含む)向けの経路. 縦方向を先に重み付けして 1 行にまとめ、横方向に縮小する.
+  // dst の dstRect の範囲だけを処理し、1 行にまとめるのも参照する列の範囲に限る.
+  void DownsampleGeneric(
+    const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint32_t srcRowPitch,
+    uint8_t* dst, uint32_t dstWidth, uint32_t dstHeight, uint32_t dstRowPitch,
+    MipColorSpace colorSpace, const MipRect& dstRect)
+  {
+    const auto& tables = GetColorTables();
+    const bool isSRGB = colorSpace == MipColorSpace::SRGB;
+    const float* decode = isSRGB ? tables.srgbToLinear : tables.unormToFloat;
+
+    std::vector<AxisTaps> tapsX, tapsY;
+    MakeAxisTaps(srcWidth, dstWidth, tapsX);
+    MakeAxisTaps(srcHeight, dstHeight, tapsY);
+    const uint32_t srcBegin = tapsX[dstRect.left].first;
+    const uint32_t srcEnd = tapsX[dstRect.right - 1].first + tapsX[dstRect.right - 1].count;
+    std::vector<float> rowAccum(size_t(srcEnd - srcBegin) * PixelBytes);
+
+    for (uint32_t y = dstRect.top; y < dstRect.bottom; ++y)
+    {
+      const auto& ty = tapsY[y];
+      std::fill(rowAccum.begin(), rowAccum.end(), 0.0f);
+      for (uint32_t j = 0; j < ty.count; ++j)
+      {
+        const uint8_t* row = src + uint64_t(srcRowPitch) * (ty.first + j) + srcBegin * PixelBytes;
+        const float w = ty.weight[j];
+        for (uint32_t i = 0; i < (srcEnd - srcBegin) * PixelBytes; i += PixelBytes)
+        {
+          rowAccum[i + 0] += w * decode[row[i + 0]];
+          rowAccum[i + 1] += w * decode[row[i + 1]];
+          rowAccum[i + 2] += w * decode[row[i + 2]];
+          rowAccum[i + 3] += w * decode[256 + row[i + 3]];
+        }
+      }
+
+      uint8_t* out = dst + uint64_t(dstRowPitch) * y;
+      for (uint32_t x = dstRect.left; x < dstRect.right; ++x)
+      {
+        const auto& tx = tapsX[x];
+        float color[PixelBytes] = {};
+        for (uint32_t i = 0; i < tx.count; ++i)
+        {
+          const float* p = rowAccum.data() + size_t(tx.first + i - srcBegin) * PixelBytes;
+          for (uint32_t c = 0; c < PixelBytes; ++c)
+          {
+            color[c] += tx.weight[i] * p[c];
+          }
+        }
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+          out[x * PixelBytes + c] = isSRGB ? EncodeSRGB(tables, color[c]) : EncodeUnorm(color[c]);
+        }
+        out[x * PixelBytes + 3] = EncodeUnorm(color[3]);
+      }
+    }
+  }
+
+  // 偶数サイズ(ちょうど 1/2)の経路. 値をそのまま平均する.
+  void Box2x2LinearPixel(const uint8_t* row0, const uint8_t* row1, uint8_t* out)
+  {
+    for (uint32_t c = 0; c < PixelBytes; ++c)
+    {
+      out[c] = uint8_t((row0[c] + row0[c + PixelBytes] + row1[c] + row1[c + PixelBytes] + 2) >> 2);
+    }
+  }
+
+  // 偶数サイズの sRGB 経路. 加算順は AVX2 版と揃えている.
+  void Box2x2SRGBPixel(const ColorTables& tables, const uint8_t* row0, const uint8_t* row1, uint8_t* out)
+  {
+    for (uint32_t c = 0; c < PixelBytes; ++c)
+    {
+      const float* decode = tables.srgbToLinear + (c == 3 ? 256 : 0);
+      const float v = ((decode[row0[c]] + decode[row1[c]]) + (decode[row0[c + PixelBytes]] + decode[row1[c + PixelBytes]])) * 0.25f;
+      out[c] = c == 3 ? EncodeUnorm(v) : EncodeSRGB(tables, v);
+    }
+  }
+
+  void DownsampleBox2x2Scalar(
+    const uint8_t* src, uint32_t srcRowPitch, uint8_t* dst, uint32_t dstWidth, uint32_t dstHeight, uint32_t dstRowPitch,
+    MipColorSpace colorSpace, uint32_t startX)
+  {
+    const auto& tables = GetColorTables();
+    for (uint32_t y = 0; y < dstHeight; ++y)
+    {
+      const uint8_t* row0 = src + uint64_t(srcRowPitch) * (2 * y);
+      const uint8_t* row1 = row0 + srcRowPitch;
+      uint8_t* out = dst + uint64_t(dstRowPitch) * y;
+      for (uint32_t x = startX; x < dstWidth; ++x)
+      {
+        if (colorSpace == MipColorSpace::SRGB)
+        {
+          Box2x2SRGBPixel(tables, row0 + x * 8, row1 + x * 8, out + x * PixelBytes);
+        }
+        else
+        {
+          Box2x2LinearPixel(row0 + x * 8, row1 + x * 8, out + x * PixelBytes);
+        }
+      }
+    }
+  }
+
+  // 2 行 x 8 ピクセルを 2x2 で平均し、出力 4 ピクセル分を 16bit で返す.
+  MIP_TARGET_AVX2 inline __m256i Box2x2Average4(__m256i r0, __m256i r1)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+    // レーン毎に lo:[p0,p1], hi:[p2,p3] の 16bit 値. 縦方向を先に加算.
+    const __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(r0, zero), _mm256_unpacklo_epi8(r1, zero));
+    const __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(r0, zero), _mm256_unpackhi_epi8(r1, zero));
+    // [p0+p1, p2+p3] となるよう 64bit 単位で組み替えて加算.
+    const __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+    return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+  }
+
+  MIP_TARGET_AVX2 void DownsampleBox2x2LinearAVX2(
+    const uint8_t* src, uint32_t srcRowPitch, uint8_t* dst, uint32_t dstWidth, uint32_t dstHeight, uint32_t dstRowPitch)
+  {
+    const uint32_t simdWidth = dstWidth & ~7u;
+    for (uint32_t y = 0; y < dstHeight; ++y)
+    {
+      const uint8_t* row0 = src + uint64_t(srcRowPitch) * (2 * y);
+      const uint8_t* row1 = row0 + srcRowPitch;
+      uint8_t* out = dst + uint64_t(dstRowPitch) * y;
+      for (uint32_t x = 0; x < simdWidth; x += 8)
+      {
+        const auto p0 = reinterpret_cast<const __m256i*>(row0 + x * 8);
+        const auto p1 = reinterpret_cast<const __m256i*>(row1 + x * 8);
+        const __m256i a = Box2x2Average4(_mm256_loadu_si256(p0), _mm256_loadu_si256(p1));
+        const __m256i b = Box2x2Average4(_mm256_loadu_si256(p0 + 1), _mm256_loadu_si256(p1 + 1));
+        // packus はレーン単位のため [d01,d45,d23,d67] となる. 64bit 単位で並べ直す.
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x * PixelBytes), packed);
+      }
+    }
+  }
+
+  // 下位 8 バイト(2 ピクセル)をリニアの float へ変換する.
+  MIP_TARGET_AVX2 inline __m256 DecodeSRGB2(const ColorTables& tables, __m128i v, __m256i alphaOffset)
+  {
+    return _mm256_i32gather_ps(tables.srgbToLinear, _mm256_add_epi32(_mm256_cvtepu8_epi32(v), alphaOffset), 4);
+  }
+
+  MIP_TARGET_AVX2 void DownsampleBox2x2SRGBAVX2(
+    const uint8_t* src, uint32_t srcRowPitch, uint8_t* dst, uint32_t dstWidth, uint32_t dstHeight, uint32_t dstRowPitch)
+  {
+    const auto& tables = GetColorTables();
+    const int* encodeTable = reinterpret_cast<const int*>(tables.linearToSRGB);
+    const __m256i alphaOffset = _mm256_setr_epi32(0, 0, 0, 256, 0, 0, 0, 256);
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    const __m256 encodeScale = _mm256_setr_ps(65535.0f, 65535.0f, 65535.0f, 255.0f, 65535.0f, 65535.0f, 65535.0f, 255.0f);
+    const __m256i byteMask = _mm256_set1_epi32(0xFF);
+    const __m256i zero = _mm256_setzero_si256();
+    const uint32_t simdWidth = dstWidth & ~1u;
+
+    for (uint32_t y = 0; y < dstHeight; ++y)
+    {
+      const uint8_t* row0 = src + uint64_t(srcRowPitch) * (2 * y);
+      const uint8_t* row1 = row0 + srcRowPitch;
+      uint8_t* out = dst + uint64_t(dstRowPitch) * y;
+      for (uint32_t x = 0; x < simdWidth; x += 2)
+      {
+        // 入力 4 ピクセル x 2 行をリニアの float へ変換.
+        const __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+        const __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+        const __m256 s01 = _mm256_add_ps(DecodeSRGB2(tables, r0, alphaOffset), DecodeSRGB2(tables, r1, alphaOffset));  // [p0+q0, p1+q1]
+        const __m256 s23 = _mm256_add_ps(
+          DecodeSRGB2(tables, _mm_srli_si128(r0, 8), alphaOffset), DecodeSRGB2(tables, _mm_srli_si128(r1, 8), alphaOffset));  // [p2+q2, p3+q3]
+        const __m256 even = _mm256_permute2f128_ps(s01, s23, 0x20);
+        const __m256 odd = _mm256_permute2f128_ps(s01, s23, 0x31);
+        const __m256 avg = _mm256_mul_ps(_mm256_add_ps(even, odd), quarter);
+
+        // RGB はテーブルで sRGB へ、アルファはそのまま 8bit へ戻す.
+        const __m256i q = _mm256_max_epi32(_mm256_cvtps_epi32(_mm256_mul_ps(avg, encodeScale)), zero);
+        const __m256i qClamped = _mm256_min_epi32(q, _mm256_setr_epi32(65535, 65535, 65535, 255, 65535, 65535, 65535, 255));
+        const __m256i rgb = _mm256_and_si256(_mm256_i32gather_epi32(encodeTable, qClamped, 1), byteMask);
+        const __m256i color = _mm256_blend_epi32(rgb, qClamped, 0x88);
+        const __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(color, color), zero);
+        const uint32_t d0 = uint32_t(_mm256_cvtsi256_si32(packed));
+        const uint32_t d1 = uint32_t(_mm256_extract_epi32(packed, 4));
+        memcpy(out + x * PixelBytes, &d0, PixelBytes);
+        memcpy(out + (x + 1) * PixelBytes, &d1, PixelBytes);
+      }
+    }
+  }
+}
+
+uint64_t MakeMipChainLayout(
+  uint32_t width, uint32_t height, uint32_t mipCount,
+  uint32_t rowPitchAlignment, uint32_t offsetAlignment,
+  std::vector<MipLevelLayout>& outLevels)
+{
+  const auto AlignUp = [](uint64_t value, uint64_t alignment) { return (value + alignment - 1) / alignment * alignment; };
+  outLevels.resize(mipCount);
+  uint64_t totalBytes = 0;
+  for (auto& level : outLevels)
+  {
+    level.width = width;
+    level.height = height;
+    level.rowPitch = uint32_t(AlignUp(uint64_t(width) * PixelBytes, rowPitchAlignment));
+    level.offset = AlignUp(totalBytes, offsetAlignment);
+    totalBytes = level.offset + uint64_t(level.rowPitch) * height;
+    width = std::max(1u, width / 2);
+    height = std::max(1u, height / 2);
+  }
+  return totalBytes;
+}
+
+void DownsampleMipLevel(
+  const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint32_t srcRowPitch,
+  uint8_t* dst, uint32_t dstWidth, uint32_t dstHeight, uint32_t dstRowPitch,
+  MipColorSpace colorSpace)
+{
+  DownsampleMipLevelRegion(
+    src, srcWidth, srcHeight, srcRowPitch, dst, dstWidth, dstHeight, dstRowPitch,
+    colorSpace, MipRect{ 0, 0, dstWidth, dstHeight });
+}
+
+void DownsampleMipLevelRegion(
+  const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint32_t srcRowPitch,
+  uint8_t* dst, uint32_t dstWidth, uint32_t dstHeight, uint32_t dstRowPitch,
+  MipColorSpace colorSpace, const MipRect& dstRect)
+{
+  assert(dstWidth == std::max(1u, srcWidth / 2) && dstHeight == std::max(1u, srcHeight / 2));
+  assert(dstRect.left < dstRect.right && dstRect.right <= dstWidth && dstRect.top < dstRect.bottom && dstRect.bottom <= dstHeight);
+  const bool isHalf = srcWidth == dstWidth * 2 && srcHeight == dstHeight * 2;
+  if (!isHalf)
+  {
+    DownsampleGeneric(src, srcWidth, srcHeight, srcRowPitch, dst, dstWidth, dstHeight, dstRowPitch, colorSpace, dstRect);
+    return;
+  }
+
+  // ちょうど 1/2 の場合は各テクセルが 2x2 の範囲だけを参照するため、範囲の先頭へずらして処理する.
+  src += uint64_t(srcRowPitch) * (2 * dstRect.top) + uint64_t(dstRect.left) * 2 * PixelBytes;
+  dst += uint64_t(dstRowPitch) * dstRect.top + uint64_t(dstRect.left) * PixelBytes;
+  const uint32_t width = dstRect.right - dstRect.left;
+  const uint32_t height = dstRect.bottom - dstRect.top;
+
+  uint32_t processed = 0;
+  if (HasAVX2)
+  {
+    if (colorSpace == MipColorSpace::SRGB)
+    {
+      DownsampleBox2x2SRGBAVX2(src, srcRowPitch, dst, width, height, dstRowPitch);
+      processed = width & ~1u;
+    }
+    else
+    {
+      DownsampleBox2x2LinearAVX2(src, srcRowPitch, dst, width, height, dstRowPitch);
+      processed = width & ~7u;
+    }
+  }
+  // SIMD で処理しきれなかった右端の列.
+  if (processed < width)
+  {
+    DownsampleBox2x2Scalar(src, srcRowPitch, dst, width, height, dstRowPitch, colorSpace, processed);
+  }
+}
+
+void MipChainBuilder::Build(
+  const uint8_t* base, uint32_t baseRowPitch,
+  uint8_t* dstBase, std::span<const MipLevelLayout> levels,
+  MipColorSpace colorSpace, bool dstIsReadable)
+{
+  if (levels.empty())
+  {
+    return;
+  }
+
+  const auto& top = levels[0];
+  uint8_t* dstTop = dstBase + top.offset;
+  if (dstTop != base)
+  {
+    for (uint32_t y = 0; y < top.height; ++y)
+    {
+      memcpy(dstTop + uint64_t(top.rowPitch) * y, base + uint64_t(baseRowPitch) * y, top.width * PixelBytes);
+    }
+  }
+
+  // 書き出し先を読み返せない場合は、作業バッファの 2 つの領域を交互に使う.
+  // 奇数レベルは level1 分の領域、偶数レベルはその後ろ(level2 分)を使う.
+  uint64_t scratchSplit = 0;
+  if (!dstIsReadable && levels.size() > 1)
+  {
+    scratchSplit = uint64_t(levels[1].width) * levels[1].height * PixelBytes;
+    const uint64_t level2Bytes = levels.size() > 2 ? uint64_t(levels[2].width) * levels[2].height * PixelBytes : 0;
+    if (m_scratch.size() < scratchSplit + level2Bytes)
+    {
+      m_scratch.resize(scratchSplit + level2Bytes);
+    }
+  }
+
+  const uint8_t* src = base;
+  uint32_t srcRowPitch = baseRowPitch;
+  for (size_t i = 1; i < levels.size(); ++i)
+  {
+    const auto& prev = levels[i - 1];
+    const auto& level = levels[i];
+    uint8_t* out = dstBase + level.offset;
+    uint32_t outRowPitch = level.rowPitch;
+    if (!dstIsReadable)
+    {
+      out = m_scratch.data() + ((i & 1) ? 0 : scratchSplit);
+      outRowPitch = level.width * PixelBytes;
+    }
+    DownsampleMipLevel(src, prev.width, prev.height, srcRowPitch, out, level.width, level.height, outRowPitch, colorSpace);
+
+    if (!dstIsReadable)
+    {
+      uint8_t* dstLevel = dstBase + level.offset;
+      for (uint32_t y = 0; y < level.height; ++y)
+      {
+        memcpy(dstLevel + uint64_t(level.rowPitch) * y, out + uint64_t(outRowPitch) * y, outRowPitch);
+      }
+    }
+    src = out;
+    srcRowPitch = outRowPitch;
+  }
+}
+
+uint64_t MipChainBuilder::Update(
+  uint8_t* data, std::span<const MipLevelLayout> levels,
+  std::span<const MipRect> dirtyRects, MipColorSpace colorSpace)
+{
+  if (levels.size() < 2)
+  {
+    return 0;
+  }
+  PropagateMipDirtyRects(levels[0].width, levels[0].height, uint32_t(levels.size()), dirtyRects, m_levelRects);
+
+  uint64_t texelCount = 0;
+  for (size_t i = 1; i < levels.size(); ++i)
+  {
+    const auto& prev = levels[i - 1];
+    const auto& level = levels[i];
+    for (const auto& rect : m_levelRects[i])
+    {
+      DownsampleMipLevelRegion(
+        data + prev.offset, prev.width, prev.height, prev.rowPitch,
+        data + level.offset, level.width, level.height, level.rowPitch,
+        colorSpace, rect);
+      texelCount += uint64_t(rect.right - rect.left) * (rect.bottom - rect.top);
+    }
+  }
+  return texelCount;
+}
+
+bool IsMipChainBuilderAVX2Enabled()
+{
+  return HasAVX2;
+}
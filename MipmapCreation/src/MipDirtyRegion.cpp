@@ -0,0 +1,164 @@
+﻿#include "MipDirtyRegion.h"
+#include "GenerateMipsCPU.h"
+
+#include <algorithm>
+
+namespace
+{
+  constexpr uint32_t GroupSize = 8;   // GenerateMipmapCS のスレッドグループの幅/高さ.
+
+  bool IsEmpty(const MipRect& r)
+  {
+    return r.left >= r.right || r.top >= r.bottom;
+  }
+
+  uint64_t Area(const MipRect& r)
+  {
+    return uint64_t(r.right - r.left) * (r.bottom - r.top);
+  }
+
+  MipRect Union(const MipRect& a, const MipRect& b)
+  {
+    return MipRect{ std::min(a.left, b.left), std::min(a.top, b.top), std::max(a.right, b.right), std::max(a.bottom, b.bottom) };
+  }
+
+  // 結合した場合に増える面積. 重なりがある場合は負になり得る.
+  int64_t MergeCost(const MipRect& a, const MipRect& b)
+  {
+    return int64_t(Area(Union(a, b))) - int64_t(Area(a)) - int64_t(Area(b));
+  }
+
+  // src の [begin, end) を参照する dst の範囲.
+  void MapAxis(uint32_t srcSize, uint32_t dstSize, uint32_t begin, uint32_t end, uint32_t& dstBegin, uint32_t& dstEnd)
+  {
+    // 奇数サイズでは x が 2x+2 まで参照するため、1 つ手前のテクセルも含める.
+    const bool isOdd = srcSize > 1 && (srcSize & 1) != 0;
+    dstBegin = isOdd ? (begin == 0 ? 0 : (begin - 1) / 2) : begin / 2;
+    dstEnd = std::min(dstSize, (end + 1) / 2);
+  }
+}
+
+void MergeMipRects(std::vector<MipRect>& rects)
+{
+  rects.erase(std::remove_if(rects.begin(), rects.end(), IsEmpty), rects.end());
+
+  // 外接矩形が 2 つの面積の和を超えない (重なる/隣接する) 組は、処理量を増やさずに結合できる.
+  for (size_t i = 0; i < rects.size(); ++i)
+  {
+    for (size_t j = i + 1; j < rects.size(); ++j)
+    {
+      if (MergeCost(rects[i], rects[j]) <= 0)
+      {
+        rects[i] = Union(rects[i], rects[j]);
+        rects.erase(rects.begin() + j);
+        j = i;  // 広がった rects[i] で比較し直す.
+      }
+    }
+  }
+
+  // 数が非常に多い場合は、位置順に並べて隣り合う組をまとめて結合し、総当たりの比較を避ける.
+  while (rects.size() > MaxMipDirtyRects * 4)
+  {
+    std::sort(rects.begin(), rects.end(), [](const MipRect& a, const MipRect& b) {
+      return a.top != b.top ? a.top < b.top : a.left < b.left;
+    });
+    size_t count = 0;
+    for (size_t i = 0; i < rects.size(); i += 2)
+    {
+      rects[count++] = i + 1 < rects.size() ? Union(rects[i], rects[i + 1]) : rects[i];
+    }
+    rects.resize(count);
+  }
+
+  while (rects.size() > MaxMipDirtyRects)
+  {
+    size_t bestI = 0, bestJ = 1;
+    int64_t bestCost = MergeCost(rects[0], rects[1]);
+    for (size_t i = 0; i < rects.size(); ++i)
+    {
+      for (size_t j = i + 1; j < rects.size(); ++j)
+      {
+        const int64_t cost = MergeCost(rects[i], rects[j]);
+        if (cost < bestCost)
+        {
+          bestCost = cost;
+          bestI = i;
+          bestJ = j;
+        }
+      }
+    }
+    rects[bestI] = Union(rects[bestI], rects[bestJ]);
+    rects.erase(rects.begin() + bestJ);
+  }
+}
+
+void PropagateMipDirtyRects(
+  uint32_t width, uint32_t height, uint32_t mipCount,
+  std::span<const MipRect> dirtyRects, std::vector<std::vector<MipRect>>& levelRects)
+{
+  levelRects.resize(mipCount);
+  for (auto& rects : levelRects)
+  {
+    rects.clear();
+  }
+  if (mipCount == 0)
+  {
+    return;
+  }
+
+  auto& top = levelRects[0];
+  for (const auto& rect : dirtyRects)
+  {
+    top.push_back(MipRect{ rect.left, rect.top, std::min(rect.right, width), std::min(rect.bottom, height) });
+  }
+  MergeMipRects(top);
+
+  uint32_t srcWidth = width, srcHeight = height;
+  for (uint32_t level = 1; level < mipCount; ++level)
+  {
+    const uint32_t dstWidth = std::max(1u, srcWidth / 2), dstHeight = std::max(1u, srcHeight / 2);
+    auto& rects = levelRects[level];
+    for (const auto& src : levelRects[level - 1])
+    {
+      MipRect dst;
+      MapAxis(srcWidth, dstWidth, src.left, src.right, dst.left, dst.right);
+      MapAxis(srcHeight, dstHeight, src.top, src.bottom, dst.top, dst.bottom);
+      rects.push_back(dst);
+    }
+    MergeMipRects(rects);
+    srcWidth = dstWidth;
+    srcHeight = dstHeight;
+  }
+}
+
+void MakeGenerateMipsDispatches(
+  uint32_t width, uint32_t height, uint32_t mipCount,
+  std::span<const MipRect> dirtyRects, std::vector<GenerateMipsDispatch>& dispatches)
+{
+  dispatches.clear();
+  std::vector<std::vector<MipRect>> levelRects;
+  PropagateMipDirtyRects(width, height, mipCount, dirtyRects, levelRects);
+
+  std::vector<MipRect> groups;
+  for (uint32_t topMip = 0; topMip + 1 < mipCount;)
+  {
+    const uint32_t srcWidth = std::max(1u, width >> topMip), srcHeight = std::max(1u, height >> topMip);
+    const uint32_t numMips = std::min(GetGenerateMipsPassMipCount(srcWidth, srcHeight), mipCount - 1 - topMip);
+
+    // OutMip1 の範囲をグループ単位へ広げ、重なったものを結合する.
+    groups.clear();
+    for (const auto& rect : levelRects[topMip + 1])
+    {
+      groups.push_back(MipRect{
+        rect.left / GroupSize, rect.top / GroupSize,
+        (rect.right + GroupSize - 1) / GroupSize, (rect.bottom + GroupSize - 1) / GroupSize });
+    }
+    MergeMipRects(groups);
+    for (const auto& group : groups)
+    {
+      dispatches.push_back(GenerateMipsDispatch{
+        topMip, numMips, group.left, group.top, group.right - group.left, group.bottom - group.top });
+    }
+    topMip += numMips;
+  }
+}
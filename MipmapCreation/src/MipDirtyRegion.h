@@ -0,0 +1,46 @@
+﻿#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "MipChainBuilder.h"
+
+// ミップ 0 の一部だけを書き換えた場合に、作り直しが必要な範囲を各レベルへ伝播する.
+// 各レベルの範囲は縮小で参照するテクセルから求める. 偶数サイズの軸では 2x, 2x+1 の 2 テクセル、
+// 奇数サイズの軸では 2x から 2x+2 の 3 テクセルを参照する (MipChainBuilder / GenerateMipmapCS 共通).
+// 縮小するにつれて近づいた矩形は結合し、1 レベルあたりの数を MaxMipDirtyRects 以下に抑える.
+// デカールや UI のように一部だけ更新するテクスチャで、処理量を更新した範囲に比例させるために使う.
+// D3D12 には依存しない.
+
+// 1 レベルあたりの矩形の最大数.
+constexpr uint32_t MaxMipDirtyRects = 16;
+
+// 空の矩形を除き、結合しても外接矩形の面積が 2 つの面積の和を超えない組を結合する.
+// それでも MaxMipDirtyRects を超える場合は、面積の増加が最小となる組から結合する.
+void MergeMipRects(std::vector<MipRect>& rects);
+
+// width x height のミップ 0 の dirtyRects から mipCount レベル分の範囲を求める.
+// levelRects[0] はレベル 0 の範囲へクリップして結合したもの. 範囲が無い場合は全レベルが空になる.
+void PropagateMipDirtyRects(
+  uint32_t width, uint32_t height, uint32_t mipCount,
+  std::span<const MipRect> dirtyRects, std::vector<std::vector<MipRect>>& levelRects);
+
+// GenerateMipmapCS の 1 回分のディスパッチ.
+// グループは OutMip1 (topMip + 1) の 8x8 テクセル単位. パス内の 2 レベル目以降はグループ内で作成するため、
+// OutMip1 の範囲を覆うグループを実行すれば、残りのレベルの範囲も全体を作り直した場合と同じ値で書き出される.
+struct GenerateMipsDispatch
+{
+  uint32_t topMip;        // SrcMipLevel.
+  uint32_t mipCount;      // NumMipLevels.
+  uint32_t groupOffsetX;  // GroupOffset. 先頭のグループの位置.
+  uint32_t groupOffsetY;
+  uint32_t groupCountX;   // Dispatch の引数.
+  uint32_t groupCountY;
+};
+
+// width x height, mipCount レベルのテクスチャの dirtyRects を作り直すディスパッチをパスの順に並べる.
+// 同じ topMip のディスパッチは連続し、互いに依存しないためバリアは不要.
+// テクスチャ全体を作り直す場合は { 0, 0, width, height } を渡す (パス毎に 1 回のディスパッチになる).
+void MakeGenerateMipsDispatches(
+  uint32_t width, uint32_t height, uint32_t mipCount,
+  std::span<const MipRect> dirtyRects, std::vector<GenerateMipsDispatch>& dispatches);
@@ -0,0 +1,305 @@
+﻿#include "ReadbackContext.h"
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+  void ThrowIfFailed(HRESULT hr, const std::string& errorMsg)
+  {
+    if (FAILED(hr))
+    {
+      OutputDebugStringA(errorMsg.c_str());
+      OutputDebugStringA("\n");
+      throw std::runtime_error(errorMsg.c_str());
+    }
+  }
+
+  D3D12_RESOURCE_DESC MakeBufferDesc(UINT64 size)
+  {
+    return D3D12_RESOURCE_DESC{
+      .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+      .Alignment = 0,
+      .Width = size, .Height = 1, .DepthOrArraySize = 1, .MipLevels = 1,
+      .Format = DXGI_FORMAT_UNKNOWN,
+      .SampleDesc = {.Count = 1, .Quality = 0 },
+      .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+      .Flags = D3D12_RESOURCE_FLAG_NONE,
+    };
+  }
+
+  const D3D12_HEAP_PROPERTIES ReadbackHeapProps{
+    .Type = D3D12_HEAP_TYPE_READBACK,
+    .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+    .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+    .CreationNodeMask = 1, .VisibleNodeMask = 1,
+  };
+}
+
+void ReadbackContext::Initialize(ID3D12Device* device, UINT64 bufferSize)
+{
+  m_device = device;
+
+  HRESULT hr = m_device->CreateFence(UploadStagingRing::NullTicket, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence));
+  ThrowIfFailed(hr, "CreateFenceに失敗(リードバック)");
+
+  auto resDesc = MakeBufferDesc(bufferSize);
+  hr = m_device->CreateCommittedResource(&ReadbackHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&m_readbackBuffer));
+  ThrowIfFailed(hr, "CreateCommittedResourceに失敗(リードバック)");
+
+  // 常時マップしておく. 読み出すのはフェンスで完了を確認した領域のみ.
+  void* p = nullptr;
+  m_readbackBuffer->Map(0, nullptr, &p);
+  m_mapped = static_cast<const UINT8*>(p);
+  m_ring.Reset(bufferSize);
+
+  m_stopWorker = false;
+  m_worker = std::thread([this]() { WorkerMain(); });
+}
+
+void ReadbackContext::Shutdown()
+{
+  if (m_fence && m_lastSubmittedTicket != UploadStagingRing::NullTicket && m_fence->GetCompletedValue() < m_lastSubmittedTicket)
+  {
+    // イベント無しで呼び出すと完了までブロックする.
+    m_fence->SetEventOnCompletion(m_lastSubmittedTicket, nullptr);
+  }
+  Update();
+
+  // ワーカーは残りの要求を書き出してから終了する.
+  if (m_worker.joinable())
+  {
+    {
+      std::lock_guard lock(m_mutex);
+      m_stopWorker = true;
+    }
+    m_workCondition.notify_all();
+    m_worker.join();
+  }
+  m_recordingItems.clear();
+  m_submittedBatches.clear();
+  if (m_readbackBuffer && m_mapped)
+  {
+    D3D12_RANGE writeRange{};
+    m_readbackBuffer->Unmap(0, &writeRange);
+    m_mapped = nullptr;
+  }
+  m_readbackBuffer.Reset();
+  m_fence.Reset();
+  m_device.Reset();
+}
+
+bool ReadbackContext::RequestSave(ID3D12GraphicsCommandList* commandList, ID3D12Resource* texture, D3D12_RESOURCE_STATES state,
+  const std::filesystem::path& filePath, const DdsWriteOptions& options)
+{
+  const auto resDesc = texture->GetDesc();
+  const UINT subresourceCount = resDesc.MipLevels * resDesc.DepthOrArraySize;
+
+  SaveItem item;
+  item.filePath = filePath;
+  item.options = options;
+  item.footprints.resize(subresourceCount);
+  std::vector<UINT64> rowSizes(subresourceCount);
+  UINT64 totalBytes = 0;
+  m_device->GetCopyableFootprints(&resDesc, 0, subresourceCount, 0, item.footprints.data(), nullptr, rowSizes.data(), &totalBytes);
+
+  item.desc.width = UINT(resDesc.Width);
+  item.desc.height = resDesc.Height;
+  item.desc.mipLevels = resDesc.MipLevels;
+  item.desc.arraySize = resDesc.DepthOrArraySize;
+  item.desc.format = UINT(resDesc.Format);
+  item.desc.bytesPerPixel = UINT(rowSizes[0] / resDesc.Width);
+  item.desc.isCubemap = resDesc.DepthOrArraySize == 6;
+
+  // 書き出し先を割り当てる. リングが埋まっている場合はフレームを止めずに断る.
+  ID3D12Resource* dstBuffer = m_readbackBuffer.Get();
+  UINT64 baseOffset = 0;
+  if (totalBytes > m_ring.GetCapacity())
+  {
+    auto bufferDesc = MakeBufferDesc(totalBytes);
+    HRESULT hr = m_device->CreateCommittedResource(&ReadbackHeapProps, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&item.dedicatedBuffer));
+    if (FAILED(hr))
+    {
+      std::lock_guard lock(m_mutex);
+      m_stats.rejectCount++;
+      return false;
+    }
+    dstBuffer = item.dedicatedBuffer.Get();
+    std::lock_guard lock(m_mutex);
+    m_stats.dedicatedCount++;
+  }
+  else
+  {
+    baseOffset = m_ring.Allocate(totalBytes, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+    if (baseOffset == UploadStagingRing::InvalidOffset)
+    {
+      std::lock_guard lock(m_mutex);
+      m_stats.rejectCount++;
+      return false;
+    }
+  }
+
+  D3D12_RESOURCE_BARRIER barrier{
+    .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+    .Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
+    .Transition = {
+      .pResource = texture,
+      .Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+      .StateBefore = state,
+      .StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE,
+    }
+  };
+  commandList->ResourceBarrier(1, &barrier);
+  for (UINT i = 0; i < subresourceCount; ++i)
+  {
+    auto& footprint = item.footprints[i];
+    footprint.Offset += baseOffset;
+
+    D3D12_TEXTURE_COPY_LOCATION srcLoc{}, dstLoc{};
+    srcLoc.pResource = texture;
+    srcLoc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+    srcLoc.SubresourceIndex = i;
+    dstLoc.pResource = dstBuffer;
+    dstLoc.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+    dstLoc.PlacedFootprint = footprint;
+    commandList->CopyTextureRegion(&dstLoc, 0, 0, 0, &srcLoc, nullptr);
+  }
+  std::swap(barrier.Transition.StateBefore, barrier.Transition.StateAfter);
+  commandList->ResourceBarrier(1, &barrier);
+
+  m_ring.MarkRecorded();
+  m_recordingItems.push_back(std::move(item));
+  m_pendingCount++;
+  std::lock_guard lock(m_mutex);
+  m_stats.requestCount++;
+  return true;
+}
+
+void ReadbackContext::Submit(ID3D12CommandQueue* queue)
+{
+  if (m_recordingItems.empty())
+  {
+    return;
+  }
+  // 専用バッファのみの場合もリングのバッチとしてチケットを発行する.
+  const auto ticket = m_ring.CloseBatch();
+  queue->Signal(m_fence.Get(), ticket);
+  m_submittedBatches.push_back(Batch{ ticket, std::move(m_recordingItems) });
+  m_recordingItems.clear();
+  m_lastSubmittedTicket = ticket;
+}
+
+void ReadbackContext::Update()
+{
+  if (!m_fence)
+  {
+    return;
+  }
+  const auto completedValue = m_fence->GetCompletedValue();
+  bool notify = false;
+  {
+    std::lock_guard lock(m_mutex);
+    while (!m_submittedBatches.empty() && m_submittedBatches.front().ticket <= completedValue)
+    {
+      m_workQueue.push_back(std::move(m_submittedBatches.front()));
+      m_submittedBatches.pop_front();
+      notify = true;
+    }
+  }
+  if (notify)
+  {
+    m_workCondition.notify_one();
+  }
+
+  // ワーカーの書き出しが終わったバッチまでを再利用する. バッチは発行順に書き出される.
+  m_ring.ReleaseCompleted(m_writtenTicket.load(std::memory_order_acquire));
+}
+
+ReadbackContext::Stats ReadbackContext::GetStats() const
+{
+  std::lock_guard lock(m_mutex);
+  return m_stats;
+}
+
+void ReadbackContext::WorkerMain()
+{
+  for (;;)
+  {
+    Batch batch;
+    {
+      std::unique_lock lock(m_mutex);
+      m_workCondition.wait(lock, [this]() { return m_stopWorker || !m_workQueue.empty(); });
+      if (m_workQueue.empty())
+      {
+        return;
+      }
+      batch = std::move(m_workQueue.front());
+      m_workQueue.pop_front();
+    }
+
+    for (const auto& item : batch.items)
+    {
+      const auto start = std::chrono::high_resolution_clock::now();
+      const bool succeeded = WriteItem(item);
+      const auto end = std::chrono::high_resolution_clock::now();
+
+      std::error_code ec;
+      const auto fileSize = succeeded ? std::filesystem::file_size(item.filePath, ec) : 0;
+      {
+        std::lock_guard lock(m_mutex);
+        if (succeeded)
+        {
+          m_stats.savedCount++;
+          m_stats.savedBytes += ec ? 0 : fileSize;
+          m_stats.lastWriteMs = std::chrono::duration<double, std::milli>(end - start).count();
+        }
+        else
+        {
+          m_stats.failedCount++;
+        }
+      }
+      m_pendingCount--;
+    }
+    m_writtenTicket.store(batch.ticket, std::memory_order_release);
+  }
+}
+
+bool ReadbackContext::WriteItem(const SaveItem& item)
+{
+  const UINT8* base = m_mapped;
+  if (item.dedicatedBuffer)
+  {
+    void* p = nullptr;
+    if (FAILED(item.dedicatedBuffer->Map(0, nullptr, &p)))
+    {
+      return false;
+    }
+    base = static_cast<const UINT8*>(p);
+  }
+
+  bool succeeded = false;
+  std::error_code ec;
+  if (item.filePath.has_parent_path())
+  {
+    std::filesystem::create_directories(item.filePath.parent_path(), ec);
+  }
+  DdsStreamWriter writer;
+  if (writer.Open(item.filePath, item.desc, item.options))
+  {
+    std::vector<DdsSubresourceSource> sources;
+    sources.reserve(item.footprints.size());
+    for (const auto& footprint : item.footprints)
+    {
+      sources.push_back(DdsSubresourceSource{ base + footprint.Offset, footprint.Footprint.RowPitch });
+    }
+    succeeded = writer.WriteSubresources(sources);
+    succeeded = writer.Close() && succeeded;
+  }
+
+  if (item.dedicatedBuffer)
+  {
+    D3D12_RANGE writeRange{};
+    item.dedicatedBuffer->Unmap(0, &writeRange);
+  }
+  return succeeded;
+}
@@ -0,0 +1,104 @@
+﻿#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include <d3d12.h>
+#include <wrl.h>
+
+#include "UploadStagingRing.h"
+#include "DdsStreamWriter.h"
+
+// テクスチャをリードバックしてファイルへ保存するコンテキスト.
+// リードバックは常時マップした 1 つのバッファからリングとして割り当て、複数の要求を同時に扱える.
+// コピーは呼び出し側のコマンドリストへ記録し、発行後の Submit でフェンスをシグナルする.
+// Update で GPU の完了を確認した要求をワーカースレッドへ渡し、ワーカーはマップしたフットプリントから
+// DdsStreamWriter へ直接書き出す. 領域は書き出しの完了後に再利用する.
+// 領域が空くのを待つことはせず、足りない場合は要求を受け付けないため、フレームを止めない.
+// リングに収まらない大きさの要求は専用のバッファを作成する.
+// Submit / Update / RequestSave はメインスレッドから呼ぶこと.
+class ReadbackContext
+{
+public:
+  template<class T>
+  using ComPtr = Microsoft::WRL::ComPtr<T>;
+  using Ticket = UploadStagingRing::Ticket;
+
+  struct Stats
+  {
+    uint64_t requestCount = 0;
+    uint64_t rejectCount = 0;     // 領域不足で受け付けなかった回数.
+    uint64_t dedicatedCount = 0;  // リングに収まらず専用のバッファを作成した回数.
+    uint64_t savedCount = 0;
+    uint64_t failedCount = 0;
+    uint64_t savedBytes = 0;      // 書き出したファイルサイズの合計.
+    double lastWriteMs = 0.0;     // 最後に保存したテクスチャの書き出しに掛かった時間.
+  };
+
+  void Initialize(ID3D12Device* device, UINT64 bufferSize);
+  // 発行済みの要求は GPU の完了と書き出しを待ってから破棄する.
+  void Shutdown();
+
+  // texture の全サブリソースのリードバックを commandList へ記録し、完了後に filePath へ保存する.
+  // texture は state の状態であること. 記録したコピーの後は state へ戻す.
+  // 領域が足りない場合は何も記録せず false を返すため、次のフレーム以降に再度要求すること.
+  bool RequestSave(ID3D12GraphicsCommandList* commandList, ID3D12Resource* texture, D3D12_RESOURCE_STATES state,
+    const std::filesystem::path& filePath, const DdsWriteOptions& options);
+
+  // RequestSave を記録したコマンドリストを queue へ発行した後に呼ぶ.
+  void Submit(ID3D12CommandQueue* queue);
+
+  // GPU で完了した要求をワーカーへ渡し、書き出しの済んだ領域を再利用可能にする. 毎フレーム呼ぶ.
+  void Update();
+
+  // 保存が終わっていない要求の数.
+  uint32_t GetPendingCount() const { return m_pendingCount; }
+  Stats GetStats() const;
+
+private:
+  struct SaveItem
+  {
+    std::filesystem::path filePath;
+    DdsTextureDesc desc;
+    DdsWriteOptions options;
+    std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints; // Offset はバッファ先頭からの位置.
+    ComPtr<ID3D12Resource> dedicatedBuffer;                     // リングに収まらない場合のみ.
+  };
+  struct Batch
+  {
+    Ticket ticket;
+    std::vector<SaveItem> items;
+  };
+
+  void WorkerMain();
+  bool WriteItem(const SaveItem& item);
+
+  ComPtr<ID3D12Device> m_device;
+  ComPtr<ID3D12Fence> m_fence;
+  ComPtr<ID3D12Resource> m_readbackBuffer;
+  const UINT8* m_mapped = nullptr;
+  UploadStagingRing m_ring;
+
+  std::vector<SaveItem> m_recordingItems; // 記録中 (未発行) の要求.
+  std::deque<Batch> m_submittedBatches;   // GPU の完了待ち.
+  Ticket m_lastSubmittedTicket = UploadStagingRing::NullTicket;
+
+  // ワーカーへ渡した要求. m_mutex で保護する.
+  std::deque<Batch> m_workQueue;
+  std::atomic<Ticket> m_writtenTicket = UploadStagingRing::NullTicket;
+  std::atomic<uint32_t> m_pendingCount = 0;
+  std::thread m_worker;
+  std::condition_variable m_workCondition;
+  bool m_stopWorker = false;
+
+  mutable std::mutex m_mutex;
+  Stats m_stats;
+};
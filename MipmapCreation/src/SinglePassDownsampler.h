@@ -0,0 +1,54 @@
+﻿#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "MipChainBuilder.h"
+
+// FidelityFX SPD (ffx_spd_downsample_pass.hlsl) と同じ構成で、ミップチェーンを 1 パスで作成する.
+// ベースレベルを 64 行単位のタイルに分けてワーカーへ分配し、各タイルはキャッシュ上の作業バッファで
+// 縮小できるレベル(最大 6 レベル)までまとめて作成する. ベースレベルの読み込みは 1 回で済む.
+// 全タイルの完了をアトミックカウンタで数え、最後に完了したワーカーが残りの小さなレベルを作成する.
+// 縮小は DownsampleMipLevel を使うため、結果は MipChainBuilder と一致する.
+// タイルで扱えるのは 2:1 ちょうどに縮小できるレベルまでで、幅/高さが奇数のベースは MipChainBuilder と同じ処理になる.
+// D3D12 には依存しない.
+class SinglePassDownsampler
+{
+public:
+  // MipChainBuilder::Build と同じく、base を levels[0] へコピーし levels[1] 以降を作成する.
+  // 書き出し先は読み返さないため、dstIsReadable は残りのレベルの作成にのみ使う.
+  // workerCount が 0 の場合はタイル数に応じてハードウェアスレッド数まで使う.
+  void Build(
+    const uint8_t* base, uint32_t baseRowPitch,
+    uint8_t* dstBase, std::span<const MipLevelLayout> levels,
+    MipColorSpace colorSpace, bool dstIsReadable, uint32_t workerCount = 0);
+
+  // タイル内で作成するレベル数. 幅と高さが 2^n で割り切れる最大の n (最大 6).
+  static uint32_t GetTileLevelCount(uint32_t width, uint32_t height);
+
+private:
+  std::vector<std::vector<uint8_t>> m_tileScratch;  // ワーカー毎の作業バッファ.
+  std::vector<uint8_t> m_tailScratch;               // タイルで作成した最後のレベル.
+  MipChainBuilder m_tailBuilder;
+};
+
+struct SinglePassDownsamplerBenchmarkResult
+{
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t workerCount = 0;
+  double levelByLevelMs = 0.0;  // MipChainBuilder (1 スレッド).
+  double singleThreadMs = 0.0;  // SinglePassDownsampler (1 スレッド).
+  double multiThreadMs = 0.0;   // SinglePassDownsampler (全ワーカー).
+
+  // 読み込みと書き出しの合計バイト数を処理時間で割ったもの.
+  double GetGBytesPerSec(double ms) const
+  {
+    const double bytes = double(width) * height * 4 * (1.0 + 4.0 / 3.0);
+    return ms > 0.0 ? bytes / (ms / 1000.0) / 1e9 : 0.0;
+  }
+};
+
+// width x height の RGBA8 イメージのフルチェーン作成を、書込み結合メモリへの書き出しを想定して
+// (dstIsReadable = false) iterations 回計測する.
+SinglePassDownsamplerBenchmarkResult RunSinglePassDownsamplerBenchmark(uint32_t width, uint32_t height, uint32_t iterations);
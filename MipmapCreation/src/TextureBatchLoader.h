@@ -0,0 +1,77 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+
+#include "GfxDevice.h"
+#include "TextureCache.h"
+
+// 複数のテクスチャをまとめて作成する.
+// ファイル読み込みとデコードはワーカースレッドで並列に行い、
+// デコードできたものから順にミップマップをステージングへ直接作成して転送を記録し、最後にまとめて発行する.
+// 同じパスの要求は 1 つにまとめる.
+// キャッシュを設定した場合は、加工済みのミップチェーンをキャッシュから読み込み、無ければ作成して保存する.
+class TextureBatchLoader
+{
+public:
+  template<class T>
+  using ComPtr = Microsoft::WRL::ComPtr<T>;
+  using TextureId = uint32_t;
+  static constexpr TextureId InvalidId = UINT32_MAX;
+
+  struct Stats
+  {
+    uint32_t requestCount = 0;  // Add の呼び出し回数.
+    uint32_t textureCount = 0;  // 重複を除いた数.
+    uint32_t failedCount = 0;
+    uint32_t workerCount = 0;
+    double   decodeMs = 0.0;    // 各ワーカーでのデコード時間の合計 (ミップマップ作成は含まない).
+    double   totalMs = 0.0;     // Execute の所要時間.
+    uint64_t decodedBytes = 0;  // ベースレベルのピクセルデータのサイズ.
+    uint32_t cacheHitCount = 0; // キャッシュから作成した数.
+  };
+
+  // 加工済みテクスチャのキャッシュを使用する. nullptr で無効.
+  void SetCache(TextureCache* cache) { m_cache = cache; }
+
+  // ファイルからの作成を登録. 同じパスは同じ ID を返す.
+  TextureId AddFile(const std::filesystem::path& filePath, bool generateMips);
+  // 同じパスかの判定に使う表記. "a/../b.png" と "b.png" のように表記の異なる同じパスは同じ文字列になる.
+  static std::string NormalizePath(const std::filesystem::path& filePath);
+  // メモリからの作成を登録. データは Execute の完了まで呼び出し側で保持すること.
+  TextureId AddMemory(const void* srcBuffer, size_t bufferSize, bool generateMips);
+
+  // 登録した全てのテクスチャを作成する. workerCount が 0 の場合はハードウェアスレッド数.
+  // 転送の完了は待たない. 描画キューは GfxDevice::Submit の際に完了を待つ.
+  void Execute(uint32_t workerCount = 0);
+
+  // 作成に失敗した場合は nullptr.
+  ComPtr<ID3D12Resource1> GetTexture(TextureId id) const { return m_entries[id].texture; }
+  const Stats& GetStats() const { return m_stats; }
+  void Clear();
+
+private:
+  struct Entry
+  {
+    std::filesystem::path filePath;
+    const void* srcBuffer = nullptr;
+    size_t bufferSize = 0;
+    bool generateMips = false;
+    ComPtr<ID3D12Resource1> texture;
+  };
+  struct CreateResult
+  {
+    bool success = false;
+    bool isCacheHit = false;
+    double decodeMs = 0.0;
+    uint64_t decodedBytes = 0;
+  };
+  // ワーカースレッドから呼ばれる.
+  CreateResult CreateEntryTexture(Entry& entry, const void* srcBuffer, size_t bufferSize);
+
+  std::vector<Entry> m_entries;
+  std::unordered_map<std::string, TextureId> m_pathToId;
+  TextureCache* m_cache = nullptr;
+  Stats m_stats;
+};
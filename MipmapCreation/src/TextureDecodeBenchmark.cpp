@@ -0,0 +1,131 @@
+﻿#include "TextureDecodeBenchmark.h"
+#include "TextureDecoder.h"
+#include "FileLoader.h"
+#include "ParallelFor.h"
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+
+namespace
+{
+  using Clock = std::chrono::high_resolution_clock;
+  double ElapsedMs(Clock::time_point start, Clock::time_point end)
+  {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  }
+
+  bool IsImageFile(const std::filesystem::path& filePath)
+  {
+    auto ext = filePath.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return char(tolower(c)); });
+    return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".tga" || ext == ".bmp";
+  }
+
+  // デコード結果のハッシュ. 失敗した場合は 0.
+  // 計測への影響を抑えるため 8 バイト単位で畳み込む.
+  uint64_t HashImage(const DecodedImage& image)
+  {
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&](uint64_t value) {
+      hash = (hash ^ value) * 1099511628211ull;
+    };
+    mix(image.width);
+    mix(image.height);
+    mix(image.GetMipCount());
+    const auto* data = image.pixels.data();
+    const auto size = image.pixels.size();
+    size_t offset = 0;
+    for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t))
+    {
+      uint64_t value;
+      memcpy(&value, data + offset, sizeof(value));
+      mix(value);
+    }
+    for (; offset < size; ++offset)
+    {
+      mix(data[offset]);
+    }
+    return hash;
+  }
+}
+
+TextureDecodeBenchmarkResult RunTextureDecodeBenchmark(const std::filesystem::path& directory, bool generateMips, uint32_t workerCount)
+{
+  TextureDecodeBenchmarkResult result;
+
+  // exe 直接実行されたときは FileLoader と同様に上位のディレクトリを探す.
+  auto searchDirectory = directory;
+  std::error_code ec;
+  if (!std::filesystem::is_directory(searchDirectory, ec))
+  {
+    searchDirectory = std::filesystem::path("../../") / directory;
+  }
+  std::vector<std::filesystem::path> imageFiles;
+  for (const auto& item : std::filesystem::directory_iterator(searchDirectory, ec))
+  {
+    if (item.is_regular_file() && IsImageFile(item.path()))
+    {
+      imageFiles.push_back(item.path());
+    }
+  }
+  std::sort(imageFiles.begin(), imageFiles.end());
+
+  // ファイルは先に読み込んでおき、計測には含めない.
+  auto& fileLoader = GetFileLoader();
+  std::vector<std::vector<char>> fileDataList;
+  for (const auto& filePath : imageFiles)
+  {
+    if (std::vector<char> fileData; fileLoader->Load(filePath, fileData))
+    {
+      result.fileBytes += fileData.size();
+      fileDataList.push_back(std::move(fileData));
+    }
+  }
+  const auto count = uint32_t(fileDataList.size());
+  result.imageCount = count;
+  if (count == 0)
+  {
+    return result;
+  }
+
+  // 1 スレッドで処理.
+  std::vector<uint64_t> serialHashes(count), parallelHashes(count);
+  auto start = Clock::now();
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    DecodedImage image;
+    if (DecodeImage(fileDataList[i].data(), fileDataList[i].size(), generateMips, image))
+    {
+      result.basePixels += uint64_t(image.width) * image.height;
+      result.decodedBytes += image.pixels.size();
+      serialHashes[i] = HashImage(image);
+    }
+    else
+    {
+      result.failedCount++;
+    }
+  }
+  result.serialMs = ElapsedMs(start, Clock::now());
+
+  // ワーカースレッドで並列に処理.
+  result.workerCount = ResolveWorkerCount(workerCount, count);
+  start = Clock::now();
+  ParallelFor(count, result.workerCount, [&](uint32_t index, uint32_t) {
+    DecodedImage image;
+    if (DecodeImage(fileDataList[index].data(), fileDataList[index].size(), generateMips, image))
+    {
+      parallelHashes[index] = HashImage(image);
+    }
+  });
+  result.parallelMs = ElapsedMs(start, Clock::now());
+
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    result.mismatchCount += serialHashes[i] != parallelHashes[i] ? 1 : 0;
+  }
+  return result;
+}
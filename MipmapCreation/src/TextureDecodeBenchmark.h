@@ -0,0 +1,27 @@
+﻿#pragma once
+#include <cstdint>
+#include <filesystem>
+
+// テクスチャのデコードとミップマップ作成 (CPU 処理) のベンチマーク.
+// ディレクトリ内の画像を対象に、1 スレッドでの処理とワーカースレッドでの並列処理を比較する.
+// 並列処理の結果は 1 スレッドでの結果とハッシュで照合する (ハッシュの計算はどちらの計測にも含む).
+// GPU には触れないため、ヘッドレスで実行できる.
+struct TextureDecodeBenchmarkResult
+{
+  uint32_t imageCount = 0;
+  uint32_t failedCount = 0;
+  uint32_t mismatchCount = 0; // 並列処理の結果が 1 スレッドでの結果と異なった数 (0 であること).
+  uint32_t workerCount = 0;
+  uint64_t fileBytes = 0;
+  uint64_t basePixels = 0;    // 最上位レベルのピクセル数の合計.
+  uint64_t decodedBytes = 0;  // ミップマップを含むピクセルデータのサイズ.
+  double serialMs = 0.0;
+  double parallelMs = 0.0;
+
+  double GetSpeedup() const { return parallelMs > 0.0 ? serialMs / parallelMs : 0.0; }
+  // 並列処理時の処理速度 (最上位レベル基準).
+  double GetMPixelsPerSec() const { return parallelMs > 0.0 ? basePixels / (parallelMs * 1000.0) : 0.0; }
+};
+
+// directory 直下の画像 (jpg/png/tga/bmp) を対象とする. ファイル読み込みの時間は含まない.
+TextureDecodeBenchmarkResult RunTextureDecodeBenchmark(const std::filesystem::path& directory, bool generateMips = true, uint32_t workerCount = 0);
@@ -1,9 +1,12 @@
 ﻿#pragma once
 #include "GfxDevice.h"
+#include "TextureDecoder.h"
 #include <filesystem>
+#include <span>
 
 // ファイルからテクスチャを作成.
-// テクスチャは GPU 転送済み、ミップマップ作成ありで作成される.
+// 転送はアップロードコンテキストへ記録され、完了を待たずに戻る.
+// 描画キューは GfxDevice::Submit の際に転送の完了を待つ.
 bool CreateTextureFromFile(
   Microsoft::WRL::ComPtr<ID3D12Resource1>& outImage,
   std::filesystem::path filePath,
@@ -12,7 +15,7 @@ bool CreateTextureFromFile(
   D3D12_RESOURCE_FLAGS resFlags = D3D12_RESOURCE_FLAG_NONE);
 
 // メモリからテクスチャを作成.
-// テクスチャは GPU 転送済み、ミップマップ作成ありで作成される.
+// 転送はアップロードコンテキストへ記録され、完了を待たずに戻る.
 bool CreateTextureFromMemory(
   Microsoft::WRL::ComPtr<ID3D12Resource1>& outImage,
   const void* srcBuffer, size_t bufferSize,
@@ -20,3 +23,34 @@ bool CreateTextureFromMemory(
   D3D12_RESOURCE_STATES afterState = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
   D3D12_RESOURCE_FLAGS resFlags = D3D12_RESOURCE_FLAG_NONE);
 
+// デコードしたベースレベルからテクスチャを作成.
+// generateMips であれば、ミップマップはアップロード用ステージングのフットプリント配置へ直接作成する.
+// afterState が COMMON から暗黙に昇格できる状態(シェーダーリソース等)であればスレッドセーフ.
+// workerCount は縮小に使うスレッド数. 0 の場合はハードウェアスレッド数まで使う.
+bool CreateTextureFromBaseImage(
+  Microsoft::WRL::ComPtr<ID3D12Resource1>& outImage,
+  const DecodedBaseImage& image,
+  bool generateMips = false,
+  D3D12_RESOURCE_STATES afterState = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+  D3D12_RESOURCE_FLAGS resFlags = D3D12_RESOURCE_FLAG_NONE,
+  uint32_t workerCount = 0);
+
+// levels の配置で並んだ RGBA8 のミップチェーンからテクスチャを作成.
+// 配置がアップロード用フットプリントと一致する場合は 1 回のコピーでステージングへ転送する.
+// afterState が COMMON から暗黙に昇格できる状態(シェーダーリソース等)であればスレッドセーフ.
+bool CreateTextureFromMipChain(
+  Microsoft::WRL::ComPtr<ID3D12Resource1>& outImage,
+  uint32_t width, uint32_t height,
+  std::span<const MipLevelLayout> levels, std::span<const uint8_t> data,
+  D3D12_RESOURCE_STATES afterState = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+  D3D12_RESOURCE_FLAGS resFlags = D3D12_RESOURCE_FLAG_NONE);
+
+// デコード済みのイメージからテクスチャを作成.
+// イメージの内容はステージングへコピーされるため、呼び出し後に破棄してよい.
+// afterState が COMMON から暗黙に昇格できる状態(シェーダーリソース等)であればスレッドセーフ.
+bool CreateTextureFromDecodedImage(
+  Microsoft::WRL::ComPtr<ID3D12Resource1>& outImage,
+  const DecodedImage& image,
+  D3D12_RESOURCE_STATES afterState = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+  D3D12_RESOURCE_FLAGS resFlags = D3D12_RESOURCE_FLAG_NONE);
+
@@ -0,0 +1,353 @@
+﻿#include "UploadContext.h"
+#include <stdexcept>
+#include <string>
+#include <cstring>
+
+namespace
+{
+  void ThrowIfFailed(HRESULT hr, const std::string& errorMsg)
+  {
+    if (FAILED(hr))
+    {
+      OutputDebugStringA(errorMsg.c_str());
+      OutputDebugStringA("\n");
+      throw std::runtime_error(errorMsg.c_str());
+    }
+  }
+
+  D3D12_RESOURCE_DESC MakeBufferDesc(UINT64 size)
+  {
+    return D3D12_RESOURCE_DESC{
+      .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+      .Alignment = 0,
+      .Width = size, .Height = 1, .DepthOrArraySize = 1, .MipLevels = 1,
+      .Format = DXGI_FORMAT_UNKNOWN,
+      .SampleDesc = {.Count = 1, .Quality = 0 },
+      .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+      .Flags = D3D12_RESOURCE_FLAG_NONE,
+    };
+  }
+
+  const D3D12_HEAP_PROPERTIES UploadHeapProps{
+    .Type = D3D12_HEAP_TYPE_UPLOAD,
+    .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+    .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+    .CreationNodeMask = 1, .VisibleNodeMask = 1,
+  };
+}
+
+void UploadContext::Initialize(ID3D12Device* device, UINT64 stagingSize)
+{
+  m_device = device;
+
+  D3D12_COMMAND_QUEUE_DESC queueDesc{
+    .Type = D3D12_COMMAND_LIST_TYPE_COPY,
+    .Priority = 0,
+    .Flags = D3D12_COMMAND_QUEUE_FLAG_NONE,
+    .NodeMask = 0,
+  };
+  HRESULT hr = m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_copyQueue));
+  ThrowIfFailed(hr, "CreateCommandQueue(Copy)に失敗");
+
+  hr = m_device->CreateFence(UploadStagingRing::NullTicket, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_fence));
+  ThrowIfFailed(hr, "CreateFenceに失敗(アップロード)");
+
+  auto resDesc = MakeBufferDesc(stagingSize);
+  hr = m_device->CreateCommittedResource(&UploadHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&m_stagingBuffer));
+  ThrowIfFailed(hr, "CreateCommittedResourceに失敗(アップロード用ステージング)");
+
+  // 常時マップしておく.
+  void* p = nullptr;
+  m_stagingBuffer->Map(0, nullptr, &p);
+  m_mapped = static_cast<UINT8*>(p);
+  m_ring.Reset(stagingSize);
+}
+
+void UploadContext::Shutdown()
+{
+  if (m_fence)
+  {
+    WaitIdle();
+  }
+  if (m_stagingBuffer && m_mapped)
+  {
+    m_stagingBuffer->Unmap(0, nullptr);
+    m_mapped = nullptr;
+  }
+  m_dedicatedStagings.clear();
+  m_pendingAllocators.clear();
+  m_recordingAllocator.Reset();
+  m_commandList.Reset();
+  m_stagingBuffer.Reset();
+  m_fence.Reset();
+  m_copyQueue.Reset();
+  m_device.Reset();
+}
+
+UploadContext::Ticket UploadContext::UploadBuffer(ID3D12Resource* dst, UINT64 dstOffset, const void* srcData, UINT64 size)
+{
+  if (size == 0)
+  {
+    return UploadStagingRing::NullTicket;
+  }
+  std::unique_lock lock(m_mutex);
+  auto staging = AllocateStaging(lock, size, 4);
+  memcpy(staging.cpuAddress, srcData, size);
+  m_commandList->CopyBufferRegion(dst, dstOffset, staging.resource, staging.offset, size);
+  return FinishRecord(size, 1);
+}
+
+UploadContext::Ticket UploadContext::UploadTexture(ID3D12Resource* dst, UINT firstSubresource, std::span<const D3D12_SUBRESOURCE_DATA> subresources)
+{
+  return UploadTexture(dst, firstSubresource, UINT(subresources.size()),
+    [&](UINT8* stagingBase, std::span<const TextureFootprint> footprints) {
+      for (size_t i = 0; i < footprints.size(); ++i)
+      {
+        const auto& footprint = footprints[i];
+        const auto& src = subresources[i];
+        const auto rowPitch = UINT64(footprint.layout.Footprint.RowPitch);
+        const auto slicePitch = rowPitch * footprint.numRows;
+        for (UINT z = 0; z < footprint.layout.Footprint.Depth; ++z)
+        {
+          auto dstSlice = stagingBase + footprint.layout.Offset + slicePitch * z;
+          auto srcSlice = static_cast<const UINT8*>(src.pData) + src.SlicePitch * z;
+          for (UINT row = 0; row < footprint.numRows; ++row)
+          {
+            memcpy(dstSlice + rowPitch * row, srcSlice + src.RowPitch * row, footprint.rowSizeInBytes);
+          }
+        }
+      }
+    });
+}
+
+UploadContext::Ticket UploadContext::UploadTexture(ID3D12Resource* dst, UINT firstSubresource, UINT subresourceCount, const TextureWriter& writer)
+{
+  if (subresourceCount == 0)
+  {
+    return UploadStagingRing::NullTicket;
+  }
+
+  const UINT count = subresourceCount;
+  const auto texDesc = dst->GetDesc();
+  std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts(count);
+  std::vector<UINT> numRows(count);
+  std::vector<UINT64> rowSizeInBytes(count);
+  UINT64 requiredSize = 0;
+  m_device->GetCopyableFootprints(
+    &texDesc, firstSubresource, count, 0, layouts.data(), numRows.data(), rowSizeInBytes.data(), &requiredSize);
+  std::vector<TextureFootprint> footprints(count);
+  for (UINT i = 0; i < count; ++i)
+  {
+    footprints[i] = TextureFootprint{ layouts[i], numRows[i], rowSizeInBytes[i] };
+  }
+
+  // ステージングの確保だけをロック中に行い、書き込みはロックを解放して行う.
+  // 書き込み中は m_activeWriterCount によりバッチの発行を止め、確保した領域のバッチへコピーを記録する.
+  std::unique_lock lock(m_mutex);
+  auto staging = AllocateStaging(lock, requiredSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+  m_activeWriterCount++;
+  lock.unlock();
+  writer(staging.cpuAddress, footprints);
+  lock.lock();
+  if (--m_activeWriterCount == 0)
+  {
+    m_writerDone.notify_all();
+  }
+  for (UINT i = 0; i < count; ++i)
+  {
+    auto footprint = layouts[i];
+    footprint.Offset += staging.offset;
+    D3D12_TEXTURE_COPY_LOCATION dstLoc{
+      .pResource = dst,
+      .Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX,
+      .SubresourceIndex = firstSubresource + i,
+    };
+    D3D12_TEXTURE_COPY_LOCATION srcLoc{
+      .pResource = staging.resource,
+      .Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT,
+      .PlacedFootprint = footprint,
+    };
+    m_commandList->CopyTextureRegion(&dstLoc, 0, 0, 0, &srcLoc, nullptr);
+  }
+  return FinishRecord(requiredSize, count);
+}
+
+void UploadContext::Submit()
+{
+  std::unique_lock lock(m_mutex);
+  SubmitLocked(lock);
+}
+
+bool UploadContext::IsCompleted(Ticket ticket) const
+{
+  return ticket <= m_fence->GetCompletedValue();
+}
+
+void UploadContext::Wait(Ticket ticket)
+{
+  {
+    std::unique_lock lock(m_mutex);
+    if (!m_ring.IsSubmitted(ticket))
+    {
+      SubmitLocked(lock);
+    }
+  }
+  WaitFence(ticket);
+}
+
+void UploadContext::QueueWait(ID3D12CommandQueue* queue, Ticket ticket)
+{
+  if (IsCompleted(ticket))
+  {
+    return;
+  }
+  std::unique_lock lock(m_mutex);
+  if (!m_ring.IsSubmitted(ticket))
+  {
+    SubmitLocked(lock);
+  }
+  queue->Wait(m_fence.Get(), ticket);
+}
+
+void UploadContext::WaitIdle()
+{
+  Ticket ticket = UploadStagingRing::NullTicket;
+  {
+    std::unique_lock lock(m_mutex);
+    SubmitLocked(lock);
+    ticket = m_ring.GetRecordingTicket() - 1;
+  }
+  WaitFence(ticket);
+  ReleaseCompleted();
+}
+
+void UploadContext::ReleaseCompleted()
+{
+  std::lock_guard lock(m_mutex);
+  ReleaseCompletedLocked();
+}
+
+UploadContext::Stats UploadContext::GetStats() const
+{
+  std::lock_guard lock(m_mutex);
+  return m_stats;
+}
+
+UploadContext::Staging UploadContext::AllocateStaging(std::unique_lock<std::mutex>& lock, UINT64 size, UINT64 alignment)
+{
+  if (size <= m_ring.GetCapacity())
+  {
+    for (;;)
+    {
+      auto offset = m_ring.Allocate(size, alignment);
+      if (offset != UploadStagingRing::InvalidOffset)
+      {
+        BeginRecording();
+        return Staging{ m_stagingBuffer.Get(), offset, m_mapped + offset };
+      }
+
+      // 記録中のコピーを発行し、最も古いバッチの完了を待って領域を空ける.
+      SubmitLocked(lock);
+      auto oldest = m_ring.GetOldestPendingTicket();
+      if (oldest == UploadStagingRing::NullTicket)
+      {
+        break;
+      }
+      m_stats.stallCount++;
+      WaitFence(oldest);
+      ReleaseCompletedLocked();
+    }
+  }
+
+  // リングに収まらないサイズは専用のステージングバッファを作成する.
+  auto resDesc = MakeBufferDesc(size);
+  ComPtr<ID3D12Resource> buffer;
+  HRESULT hr = m_device->CreateCommittedResource(&UploadHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&buffer));
+  ThrowIfFailed(hr, "CreateCommittedResourceに失敗(アップロード用ステージング)");
+
+  void* p = nullptr;
+  buffer->Map(0, nullptr, &p);
+  BeginRecording();
+  m_dedicatedStagings.push_back(DedicatedStaging{ buffer, m_ring.GetRecordingTicket() });
+  m_stats.dedicatedCount++;
+  return Staging{ buffer.Get(), 0, static_cast<UINT8*>(p) };
+}
+
+void UploadContext::BeginRecording()
+{
+  if (m_isRecording)
+  {
+    return;
+  }
+
+  // 完了したバッチのアロケータがあれば再利用する.
+  HRESULT hr;
+  const auto completedValue = m_fence->GetCompletedValue();
+  if (!m_pendingAllocators.empty() && m_pendingAllocators.front().ticket <= completedValue)
+  {
+    m_recordingAllocator = std::move(m_pendingAllocators.front().allocator);
+    m_pendingAllocators.pop_front();
+    m_recordingAllocator->Reset();
+  }
+  else
+  {
+    hr = m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&m_recordingAllocator));
+    ThrowIfFailed(hr, "CreateCommandAllocator(Copy)に失敗");
+  }
+
+  if (m_commandList)
+  {
+    hr = m_commandList->Reset(m_recordingAllocator.Get(), nullptr);
+  }
+  else
+  {
+    hr = m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, m_recordingAllocator.Get(), nullptr, IID_PPV_ARGS(&m_commandList));
+  }
+  ThrowIfFailed(hr, "コピー用コマンドリストの準備に失敗");
+  m_isRecording = true;
+}
+
+void UploadContext::SubmitLocked(std::unique_lock<std::mutex>& lock)
+{
+  // 書き込み中の領域は記録中のバッチに含まれるため、書き込みとコピーの記録が終わるまで待つ.
+  m_writerDone.wait(lock, [&]() { return m_activeWriterCount == 0; });
+  if (!m_isRecording)
+  {
+    return;
+  }
+  m_commandList->Close();
+  ID3D12CommandList* commandLists[] = { m_commandList.Get() };
+  m_copyQueue->ExecuteCommandLists(1, commandLists);
+
+  const auto ticket = m_ring.CloseBatch();
+  m_copyQueue->Signal(m_fence.Get(), ticket);
+  m_pendingAllocators.push_back(PendingAllocator{ std::move(m_recordingAllocator), ticket });
+  m_isRecording = false;
+  m_stats.submitCount++;
+}
+
+void UploadContext::WaitFence(Ticket ticket)
+{
+  if (m_fence->GetCompletedValue() < ticket)
+  {
+    // イベント無しで呼び出すと完了までブロックする.
+    m_fence->SetEventOnCompletion(ticket, nullptr);
+  }
+}
+
+void UploadContext::ReleaseCompletedLocked()
+{
+  const auto completedValue = m_fence->GetCompletedValue();
+  m_ring.ReleaseCompleted(completedValue);
+  std::erase_if(m_dedicatedStagings, [&](const DedicatedStaging& v) { return v.ticket <= completedValue; });
+}
+
+UploadContext::Ticket UploadContext::FinishRecord(UINT64 bytes, UINT copyCount)
+{
+  m_ring.MarkRecorded();
+  m_stats.copyCount += copyCount;
+  m_stats.uploadBytes += bytes;
+  const auto ticket = m_ring.GetRecordingTicket();
+  m_lastTicket = ticket;
+  return ticket;
+}
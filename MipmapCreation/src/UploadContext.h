@@ -0,0 +1,129 @@
+﻿#pragma once
+#include <deque>
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <span>
+#include <functional>
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include <d3d12.h>
+#include <wrl.h>
+
+#include "UploadStagingRing.h"
+
+// 初期化時のデータ転送をまとめて行うアップロードコンテキスト.
+// ステージングは常時マップした 1 つのバッファからリングとして割り当て、コピーは 1 つのコマンドリストへ記録していく.
+// 記録したコピーはコピーキューへまとめて発行し、完了はチケット(フェンス値)で確認する.
+// コピーキューで使用したリソースは完了後に COMMON へ戻るため、描画キューでは暗黙の昇格により読み取り状態で使用できる.
+// 各メソッドはスレッドセーフ.
+class UploadContext
+{
+public:
+  template<class T>
+  using ComPtr = Microsoft::WRL::ComPtr<T>;
+  using Ticket = UploadStagingRing::Ticket;
+
+  struct Stats
+  {
+    uint64_t submitCount = 0;
+    uint64_t copyCount = 0;
+    uint64_t uploadBytes = 0;
+    uint64_t stallCount = 0;      // ステージング不足で完了待ちをした回数.
+    uint64_t dedicatedCount = 0;  // リングに収まらず専用のステージングを作成した回数.
+  };
+
+  // ステージング上の 1 サブリソース分の配置. layout.Offset は書込み先の先頭からの位置.
+  struct TextureFootprint
+  {
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout;
+    UINT numRows;
+    UINT64 rowSizeInBytes;
+  };
+  using TextureWriter = std::function<void(UINT8* stagingBase, std::span<const TextureFootprint> footprints)>;
+
+  void Initialize(ID3D12Device* device, UINT64 stagingSize);
+  void Shutdown();
+
+  // バッファへの転送を記録. 転送先は COMMON 状態であること.
+  Ticket UploadBuffer(ID3D12Resource* dst, UINT64 dstOffset, const void* srcData, UINT64 size);
+  // テクスチャへの転送を記録. subresources は firstSubresource から順に並べる.
+  // 転送先は COMMON または COPY_DEST 状態であること.
+  Ticket UploadTexture(ID3D12Resource* dst, UINT firstSubresource, std::span<const D3D12_SUBRESOURCE_DATA> subresources);
+  // ステージングへ writer が直接書き込み、テクスチャへの転送を記録する. 中間のイメージを持たずに済む.
+  // ステージングは書込み結合メモリの場合があるため、writer は書き込んだ内容を読み返さないこと.
+  // writer はロックの外で呼ばれるため、複数スレッドからの書き込みは並行して行われる.
+  // 書き込み中はバッチが発行されないため、writer の中でこのコンテキストを使用しないこと.
+  Ticket UploadTexture(ID3D12Resource* dst, UINT firstSubresource, UINT subresourceCount, const TextureWriter& writer);
+
+  // 記録済みのコピーをコピーキューへ発行.
+  void Submit();
+  bool IsCompleted(Ticket ticket) const;
+  // チケットの転送完了を CPU で待つ. 未発行であれば先に発行する.
+  void Wait(Ticket ticket);
+  // queue がチケットの転送完了を GPU 上で待つようにする. 未発行であれば先に発行する.
+  void QueueWait(ID3D12CommandQueue* queue, Ticket ticket);
+  // 全ての転送の完了を待つ.
+  void WaitIdle();
+  // これまでに発行したチケットの最大値.
+  Ticket GetLastTicket() const { return m_lastTicket; }
+  // 完了した転送のステージング領域を再利用可能にする.
+  void ReleaseCompleted();
+
+  Stats GetStats() const;
+
+private:
+  struct Staging
+  {
+    ID3D12Resource* resource;
+    UINT64 offset;
+    UINT8* cpuAddress;
+  };
+  // ステージングを確保し、コピー記録可能な状態にする. m_mutex をロックした状態で呼ぶこと.
+  // 不足した場合は発行と完了待ちのために一時的にロックを解放する.
+  Staging AllocateStaging(std::unique_lock<std::mutex>& lock, UINT64 size, UINT64 alignment);
+  void BeginRecording();
+  // 記録中のバッチを発行する. ロックの外でステージングへ書き込み中のものがあれば、その完了を待ってから発行する.
+  void SubmitLocked(std::unique_lock<std::mutex>& lock);
+  void WaitFence(Ticket ticket);
+  void ReleaseCompletedLocked();
+  Ticket FinishRecord(UINT64 bytes, UINT copyCount);
+
+  ComPtr<ID3D12Device> m_device;
+  ComPtr<ID3D12CommandQueue> m_copyQueue;
+  ComPtr<ID3D12Fence> m_fence;
+  ComPtr<ID3D12GraphicsCommandList> m_commandList;
+  ComPtr<ID3D12CommandAllocator> m_recordingAllocator;
+  bool m_isRecording = false;
+
+  // 発行済みバッチのコマンドアロケータ. 完了後に再利用する.
+  struct PendingAllocator
+  {
+    ComPtr<ID3D12CommandAllocator> allocator;
+    Ticket ticket;
+  };
+  std::deque<PendingAllocator> m_pendingAllocators;
+
+  ComPtr<ID3D12Resource> m_stagingBuffer;
+  UINT8* m_mapped = nullptr;
+  UploadStagingRing m_ring;
+
+  // リングに収まらないサイズの転送用. 転送完了まで保持する.
+  struct DedicatedStaging
+  {
+    ComPtr<ID3D12Resource> buffer;
+    Ticket ticket;
+  };
+  std::vector<DedicatedStaging> m_dedicatedStagings;
+
+  std::atomic<Ticket> m_lastTicket = UploadStagingRing::NullTicket;
+  Stats m_stats;
+  mutable std::mutex m_mutex;
+  // ロックの外でステージングへ書き込み中の数. 0 になるまで記録中のバッチは発行しない.
+  uint32_t m_activeWriterCount = 0;
+  std::condition_variable m_writerDone;
+};
@@ -0,0 +1,58 @@
+﻿#pragma once
+#include <cstdint>
+#include <deque>
+
+// アップロード用ステージング領域の割り当て管理 (リングバッファ) と転送完了チケットの発行.
+// 割り当てはバッチ単位でまとめられ、CloseBatch で返るチケット(フェンス値)の完了が
+// ReleaseCompleted で通知されるまで再利用されない.
+// オフセットとチケットの管理のみを行うため、GPU 無しでもフェンスを模擬して動作確認できる.
+class UploadStagingRing
+{
+public:
+  using Ticket = uint64_t;
+  static constexpr uint64_t InvalidOffset = UINT64_MAX;
+  // 転送が無いことを示すチケット. 常に完了扱い.
+  static constexpr Ticket NullTicket = 0;
+
+  void Reset(uint64_t capacity);
+
+  // 割り当てに失敗した場合は InvalidOffset を返す.
+  uint64_t Allocate(uint64_t size, uint64_t alignment);
+
+  // 記録中のバッチのチケット. このバッチへ記録した転送は、この値のシグナルで完了となる.
+  Ticket GetRecordingTicket() const { return m_nextTicket; }
+  // 記録中のバッチへコピーを記録したことを通知.
+  void MarkRecorded() { ++m_recordedCount; }
+  bool HasRecordedWork() const { return m_recordedCount > 0; }
+  // 記録中のバッチを締めて、シグナルすべきフェンス値を返す.
+  Ticket CloseBatch();
+  // completedValue までに完了したバッチの領域を解放.
+  void ReleaseCompleted(uint64_t completedValue);
+
+  bool IsSubmitted(Ticket ticket) const { return ticket < m_nextTicket; }
+  bool IsCompleted(Ticket ticket, uint64_t completedValue) const { return ticket <= completedValue; }
+  // 領域を使用中のバッチのうち最も古いもののチケット. 無い場合は NullTicket.
+  Ticket GetOldestPendingTicket() const { return m_batches.empty() ? NullTicket : m_batches.front().ticket; }
+
+  uint64_t GetCapacity() const { return m_capacity; }
+  // 使用中(GPU 待ちを含む)のサイズ. アライメントや折り返しによる未使用領域も含む.
+  uint64_t GetUsedBytes() const { return m_usedBytes; }
+  uint32_t GetPendingBatchCount() const { return uint32_t(m_batches.size()); }
+
+private:
+  struct BatchSegment
+  {
+    Ticket   ticket;
+    uint64_t endOffset;  // このバッチの割り当て終端 (解放後の tail).
+    uint64_t bytes;      // このバッチで消費したサイズ.
+  };
+
+  uint64_t m_capacity = 0;
+  uint64_t m_head = 0;        // 次に割り当てる位置.
+  uint64_t m_tail = 0;        // 使用中の先頭位置.
+  uint64_t m_usedBytes = 0;
+  uint64_t m_batchBytes = 0;  // 記録中のバッチで消費したサイズ.
+  uint32_t m_recordedCount = 0;
+  Ticket   m_nextTicket = 1;  // フェンスの初期値 0 より大きい値から始める.
+  std::deque<BatchSegment> m_batches;
+};
@@ -0,0 +1,146 @@
+﻿#include "UploadStagingStress.h"
+#include "UploadStagingRing.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace
+{
+  using Ticket = UploadStagingRing::Ticket;
+
+  struct LiveRange
+  {
+    uint64_t offset;
+    uint64_t size;
+    Ticket   ticket;
+  };
+
+  bool IsOverlapped(const LiveRange& a, uint64_t offset, uint64_t size)
+  {
+    return offset < a.offset + a.size && a.offset < offset + size;
+  }
+
+  // 小さなテクスチャを中心に、まれに容量の半分程度のものと容量を超えるものを混ぜる.
+  uint64_t RandomSize(std::default_random_engine& rng, uint64_t capacity)
+  {
+    auto r = rng() % 100;
+    if (r < 70) return 256 + rng() % (64 * 1024);
+    if (r < 97) return 64 * 1024 + rng() % (capacity / 8);
+    if (r < 99) return capacity / 4 + rng() % (capacity / 4 * 3);
+    return capacity + 1 + rng() % capacity;
+  }
+}
+
+UploadStagingStressResult RunUploadStagingStress(uint32_t stepCount, uint64_t capacity)
+{
+  UploadStagingStressResult result;
+  result.stepCount = stepCount;
+  result.ticketsValid = true;
+
+  UploadStagingRing ring;
+  ring.Reset(capacity);
+  std::default_random_engine rng(1);
+  std::vector<LiveRange> live;
+  Ticket lastSubmitted = UploadStagingRing::NullTicket;
+  Ticket completedValue = UploadStagingRing::NullTicket;
+  uint64_t lastOffset = 0;
+
+  auto release = [&](Ticket value) {
+    completedValue = (std::max)(completedValue, value);
+    ring.ReleaseCompleted(completedValue);
+    std::erase_if(live, [&](const LiveRange& r) { return r.ticket <= completedValue; });
+  };
+  auto submit = [&]() {
+    // UploadContext::SubmitLocked に相当. 記録が無ければ発行しない.
+    if (!ring.HasRecordedWork())
+    {
+      return;
+    }
+    auto ticket = ring.CloseBatch();
+    result.ticketsValid &= ticket == lastSubmitted + 1 && ring.IsSubmitted(ticket) && !ring.IsSubmitted(ring.GetRecordingTicket());
+    lastSubmitted = ticket;
+    result.submitCount++;
+  };
+
+  auto start = std::chrono::high_resolution_clock::now();
+  for (uint32_t step = 0; step < stepCount; ++step)
+  {
+    // コピーキューは発行済みのバッチを 0～3 個遅れて完了する.
+    auto latency = rng() % 4;
+    release(lastSubmitted > latency ? lastSubmitted - latency : UploadStagingRing::NullTicket);
+
+    const auto allocationsInStep = rng() % 8;
+    for (uint32_t i = 0; i < allocationsInStep; ++i)
+    {
+      auto size = RandomSize(rng, capacity);
+      uint64_t alignment = (rng() % 4) ? 512 : 4;
+      if (size > capacity)
+      {
+        // 専用のステージングへ回す. リングの状態は変わらないこと.
+        auto usedBefore = ring.GetUsedBytes();
+        auto pendingBefore = ring.GetPendingBatchCount();
+        auto ticketBefore = ring.GetRecordingTicket();
+        auto offset = ring.Allocate(size, alignment);
+        result.oversizeStateChanges += (offset != UploadStagingRing::InvalidOffset || ring.GetUsedBytes() != usedBefore ||
+          ring.GetPendingBatchCount() != pendingBefore || ring.GetRecordingTicket() != ticketBefore) ? 1 : 0;
+        result.dedicatedCount++;
+        continue;
+      }
+
+      // UploadContext::AllocateStaging と同じく、不足すれば発行して最も古いバッチの完了を待つ.
+      auto offset = ring.Allocate(size, alignment);
+      while (offset == UploadStagingRing::InvalidOffset)
+      {
+        submit();
+        auto oldest = ring.GetOldestPendingTicket();
+        if (oldest == UploadStagingRing::NullTicket)
+        {
+          break;
+        }
+        result.stallCount++;
+        result.ticketsValid &= oldest > completedValue && oldest <= lastSubmitted;
+        release(oldest);
+        offset = ring.Allocate(size, alignment);
+      }
+      if (offset == UploadStagingRing::InvalidOffset)
+      {
+        result.unexpectedFallbackCount++;
+        continue;
+      }
+      result.allocationCount++;
+      result.misalignedCount += (offset % alignment != 0 || offset + size > capacity) ? 1 : 0;
+      result.wrapCount += (offset < lastOffset) ? 1 : 0;
+      lastOffset = offset;
+      for (const auto& range : live)
+      {
+        result.overlapCount += IsOverlapped(range, offset, size) ? 1 : 0;
+      }
+      live.push_back(LiveRange{ offset, size, ring.GetRecordingTicket() });
+      ring.MarkRecorded();
+    }
+
+    uint64_t liveBytes = 0;
+    for (const auto& range : live)
+    {
+      liveBytes += range.size;
+    }
+    auto usedBytes = ring.GetUsedBytes();
+    result.accountingErrors += (usedBytes < liveBytes || usedBytes > capacity) ? 1 : 0;
+
+    // 発行はまとめて行われることが多いため、毎回は発行しない.
+    if (rng() % 3 == 0)
+    {
+      submit();
+    }
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  result.elapsedMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+  // 記録中のものを発行し、全ての完了後は全て解放される.
+  submit();
+  release(lastSubmitted);
+  result.fullyReleased = ring.GetUsedBytes() == 0 && ring.GetPendingBatchCount() == 0 && live.empty() &&
+    ring.GetOldestPendingTicket() == UploadStagingRing::NullTicket;
+  return result;
+}
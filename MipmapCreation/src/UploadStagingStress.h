@@ -0,0 +1,27 @@
+﻿#pragma once
+#include <cstdint>
+
+// UploadStagingRing の動作検証.
+// コピーキューの完了が遅れる状況をチケット(フェンス値)で模擬し、UploadContext と同じ手順で割り当てを繰り返す.
+// 不足時は記録中のバッチを締めて最も古いバッチの完了を待ち、容量を超えるものは専用のステージングへ回す.
+// 折り返しを含めて使用中の領域と重ならないこと、チケットの完了前に再利用されないこと、
+// 容量以下の要求は必ずリングから割り当てられ、容量を超える要求は状態を変えずに失敗することを確認する.
+struct UploadStagingStressResult
+{
+  uint32_t stepCount = 0;
+  uint64_t allocationCount = 0;
+  uint64_t submitCount = 0;
+  uint64_t stallCount = 0;         // 領域不足で最も古いバッチの完了を待った回数.
+  uint64_t dedicatedCount = 0;     // 容量を超えるため専用のステージングへ回した回数.
+  uint64_t wrapCount = 0;          // 先頭へ折り返した回数.
+  uint64_t overlapCount = 0;       // 完了前のバッチの領域と重なった回数 (0 であること).
+  uint64_t misalignedCount = 0;    // アライメントや範囲が不正だった回数 (0 であること).
+  uint64_t accountingErrors = 0;   // 使用量が生存中の割り当ての合計未満、または容量超過だった回数 (0 であること).
+  uint64_t unexpectedFallbackCount = 0;  // 容量以下の要求がリングから割り当てられなかった回数 (0 であること).
+  uint64_t oversizeStateChanges = 0;     // 容量を超える要求で状態が変わった回数 (0 であること).
+  bool     ticketsValid = false;   // チケットが連番で発行され、発行済みの判定と一致したか.
+  bool     fullyReleased = false;  // 全チケットの完了後に使用量が 0 に戻るか.
+  double   elapsedMs = 0.0;
+};
+
+UploadStagingStressResult RunUploadStagingStress(uint32_t stepCount = 100000, uint64_t capacity = 4 * 1024 * 1024);
@@ -9,7 +9,9 @@
 #include "imgui/backends/imgui_impl_win32.h"
 
 #include "TextureUtility.h"
+#include "UploadStagingStress.h"
 #include <DirectXTex.h>
+#include <format>
 #include <fstream>
 #include <random>
 
@@ -546,14 +548,40 @@ void MyApplication::PrepareModelData()
   }
 
   auto& gfxDevice = GetGfxDevice();
+
+  // テクスチャはまとめて登録し、デコードとミップマップ作成を並列に行う.
+  // 複数のマテリアルから参照されるファイルは 1 回だけ読み込まれる.
+  // デコードとミップマップ作成の結果はキャッシュへ保存し、次回以降の起動ではそれを使う.
+  m_textureCache.Initialize("texcache", 1024ull * 1024 * 1024);
+  TextureBatchLoader textureLoader;
+  textureLoader.SetCache(&m_textureCache);
+  std::vector<TextureBatchLoader::TextureId> embeddedTextureIds;
   for (const auto& embeddedInfo : modelEmbeddedTextures)
   {
-    auto& texture = m_model.embeddedTextures.emplace_back();
-    auto success = CreateTextureFromMemory(texture.texResource, embeddedInfo.data.data(), embeddedInfo.data.size(), true);
-    assert(success);
+    embeddedTextureIds.push_back(textureLoader.AddMemory(embeddedInfo.data.data(), embeddedInfo.data.size(), true));
   }
+  std::vector<TextureBatchLoader::TextureId> materialTextureIds;
   for (const auto& material : modelMaterials)
   {
+    auto id = TextureBatchLoader::InvalidId;
+    if (material.texDiffuse.embeddedIndex == -1)
+    {
+      id = textureLoader.AddFile(material.texDiffuse.filePath, true);
+    }
+    materialTextureIds.push_back(id);
+  }
+  textureLoader.Execute();
+  m_textureLoadStats = textureLoader.GetStats();
+
+  for (auto id : embeddedTextureIds)
+  {
+    auto& texture = m_model.embeddedTextures.emplace_back();
+    texture.texResource = textureLoader.GetTexture(id);
+    assert(texture.texResource);
+  }
+  for (size_t materialIndex = 0; materialIndex < modelMaterials.size(); ++materialIndex)
+  {
+    const auto& material = modelMaterials[materialIndex];
     auto& dstMaterial = m_model.materials.emplace_back();
 
     dstMaterial.alphaMode = material.alphaMode;
@@ -587,18 +615,25 @@ void MyApplication::PrepareModelData()
     };
     GfxDevice::DescriptorHandle diffuseSrvDescriptor;
 
-    bool success;
     if (material.texDiffuse.embeddedIndex == -1)
     {
-      // ファイルから読み込み.
-      auto& info = m_model.textureList.emplace_back();
-      info.filePath = material.texDiffuse.filePath;
-
-      success = CreateTextureFromFile(info.texResource, info.filePath, true);
+      // ファイルから読み込んだテクスチャ. 同じファイルは 1 つのエントリを共有する.
+      // TextureBatchLoader と同じく、表記を揃えたパスで判定する.
+      auto filePath = TextureBatchLoader::NormalizePath(material.texDiffuse.filePath);
+      auto itr = std::find_if(m_model.textureList.begin(), m_model.textureList.end(),
+        [&](const auto& v) { return v.filePath == filePath; });
+      if (itr == m_model.textureList.end())
+      {
+        auto& info = m_model.textureList.emplace_back();
+        info.filePath = filePath;
+        info.texResource = textureLoader.GetTexture(materialTextureIds[materialIndex]);
+        itr = std::prev(m_model.textureList.end());
+      }
+      const auto& info = *itr;
+      assert(info.texResource);
       const auto texDesc = info.texResource->GetDesc();
       srvDesc.Format = texDesc.Format;
       srvDesc.Texture2D.MipLevels = texDesc.MipLevels;
-      assert(success);
       diffuseSrvDescriptor = gfxDevice->CreateShaderResourceView(info.texResource, &srvDesc);
     }
     else
@@ -615,70 +650,98 @@ void MyApplication::PrepareModelData()
     dstMaterial.samplerDiffuse = gfxDevice->CreateSampler(samplerDesc);
   }
 
+  // 全メッシュの頂点/インデックスをストリーム毎に 1 つの配列へ詰める.
+  // ストリーム毎に 1 つのバッファとしてまとめて転送し、各メッシュのビューはその中の範囲を参照する.
+  struct MeshRange
+  {
+    UINT baseVertex;
+    UINT vertexCount;
+    UINT firstIndex;
+    UINT indexCount;
+  };
+  std::vector<MeshRange> meshRanges;
+  std::vector<XMFLOAT3> packedPositions, packedNormals;
+  std::vector<XMFLOAT2> packedTexcoords;
+  std::vector<uint32_t> packedIndices;
+  size_t totalVertexCount = 0, totalIndexCount = 0;
   for (const auto& mesh : modelMeshes)
   {
-    auto& dstMesh = m_model.meshes.emplace_back();
+    totalVertexCount += mesh.positions.size();
+    totalIndexCount += mesh.indices.size();
+  }
+  meshRanges.reserve(modelMeshes.size());
+  packedPositions.reserve(totalVertexCount);
+  packedNormals.reserve(totalVertexCount);
+  packedTexcoords.reserve(totalVertexCount);
+  packedIndices.reserve(totalIndexCount);
+  for (const auto& mesh : modelMeshes)
+  {
+    meshRanges.push_back({
+      .baseVertex = UINT(packedPositions.size()),
+      .vertexCount = UINT(mesh.positions.size()),
+      .firstIndex = UINT(packedIndices.size()),
+      .indexCount = UINT(mesh.indices.size()),
+    });
+    packedPositions.insert(packedPositions.end(), mesh.positions.begin(), mesh.positions.end());
+    packedNormals.insert(packedNormals.end(), mesh.normals.begin(), mesh.normals.end());
+    packedTexcoords.insert(packedTexcoords.end(), mesh.texcoords.begin(), mesh.texcoords.end());
+    packedIndices.insert(packedIndices.end(), mesh.indices.begin(), mesh.indices.end());
+  }
+
+  auto createMeshBuffer = [&](const void* srcData, UINT64 bufferSize, D3D12_RESOURCE_STATES resourceState) {
     D3D12_RESOURCE_DESC resDesc{
       .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
       .Alignment = 0,
-      .Width = 0,
+      .Width = bufferSize,
       .Height = 1, .DepthOrArraySize = 1, .MipLevels = 1,
       .Format = DXGI_FORMAT_UNKNOWN,
       .SampleDesc = {.Count = 1, .Quality = 0 },
       .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
       .Flags = D3D12_RESOURCE_FLAG_NONE,
     };
-    UINT stride = 0;
-    auto resourceState = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER;
-    UINT vertexCount = UINT(mesh.positions.size());
-    UINT indexCount = UINT(mesh.indices.size());
+    return gfxDevice->CreateBuffer(resDesc, D3D12_HEAP_TYPE_DEFAULT, resourceState, srcData);
+  };
+  auto vertexState = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER;
+  m_model.positionBuffer = createMeshBuffer(packedPositions.data(), packedPositions.size() * sizeof(XMFLOAT3), vertexState);
+  m_model.normalBuffer = createMeshBuffer(packedNormals.data(), packedNormals.size() * sizeof(XMFLOAT3), vertexState);
+  m_model.texcoordBuffer = createMeshBuffer(packedTexcoords.data(), packedTexcoords.size() * sizeof(XMFLOAT2), vertexState);
+  m_model.indexBuffer = createMeshBuffer(packedIndices.data(), packedIndices.size() * sizeof(uint32_t), D3D12_RESOURCE_STATE_INDEX_BUFFER);
 
-    stride = sizeof(XMFLOAT3);
-    resDesc.Width = stride * vertexCount;
-    dstMesh.position = gfxDevice->CreateBuffer(resDesc,
-      D3D12_HEAP_TYPE_DEFAULT, resourceState,
-      mesh.positions.data());
+  for (size_t i = 0; i < modelMeshes.size(); ++i)
+  {
+    const auto& range = meshRanges[i];
+    auto& dstMesh = m_model.meshes.emplace_back();
+
+    UINT stride = sizeof(XMFLOAT3);
     dstMesh.vbViews[0] = {
-      .BufferLocation = dstMesh.position->GetGPUVirtualAddress(),
-      .SizeInBytes = UINT(resDesc.Width),
+      .BufferLocation = m_model.positionBuffer->GetGPUVirtualAddress() + UINT64(range.baseVertex) * stride,
+      .SizeInBytes = range.vertexCount * stride,
       .StrideInBytes = stride,
     };
 
     stride = sizeof(XMFLOAT3);
-    resDesc.Width = stride * vertexCount;
-    dstMesh.normal = gfxDevice->CreateBuffer(resDesc,
-      D3D12_HEAP_TYPE_DEFAULT, resourceState,
-      mesh.normals.data());
     dstMesh.vbViews[1] = {
-      .BufferLocation = dstMesh.normal->GetGPUVirtualAddress(),
-      .SizeInBytes = UINT(resDesc.Width),
+      .BufferLocation = m_model.normalBuffer->GetGPUVirtualAddress() + UINT64(range.baseVertex) * stride,
+      .SizeInBytes = range.vertexCount * stride,
       .StrideInBytes = stride,
     };
 
     stride = sizeof(XMFLOAT2);
-    resDesc.Width = stride * vertexCount;
-    dstMesh.texcoord0 = gfxDevice->CreateBuffer(resDesc,
-      D3D12_HEAP_TYPE_DEFAULT, resourceState,
-      mesh.texcoords.data());
     dstMesh.vbViews[2] = {
-      .BufferLocation = dstMesh.texcoord0->GetGPUVirtualAddress(),
-      .SizeInBytes = UINT(resDesc.Width),
+      .BufferLocation = m_model.texcoordBuffer->GetGPUVirtualAddress() + UINT64(range.baseVertex) * stride,
+      .SizeInBytes = range.vertexCount * stride,
       .StrideInBytes = stride,
     };
 
-    resDesc.Width = indexCount * sizeof(uint32_t);
-    dstMesh.indices = gfxDevice->CreateBuffer(resDesc,
-      D3D12_HEAP_TYPE_DEFAULT, D3D12_RESOURCE_STATE_INDEX_BUFFER,
-      mesh.indices.data());
     dstMesh.ibv = {
-      .BufferLocation = dstMesh.indices->GetGPUVirtualAddress(),
-      .SizeInBytes = UINT(resDesc.Width),
+      .BufferLocation = m_model.indexBuffer->GetGPUVirtualAddress() + UINT64(range.firstIndex) * sizeof(uint32_t),
+      .SizeInBytes = UINT(range.indexCount * sizeof(uint32_t)),
       .Format = DXGI_FORMAT_R32_UINT,
     };
 
-    dstMesh.indexCount = indexCount;
-    dstMesh.vertexCount = vertexCount;
-    dstMesh.materialIndex = mesh.materialIndex;
+    dstMesh.indexCount = range.indexCount;
+    dstMesh.vertexCount = range.vertexCount;
+    dstMesh.materialIndex = modelMeshes[i].materialIndex;
   }
 
   // メッシュ単位の描画情報を組み立てる.
@@ -756,6 +819,23 @@ void MyApplication::OnUpdate()
   ImGui::InputFloat("Power", (float*)&m_globalSpecular.w);
   float* ambientColor = (float*)&m_globalAmbient;
   ImGui::InputFloat3("Ambient", ambientColor);
+
+  const auto& loadStats = m_textureLoadStats;
+  ImGui::Text("Textures: %u (requests %u), %.1f ms (%u workers)", loadStats.textureCount, loadStats.requestCount, loadStats.totalMs, loadStats.workerCount);
+  const auto cacheStats = m_textureCache.GetStats();
+  ImGui::Text("Texture cache: hit %llu, miss %llu, %.1f MB", cacheStats.hitCount, cacheStats.missCount, cacheStats.totalBytes / (1024.0 * 1024.0));
+
+  if (ImGui::Button("Upload Staging Stress"))
+  {
+    auto result = RunUploadStagingStress();
+    m_strUploadStagingStress = std::format(
+      "{} steps: {} allocs, {} submits, {} stalls, {} dedicated, {} wraps, {:.1f} ms\n"
+      "overlap {}, misaligned {}, accounting {}, fallback {}, oversize {}, tickets {}, released {}",
+      result.stepCount, result.allocationCount, result.submitCount, result.stallCount, result.dedicatedCount, result.wrapCount,
+      result.elapsedMs, result.overlapCount, result.misalignedCount, result.accountingErrors, result.unexpectedFallbackCount,
+      result.oversizeStateChanges, result.ticketsValid ? "yes" : "NO", result.fullyReleased ? "yes" : "NO");
+  }
+  ImGui::TextUnformatted(m_strUploadStagingStress.c_str());
   ImGui::End();
 
   auto& gfxDevice = GetGfxDevice();
@@ -935,7 +1015,8 @@ ComPtr<ID3D12GraphicsCommandList>  MyApplication::MakeCommandList()
 
 std::vector<MyApplication::TextureInfo>::const_iterator MyApplication::FindModelTexture(const std::string& filePath, const ModelData& model)
 {
-  return std::find_if(model.textureList.begin(), model.textureList.end(), [&](const auto& v) { return v.filePath == filePath; });
+  auto normalizedPath = TextureBatchLoader::NormalizePath(filePath);
+  return std::find_if(model.textureList.begin(), model.textureList.end(), [&](const auto& v) { return v.filePath == normalizedPath; });
 }
 
 void MyApplication::DrawModel(ComPtr<ID3D12GraphicsCommandList> commandList)
@@ -8,6 +8,7 @@
 
 #include "GfxDevice.h"
 #include "Model.h"
+#include "TextureBatchLoader.h"
 
 class MyApplication 
 {
@@ -84,12 +85,7 @@ private:
   struct PolygonMesh
   {
     D3D12_VERTEX_BUFFER_VIEW vbViews[3];
-    D3D12_INDEX_BUFFER_VIEW  ibv;
-
-    ComPtr<ID3D12Resource1>  position;
-    ComPtr<ID3D12Resource1>  normal;
-    ComPtr<ID3D12Resource1>  texcoord0;
-    ComPtr<ID3D12Resource1>  indices;
+    D3D12_INDEX_BUFFER_VIEW  ibv;   // ビューは ModelData のストリーム毎のバッファ内を指す.
 
     uint32_t indexCount;
     uint32_t vertexCount;
@@ -124,7 +120,7 @@ private:
 
   struct TextureInfo
   {
-    std::string filePath;
+    std::string filePath;   // TextureBatchLoader::NormalizePath で表記を揃えたもの.
     ComPtr<ID3D12Resource1> texResource;
     GfxDevice::DescriptorHandle srvDescriptor;
   };
@@ -144,6 +140,12 @@ private:
     std::vector<TextureInfo> textureList;
     std::vector<TextureInfo> embeddedTextures;
     DirectX::XMMATRIX mtxWorld;
+
+    // 全メッシュの頂点/インデックスをストリーム毎にまとめたバッファ.
+    ComPtr<ID3D12Resource1> positionBuffer;
+    ComPtr<ID3D12Resource1> normalBuffer;
+    ComPtr<ID3D12Resource1> texcoordBuffer;
+    ComPtr<ID3D12Resource1> indexBuffer;
   } m_model;
   std::vector<TextureInfo>::const_iterator FindModelTexture(const std::string& filePath, const ModelData& model);
 
@@ -154,6 +156,10 @@ private:
   std::wstring m_title;
   bool m_overwrite = false;
 
+  TextureBatchLoader::Stats m_textureLoadStats;  // モデルのテクスチャ作成の計測結果.
+  std::string m_strUploadStagingStress;
+  TextureCache m_textureCache;  // 加工済みテクスチャのディスクキャッシュ.
+
   const UINT RenderTexWidth = 2048;
   const UINT RenderTexHeight = 2048;
 
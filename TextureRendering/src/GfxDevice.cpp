@@ -68,11 +68,16 @@ void GfxDevice::Initialize(const DeviceInitParams& initParams)
   // コマンドアロケーターの作成.
   CreateCommandAllocators();
 
+  // アップロードコンテキストの作成.
+  const UINT64 uploadStagingSize = 64 * 1024 * 1024;
+  m_uploadContext.Initialize(m_d3d12Device.Get(), uploadStagingSize);
+
   m_frameIndex = m_swapchain->GetCurrentBackBufferIndex();
 }
 
 void GfxDevice::Shutdown()
 {
+  m_uploadContext.Shutdown();
   DestroyCommandAllocators();
   
   m_swapchain.Reset();
@@ -92,6 +97,13 @@ GfxDevice::ComPtr<ID3D12Resource1> GfxDevice::GetSwapchainBufferResource()
 
 void GfxDevice::Submit(ID3D12CommandList* const commandList)
 {
+  // 記録済みの転送がある場合は、その完了を描画キュー上で待たせる.
+  auto uploadTicket = m_uploadContext.GetLastTicket();
+  if (uploadTicket > m_uploadWaitTicket)
+  {
+    m_uploadContext.QueueWait(m_commandQueue.Get(), uploadTicket);
+    m_uploadWaitTicket = uploadTicket;
+  }
   m_commandQueue->ExecuteCommandLists(1, &commandList);
 }
 
@@ -119,22 +131,22 @@ void GfxDevice::Present(UINT syncInterval, UINT flags)
 void GfxDevice::NewFrame()
 {
   m_frameInfo[m_frameIndex].commandAllocator->Reset();
+  m_uploadContext.ReleaseCompleted();
 }
 
 void GfxDevice::WaitForGPU()
 {
-  ComPtr<ID3D12Fence1> fence;
-  HANDLE hWait = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-  HRESULT hr;
-  hr = m_d3d12Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence));
-  ThrowIfFailed(hr, "CreateFenceに失敗");
-
-  const auto value = 1;
-  m_commandQueue->Signal(fence.Get(), value);
-  fence->SetEventOnCompletion(value, hWait);
-  WaitForSingleObjectEx(hWait, INFINITE, FALSE);
+  // 未発行の転送も含めて完了させる.
+  m_uploadContext.WaitIdle();
 
-  CloseHandle(hWait);
+  // フェンスとイベントは使い回す.
+  const auto value = ++m_gpuWaitValue;
+  m_commandQueue->Signal(m_gpuWaitFence.Get(), value);
+  if (m_gpuWaitFence->GetCompletedValue() < value)
+  {
+    m_gpuWaitFence->SetEventOnCompletion(value, m_waitFence);
+    WaitForSingleObjectEx(m_waitFence, INFINITE, FALSE);
+  }
 }
 
 
@@ -256,50 +268,9 @@ GfxDevice::ComPtr<ID3D12Resource1> GfxDevice::CreateBuffer(const D3D12_RESOURCE_
     }
     else
     {
-      // ステージングバッファを作成.
-      D3D12_HEAP_PROPERTIES uploadHeapProps(heapProps);
-      uploadHeapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
-      ComPtr<ID3D12Resource1> staging;
-      hr = m_d3d12Device->CreateCommittedResource(&uploadHeapProps, D3D12_HEAP_FLAG_NONE, &resDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&staging));
-      ThrowIfFailed(hr, "CreateCommittedResourceに失敗(ステージングバッファ)");
-
-      void* p = nullptr;
-      staging->Map(0, nullptr, &p);
-      if (p)
-      {
-        memcpy(p, srcData, resDesc.Width);
-        staging->Unmap(0, nullptr);
-      }
-
-      // ステージングバッファから目的のバッファへ転送.
-      auto commandList = CreateCommandList();
-      D3D12_RESOURCE_BARRIER beginBarrier{
-        .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
-        .Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
-        .Transition = {
-          .pResource = retBuffer.Get(),
-          .Subresource = 0,
-          .StateBefore = D3D12_RESOURCE_STATE_COMMON,
-          .StateAfter = D3D12_RESOURCE_STATE_COPY_DEST
-        }
-      };
-      commandList->CopyResource(retBuffer.Get(), staging.Get());
-
-      // リソース状態を変更.
-      D3D12_RESOURCE_BARRIER lastBarrier{
-        .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
-        .Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE,
-        .Transition = {
-          .pResource = retBuffer.Get(),
-          .Subresource = 0,
-          .StateBefore = D3D12_RESOURCE_STATE_COPY_DEST,
-          .StateAfter = resourceState
-        }
-      };
-      commandList->ResourceBarrier(1, &lastBarrier);
-      commandList->Close();
-      Submit(commandList.Get());
-      WaitForGPU();
+      // アップロードコンテキストのステージングを経由して転送.
+      // 転送先は COMMON から暗黙に昇格するため、ここでの状態遷移は不要.
+      m_uploadContext.UploadBuffer(retBuffer.Get(), 0, srcData, resDesc.Width);
     }
   }
   return retBuffer;
@@ -567,6 +538,10 @@ void GfxDevice::CreateCommandAllocators()
     0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_frameFence)
   );
   ThrowIfFailed(hr, "CreateFenceに失敗.");
+  hr = m_d3d12Device->CreateFence(
+    0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_gpuWaitFence)
+  );
+  ThrowIfFailed(hr, "CreateFenceに失敗.");
 
   for (UINT i = 0; i < BackBufferCount; ++i)
   {
@@ -584,6 +559,7 @@ void GfxDevice::CreateCommandAllocators()
 void GfxDevice::DestroyCommandAllocators()
 {
   m_frameFence.Reset();
+  m_gpuWaitFence.Reset();
   for (UINT i = 0; i < BackBufferCount; ++i)
   {
     auto& frame = m_frameInfo[i];
@@ -0,0 +1,59 @@
+﻿#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// RGBA8 イメージのミップマップを 2x2 ボックスフィルタで作成する.
+// 各レベルの配置(オフセット/行ピッチ)は呼び出し側が指定するため、
+// アップロード用ステージングのフットプリント配置へ直接書き出すことができる.
+// D3D12 には依存しない.
+
+// 1 レベル分の配置. offset は書き出し先の先頭からのバイト位置.
+struct MipLevelLayout
+{
+  uint32_t width;
+  uint32_t height;
+  uint64_t offset;
+  uint32_t rowPitch;
+};
+
+// width x height から 1x1 までの mipCount レベル分の配置を求め、全体のバイト数を返す.
+// 行ピッチ/各レベルの開始位置はそれぞれ指定の倍数に揃える.
+// D3D12 のアップロード用フットプリントと同じ配置にする場合は 256 / 512 を指定する.
+uint64_t MakeMipChainLayout(
+  uint32_t width, uint32_t height, uint32_t mipCount,
+  uint32_t rowPitchAlignment, uint32_t offsetAlignment,
+  std::vector<MipLevelLayout>& outLevels);
+
+enum class MipColorSpace
+{
+  Linear, // 値をそのまま平均する.
+  SRGB,   // RGB をリニアに変換して平均し、sRGB に戻す. アルファはそのまま平均する.
+};
+
+// src を 1 段縮小して dst に書き出す. dst の幅/高さは max(1, src/2) であること.
+// 奇数サイズの軸では 1 テクセルの範囲が 2 テクセルを超えるため、3 テクセルを面積比で重み付けする.
+void DownsampleMipLevel(
+  const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint32_t srcRowPitch,
+  uint8_t* dst, uint32_t dstWidth, uint32_t dstHeight, uint32_t dstRowPitch,
+  MipColorSpace colorSpace);
+
+// ミップチェーン全体を作成する.
+// 作業バッファを保持するため、スレッド毎にインスタンスを用意して使い回すこと.
+class MipChainBuilder
+{
+public:
+  // base (levels[0] のサイズ) を dstBase + levels[0].offset へコピーし、levels[1] 以降を縮小して書き出す.
+  // dstIsReadable が false の場合(書込み結合のアップロードヒープ等)は書き出し先を読み返さず、
+  // 縮小は作業バッファ上で行って各レベルを 1 度だけ書き出す.
+  void Build(
+    const uint8_t* base, uint32_t baseRowPitch,
+    uint8_t* dstBase, std::span<const MipLevelLayout> levels,
+    MipColorSpace colorSpace, bool dstIsReadable);
+
+private:
+  std::vector<uint8_t> m_scratch;
+};
+
+// AVX2 の経路が使用可能か.
+bool IsMipChainBuilderAVX2Enabled();
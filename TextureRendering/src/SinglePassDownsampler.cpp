@@ -0,0 +1,201 @@
+﻿#include "SinglePassDownsampler.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+namespace
+{
+  constexpr uint32_t PixelBytes = 4;
+  // SPD のワークグループは 64x64 テクセルだが、CPU では行方向に連続して読む方がプリフェッチが効くため、
+  // タイルは 64 行 x 最大 4096 テクセルとする.
+  constexpr uint32_t TileHeight = 64;
+  constexpr uint32_t TileWidth = 4096;
+  constexpr uint32_t MaxTileLevels = 6;       // 64 -> 1.
+  constexpr uint32_t RowChunk = 8;            // ベースレベルのコピーと level1 の縮小をまとめて行う行数.
+  constexpr uint32_t MinTilesPerWorker = 4;   // 小さいイメージでスレッドを起こしすぎないよう.
+  // タイル内の作業バッファ. level1 分を 2 面使い、交互に読み書きする.
+  constexpr uint32_t TileScratchBytes = (TileWidth / 2) * (TileHeight / 2) * PixelBytes;
+
+  void CopyRows(uint8_t* dst, uint32_t dstRowPitch, const uint8_t* src, uint32_t srcRowPitch, uint32_t rowBytes, uint32_t rows)
+  {
+    for (uint32_t y = 0; y < rows; ++y)
+    {
+      memcpy(dst + uint64_t(dstRowPitch) * y, src + uint64_t(srcRowPitch) * y, rowBytes);
+    }
+  }
+
+  using Clock = std::chrono::high_resolution_clock;
+  double ElapsedMs(Clock::time_point start, Clock::time_point end)
+  {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  }
+}
+
+uint32_t SinglePassDownsampler::GetTileLevelCount(uint32_t width, uint32_t height)
+{
+  uint32_t count = 0;
+  while (count < MaxTileLevels && ((width | height) & ((2u << count) - 1)) == 0)
+  {
+    ++count;
+  }
+  return count;
+}
+
+void SinglePassDownsampler::Build(
+  const uint8_t* base, uint32_t baseRowPitch,
+  uint8_t* dstBase, std::span<const MipLevelLayout> levels,
+  MipColorSpace colorSpace, bool dstIsReadable, uint32_t workerCount)
+{
+  if (levels.empty())
+  {
+    return;
+  }
+  const auto& top = levels[0];
+  const uint32_t tileLevels = std::min(GetTileLevelCount(top.width, top.height), uint32_t(levels.size() - 1));
+  if (tileLevels == 0)
+  {
+    m_tailBuilder.Build(base, baseRowPitch, dstBase, levels, colorSpace, dstIsReadable);
+    return;
+  }
+
+  // タイルで作成する最後のレベルは、残りのレベルの入力として読み返せる作業バッファへ書き出す.
+  const auto& tail = levels[tileLevels];
+  const uint32_t tailRowPitch = tail.width * PixelBytes;
+  m_tailScratch.resize(uint64_t(tailRowPitch) * tail.height);
+
+  const uint32_t tileCountX = (top.width + TileWidth - 1) / TileWidth;
+  const uint32_t tileCountY = (top.height + TileHeight - 1) / TileHeight;
+  const uint32_t tileCount = tileCountX * tileCountY;
+  if (workerCount == 0)
+  {
+    workerCount = std::max(1u, tileCount / MinTilesPerWorker);
+  }
+  workerCount = ResolveWorkerCount(workerCount, tileCount);
+  if (m_tileScratch.size() < workerCount)
+  {
+    m_tileScratch.resize(workerCount);
+  }
+
+  std::atomic<uint32_t> finishedTileCount = 0;
+  ParallelFor(tileCount, workerCount, [&](uint32_t tileIndex, uint32_t workerIndex) {
+    // 幅と高さは 2^tileLevels の倍数のため、端のタイルも各レベルで 2:1 ちょうどになる.
+    const uint32_t x0 = (tileIndex % tileCountX) * TileWidth;
+    const uint32_t y0 = (tileIndex / tileCountX) * TileHeight;
+    const uint32_t tileWidth = std::min(TileWidth, top.width - x0);
+    const uint32_t tileHeight = std::min(TileHeight, top.height - y0);
+
+    auto& scratch = m_tileScratch[workerIndex];
+    if (scratch.size() < TileScratchBytes * 2)
+    {
+      scratch.resize(TileScratchBytes * 2);
+    }
+
+    // タイルで作成するレベルの書き出し先. 最後のレベルは残りのレベル用の作業バッファ.
+    auto getTileOutput = [&](uint32_t i, uint32_t& outRowPitch) {
+      if (i == tileLevels)
+      {
+        outRowPitch = tailRowPitch;
+        return m_tailScratch.data() + uint64_t(outRowPitch) * (y0 >> i) + uint64_t(x0 >> i) * PixelBytes;
+      }
+      outRowPitch = (tileWidth >> i) * PixelBytes;
+      return scratch.data() + ((i & 1) ? 0 : TileScratchBytes);
+    };
+    auto copyToLevel = [&](uint32_t i, const uint8_t* out, uint32_t outRowPitch) {
+      const auto& level = levels[i];
+      CopyRows(dstBase + level.offset + uint64_t(level.rowPitch) * (y0 >> i) + uint64_t(x0 >> i) * PixelBytes, level.rowPitch,
+        out, outRowPitch, (tileWidth >> i) * PixelBytes, tileHeight >> i);
+    };
+
+    // ベースレベルは読み込んだ行がキャッシュにあるうちに、コピーと level1 の縮小をまとめて行う.
+    const uint8_t* src = base + uint64_t(baseRowPitch) * y0 + uint64_t(x0) * PixelBytes;
+    uint32_t srcRowPitch = 0;
+    uint8_t* out = getTileOutput(1, srcRowPitch);
+    for (uint32_t y = 0; y < tileHeight; y += RowChunk)
+    {
+      const uint32_t rows = std::min(RowChunk, tileHeight - y);
+      const uint8_t* srcRows = src + uint64_t(baseRowPitch) * y;
+      CopyRows(dstBase + top.offset + uint64_t(top.rowPitch) * (y0 + y) + uint64_t(x0) * PixelBytes, top.rowPitch,
+        srcRows, baseRowPitch, tileWidth * PixelBytes, rows);
+      DownsampleMipLevel(srcRows, tileWidth, rows, baseRowPitch,
+        out + uint64_t(srcRowPitch) * (y / 2), tileWidth / 2, rows / 2, srcRowPitch, colorSpace);
+    }
+    if (tileLevels > 1)
+    {
+      copyToLevel(1, out, srcRowPitch);
+    }
+
+    // 残りはタイル内の作業バッファ上で縮小する.
+    src = out;
+    for (uint32_t i = 2; i <= tileLevels; ++i)
+    {
+      const uint32_t srcWidth = tileWidth >> (i - 1), srcHeight = tileHeight >> (i - 1);
+      uint32_t outRowPitch = 0;
+      out = getTileOutput(i, outRowPitch);
+      DownsampleMipLevel(src, srcWidth, srcHeight, srcRowPitch, out, tileWidth >> i, tileHeight >> i, outRowPitch, colorSpace);
+      if (i < tileLevels)
+      {
+        copyToLevel(i, out, outRowPitch);
+      }
+      src = out;
+      srcRowPitch = outRowPitch;
+    }
+
+    // 最後に完了したタイルの処理が、残りのレベルをまとめて作成する.
+    if (finishedTileCount.fetch_add(1, std::memory_order_acq_rel) + 1 == tileCount)
+    {
+      m_tailBuilder.Build(m_tailScratch.data(), tailRowPitch, dstBase, levels.subspan(tileLevels), colorSpace, dstIsReadable);
+    }
+  });
+}
+
+SinglePassDownsamplerBenchmarkResult RunSinglePassDownsamplerBenchmark(uint32_t width, uint32_t height, uint32_t iterations)
+{
+  SinglePassDownsamplerBenchmarkResult result;
+  result.width = width;
+  result.height = height;
+  iterations = std::max(1u, iterations);
+
+  uint32_t mipCount = 1;
+  while ((std::max(width, height) >> mipCount) != 0)
+  {
+    mipCount++;
+  }
+  std::vector<MipLevelLayout> levels;
+  std::vector<uint8_t> dst(MakeMipChainLayout(width, height, mipCount, 256, 512, levels));
+  std::vector<uint8_t> base(uint64_t(width) * height * PixelBytes);
+  uint32_t state = 0x12345678u;
+  for (auto& value : base)
+  {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    value = uint8_t(state >> 24);
+  }
+
+  auto measure = [&](auto&& build) {
+    build(); // ウォームアップ.
+    const auto start = Clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+      build();
+    }
+    return ElapsedMs(start, Clock::now()) / iterations;
+  };
+
+  MipChainBuilder chainBuilder;
+  result.levelByLevelMs = measure([&]() {
+    chainBuilder.Build(base.data(), width * PixelBytes, dst.data(), levels, MipColorSpace::Linear, false);
+  });
+  SinglePassDownsampler downsampler;
+  result.singleThreadMs = measure([&]() {
+    downsampler.Build(base.data(), width * PixelBytes, dst.data(), levels, MipColorSpace::Linear, false, 1);
+  });
+  result.workerCount = ResolveWorkerCount(0, ~0u);
+  result.multiThreadMs = measure([&]() {
+    downsampler.Build(base.data(), width * PixelBytes, dst.data(), levels, MipColorSpace::Linear, false, result.workerCount);
+  });
+  return result;
+}
@@ -0,0 +1,157 @@
+﻿#include "TextureBatchLoader.h"
+#include "TextureUtility.h"
+#include "FileLoader.h"
+#include "ParallelFor.h"
+#include "SinglePassDownsampler.h"
+
+#include <chrono>
+#include <mutex>
+
+namespace
+{
+  using Clock = std::chrono::high_resolution_clock;
+  double ElapsedMs(Clock::time_point start, Clock::time_point end)
+  {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  }
+}
+
+TextureBatchLoader::TextureId TextureBatchLoader::AddFile(const std::filesystem::path& filePath, bool generateMips)
+{
+  m_stats.requestCount++;
+  auto key = NormalizePath(filePath);
+  key += generateMips ? ":mips" : ":nomips";
+  if (auto itr = m_pathToId.find(key); itr != m_pathToId.end())
+  {
+    return itr->second;
+  }
+
+  const auto id = TextureId(m_entries.size());
+  auto& entry = m_entries.emplace_back();
+  entry.filePath = filePath;
+  entry.generateMips = generateMips;
+  m_pathToId.emplace(key, id);
+  return id;
+}
+
+std::string TextureBatchLoader::NormalizePath(const std::filesystem::path& filePath)
+{
+  return filePath.lexically_normal().generic_string();
+}
+
+TextureBatchLoader::TextureId TextureBatchLoader::AddMemory(const void* srcBuffer, size_t bufferSize, bool generateMips)
+{
+  m_stats.requestCount++;
+  const auto id = TextureId(m_entries.size());
+  auto& entry = m_entries.emplace_back();
+  entry.srcBuffer = srcBuffer;
+  entry.bufferSize = bufferSize;
+  entry.generateMips = generateMips;
+  return id;
+}
+
+void TextureBatchLoader::Execute(uint32_t workerCount)
+{
+  const auto startTime = Clock::now();
+  const auto count = uint32_t(m_entries.size());
+  m_stats.textureCount = count;
+  m_stats.workerCount = ResolveWorkerCount(workerCount, count);
+
+  auto& fileLoader = GetFileLoader();
+  std::mutex mutexStats;
+  ParallelFor(count, m_stats.workerCount, [&](uint32_t index, uint32_t) {
+    auto& entry = m_entries[index];
+    std::vector<char> fileData;
+    const void* srcBuffer = entry.srcBuffer;
+    size_t bufferSize = entry.bufferSize;
+    if (srcBuffer == nullptr)
+    {
+      if (!fileLoader->Load(entry.filePath, fileData))
+      {
+        std::lock_guard lock(mutexStats);
+        m_stats.failedCount++;
+        return;
+      }
+      srcBuffer = fileData.data();
+      bufferSize = fileData.size();
+    }
+
+    const auto result = CreateEntryTexture(entry, srcBuffer, bufferSize);
+
+    std::lock_guard lock(mutexStats);
+    m_stats.decodeMs += result.decodeMs;
+    m_stats.decodedBytes += result.decodedBytes;
+    m_stats.cacheHitCount += result.isCacheHit ? 1 : 0;
+    if (!result.success)
+    {
+      entry.texture.Reset();
+      m_stats.failedCount++;
+    }
+  });
+
+  // 記録した転送をまとめて発行.
+  GetGfxDevice()->GetUploadContext().Submit();
+  m_stats.totalMs = ElapsedMs(startTime, Clock::now());
+}
+
+TextureBatchLoader::CreateResult TextureBatchLoader::CreateEntryTexture(Entry& entry, const void* srcBuffer, size_t bufferSize)
+{
+  CreateResult result;
+  const bool useCache = m_cache && m_cache->IsEnabled();
+  TextureCache::Key cacheKey;
+  if (useCache)
+  {
+    const TextureCache::Options options{
+      .generateMips = entry.generateMips,
+      .format = DXGI_FORMAT_R8G8B8A8_UNORM,
+      .colorSpace = MipColorSpace::Linear,
+    };
+    cacheKey = TextureCache::MakeKey(srcBuffer, bufferSize, options);
+    if (auto cached = m_cache->Find(cacheKey))
+    {
+      // キャッシュはフットプリント配置のため、マップした内容をそのままステージングへコピーする.
+      result.isCacheHit = true;
+      result.success = CreateTextureFromMipChain(entry.texture, cached->GetWidth(), cached->GetHeight(), cached->GetLevels(), cached->GetData());
+      return result;
+    }
+  }
+
+  const auto decodeStart = Clock::now();
+  DecodedBaseImage image;
+  if (!DecodeBaseImage(srcBuffer, bufferSize, image))
+  {
+    return result;
+  }
+  result.decodeMs = ElapsedMs(decodeStart, Clock::now());
+  result.decodedBytes = uint64_t(image.GetRowPitch()) * image.height;
+
+  if (!useCache)
+  {
+    // ミップマップはステージング上に直接作成され、転送はアップロードコンテキスト上の 1 つのバッチへ記録されていく.
+    // テクスチャ単位で既に並列化されているため、縮小は 1 スレッドで行う.
+    result.success = CreateTextureFromBaseImage(
+      entry.texture, image, entry.generateMips, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_FLAG_NONE, 1);
+    return result;
+  }
+
+  // キャッシュへ保存するため、フットプリントと同じ配置でミップチェーンを作成する.
+  const auto mipCount = entry.generateMips ? GetFullMipCount(image.width, image.height) : 1u;
+  std::vector<MipLevelLayout> levels;
+  const auto chainBytes = MakeMipChainLayout(
+    image.width, image.height, mipCount, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, levels);
+  std::vector<uint8_t> chain(chainBytes);
+  // テクスチャ単位で既に並列化されているため、1 スレッドで作成する.
+  thread_local SinglePassDownsampler downsampler;
+  downsampler.Build(image.pixels.get(), image.GetRowPitch(), chain.data(), levels, MipColorSpace::Linear, true, 1);
+
+  m_cache->Store(cacheKey, image.width, image.height, levels, chain);
+  result.success = CreateTextureFromMipChain(entry.texture, image.width, image.height, levels, chain);
+  return result;
+}
+
+void TextureBatchLoader::Clear()
+{
+  m_entries.clear();
+  m_pathToId.clear();
+  m_stats = Stats();
+}
@@ -0,0 +1,366 @@
+﻿#include "TextureCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  constexpr uint32_t CacheMagic = 0x31435854; // 'TXC1'
+  constexpr uint32_t CacheVersion = 1;
+  constexpr uint64_t DataAlignment = 256;
+  const char* CacheExtension = ".texcache";
+
+  struct FileHeader
+  {
+    uint32_t magic;
+    uint32_t version;
+    TextureCache::Key key;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipCount;
+    uint32_t reserved;
+    uint64_t dataOffset;
+    uint64_t dataSize;
+  };
+  struct LevelRecord
+  {
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowPitch;
+    uint32_t reserved;
+    uint64_t offset;
+  };
+
+  // 64bit 単位で処理するハッシュ (MurmurHash64A).
+  uint64_t HashBytes(const void* data, size_t size)
+  {
+    constexpr uint64_t m = 0xc6a4a7935bd1e995ull;
+    constexpr int r = 47;
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ (size * m);
+
+    const auto bytes = static_cast<const uint8_t*>(data);
+    const size_t wordCount = size / 8;
+    for (size_t i = 0; i < wordCount; ++i)
+    {
+      uint64_t k;
+      memcpy(&k, bytes + i * 8, 8);
+      k *= m;
+      k ^= k >> r;
+      k *= m;
+      h ^= k;
+      h *= m;
+    }
+    if (const auto rest = size & 7; rest != 0)
+    {
+      uint64_t k = 0;
+      memcpy(&k, bytes + wordCount * 8, rest);
+      h ^= k;
+      h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+  }
+
+  uint64_t AlignUp(uint64_t value, uint64_t alignment)
+  {
+    return (value + alignment - 1) / alignment * alignment;
+  }
+}
+
+TextureCache::Entry::~Entry()
+{
+#if defined(_WIN32)
+  if (m_view)
+  {
+    UnmapViewOfFile(m_view);
+  }
+  if (m_mappingHandle)
+  {
+    CloseHandle(m_mappingHandle);
+  }
+  if (m_fileHandle)
+  {
+    CloseHandle(m_fileHandle);
+  }
+#else
+  if (m_view)
+  {
+    munmap(const_cast<uint8_t*>(m_view), m_viewSize);
+  }
+#endif
+}
+
+bool TextureCache::Entry::Open(const std::filesystem::path& filePath, const Key& key)
+{
+#if defined(_WIN32)
+  // マップ中でも削除や置き換えができるよう FILE_SHARE_DELETE を指定する.
+  HANDLE file = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+  m_fileHandle = file;
+  LARGE_INTEGER fileSize{};
+  if (!GetFileSizeEx(file, &fileSize) || uint64_t(fileSize.QuadPart) < sizeof(FileHeader))
+  {
+    return false;
+  }
+  m_mappingHandle = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (m_mappingHandle == nullptr)
+  {
+    return false;
+  }
+  m_view = static_cast<const uint8_t*>(MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+  if (m_view == nullptr)
+  {
+    return false;
+  }
+  m_viewSize = uint64_t(fileSize.QuadPart);
+#else
+  const int fd = open(filePath.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+  struct stat st {};
+  if (fstat(fd, &st) != 0 || uint64_t(st.st_size) < sizeof(FileHeader))
+  {
+    close(fd);
+    return false;
+  }
+  void* view = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (view == MAP_FAILED)
+  {
+    return false;
+  }
+  m_view = static_cast<const uint8_t*>(view);
+  m_viewSize = uint64_t(st.st_size);
+#endif
+
+  // ヘッダと配置の検証. キーが一致しないものはハッシュの衝突として扱う.
+  FileHeader header;
+  memcpy(&header, m_view, sizeof(header));
+  const uint64_t levelsEnd = sizeof(FileHeader) + uint64_t(header.mipCount) * sizeof(LevelRecord);
+  if (header.magic != CacheMagic || header.version != CacheVersion || !(header.key == key) ||
+    header.mipCount == 0 || header.mipCount > 32 || levelsEnd > header.dataOffset ||
+    header.dataOffset > m_viewSize || header.dataSize > m_viewSize - header.dataOffset)
+  {
+    return false;
+  }
+
+  m_key = header.key;
+  m_width = header.width;
+  m_height = header.height;
+  m_data = m_view + header.dataOffset;
+  m_dataSize = header.dataSize;
+  m_levels.resize(header.mipCount);
+  for (uint32_t i = 0; i < header.mipCount; ++i)
+  {
+    LevelRecord record;
+    memcpy(&record, m_view + sizeof(FileHeader) + i * sizeof(LevelRecord), sizeof(record));
+    if (record.offset + uint64_t(record.rowPitch) * record.height > m_dataSize)
+    {
+      return false;
+    }
+    m_levels[i] = MipLevelLayout{ record.width, record.height, record.offset, record.rowPitch };
+  }
+  return true;
+}
+
+void TextureCache::Initialize(const std::filesystem::path& directory, uint64_t maxBytes)
+{
+  std::lock_guard lock(m_mutex);
+  std::error_code ec;
+  std::filesystem::create_directories(directory, ec);
+  if (!std::filesystem::is_directory(directory, ec))
+  {
+    m_directory.clear();
+    return;
+  }
+  m_directory = directory;
+  m_maxBytes = maxBytes;
+  TrimLocked();
+}
+
+TextureCache::Key TextureCache::MakeKey(const void* srcBuffer, size_t bufferSize, const Options& options)
+{
+  Key key;
+  key.contentHash = HashBytes(srcBuffer, bufferSize);
+  key.contentSize = bufferSize;
+  key.format = options.format;
+  key.flags = (options.generateMips ? 1u : 0u) | (uint32_t(options.colorSpace) << 1);
+  return key;
+}
+
+std::unique_ptr<TextureCache::Entry> TextureCache::Find(const Key& key)
+{
+  if (!IsEnabled())
+  {
+    return nullptr;
+  }
+
+  const auto filePath = MakeFilePath(key);
+  std::error_code ec;
+  std::unique_ptr<Entry> entry;
+  if (std::filesystem::exists(filePath, ec))
+  {
+    // 最後に使われた時刻として更新時刻を使う.
+    std::filesystem::last_write_time(filePath, std::filesystem::file_time_type::clock::now(), ec);
+    entry.reset(new Entry());
+    if (!entry->Open(filePath, key))
+    {
+      entry.reset();
+    }
+  }
+
+  std::lock_guard lock(m_mutex);
+  if (entry)
+  {
+    m_stats.hitCount++;
+  }
+  else
+  {
+    m_stats.missCount++;
+  }
+  return entry;
+}
+
+bool TextureCache::Store(const Key& key, uint32_t width, uint32_t height, std::span<const MipLevelLayout> levels, std::span<const uint8_t> data)
+{
+  if (!IsEnabled() || levels.empty())
+  {
+    return false;
+  }
+
+  FileHeader header{
+    .magic = CacheMagic,
+    .version = CacheVersion,
+    .key = key,
+    .width = width, .height = height,
+    .mipCount = uint32_t(levels.size()),
+    .reserved = 0,
+    .dataOffset = AlignUp(sizeof(FileHeader) + levels.size() * sizeof(LevelRecord), DataAlignment),
+    .dataSize = data.size(),
+  };
+  std::vector<uint8_t> headerBlock(header.dataOffset, 0);
+  memcpy(headerBlock.data(), &header, sizeof(header));
+  for (size_t i = 0; i < levels.size(); ++i)
+  {
+    const LevelRecord record{ levels[i].width, levels[i].height, levels[i].rowPitch, 0, levels[i].offset };
+    memcpy(headerBlock.data() + sizeof(FileHeader) + i * sizeof(LevelRecord), &record, sizeof(record));
+  }
+
+  // 書き込み途中のファイルを読まれないよう、一時ファイルへ書いてから置き換える.
+  const auto filePath = MakeFilePath(key);
+  auto tempPath = filePath;
+  tempPath += "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+  {
+    std::ofstream outFile(tempPath, std::ios::binary | std::ios::trunc);
+    outFile.write(reinterpret_cast<const char*>(headerBlock.data()), headerBlock.size());
+    outFile.write(reinterpret_cast<const char*>(data.data()), data.size());
+    if (!outFile)
+    {
+      outFile.close();
+      std::error_code ec;
+      std::filesystem::remove(tempPath, ec);
+      return false;
+    }
+  }
+
+  std::lock_guard lock(m_mutex);
+  std::error_code ec;
+  const auto oldSize = std::filesystem::exists(filePath, ec) ? std::filesystem::file_size(filePath, ec) : 0;
+  std::filesystem::rename(tempPath, filePath, ec);
+  if (ec)
+  {
+    std::filesystem::remove(tempPath, ec);
+    return false;
+  }
+  m_stats.storeCount++;
+  m_stats.totalBytes += headerBlock.size() + data.size();
+  m_stats.totalBytes -= std::min(m_stats.totalBytes, uint64_t(oldSize));
+  if (m_stats.totalBytes > m_maxBytes)
+  {
+    TrimLocked();
+  }
+  return true;
+}
+
+void TextureCache::Trim()
+{
+  std::lock_guard lock(m_mutex);
+  TrimLocked();
+}
+
+TextureCache::Stats TextureCache::GetStats() const
+{
+  std::lock_guard lock(m_mutex);
+  return m_stats;
+}
+
+std::filesystem::path TextureCache::MakeFilePath(const Key& key) const
+{
+  char fileName[32];
+  snprintf(fileName, sizeof(fileName), "%016llx%s", static_cast<unsigned long long>(HashBytes(&key, sizeof(key))), CacheExtension);
+  return m_directory / fileName;
+}
+
+void TextureCache::TrimLocked()
+{
+  struct CacheFile
+  {
+    std::filesystem::path path;
+    std::filesystem::file_time_type lastUsed;
+    uint64_t size;
+  };
+  std::vector<CacheFile> files;
+  uint64_t totalBytes = 0;
+  std::error_code ec;
+  for (const auto& item : std::filesystem::directory_iterator(m_directory, ec))
+  {
+    if (!item.is_regular_file(ec) || item.path().extension() != CacheExtension)
+    {
+      continue;
+    }
+    CacheFile file{ item.path(), item.last_write_time(ec), item.file_size(ec) };
+    totalBytes += file.size;
+    files.push_back(std::move(file));
+  }
+
+  if (totalBytes > m_maxBytes)
+  {
+    std::sort(files.begin(), files.end(), [](const CacheFile& a, const CacheFile& b) { return a.lastUsed < b.lastUsed; });
+    for (const auto& file : files)
+    {
+      if (totalBytes <= m_maxBytes)
+      {
+        break;
+      }
+      if (std::filesystem::remove(file.path, ec))
+      {
+        totalBytes -= file.size;
+        m_stats.evictCount++;
+      }
+    }
+  }
+  m_stats.totalBytes = totalBytes;
+}
@@ -0,0 +1,107 @@
+﻿#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "MipChainBuilder.h"
+
+// 加工済みテクスチャ(デコードとミップマップ作成が済んだもの)のディスクキャッシュ.
+// 元ファイルの内容のハッシュと読み込みオプションをキーとし、
+// ミップチェーンはアップロード用フットプリントと同じ配置のまま保存する.
+// ヒット時はファイルをマップしてステージングへコピーするだけで済む.
+// サイズ上限を超えた分は、最後に使われた時刻が古いエントリから削除する.
+// 各メソッドはスレッドセーフ. D3D12 には依存しない.
+class TextureCache
+{
+public:
+  struct Options
+  {
+    bool generateMips = false;
+    uint32_t format = 0;  // DXGI_FORMAT の値.
+    MipColorSpace colorSpace = MipColorSpace::Linear;
+  };
+
+  struct Key
+  {
+    uint64_t contentHash = 0;
+    uint64_t contentSize = 0;
+    uint32_t format = 0;
+    uint32_t flags = 0;   // generateMips, colorSpace.
+
+    bool operator==(const Key&) const = default;
+  };
+
+  struct Stats
+  {
+    uint64_t hitCount = 0;
+    uint64_t missCount = 0;
+    uint64_t storeCount = 0;
+    uint64_t evictCount = 0;
+    uint64_t totalBytes = 0;  // ディスク上のキャッシュサイズ.
+  };
+
+  // 読み込んだエントリ. 破棄するまでファイルをマップしたままにする.
+  class Entry
+  {
+  public:
+    ~Entry();
+    Entry(const Entry&) = delete;
+    Entry& operator=(const Entry&) = delete;
+
+    uint32_t GetWidth() const { return m_width; }
+    uint32_t GetHeight() const { return m_height; }
+    uint32_t GetFormat() const { return m_key.format; }
+    std::span<const MipLevelLayout> GetLevels() const { return m_levels; }
+    // 全レベルのデータ. 各レベルの位置は GetLevels().offset.
+    std::span<const uint8_t> GetData() const { return { m_data, m_dataSize }; }
+
+  private:
+    friend class TextureCache;
+    Entry() = default;
+    bool Open(const std::filesystem::path& filePath, const Key& key);
+
+    Key m_key;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    std::vector<MipLevelLayout> m_levels;
+    const uint8_t* m_data = nullptr;
+    uint64_t m_dataSize = 0;
+
+    // マップしたファイル.
+    const uint8_t* m_view = nullptr;
+    uint64_t m_viewSize = 0;
+#if defined(_WIN32)
+    void* m_fileHandle = nullptr;
+    void* m_mappingHandle = nullptr;
+#endif
+  };
+
+  // directory をキャッシュの保存先とする. 存在しなければ作成し、上限を超えていれば削除を行う.
+  void Initialize(const std::filesystem::path& directory, uint64_t maxBytes);
+
+  static Key MakeKey(const void* srcBuffer, size_t bufferSize, const Options& options);
+
+  // 見つからなければ nullptr.
+  std::unique_ptr<Entry> Find(const Key& key);
+
+  // levels の配置で並んだ data を保存する. 上限を超えた場合は古いものから削除する.
+  bool Store(const Key& key, uint32_t width, uint32_t height, std::span<const MipLevelLayout> levels, std::span<const uint8_t> data);
+
+  // 合計サイズが上限以下になるまで、最後に使われた時刻が古いエントリから削除する.
+  void Trim();
+
+  Stats GetStats() const;
+  bool IsEnabled() const { return !m_directory.empty(); }
+
+private:
+  std::filesystem::path MakeFilePath(const Key& key) const;
+  void TrimLocked();
+
+  std::filesystem::path m_directory;
+  uint64_t m_maxBytes = 0;
+  Stats m_stats;
+  mutable std::mutex m_mutex;
+};
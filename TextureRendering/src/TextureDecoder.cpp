@@ -0,0 +1,60 @@
+﻿#include "TextureDecoder.h"
+
+#include "stb/stb_image.h"
+
+#include <algorithm>
+
+void DecodedBaseImage::Deleter::operator()(uint8_t* p) const
+{
+  stbi_image_free(p);
+}
+
+uint32_t GetFullMipCount(uint32_t width, uint32_t height)
+{
+  uint32_t count = 1;
+  while (width > 1 || height > 1)
+  {
+    width = std::max(1u, width / 2);
+    height = std::max(1u, height / 2);
+    ++count;
+  }
+  return count;
+}
+
+bool DecodeBaseImage(const void* srcBuffer, size_t bufferSize, DecodedBaseImage& outImage)
+{
+  const int channels = DecodedImage::PixelBytes;
+  int imageWidth = 0, imageHeight = 0;
+  auto srcImage = stbi_load_from_memory(
+    reinterpret_cast<const stbi_uc*>(srcBuffer), int(bufferSize), &imageWidth, &imageHeight, nullptr, channels);
+  if (srcImage == nullptr)
+  {
+    return false;
+  }
+  outImage.width = uint32_t(imageWidth);
+  outImage.height = uint32_t(imageHeight);
+  outImage.pixels.reset(srcImage);
+  return true;
+}
+
+bool DecodeImage(const void* srcBuffer, size_t bufferSize, bool generateMips, DecodedImage& outImage)
+{
+  DecodedBaseImage baseImage;
+  if (!DecodeBaseImage(srcBuffer, bufferSize, baseImage))
+  {
+    return false;
+  }
+
+  outImage.width = baseImage.width;
+  outImage.height = baseImage.height;
+  const auto mipCount = generateMips ? GetFullMipCount(outImage.width, outImage.height) : 1u;
+
+  // 全レベルの配置を決めてから、まとめて確保する.
+  const auto totalBytes = MakeMipChainLayout(outImage.width, outImage.height, mipCount, 1, 1, outImage.mips);
+  outImage.pixels.resize(totalBytes);
+
+  // 各レベルは 1 つ上のレベルから縮小して、配列内へ直接書き出す.
+  thread_local MipChainBuilder builder;
+  builder.Build(baseImage.pixels.get(), baseImage.GetRowPitch(), outImage.pixels.data(), outImage.mips, MipColorSpace::Linear, true);
+  return true;
+}
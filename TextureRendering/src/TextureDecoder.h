@@ -0,0 +1,48 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+
+#include "MipChainBuilder.h"
+
+// CPU 側でデコードしたテクスチャイメージ (RGBA8).
+// ミップマップは全レベルを 1 つの配列に詰めて保持する.
+struct DecodedImage
+{
+  static constexpr uint32_t PixelBytes = 4;
+
+  using MipLevel = MipLevelLayout;  // offset は pixels 内の開始位置.
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<MipLevel> mips;
+  std::vector<uint8_t> pixels;
+
+  uint32_t GetMipCount() const { return uint32_t(mips.size()); }
+  const uint8_t* GetMipData(uint32_t mip) const { return pixels.data() + mips[mip].offset; }
+};
+
+// デコードしたままのベースレベル (RGBA8). デコーダが確保したメモリをそのまま保持する.
+// ミップマップは書き出し先(ステージング等)で作成するため、ここでは持たない.
+struct DecodedBaseImage
+{
+  struct Deleter
+  {
+    void operator()(uint8_t* p) const;
+  };
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::unique_ptr<uint8_t, Deleter> pixels;
+
+  uint32_t GetRowPitch() const { return width * DecodedImage::PixelBytes; }
+};
+
+// 1x1 までの完全なミップチェーンのレベル数.
+uint32_t GetFullMipCount(uint32_t width, uint32_t height);
+
+// メモリ上の画像ファイルをデコードし、generateMips であればミップマップを作成する.
+// D3D12 には依存しないため、ワーカースレッドやヘッドレスの計測から直接呼び出せる.
+bool DecodeImage(const void* srcBuffer, size_t bufferSize, bool generateMips, DecodedImage& outImage);
+
+// メモリ上の画像ファイルのベースレベルのみをデコードする.
+bool DecodeBaseImage(const void* srcBuffer, size_t bufferSize, DecodedBaseImage& outImage);
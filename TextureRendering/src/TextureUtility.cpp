@@ -1,12 +1,13 @@
 ﻿#include "TextureUtility.h"
 #include "FileLoader.h"
 
-#include "stb/stb_image.h"
-#include "stb/stb_image_resize.h"
+#include "TextureDecoder.h"
+#include "SinglePassDownsampler.h"
 
 #include <numeric>
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 
 #define USE_STB_LIBRARY
 #define USE_STB_LIBRARY_FORCE // Agility SDKがあってもSTBを使いたい時に定義
@@ -20,6 +21,62 @@
 #endif
 #endif
 
+namespace
+{
+  // COMMON からの暗黙の昇格で到達できる状態か.
+  bool IsImplicitlyPromotable(D3D12_RESOURCE_STATES state)
+  {
+    const auto promotable = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_COPY_SOURCE;
+    return (state & ~promotable) == 0;
+  }
+
+  // コピーキューで転送したテクスチャは完了後に COMMON へ戻る.
+  // 暗黙の昇格で到達できない状態を指定された場合のみ、描画キューで状態遷移を行う.
+  void TransitionUploadedTexture(ID3D12Resource* texture, D3D12_RESOURCE_STATES afterState)
+  {
+    if (IsImplicitlyPromotable(afterState))
+    {
+      return;
+    }
+    auto& gfxDevice = GetGfxDevice();
+    auto commandList = gfxDevice->CreateCommandList();
+    D3D12_RESOURCE_BARRIER barrier{
+      .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+      .Transition = {
+        .pResource = texture,
+        .Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+        .StateBefore = D3D12_RESOURCE_STATE_COMMON,
+        .StateAfter = afterState,
+      }
+    };
+    commandList->ResourceBarrier(1, &barrier);
+    commandList->Close();
+    // Submit は転送の完了を描画キュー上で待ってから実行する.
+    gfxDevice->Submit(commandList.Get());
+  }
+
+  Microsoft::WRL::ComPtr<ID3D12Resource1> CreateTexture2D(uint32_t width, uint32_t height, uint32_t mipmapCount, D3D12_RESOURCE_FLAGS resFlags)
+  {
+    D3D12_RESOURCE_DESC texDesc{
+      .Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+      .Alignment = 0,
+      .Width = width, .Height = height, .DepthOrArraySize = 1,
+      .MipLevels = UINT16(mipmapCount),
+      .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
+      .SampleDesc = {.Count = 1, .Quality = 0 },
+      .Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN,
+      .Flags = resFlags,
+    };
+    D3D12_HEAP_PROPERTIES heapProps{
+      .Type = D3D12_HEAP_TYPE_DEFAULT,
+      .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
+      .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
+      .CreationNodeMask = 0, .VisibleNodeMask = 0,
+    };
+    return GetGfxDevice()->CreateImage2D(texDesc, heapProps, D3D12_RESOURCE_STATE_COMMON, nullptr);
+  }
+}
+
 bool CreateTextureFromFile(Microsoft::WRL::ComPtr<ID3D12Resource1>& outImage, std::filesystem::path filePath, bool generateMips, D3D12_RESOURCE_STATES afterState, D3D12_RESOURCE_FLAGS resFlags)
 {
   auto& loader = GetFileLoader();
@@ -33,156 +90,110 @@ bool CreateTextureFromFile(Microsoft::WRL::ComPtr<ID3D12Resource1>& outImage, st
 #if defined(USE_STB_LIBRARY)
 bool CreateTextureFromMemory(Microsoft::WRL::ComPtr<ID3D12Resource1>& outImage, const void* srcBuffer, size_t bufferSize, bool generateMips, D3D12_RESOURCE_STATES afterState, D3D12_RESOURCE_FLAGS resFlags)
 {
-  auto& gfxDevice = GetGfxDevice();
-  using namespace std;
-
-  auto buffer = reinterpret_cast<const stbi_uc*>(srcBuffer);
-  int imageWidth = 0, imageHeight = 0;
-  int channels = 4;
-  const int pixelBytes = sizeof(uint32_t);
-  auto srcImage = stbi_load_from_memory(buffer, int(bufferSize), &imageWidth, &imageHeight, nullptr, channels);
-
-  // ミップマップイメージを作成する.
-  std::vector<stbi_uc*> workImages;
-  if(generateMips)
+  DecodedBaseImage image;
+  if (!DecodeBaseImage(srcBuffer, bufferSize, image))
   {
-    int width = imageWidth, height = imageHeight;
-    stbi_uc* resizeSrc = srcImage;
-    while (width > 1 && height > 1)
-    {
-      int mipWidth = std::max(1, width / 2);
-      int mipHeight = std::max(1, height / 2);
-      int surfaceByteSize = mipWidth * mipHeight * pixelBytes;
-      auto mipmapImage = new stbi_uc[surfaceByteSize];
-      workImages.push_back(mipmapImage);
-
-      stbir_resize_uint8(resizeSrc, width, height, 0, mipmapImage, mipWidth, mipHeight, 0, channels);
-      // 次回に備えてセット.
-      resizeSrc = mipmapImage;
-      width = mipWidth;
-      height = mipHeight;
-    }
+    return false;
   }
+  return CreateTextureFromBaseImage(outImage, image, generateMips, afterState, resFlags);
+}
+#endif
 
-  auto mipmapCount = uint32_t(floor(log2(max(imageWidth, imageHeight))) + 1);
-  if (generateMips == false)
+bool CreateTextureFromBaseImage(Microsoft::WRL::ComPtr<ID3D12Resource1>& outImage, const DecodedBaseImage& image, bool generateMips, D3D12_RESOURCE_STATES afterState, D3D12_RESOURCE_FLAGS resFlags, uint32_t workerCount)
+{
+  const auto mipmapCount = generateMips ? GetFullMipCount(image.width, image.height) : 1u;
+  outImage = CreateTexture2D(image.width, image.height, mipmapCount, resFlags);
+  if (outImage == nullptr)
   {
-    mipmapCount = 1;
+    return false;
   }
-  D3D12_RESOURCE_DESC texDesc{
-    .Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D,
-    .Alignment = 0,
-    .Width = UINT(imageWidth), .Height = UINT(imageHeight), .DepthOrArraySize = 1,
-    .MipLevels = UINT16(mipmapCount),
-    .Format = DXGI_FORMAT_R8G8B8A8_UNORM,
-    .SampleDesc = {.Count = 1, .Quality = 0 },
-    .Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN,
-    .Flags = resFlags,
-  };
-  D3D12_HEAP_PROPERTIES heapProps{
-    .Type = D3D12_HEAP_TYPE_DEFAULT,
-    .CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
-    .MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN,
-    .CreationNodeMask = 0, .VisibleNodeMask = 0,
-  };
-  outImage = gfxDevice->CreateImage2D(texDesc, heapProps, D3D12_RESOURCE_STATE_COPY_DEST, nullptr);
-
-  // ステージングバッファを作成.
-  // まずは必要なバッファサイズを求める.
-  UINT64 uploadBufferRequiredSize = 0;
-  UINT64 uploadOffset = 0;
-  std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints(mipmapCount);
-  std::vector<UINT> numRows(mipmapCount);
-  std::vector<UINT64> rowSizeInByte(mipmapCount);
-  auto d3d12Device = gfxDevice->GetD3D12Device();
-
-  d3d12Device->GetCopyableFootprints(
-    &texDesc, 0, mipmapCount, uploadOffset, footprints.data(), numRows.data(), rowSizeInByte.data(), &uploadBufferRequiredSize);
 
-  // ステージングバッファの作成.
-  D3D12_RESOURCE_DESC resDesc{
-    .Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
-    .Alignment = 0,
-    .Width = uploadBufferRequiredSize, .Height = 1, .DepthOrArraySize = 1, .MipLevels = 1,
-    .Format = DXGI_FORMAT_UNKNOWN,
-    .SampleDesc = {.Count = 1, .Quality = 0 },
-    .Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
-    .Flags = D3D12_RESOURCE_FLAG_NONE,
+  // ベースレベルのコピーと各ミップレベルの縮小を、ステージング上のフットプリント配置へ直接行う.
+  // ステージングは書込み結合メモリのため、縮小は作業バッファ上で行い各レベルを 1 度だけ書き出す.
+  // 書き出し中は転送のバッチが発行されないため、タイル単位で複数スレッドに分けて短く済ませる.
+  auto writer = [&](UINT8* stagingBase, std::span<const UploadContext::TextureFootprint> footprints) {
+    std::vector<MipLevelLayout> levels(footprints.size());
+    for (size_t i = 0; i < footprints.size(); ++i)
+    {
+      const auto& layout = footprints[i].layout;
+      levels[i] = MipLevelLayout{ layout.Footprint.Width, layout.Footprint.Height, layout.Offset, layout.Footprint.RowPitch };
+    }
+    thread_local SinglePassDownsampler downsampler;
+    downsampler.Build(image.pixels.get(), image.GetRowPitch(), stagingBase, levels, MipColorSpace::Linear, false, workerCount);
   };
-  auto staging = gfxDevice->CreateBuffer(resDesc, D3D12_HEAP_TYPE_UPLOAD, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr);
+  GetGfxDevice()->GetUploadContext().UploadTexture(outImage.Get(), 0, mipmapCount, writer);
+  TransitionUploadedTexture(outImage.Get(), afterState);
+  return true;
+}
 
-  void* dest;
-  staging->Map(0, nullptr, &dest);
-  BYTE* destBase = reinterpret_cast<BYTE*>(dest);
-  for (UINT mip = 0; mip < mipmapCount; ++mip)
+bool CreateTextureFromMipChain(Microsoft::WRL::ComPtr<ID3D12Resource1>& outImage, uint32_t width, uint32_t height, std::span<const MipLevelLayout> levels, std::span<const uint8_t> data, D3D12_RESOURCE_STATES afterState, D3D12_RESOURCE_FLAGS resFlags)
+{
+  const auto mipmapCount = uint32_t(levels.size());
+  outImage = CreateTexture2D(width, height, mipmapCount, resFlags);
+  if (outImage == nullptr)
   {
-    const auto& footprint = footprints[mip];
-    auto* dstMip = destBase + footprint.Offset;
-    BYTE* srcMip = nullptr;
-    if (mip == 0)
+    return false;
+  }
+
+  auto writer = [&](UINT8* stagingBase, std::span<const UploadContext::TextureFootprint> footprints) {
+    const bool isSameLayout = std::equal(levels.begin(), levels.end(), footprints.begin(),
+      [](const MipLevelLayout& level, const UploadContext::TextureFootprint& footprint) {
+        return level.offset == footprint.layout.Offset && level.rowPitch == footprint.layout.Footprint.RowPitch;
+      });
+    if (isSameLayout)
     {
-      srcMip = reinterpret_cast<BYTE*>(srcImage);
+      // ステージングの最終行は RowPitch ではなく rowSizeInBytes までしか確保されていない.
+      const auto& last = footprints.back();
+      const auto copySize = last.layout.Offset + UINT64(last.layout.Footprint.RowPitch) * (last.numRows - 1) + last.rowSizeInBytes;
+      assert(data.size() >= copySize);
+      memcpy(stagingBase, data.data(), copySize);
+      return;
     }
-    else
+    for (size_t i = 0; i < footprints.size(); ++i)
     {
-      srcMip = workImages[mip - 1];
+      const auto& footprint = footprints[i];
+      const auto& level = levels[i];
+      for (UINT row = 0; row < footprint.numRows; ++row)
+      {
+        memcpy(
+          stagingBase + footprint.layout.Offset + UINT64(footprint.layout.Footprint.RowPitch) * row,
+          data.data() + level.offset + UINT64(level.rowPitch) * row, footprint.rowSizeInBytes);
+      }
     }
-    assert(srcMip);
+  };
+  GetGfxDevice()->GetUploadContext().UploadTexture(outImage.Get(), 0, mipmapCount, writer);
+  TransitionUploadedTexture(outImage.Get(), afterState);
+  return true;
+}
 
-    // コピー.
-    for (UINT row = 0; row < numRows[mip]; row++)
-    {
-      auto dst = dstMip + row * footprint.Footprint.RowPitch;
-      auto src = srcMip + row * rowSizeInByte[mip];
-      auto size = rowSizeInByte[mip];
-      memcpy(dst, src, size);
-    }
+bool CreateTextureFromDecodedImage(Microsoft::WRL::ComPtr<ID3D12Resource1>& outImage, const DecodedImage& image, D3D12_RESOURCE_STATES afterState, D3D12_RESOURCE_FLAGS resFlags)
+{
+  auto& gfxDevice = GetGfxDevice();
+  const auto mipmapCount = image.GetMipCount();
+  outImage = CreateTexture2D(image.width, image.height, mipmapCount, resFlags);
+  if (outImage == nullptr)
+  {
+    return false;
   }
-  staging->Unmap(0, nullptr);
 
-  // 転送
-  auto commandList = gfxDevice->CreateCommandList();
+  // 各ミップレベルのイメージを転送元として並べる.
+  std::vector<D3D12_SUBRESOURCE_DATA> subresources(mipmapCount);
   for (UINT mip = 0; mip < mipmapCount; ++mip)
   {
-    D3D12_TEXTURE_COPY_LOCATION dstLoc{
-      .pResource = outImage.Get(),
-      .Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX,
-      .SubresourceIndex = mip,
+    const auto& level = image.mips[mip];
+    subresources[mip] = {
+      .pData = image.GetMipData(mip),
+      .RowPitch = LONG_PTR(level.rowPitch),
+      .SlicePitch = LONG_PTR(level.rowPitch) * level.height,
     };
-    D3D12_TEXTURE_COPY_LOCATION srcLoc{
-      .pResource = staging.Get(),
-      .Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT,
-      .PlacedFootprint = footprints[mip],
-    };
-
-    commandList->CopyTextureRegion(&dstLoc, 0, 0, 0, &srcLoc, nullptr);
   }
-  D3D12_RESOURCE_BARRIER barrier{
-    .Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
-    .Transition = {
-      .pResource = outImage.Get(),
-      .Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
-      .StateBefore = D3D12_RESOURCE_STATE_COPY_DEST,
-      .StateAfter = afterState,
-    }
-  };
-  commandList->ResourceBarrier(1, &barrier);
-  commandList->Close();
-  gfxDevice->Submit(commandList.Get());
-  gfxDevice->WaitForGPU();
 
-  // 後始末
-  stbi_image_free(srcImage);
-  for (auto& v : workImages)
-  {
-    delete[] v;
-  }
-  staging.Reset();
+  // 転送はアップロードコンテキストでまとめて行う.
+  gfxDevice->GetUploadContext().UploadTexture(outImage.Get(), 0, subresources);
+  TransitionUploadedTexture(outImage.Get(), afterState);
   return true;
 }
 
-#endif
-
 #if !defined(USE_STB_LIBRARY)
 bool CreateTextureFromMemory(Microsoft::WRL::ComPtr<ID3D12Resource1>& outImage, const void* srcBuffer, size_t bufferSize, bool generateMips, D3D12_RESOURCE_STATES afterState, D3D12_RESOURCE_FLAGS resFlags)
 {
@@ -227,31 +238,10 @@ bool CreateTextureFromMemory(Microsoft::WRL::ComPtr<ID3D12Resource1>& outImage,
 
   std::vector<D3D12_SUBRESOURCE_DATA> subresources;
   DirectX::PrepareUpload(d3d12Device.Get(), image.GetImages(), image.GetImageCount(), metadata, subresources);
-  auto uploadBufferSize = GetRequiredIntermediateSize(texture.Get(), 0, UINT(subresources.size()));
-  
-  // アップロードヒープの準備.
-  CD3DX12_HEAP_PROPERTIES heapProps(D3D12_HEAP_TYPE_UPLOAD);
-  auto uploadResDesc = CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize);
-  ID3D12Resource1* uploadHeap = nullptr;
-  hr = d3d12Device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &uploadResDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&uploadHeap));
-  if (FAILED(hr))
-  {
-    return false;
-  }
-
-  auto commandList = gfxDevice->CreateCommandList();
-  UpdateSubresources(commandList.Get(), texture.Get(), uploadHeap, 0, 0, UINT(subresources.size()), subresources.data());
-
-  // シェーダーリソースへ変更.
-  auto barrier = CD3DX12_RESOURCE_BARRIER::Transition(
-    texture.Get(), D3D12_RESOURCE_STATE_COPY_DEST, afterState
-  );
-  commandList->ResourceBarrier(1, &barrier);
-  commandList->Close();
 
-  gfxDevice->Submit(commandList.Get());
-  gfxDevice->WaitForGPU();
-  uploadHeap->Release();
+  // 転送はアップロードコンテキストでまとめて行う.
+  gfxDevice->GetUploadContext().UploadTexture(texture.Get(), 0, subresources);
+  TransitionUploadedTexture(texture.Get(), afterState);
   texture.As(&outImage);
   return true;
 }
@@ -0,0 +1,106 @@
+﻿#include "UploadStagingRing.h"
+#include <cassert>
+
+namespace
+{
+  uint64_t AlignUp(uint64_t value, uint64_t alignment)
+  {
+    return (value + alignment - 1) / alignment * alignment;
+  }
+}
+
+void UploadStagingRing::Reset(uint64_t capacity)
+{
+  m_capacity = capacity;
+  m_head = 0;
+  m_tail = 0;
+  m_usedBytes = 0;
+  m_batchBytes = 0;
+  m_recordedCount = 0;
+  m_batches.clear();
+}
+
+uint64_t UploadStagingRing::Allocate(uint64_t size, uint64_t alignment)
+{
+  assert(alignment > 0);
+  if (size == 0 || size > m_capacity)
+  {
+    return InvalidOffset;
+  }
+  if (m_usedBytes == 0)
+  {
+    // 空であれば先頭から使う.
+    m_head = 0;
+    m_tail = 0;
+  }
+
+  uint64_t offset = InvalidOffset;
+  uint64_t newHead = 0;
+  bool wrapped = false;
+  if (m_usedBytes == 0 || m_head > m_tail)
+  {
+    // 空き領域は [head, capacity) と [0, tail).
+    auto aligned = AlignUp(m_head, alignment);
+    if (aligned + size <= m_capacity)
+    {
+      offset = aligned;
+      newHead = aligned + size;
+    }
+    else if (size <= m_tail)
+    {
+      // 末尾に収まらないため先頭へ折り返す. 末尾の残りは未使用として扱う.
+      offset = 0;
+      newHead = size;
+      wrapped = true;
+    }
+  }
+  else if (m_head < m_tail)
+  {
+    // 空き領域は [head, tail).
+    auto aligned = AlignUp(m_head, alignment);
+    if (aligned + size <= m_tail)
+    {
+      offset = aligned;
+      newHead = aligned + size;
+    }
+  }
+  // head == tail かつ使用中の場合は満杯.
+  if (offset == InvalidOffset)
+  {
+    return InvalidOffset;
+  }
+
+  uint64_t consumed = wrapped ? (m_capacity - m_head) + newHead : newHead - m_head;
+  if (newHead == m_capacity)
+  {
+    newHead = 0;
+  }
+  m_head = newHead;
+  m_usedBytes += consumed;
+  m_batchBytes += consumed;
+  return offset;
+}
+
+UploadStagingRing::Ticket UploadStagingRing::CloseBatch()
+{
+  const auto ticket = m_nextTicket++;
+  if (m_batchBytes > 0)
+  {
+    m_batches.push_back(BatchSegment{ ticket, m_head, m_batchBytes });
+  }
+  m_batchBytes = 0;
+  m_recordedCount = 0;
+  return ticket;
+}
+
+void UploadStagingRing::ReleaseCompleted(uint64_t completedValue)
+{
+  while (!m_batches.empty() && m_batches.front().ticket <= completedValue)
+  {
+    const auto& batch = m_batches.front();
+    m_tail = batch.endOffset;
+    assert(m_usedBytes >= batch.bytes);
+    m_usedBytes -= batch.bytes;
+    m_batches.pop_front();
+  }
+}